@@ -0,0 +1,262 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkDecimatedSurfaceProxy.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkPoints.h>
+#include <vtkQuadricDecimation.h>
+#include <vtkSMPThreadLocal.h>
+#include <vtkSMPTools.h>
+#include <vtkTriangleFilter.h>
+
+// STD includes
+#include <cmath>
+#include <vector>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro( vtkDecimatedSurfaceProxy );
+
+//----------------------------------------------------------------------------
+// Computes an upper bound of the distance of a surface from a surface hierarchy.
+// Each polygon is represented by its center and the radius of the sphere around the center that contains the polygon.
+// Distance is 1-Lipschitz, so no point of the polygon is farther from the hierarchy than the center distance plus the radius.
+class vtkDecimatedSurfaceProxyErrorComputer
+{
+public:
+  vtkTriangleBVH* Hierarchy;
+  const double* SamplePoints;
+  const double* SampleRadii;
+
+  vtkSMPThreadLocal< double > MaximumDistance;
+  double Result;
+
+  void Initialize()
+  {
+    this->MaximumDistance.Local() = 0.0;
+  }
+
+  void operator()( vtkIdType begin, vtkIdType end )
+  {
+    double& maximumDistance = this->MaximumDistance.Local();
+    double closestPoint[3] = { 0.0, 0.0, 0.0 };
+    int closestSurfaceIndex = -1;
+    for ( vtkIdType sampleIndex = begin; sampleIndex < end; sampleIndex++ )
+    {
+      double distance = fabs( this->Hierarchy->FindClosestPoint( this->SamplePoints + 3 * sampleIndex, closestPoint, closestSurfaceIndex ) )
+        + this->SampleRadii[ sampleIndex ];
+      if ( distance > maximumDistance )
+      {
+        maximumDistance = distance;
+      }
+    }
+  }
+
+  void Reduce()
+  {
+    this->Result = 0.0;
+    for ( vtkSMPThreadLocal< double >::iterator it = this->MaximumDistance.begin(); it != this->MaximumDistance.end(); ++it )
+    {
+      if ( *it > this->Result )
+      {
+        this->Result = *it;
+      }
+    }
+  }
+};
+
+//----------------------------------------------------------------------------
+vtkDecimatedSurfaceProxy::vtkDecimatedSurfaceProxy()
+: TargetReduction( 0.9 )
+, ErrorBound( 0.0 )
+, ProxyValid( false )
+{
+  this->ProxyHierarchy = vtkSmartPointer< vtkTriangleBVH >::New();
+}
+
+//----------------------------------------------------------------------------
+vtkDecimatedSurfaceProxy::~vtkDecimatedSurfaceProxy()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkDecimatedSurfaceProxy::PrintSelf( ostream &os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+  os << indent << "TargetReduction: " << this->TargetReduction << std::endl;
+  os << indent << "ErrorBound: " << this->ErrorBound << std::endl;
+  os << indent << "ProxyValid: " << this->ProxyValid << std::endl;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkDecimatedSurfaceProxy::GetNumberOfTriangles()
+{
+  return this->ProxyValid ? this->ProxyHierarchy->GetNumberOfTriangles() : 0;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDecimatedSurfaceProxy::Build( vtkPolyData* surface, vtkTriangleBVH* surfaceHierarchy )
+{
+  this->ProxyValid = false;
+  this->ErrorBound = 0.0;
+  if ( surface == NULL || surface->GetNumberOfCells() == 0 || surfaceHierarchy == NULL )
+  {
+    vtkErrorMacro( "vtkDecimatedSurfaceProxy::Build failed: invalid surface" );
+    return false;
+  }
+
+  // Decimation requires a triangle mesh
+  vtkSmartPointer< vtkTriangleFilter > triangleFilter = vtkSmartPointer< vtkTriangleFilter >::New();
+  triangleFilter->PassVertsOff();
+  triangleFilter->PassLinesOff();
+#if (VTK_MAJOR_VERSION <= 5)
+  triangleFilter->SetInput( surface );
+#else
+  triangleFilter->SetInputData( surface );
+#endif
+  triangleFilter->Update();
+
+  vtkSmartPointer< vtkQuadricDecimation > decimation = vtkSmartPointer< vtkQuadricDecimation >::New();
+  decimation->SetInputConnection( triangleFilter->GetOutputPort() );
+  decimation->SetTargetReduction( this->TargetReduction );
+  decimation->Update(); // expensive: collapses edges of the full-resolution surface
+  vtkPolyData* proxySurface = decimation->GetOutput();
+
+  this->ProxyHierarchy->RemoveAllSurfaces();
+  this->ProxyHierarchy->AddSurface( proxySurface );
+  if ( !this->ProxyHierarchy->Build() )
+  {
+    vtkErrorMacro( "vtkDecimatedSurfaceProxy::Build failed: decimated surface is empty" );
+    return false;
+  }
+
+  // Hausdorff distance is the larger of the two one-sided distances (both are upper bounds, so the result is an upper bound, too)
+  double fullToProxyDistance = GetMaximumDistance( triangleFilter->GetOutput(), this->ProxyHierarchy );
+  double proxyToFullDistance = GetMaximumDistance( proxySurface, surfaceHierarchy );
+  this->ErrorBound = ( fullToProxyDistance > proxyToFullDistance ) ? fullToProxyDistance : proxyToFullDistance;
+
+  this->ProxyValid = true;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+double vtkDecimatedSurfaceProxy::GetMaximumDistance( vtkPolyData* surface, vtkTriangleBVH* hierarchy )
+{
+  vtkPoints* points = surface->GetPoints();
+  if ( points == NULL )
+  {
+    return 0.0;
+  }
+
+  // Sample the surface at polygon centers. Points of the polygon are within the radius of the center:
+  // the polygon is in the convex hull of its points, so the farthest point of the polygon from the center is one of its points.
+  std::vector< double > samplePoints;
+  std::vector< double > sampleRadii;
+  samplePoints.reserve( 3 * surface->GetNumberOfPolys() );
+  sampleRadii.reserve( surface->GetNumberOfPolys() );
+  vtkCellArray* polys = surface->GetPolys();
+  vtkSmartPointer< vtkIdList > pointIds = vtkSmartPointer< vtkIdList >::New();
+  polys->InitTraversal();
+  while ( polys->GetNextCell( pointIds ) )
+  {
+    vtkIdType numberOfIds = pointIds->GetNumberOfIds();
+    if ( numberOfIds == 0 )
+    {
+      continue;
+    }
+    double center[3] = { 0.0, 0.0, 0.0 };
+    for ( vtkIdType i = 0; i < numberOfIds; i++ )
+    {
+      double point[3] = { 0.0, 0.0, 0.0 };
+      points->GetPoint( pointIds->GetId( i ), point );
+      center[ 0 ] += point[ 0 ];
+      center[ 1 ] += point[ 1 ];
+      center[ 2 ] += point[ 2 ];
+    }
+    center[ 0 ] /= numberOfIds;
+    center[ 1 ] /= numberOfIds;
+    center[ 2 ] /= numberOfIds;
+    double radius2 = 0.0;
+    for ( vtkIdType i = 0; i < numberOfIds; i++ )
+    {
+      double point[3] = { 0.0, 0.0, 0.0 };
+      points->GetPoint( pointIds->GetId( i ), point );
+      double distance2 = vtkMath::Distance2BetweenPoints( point, center );
+      if ( distance2 > radius2 )
+      {
+        radius2 = distance2;
+      }
+    }
+    samplePoints.push_back( center[ 0 ] );
+    samplePoints.push_back( center[ 1 ] );
+    samplePoints.push_back( center[ 2 ] );
+    sampleRadii.push_back( sqrt( radius2 ) );
+  }
+  if ( sampleRadii.empty() )
+  {
+    return 0.0;
+  }
+
+  vtkDecimatedSurfaceProxyErrorComputer errorComputer;
+  errorComputer.Hierarchy = hierarchy;
+  errorComputer.SamplePoints = &( samplePoints[ 0 ] );
+  errorComputer.SampleRadii = &( sampleRadii[ 0 ] );
+  errorComputer.Result = 0.0;
+  vtkSMPTools::For( 0, static_cast< vtkIdType >( sampleRadii.size() ), errorComputer ); // expensive: one closest point query per sample
+  return errorComputer.Result;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDecimatedSurfaceProxy::FindClosestPoint( const double x[3], double refinementDistance, double& distance, double closestPoint[3] ) const
+{
+  if ( !this->ProxyValid )
+  {
+    return false;
+  }
+  int closestSurfaceIndex = -1;
+  double proxyDistance = this->ProxyHierarchy->FindClosestPoint( x, closestPoint, closestSurfaceIndex );
+  if ( closestSurfaceIndex < 0 || fabs( proxyDistance ) - this->ErrorBound < refinementDistance )
+  {
+    // close to the surface, proxy is not accurate enough
+    return false;
+  }
+  distance = proxyDistance;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkDecimatedSurfaceProxy::FindClosestPointToSegment( const double p0[3], const double p1[3], double refinementDistance, double& distance,
+  double closestPointOnSegment[3], double closestPoint[3] ) const
+{
+  if ( !this->ProxyValid )
+  {
+    return false;
+  }
+  int closestSurfaceIndex = -1;
+  double proxyDistance = this->ProxyHierarchy->FindClosestPointToSegment( p0, p1, closestPointOnSegment, closestPoint, closestSurfaceIndex );
+  if ( closestSurfaceIndex < 0 || fabs( proxyDistance ) - this->ErrorBound < refinementDistance )
+  {
+    // close to the surface, proxy is not accurate enough
+    return false;
+  }
+  distance = proxyDistance;
+  return true;
+}
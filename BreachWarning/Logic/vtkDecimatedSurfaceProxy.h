@@ -0,0 +1,88 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkDecimatedSurfaceProxy_h
+#define __vtkDecimatedSurfaceProxy_h
+
+#include <vtkObject.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+#include "vtkTriangleBVH.h"
+
+// export
+#include "vtkSlicerBreachWarningModuleLogicExport.h"
+
+// Low-resolution proxy of a surface for fast approximate distance queries (level of detail).
+// The proxy is a decimated copy of the surface with a known error bound: an upper bound of the Hausdorff distance
+// between the proxy and the full-resolution surface. Distance to the full surface differs from the distance to the proxy
+// by at most the error bound, therefore the proxy can be used instead of the full surface if the point is farther
+// than a refinement distance (plus the error bound) from the proxy. Closer to the surface the query refuses
+// to return a result and exact distance computation on the full-resolution surface is needed.
+class VTK_SLICER_BREACHWARNING_MODULE_LOGIC_EXPORT vtkDecimatedSurfaceProxy : public vtkObject
+{
+public:
+  static vtkDecimatedSurfaceProxy* New();
+  vtkTypeMacro( vtkDecimatedSurfaceProxy, vtkObject );
+  void PrintSelf( ostream &os, vtkIndent indent ) VTK_OVERRIDE;
+
+  // Requested fraction of triangles to be removed (between 0 and 1). 0.9 by default.
+  vtkSetClampMacro( TargetReduction, double, 0.0, 1.0 );
+  vtkGetMacro( TargetReduction, double );
+
+  // Decimates the surface and computes the error bound.
+  // surfaceHierarchy must contain the full-resolution surface, it is used for measuring the decimation error.
+  // Returns false on failure.
+  bool Build( vtkPolyData* surface, vtkTriangleBVH* surfaceHierarchy );
+
+  // Upper bound of the Hausdorff distance between the proxy and the full-resolution surface. Computed from the distance
+  // of each triangle center of both surfaces plus the distance of the farthest triangle point from the center,
+  // so it holds for every point of the surfaces, not only for the sampled ones. Valid after Build().
+  vtkGetMacro( ErrorBound, double );
+
+  vtkIdType GetNumberOfTriangles();
+
+  // Computes signed distance and closest point using the proxy surface.
+  // Returns false if the proxy is not built or the point may be within refinementDistance from the full-resolution surface
+  // (proxy distance minus the error bound is smaller than refinementDistance), where exact distance computation must be used instead.
+  // The proxy is not modified by queries, therefore they can be run from multiple threads at the same time.
+  bool FindClosestPoint( const double x[3], double refinementDistance, double& distance, double closestPoint[3] ) const;
+
+  // Computes signed distance and closest point pair of a line segment using the proxy surface.
+  // Returns false if the proxy is not built or the segment may be within refinementDistance from the full-resolution surface.
+  bool FindClosestPointToSegment( const double p0[3], const double p1[3], double refinementDistance, double& distance,
+    double closestPointOnSegment[3], double closestPoint[3] ) const;
+
+protected:
+  vtkDecimatedSurfaceProxy();
+  ~vtkDecimatedSurfaceProxy();
+
+  // Returns an upper bound of the distance of any point of the surface from the hierarchy.
+  static double GetMaximumDistance( vtkPolyData* surface, vtkTriangleBVH* hierarchy );
+
+private:
+  double TargetReduction;
+  double ErrorBound;
+
+  vtkSmartPointer< vtkTriangleBVH > ProxyHierarchy;
+  bool ProxyValid;
+
+  vtkDecimatedSurfaceProxy(const vtkDecimatedSurfaceProxy&); // Not implemented.
+  void operator=(const vtkDecimatedSurfaceProxy&); // Not implemented.
+};
+
+#endif
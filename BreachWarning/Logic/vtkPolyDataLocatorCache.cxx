@@ -0,0 +1,160 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkPolyDataLocatorCache.h"
+#include "vtkTriangleBVH.h"
+
+// VTK includes
+#include <vtkCellLocator.h>
+#include <vtkMutexLock.h>
+#include <vtkObjectFactory.h>
+#include <vtkPolyData.h>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro( vtkPolyDataLocatorCache );
+
+//----------------------------------------------------------------------------
+vtkPolyDataLocatorCache::vtkPolyDataLocatorCache()
+: NumberOfBuilds( 0 )
+{
+  this->Mutex = vtkSmartPointer< vtkMutexLock >::New();
+}
+
+//----------------------------------------------------------------------------
+vtkPolyDataLocatorCache::~vtkPolyDataLocatorCache()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataLocatorCache::PrintSelf( ostream &os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+  os << indent << "NumberOfCachedPolyData: " << this->Entries.size() << std::endl;
+  os << indent << "NumberOfBuilds: " << this->NumberOfBuilds << std::endl;
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer< vtkCellLocator > vtkPolyDataLocatorCache::GetCellLocator( vtkPolyData* polyData )
+{
+  if ( polyData == NULL )
+  {
+    vtkErrorMacro( "vtkPolyDataLocatorCache::GetCellLocator failed: invalid polydata" );
+    return NULL;
+  }
+  this->Mutex->Lock();
+  Entry& entry = this->GetUpToDateEntry( polyData );
+  if ( entry.CellLocator.GetPointer() == NULL )
+  {
+    // The locator would keep a reference to its dataset, which would prevent detecting deletion of the polydata,
+    // therefore it is built from a shallow copy (point and cell arrays are shared, not copied).
+    vtkSmartPointer< vtkPolyData > polyDataCopy = vtkSmartPointer< vtkPolyData >::New();
+    polyDataCopy->ShallowCopy( polyData );
+    entry.CellLocator = vtkSmartPointer< vtkCellLocator >::New();
+    entry.CellLocator->SetDataSet( polyDataCopy );
+    entry.CellLocator->SetNumberOfCellsPerBucket( 1 );
+    entry.CellLocator->BuildLocator(); // expensive
+    this->NumberOfBuilds++;
+  }
+  // take a reference while locked, the entry may be rebuilt by another thread after unlocking
+  vtkSmartPointer< vtkCellLocator > cellLocator = entry.CellLocator;
+  this->Mutex->Unlock();
+  return cellLocator;
+}
+
+//----------------------------------------------------------------------------
+vtkSmartPointer< vtkTriangleBVH > vtkPolyDataLocatorCache::GetTriangleBVH( vtkPolyData* polyData )
+{
+  if ( polyData == NULL )
+  {
+    vtkErrorMacro( "vtkPolyDataLocatorCache::GetTriangleBVH failed: invalid polydata" );
+    return NULL;
+  }
+  this->Mutex->Lock();
+  Entry& entry = this->GetUpToDateEntry( polyData );
+  if ( entry.TriangleBVH.GetPointer() == NULL )
+  {
+    // The hierarchy copies the points and cells, it does not keep a reference to the polydata
+    entry.TriangleBVH = vtkSmartPointer< vtkTriangleBVH >::New();
+    entry.TriangleBVH->AddSurface( polyData );
+    entry.TriangleBVH->Build(); // expensive
+    this->NumberOfBuilds++;
+  }
+  // take a reference while locked, the entry may be rebuilt by another thread after unlocking
+  vtkSmartPointer< vtkTriangleBVH > triangleBVH = entry.TriangleBVH;
+  this->Mutex->Unlock();
+  return triangleBVH;
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataLocatorCache::RemovePolyData( vtkPolyData* polyData )
+{
+  this->Mutex->Lock();
+  this->Entries.erase( polyData );
+  this->Mutex->Unlock();
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataLocatorCache::RemoveAll()
+{
+  this->Mutex->Lock();
+  this->Entries.clear();
+  this->Mutex->Unlock();
+}
+
+//----------------------------------------------------------------------------
+int vtkPolyDataLocatorCache::GetNumberOfCachedPolyData()
+{
+  this->Mutex->Lock();
+  this->RemoveDeletedPolyData();
+  int numberOfCachedPolyData = static_cast< int >( this->Entries.size() );
+  this->Mutex->Unlock();
+  return numberOfCachedPolyData;
+}
+
+//----------------------------------------------------------------------------
+vtkPolyDataLocatorCache::Entry& vtkPolyDataLocatorCache::GetUpToDateEntry( vtkPolyData* polyData )
+{
+  this->RemoveDeletedPolyData();
+  Entry& entry = this->Entries[ polyData ];
+  if ( entry.PolyData.GetPointer() != polyData || entry.MTime != polyData->GetMTime() )
+  {
+    // new or modified polydata
+    entry.PolyData = polyData;
+    entry.MTime = polyData->GetMTime();
+    entry.CellLocator = NULL;
+    entry.TriangleBVH = NULL;
+  }
+  return entry;
+}
+
+//----------------------------------------------------------------------------
+void vtkPolyDataLocatorCache::RemoveDeletedPolyData()
+{
+  EntryMapType::iterator it = this->Entries.begin();
+  while ( it != this->Entries.end() )
+  {
+    if ( it->second.PolyData.GetPointer() == NULL )
+    {
+      // polydata is deleted (a new polydata may be created at the same address later)
+      this->Entries.erase( it++ );
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
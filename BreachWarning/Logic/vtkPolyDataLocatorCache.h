@@ -0,0 +1,98 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkPolyDataLocatorCache_h
+#define __vtkPolyDataLocatorCache_h
+
+#include <vtkObject.h>
+#include <vtkSmartPointer.h>
+#include <vtkWeakPointer.h>
+
+#include <map>
+
+// export
+#include "vtkSlicerBreachWarningModuleLogicExport.h"
+
+class vtkCellLocator;
+class vtkMutexLock;
+class vtkPolyData;
+class vtkTriangleBVH;
+
+// Shared acceleration structures (cell locator, triangle hierarchy) of surfaces.
+// Building a locator for a large surface is expensive, therefore modules that compute distances from the same
+// surface should get the locator from this cache instead of building their own. Structures are identified by
+// the polydata object and rebuilt when the polydata is modified (its MTime is changed). Entries of deleted
+// polydata are removed automatically.
+// Returned structures are shared and must not be modified. They are returned as smart pointers, so a structure
+// that the caller still uses is not deleted when the cache rebuilds it for a modified polydata.
+// The cache can be accessed from multiple threads.
+class VTK_SLICER_BREACHWARNING_MODULE_LOGIC_EXPORT vtkPolyDataLocatorCache : public vtkObject
+{
+public:
+  static vtkPolyDataLocatorCache* New();
+  vtkTypeMacro( vtkPolyDataLocatorCache, vtkObject );
+  void PrintSelf( ostream &os, vtkIndent indent ) VTK_OVERRIDE;
+
+  // Returns an up-to-date cell locator of the polydata (built with one cell per bucket).
+  // vtkCellLocator queries use internal buffers, therefore the returned locator must only be used from the main thread.
+  vtkSmartPointer< vtkCellLocator > GetCellLocator( vtkPolyData* polyData );
+
+  // Returns an up-to-date triangle hierarchy of the polydata (in the coordinate system of the polydata).
+  // Queries do not modify the hierarchy, so it can be used from multiple threads.
+  vtkSmartPointer< vtkTriangleBVH > GetTriangleBVH( vtkPolyData* polyData );
+
+  // Releases all structures that are built for the polydata
+  void RemovePolyData( vtkPolyData* polyData );
+
+  // Releases all structures (for example when the scene is closed)
+  void RemoveAll();
+
+  int GetNumberOfCachedPolyData();
+
+  // Number of structures that have been built since the cache was created. Can be used for checking cache efficiency.
+  vtkGetMacro( NumberOfBuilds, int );
+
+protected:
+  vtkPolyDataLocatorCache();
+  ~vtkPolyDataLocatorCache();
+
+  struct Entry
+  {
+    Entry() : MTime( 0 ) {}
+    vtkWeakPointer< vtkPolyData > PolyData;
+    vtkMTimeType MTime; // polydata MTime when the structures were built
+    vtkSmartPointer< vtkCellLocator > CellLocator;
+    vtkSmartPointer< vtkTriangleBVH > TriangleBVH;
+  };
+
+  // Returns the entry of the polydata, removes outdated structures. Must be called with the mutex locked.
+  Entry& GetUpToDateEntry( vtkPolyData* polyData );
+
+  // Removes entries of deleted polydata. Must be called with the mutex locked.
+  void RemoveDeletedPolyData();
+
+private:
+  typedef std::map< vtkPolyData*, Entry > EntryMapType;
+  EntryMapType Entries;
+  vtkSmartPointer< vtkMutexLock > Mutex;
+  int NumberOfBuilds;
+
+  vtkPolyDataLocatorCache(const vtkPolyDataLocatorCache&); // Not implemented.
+  void operator=(const vtkPolyDataLocatorCache&); // Not implemented.
+};
+
+#endif
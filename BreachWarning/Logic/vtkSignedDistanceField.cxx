@@ -0,0 +1,292 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkSignedDistanceField.h"
+#include "vtkTriangleBVH.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
+
+// STD includes
+#include <cmath>
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro( vtkSignedDistanceField );
+
+//----------------------------------------------------------------------------
+// Computes distance values for a range of slices of the grid.
+// Hierarchy queries do not modify the hierarchy, so all threads share the same one.
+class vtkSignedDistanceFieldSampler
+{
+public:
+  const vtkTriangleBVH* Hierarchy;
+  float* Values;
+  int Dimensions[3];
+  double Origin[3];
+  double Spacing[3];
+
+  void operator()( vtkIdType beginSlice, vtkIdType endSlice )
+  {
+    vtkIdType sliceSize = static_cast< vtkIdType >( this->Dimensions[ 0 ] ) * this->Dimensions[ 1 ];
+    double position[3] = { 0.0, 0.0, 0.0 };
+    double closestPoint[3] = { 0.0, 0.0, 0.0 };
+    int closestSurfaceIndex = -1;
+    for ( vtkIdType k = beginSlice; k < endSlice; k++ )
+    {
+      float* sliceValues = this->Values + k * sliceSize;
+      position[ 2 ] = this->Origin[ 2 ] + k * this->Spacing[ 2 ];
+      for ( int j = 0; j < this->Dimensions[ 1 ]; j++ )
+      {
+        position[ 1 ] = this->Origin[ 1 ] + j * this->Spacing[ 1 ];
+        for ( int i = 0; i < this->Dimensions[ 0 ]; i++ )
+        {
+          position[ 0 ] = this->Origin[ 0 ] + i * this->Spacing[ 0 ];
+          sliceValues[ j * this->Dimensions[ 0 ] + i ] = static_cast< float >(
+            this->Hierarchy->FindClosestPoint( position, closestPoint, closestSurfaceIndex ) );
+        }
+      }
+    }
+  }
+};
+
+//----------------------------------------------------------------------------
+vtkSignedDistanceField::vtkSignedDistanceField()
+: Spacing( 2.0 )
+, Margin( 20.0 )
+, MaximumNumberOfVoxels( 16 * 1024 * 1024 )
+, NarrowBandWidthVoxels( 2.0 )
+, GridValid( false )
+, GridValues( NULL )
+{
+  for ( int i = 0; i < 3; i++ )
+  {
+    this->GridDimensions[ i ] = 0;
+    this->GridOrigin[ i ] = 0.0;
+    this->GridSpacing[ i ] = 0.0;
+  }
+  this->Grid = vtkSmartPointer< vtkImageData >::New();
+}
+
+//----------------------------------------------------------------------------
+vtkSignedDistanceField::~vtkSignedDistanceField()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkSignedDistanceField::PrintSelf( ostream &os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+  os << indent << "Spacing: " << this->Spacing << std::endl;
+  os << indent << "Margin: " << this->Margin << std::endl;
+  os << indent << "MaximumNumberOfVoxels: " << this->MaximumNumberOfVoxels << std::endl;
+  os << indent << "NarrowBandWidthVoxels: " << this->NarrowBandWidthVoxels << std::endl;
+  os << indent << "GridValid: " << this->GridValid << std::endl;
+}
+
+//----------------------------------------------------------------------------
+vtkImageData* vtkSignedDistanceField::GetGrid()
+{
+  return this->Grid;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSignedDistanceField::Build( vtkPolyData* surface, vtkTriangleBVH* surfaceHierarchy )
+{
+  this->GridValid = false;
+  this->GridValues = NULL;
+  if ( surface == NULL || surface->GetNumberOfCells() == 0 || surfaceHierarchy == NULL
+    || surfaceHierarchy->GetNumberOfTriangles() == 0 )
+  {
+    vtkErrorMacro( "vtkSignedDistanceField::Build failed: invalid surface" );
+    return false;
+  }
+  if ( this->Spacing <= 0 || this->Margin < 0 || this->MaximumNumberOfVoxels < 8 )
+  {
+    vtkErrorMacro( "vtkSignedDistanceField::Build failed: invalid grid parameters" );
+    return false;
+  }
+
+  double bounds[6] = { 0.0, -1.0, 0.0, -1.0, 0.0, -1.0 };
+  surface->GetBounds( bounds );
+  double extent[3] = { 0.0, 0.0, 0.0 };
+  for ( int i = 0; i < 3; i++ )
+  {
+    extent[ i ] = bounds[ 2 * i + 1 ] - bounds[ 2 * i ] + 2.0 * this->Margin;
+  }
+
+  double spacing = this->Spacing;
+  int dimensions[3] = { 0, 0, 0 };
+  for ( int iteration = 0; iteration < 10; iteration++ )
+  {
+    for ( int i = 0; i < 3; i++ )
+    {
+      dimensions[ i ] = static_cast< int >( ceil( extent[ i ] / spacing ) ) + 1;
+      if ( dimensions[ i ] < 2 )
+      {
+        dimensions[ i ] = 2;
+      }
+    }
+    double numberOfVoxels = double( dimensions[ 0 ] ) * double( dimensions[ 1 ] ) * double( dimensions[ 2 ] );
+    if ( numberOfVoxels <= this->MaximumNumberOfVoxels )
+    {
+      break;
+    }
+    // Too many voxels, increase spacing
+    spacing *= 1.01 * pow( numberOfVoxels / this->MaximumNumberOfVoxels, 1.0 / 3.0 );
+  }
+  if ( spacing != this->Spacing )
+  {
+    vtkWarningMacro( "vtkSignedDistanceField::Build: spacing is increased from " << this->Spacing << " to " << spacing
+      << " to limit the number of voxels to " << this->MaximumNumberOfVoxels );
+  }
+
+  this->Grid->Initialize();
+  this->Grid->SetOrigin( bounds[ 0 ] - this->Margin, bounds[ 2 ] - this->Margin, bounds[ 4 ] - this->Margin );
+  this->Grid->SetSpacing( spacing, spacing, spacing );
+  this->Grid->SetDimensions( dimensions );
+#if (VTK_MAJOR_VERSION <= 5)
+  this->Grid->SetScalarTypeToFloat();
+  this->Grid->SetNumberOfScalarComponents( 1 );
+  this->Grid->AllocateScalars();
+#else
+  this->Grid->AllocateScalars( VTK_FLOAT, 1 );
+#endif
+
+  // Grid geometry is stored in members, so that queries do not need to access the image data
+  this->Grid->GetDimensions( this->GridDimensions );
+  this->Grid->GetOrigin( this->GridOrigin );
+  this->Grid->GetSpacing( this->GridSpacing );
+  this->GridValues = static_cast< float* >( this->Grid->GetScalarPointer() );
+
+  vtkSignedDistanceFieldSampler sampler;
+  sampler.Hierarchy = surfaceHierarchy;
+  sampler.Values = this->GridValues;
+  for ( int i = 0; i < 3; i++ )
+  {
+    sampler.Dimensions[ i ] = this->GridDimensions[ i ];
+    sampler.Origin[ i ] = this->GridOrigin[ i ];
+    sampler.Spacing[ i ] = this->GridSpacing[ i ];
+  }
+  vtkSMPTools::For( 0, dimensions[ 2 ], sampler ); // expensive: computes distance for each voxel
+
+  this->GridValid = true;
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSignedDistanceField::InterpolateDistance( const double x[3], double& distance, double gradient[3] )
+{
+  if ( !this->GridValid )
+  {
+    return false;
+  }
+
+  const int* dimensions = this->GridDimensions;
+  const double* origin = this->GridOrigin;
+  const double* spacing = this->GridSpacing;
+
+  int baseIndex[3] = { 0, 0, 0 };
+  double fraction[3] = { 0.0, 0.0, 0.0 };
+  for ( int i = 0; i < 3; i++ )
+  {
+    double continuousIndex = ( x[ i ] - origin[ i ] ) / spacing[ i ];
+    if ( continuousIndex < 0 || continuousIndex > dimensions[ i ] - 1 )
+    {
+      // outside the grid
+      return false;
+    }
+    baseIndex[ i ] = static_cast< int >( floor( continuousIndex ) );
+    if ( baseIndex[ i ] > dimensions[ i ] - 2 )
+    {
+      baseIndex[ i ] = dimensions[ i ] - 2;
+    }
+    fraction[ i ] = continuousIndex - baseIndex[ i ];
+  }
+
+  const float* values = this->GridValues;
+  vtkIdType increments[3] = { 1, dimensions[ 0 ], static_cast< vtkIdType >( dimensions[ 0 ] ) * dimensions[ 1 ] };
+  const float* corner = values + baseIndex[ 0 ] + baseIndex[ 1 ] * increments[ 1 ] + baseIndex[ 2 ] * increments[ 2 ];
+  double v000 = corner[ 0 ];
+  double v100 = corner[ increments[ 0 ] ];
+  double v010 = corner[ increments[ 1 ] ];
+  double v110 = corner[ increments[ 0 ] + increments[ 1 ] ];
+  double v001 = corner[ increments[ 2 ] ];
+  double v101 = corner[ increments[ 0 ] + increments[ 2 ] ];
+  double v011 = corner[ increments[ 1 ] + increments[ 2 ] ];
+  double v111 = corner[ increments[ 0 ] + increments[ 1 ] + increments[ 2 ] ];
+
+  double fx = fraction[ 0 ];
+  double fy = fraction[ 1 ];
+  double fz = fraction[ 2 ];
+
+  // Interpolate along x
+  double v00 = v000 + ( v100 - v000 ) * fx;
+  double v10 = v010 + ( v110 - v010 ) * fx;
+  double v01 = v001 + ( v101 - v001 ) * fx;
+  double v11 = v011 + ( v111 - v011 ) * fx;
+  // Interpolate along y
+  double v0 = v00 + ( v10 - v00 ) * fy;
+  double v1 = v01 + ( v11 - v01 ) * fy;
+  // Interpolate along z
+  distance = v0 + ( v1 - v0 ) * fz;
+
+  // Analytic gradient of the trilinear interpolant
+  double dx0 = ( v100 - v000 ) * ( 1 - fy ) + ( v110 - v010 ) * fy;
+  double dx1 = ( v101 - v001 ) * ( 1 - fy ) + ( v111 - v011 ) * fy;
+  gradient[ 0 ] = ( dx0 * ( 1 - fz ) + dx1 * fz ) / spacing[ 0 ];
+  double dy0 = v10 - v00;
+  double dy1 = v11 - v01;
+  gradient[ 1 ] = ( dy0 * ( 1 - fz ) + dy1 * fz ) / spacing[ 1 ];
+  gradient[ 2 ] = ( v1 - v0 ) / spacing[ 2 ];
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkSignedDistanceField::InterpolateFunctionAndGetClosestPoint( const double x[3], double& distance, double closestPoint[3] )
+{
+  double interpolatedDistance = 0.0;
+  double gradient[3] = { 0.0, 0.0, 0.0 };
+  if ( !this->InterpolateDistance( x, interpolatedDistance, gradient ) )
+  {
+    return false;
+  }
+
+  const double* spacing = this->GridSpacing;
+  double voxelDiagonal = sqrt( spacing[ 0 ] * spacing[ 0 ] + spacing[ 1 ] * spacing[ 1 ] + spacing[ 2 ] * spacing[ 2 ] );
+  if ( fabs( interpolatedDistance ) < this->NarrowBandWidthVoxels * voxelDiagonal )
+  {
+    // close to the surface, interpolation is not accurate enough
+    return false;
+  }
+
+  double gradientNorm = vtkMath::Norm( gradient );
+  if ( gradientNorm < 1e-6 )
+  {
+    // gradient is undefined (e.g., on the medial axis), closest point cannot be estimated
+    return false;
+  }
+
+  // The closest point is in the opposite direction of the gradient of the distance function
+  for ( int i = 0; i < 3; i++ )
+  {
+    closestPoint[ i ] = x[ i ] - interpolatedDistance * gradient[ i ] / gradientNorm;
+  }
+  distance = interpolatedDistance;
+  return true;
+}
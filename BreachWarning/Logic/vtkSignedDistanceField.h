@@ -0,0 +1,101 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkSignedDistanceField_h
+#define __vtkSignedDistanceField_h
+
+#include <vtkImageData.h>
+#include <vtkObject.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// export
+#include "vtkSlicerBreachWarningModuleLogicExport.h"
+
+class vtkTriangleBVH;
+
+// Signed distance of a closed surface sampled on a regular grid.
+// The grid covers the bounding box of the surface, expanded by a margin. Distance is negative inside the surface.
+// Building the grid is expensive (one exact distance computation per voxel), but afterwards distance can be
+// retrieved by a trilinear lookup, in constant time, independently from the number of triangles in the surface.
+// Interpolated distance is not accurate close to the surface, therefore the lookup refuses to return a result
+// within a narrow band around the surface (and outside the grid): in these cases exact distance computation is needed.
+class VTK_SLICER_BREACHWARNING_MODULE_LOGIC_EXPORT vtkSignedDistanceField : public vtkObject
+{
+public:
+  static vtkSignedDistanceField* New();
+  vtkTypeMacro( vtkSignedDistanceField, vtkObject );
+  void PrintSelf( ostream &os, vtkIndent indent ) VTK_OVERRIDE;
+
+  // Requested distance between grid points. Actual spacing may be larger if the grid would contain
+  // more than MaximumNumberOfVoxels voxels.
+  vtkSetMacro( Spacing, double );
+  vtkGetMacro( Spacing, double );
+
+  // Distance of the grid boundary from the bounding box of the surface.
+  vtkSetMacro( Margin, double );
+  vtkGetMacro( Margin, double );
+
+  // Limits the memory usage and build time of the grid.
+  vtkSetMacro( MaximumNumberOfVoxels, vtkIdType );
+  vtkGetMacro( MaximumNumberOfVoxels, vtkIdType );
+
+  // Width of the band around the surface where interpolated distance is not used, in multiples of the voxel diagonal.
+  vtkSetMacro( NarrowBandWidthVoxels, double );
+  vtkGetMacro( NarrowBandWidthVoxels, double );
+
+  // Samples the signed distance of the surface on the grid. Sampling is performed in parallel,
+  // all threads query the same surfaceHierarchy (built from the surface, in the same coordinate system).
+  // Returns false on failure.
+  bool Build( vtkPolyData* surface, vtkTriangleBVH* surfaceHierarchy );
+
+  // Computes signed distance and approximate closest point by interpolation in the grid.
+  // Returns false if the point is outside the grid or in the narrow band around the surface,
+  // where exact distance computation must be used instead.
+  bool InterpolateFunctionAndGetClosestPoint( const double x[3], double& distance, double closestPoint[3] );
+
+  // Grid storing the sampled signed distance values. Empty if the field is not built yet.
+  vtkImageData* GetGrid();
+
+protected:
+  vtkSignedDistanceField();
+  ~vtkSignedDistanceField();
+
+  // Computes trilinearly interpolated distance and its gradient. Returns false if the point is outside the grid.
+  bool InterpolateDistance( const double x[3], double& distance, double gradient[3] );
+
+private:
+  double Spacing;
+  double Margin;
+  vtkIdType MaximumNumberOfVoxels;
+  double NarrowBandWidthVoxels;
+
+  vtkSmartPointer< vtkImageData > Grid;
+  bool GridValid;
+
+  // Copy of the grid geometry and scalar pointer, set in Build(). Queries only read these,
+  // so that they do not call vtkImageData methods from multiple threads.
+  int GridDimensions[3];
+  double GridOrigin[3];
+  double GridSpacing[3];
+  float* GridValues;
+
+  vtkSignedDistanceField(const vtkSignedDistanceField&); // Not implemented.
+  void operator=(const vtkSignedDistanceField&); // Not implemented.
+};
+
+#endif
@@ -17,6 +17,10 @@
 
 // BreachWarning includes
 #include "vtkSlicerBreachWarningLogic.h"
+#include "vtkDecimatedSurfaceProxy.h"
+#include "vtkPolyDataLocatorCache.h"
+#include "vtkSignedDistanceField.h"
+#include "vtkTriangleBVH.h"
 
 // MRML includes
 #include "vtkMRMLAnnotationLineDisplayNode.h"
@@ -30,28 +34,1059 @@
 #include "vtkMRMLTransformNode.h"
 
 // VTK includes
+#include <vtkCellArray.h>
 #include <vtkCellData.h>
 #include <vtkCellLocator.h>
+#include <vtkConditionVariable.h>
+#include <vtkDoubleArray.h>
 #include <vtkGeneralTransform.h>
 #include <vtkGenericCell.h>
-#include <vtkImplicitPolyDataDistance.h>
 #include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMultiThreader.h>
+#include <vtkMutexLock.h>
 #include <vtkNew.h>
 #include <vtkObjectFactory.h>
 #include <vtkPolyData.h>
 #include <vtkPolygon.h>
+#include <vtkSMPTools.h>
 #include <vtkSmartPointer.h>
+#include <vtkTimerLog.h>
 #include <vtkTransformPolyDataFilter.h>
+#include <vtkWeakPointer.h>
 
 // STD includes
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <vector>
 
 // Slicer methods 
 
 vtkStandardNewMacro(vtkSlicerBreachWarningLogic);
 
+// Tolerance for deciding if a linear transform preserves distances (up to isotropic scaling)
+static const double SIMILARITY_TRANSFORM_TOLERANCE = 1e-6;
+
+// Signed distance field and decimated surface of a deforming model are only built after the surface
+// has not changed for this long. Until then the refitted triangle hierarchy is queried directly.
+static const double SURFACE_STABLE_TIME_SEC = 0.5;
+
+//------------------------------------------------------------------------------
+// Computes closest points of a range of points. Hierarchy queries are read-only, so ranges can be processed in parallel.
+class vtkBreachWarningPointDistanceComputer
+{
+public:
+  vtkTriangleBVH* Hierarchy;
+  int SurfaceIndex;
+  // Transforms between RAS and the coordinate system of the hierarchy, NULL if the hierarchy is in RAS.
+  // The transform must be a similarity transform, so that closest points are invariant.
+  vtkMatrix4x4* RasToSurfaceMatrix;
+  vtkMatrix4x4* SurfaceToRasMatrix;
+  vtkPoints* Points_Ras;
+  double* Distances;
+  double* ClosestPoints_Ras; // may be NULL
+
+  void operator()( vtkIdType beginPoint, vtkIdType endPoint )
+  {
+    double position_Ras[4] = { 0.0, 0.0, 0.0, 1.0 };
+    double position_Surface[4] = { 0.0, 0.0, 0.0, 1.0 };
+    double closestPoint_Surface[4] = { 0.0, 0.0, 0.0, 1.0 };
+    double closestPoint_Ras[4] = { 0.0, 0.0, 0.0, 1.0 };
+    for ( vtkIdType pointIndex = beginPoint; pointIndex < endPoint; pointIndex++ )
+    {
+      this->Points_Ras->GetPoint( pointIndex, position_Ras );
+      int closestSurfaceIndex = -1;
+      double distance = 0.0;
+      if ( this->RasToSurfaceMatrix == NULL )
+      {
+        distance = this->Hierarchy->FindClosestPoint( position_Ras, closestPoint_Ras, closestSurfaceIndex, this->SurfaceIndex );
+      }
+      else
+      {
+        this->RasToSurfaceMatrix->MultiplyPoint( position_Ras, position_Surface );
+        distance = this->Hierarchy->FindClosestPoint( position_Surface, closestPoint_Surface, closestSurfaceIndex, this->SurfaceIndex );
+        if ( closestSurfaceIndex >= 0 )
+        {
+          this->SurfaceToRasMatrix->MultiplyPoint( closestPoint_Surface, closestPoint_Ras );
+          double distance_Ras = sqrt( vtkMath::Distance2BetweenPoints( position_Ras, closestPoint_Ras ) );
+          distance = ( distance < 0 ) ? -distance_Ras : distance_Ras;
+        }
+      }
+      this->Distances[ pointIndex ] = distance;
+      if ( this->ClosestPoints_Ras != NULL )
+      {
+        double* closestPoint = this->ClosestPoints_Ras + 3 * pointIndex;
+        closestPoint[ 0 ] = closestPoint_Ras[ 0 ];
+        closestPoint[ 1 ] = closestPoint_Ras[ 1 ];
+        closestPoint[ 2 ] = closestPoint_Ras[ 2 ];
+      }
+    }
+  }
+};
+
+//------------------------------------------------------------------------------
+class vtkSlicerBreachWarningLogic::vtkInternal
+{
+public:
+
+  // Distance computation pipeline of a breach warning node.
+  // Building the locator is expensive, therefore it is only rebuilt if the watched model's
+  // polydata or its transform to RAS is changed. Tool motion does not require any locator update.
+  // If only the point coordinates change (deforming model or non-linear transform) then the
+  // triangle hierarchy is refitted instead of rebuilding a locator.
+  struct DistanceEngine
+  {
+    DistanceEngine()
+    : RefinementDistance(0.0)
+    , HierarchyShared(false)
+    , QueryInModelCoordinates(false)
+    , Deforming(false)
+    , LastDeformationTimeSec(0.0)
+    , PolyDataMTime(0)
+    , TopologyMTime(0)
+    , ModelToRasTransformMTime(0)
+    {
+      this->ModelToRasMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+      this->RasToModelMatrix = vtkSmartPointer< vtkMatrix4x4 >::New();
+    }
+
+    vtkSmartPointer< vtkPolyData > Surface; // surface that the locator is built from (in model or RAS coordinate system)
+
+    // Optional precomputed distance grid (in the same coordinate system as the locator)
+    vtkSmartPointer< vtkSignedDistanceField > DistanceField;
+
+    // Optional decimated surface for queries far from the surface (in the same coordinate system as the locator)
+    vtkSmartPointer< vtkDecimatedSurfaceProxy > SurfaceProxy;
+    double RefinementDistance; // full-resolution surface is queried within this distance from the surface
+
+    // Triangle hierarchy for exact point and tool shaft (segment) queries, built from Surface when first needed
+    vtkSmartPointer< vtkTriangleBVH > Hierarchy;
+    // If true then Hierarchy is obtained from the locator cache and other modules may use it, so it must not be modified
+    bool HierarchyShared;
+    vtkWeakPointer< vtkPolyDataLocatorCache > LocatorCache;
+
+    // If true then the locator is built from the untransformed model surface and the tool tip
+    // is transformed into the model coordinate system (possible if the model transform is linear
+    // and preserves distances). Otherwise the locator is built from the surface transformed to RAS.
+    bool QueryInModelCoordinates;
+    vtkSmartPointer< vtkMatrix4x4 > ModelToRasMatrix;
+    vtkSmartPointer< vtkMatrix4x4 > RasToModelMatrix;
+
+    // If true then point coordinates of the surface changed while its cells remained the same.
+    // The triangle hierarchy is refitted then, instead of rebuilding it. Signed distance field
+    // and decimated surface are not built while deforming, as they would be outdated by the next change.
+    // Cleared when the surface has not changed for SURFACE_STABLE_TIME_SEC.
+    bool Deforming;
+    double LastDeformationTimeSec;
+
+    vtkWeakPointer< vtkPolyData > PolyData; // watched model surface that the engine was built from
+    vtkWeakPointer< vtkMRMLTransformNode > ModelParentTransformNode;
+    vtkMTimeType PolyDataMTime;
+    vtkMTimeType TopologyMTime;
+    vtkMTimeType ModelToRasTransformMTime;
+  };
+
+  typedef std::map< vtkMRMLBreachWarningNode*, DistanceEngine > DistanceEngineMapType;
+  DistanceEngineMapType DistanceEngines;
+
+  // Bounding volume hierarchy of all the watched models of a breach warning node, used if multiple models are watched.
+  // The hierarchy is built in RAS, therefore it is refitted if any of the watched surface points or their transforms change
+  // and rebuilt if the set of surfaces or their cells change.
+  struct ModelHierarchy
+  {
+    vtkSmartPointer< vtkTriangleBVH > Hierarchy;
+    // Watched model index of each surface in the hierarchy (models without surface are not added)
+    std::vector< int > WatchedModelIndices;
+    std::vector< vtkWeakPointer< vtkPolyData > > PolyDatas;
+    std::vector< vtkMTimeType > PolyDataMTimes;
+    std::vector< vtkMTimeType > TopologyMTimes;
+    std::vector< vtkWeakPointer< vtkMRMLTransformNode > > ModelParentTransformNodes;
+    std::vector< vtkMTimeType > ModelToRasTransformMTimes;
+  };
+
+  typedef std::map< vtkMRMLBreachWarningNode*, ModelHierarchy > ModelHierarchyMapType;
+  ModelHierarchyMapType ModelHierarchies;
+
+  // Returns the up-to-date distance engine of the breach warning node (rebuilds the locator if needed).
+  DistanceEngine& GetUpdatedDistanceEngine( vtkMRMLBreachWarningNode* bwNode, vtkMRMLModelNode* modelNode );
+
+  // Returns the up-to-date hierarchy of all watched models of the breach warning node (rebuilds it if needed).
+  ModelHierarchy& GetUpdatedModelHierarchy( vtkMRMLBreachWarningNode* bwNode );
+
+  // Get tool tip position in RAS. Returns false if the tool transform is not set.
+  static bool GetToolTipPosition( vtkMRMLBreachWarningNode* bwNode, double toolTipPosition_Ras[3] );
+
+  // Get position of a point specified in ToolTip coordinate system in RAS. Returns false if the tool transform is not set.
+  static bool GetToolPointPosition( vtkMRMLBreachWarningNode* bwNode, const double point_Tool[3], double point_Ras[3] );
+
+  // Returns the triangle hierarchy of the engine's surface, builds it if needed.
+  static vtkTriangleBVH* GetUpdatedHierarchy( DistanceEngine& engine );
+
+  // Returns the last modification time of the cells of the surface (point coordinate changes are not included).
+  static vtkMTimeType GetTopologyMTime( vtkPolyData* surface );
+
+  // Refits the hierarchy after its surface points are updated by the caller-provided surfaces.
+  // The hierarchy may be used by the background worker, so in that case a refitted copy is returned.
+  // Returns NULL if refit is not possible (the hierarchy has to be rebuilt).
+  vtkSmartPointer< vtkTriangleBVH > GetRefittedHierarchy( vtkTriangleBVH* hierarchy, bool hierarchyShared,
+    const std::vector< vtkPolyData* >& surfaces, const std::vector< vtkAbstractTransform* >& transforms );
+
+  // Returns true if the matrix is a rotation, translation, mirroring, and isotropic scaling.
+  // For these transforms closest points are invariant, so the query can be performed in the model coordinate system.
+  static bool IsSimilarityTransform( vtkMatrix4x4* matrix );
+
+  // Computed distances of a breach warning node
+  struct ToolState
+  {
+    ToolState();
+    bool Valid;
+    double ToolTipPosition_Ras[3];
+    double ClosestDistance;
+    double ClosestPointOnModel_Ras[3];
+    int ClosestWatchedModelIndex;
+    bool ToolShaftEnabled;
+    double ToolShaftAxisDistance; // distance from the shaft axis (shaft radius is not subtracted)
+    double ClosestPointOnToolShaft_Ras[3];
+    double ClosestPointOnModelFromToolShaft_Ras[3];
+    int ClosestWatchedModelIndexToToolShaft;
+  };
+
+  // Estimates the time until the tool tip reaches the surface from the tool tip velocity component along the distance gradient.
+  // Returns 0 if the tool tip is inside and -1 if the tool tip is not approaching the surface.
+  static double GetTimeToBreach( vtkMRMLBreachWarningNode* bwNode, const ToolState& state );
+
+  // Stores the computed distances in the breach warning node and updates the line to the closest point.
+  static void ApplyToolState( vtkSlicerBreachWarningLogic* logic, vtkMRMLBreachWarningNode* bwNode, const ToolState& state );
+
+  // All inputs of a tool state computation. The computation does not access any MRML nodes,
+  // therefore it can be performed in a background thread. The surface hierarchy and distance field are
+  // only read during the computation and kept alive by the query, even if the main thread replaces them.
+  struct ToolStateQuery
+  {
+    ToolStateQuery();
+    unsigned long Generation; // set when the query is posted to the worker
+    vtkSmartPointer< vtkTriangleBVH > Hierarchy;
+    vtkSmartPointer< vtkSignedDistanceField > DistanceField; // optional, same coordinate system as Hierarchy
+    vtkSmartPointer< vtkDecimatedSurfaceProxy > SurfaceProxy; // optional, same coordinate system as Hierarchy
+    double RefinementDistance;
+    bool QueryInModelCoordinates;
+    double ModelToRasMatrix[16];
+    double RasToModelMatrix[16];
+    std::vector< int > WatchedModelIndices; // watched model index of each surface in Hierarchy
+    double ToolTipPosition_Ras[3];
+    bool ToolShaftEnabled;
+    double ToolShaftEndPosition_Ras[3];
+  };
+
+  // Collects inputs for computing the tool state (main thread). Returns false if the tool state cannot be computed.
+  bool PrepareToolStateQuery( vtkMRMLBreachWarningNode* bwNode, ToolStateQuery& query );
+
+  // Sets the surface of the query from the distance engine of a single watched model (main thread)
+  static void SetQuerySurface( DistanceEngine& engine, ToolStateQuery& query );
+
+  // Computes the tool state (can be called from any thread). Used for both synchronous and asynchronous updates,
+  // so that the results do not depend on AsynchronousUpdate.
+  static void ExecuteToolStateQuery( ToolStateQuery& query, ToolState& state );
+
+  // Background worker. Only the latest query of each node is kept: if the worker cannot keep up with
+  // tool updates then intermediate poses are skipped. Completed results are applied on the main thread.
+  // Nodes are only used as keys by the worker, they are never accessed from the worker thread. Each node gets
+  // a new query generation when its queries are removed (node removed from the scene, outputs reset), so that results
+  // of queries that were already running at that time are discarded, even if a new node is created at the same address.
+  void StartWorker();
+  void StopWorker();
+  bool IsWorkerRunning();
+  void PostQuery( vtkMRMLBreachWarningNode* bwNode, const ToolStateQuery& query );
+  void RemoveQueries( vtkMRMLBreachWarningNode* bwNode );
+  static VTK_THREAD_RETURN_TYPE WorkerThreadFunction( void* threadInfoPtr );
+
+  struct CompletedToolState
+  {
+    unsigned long Generation; // generation of the query that the state is computed from
+    ToolState State;
+  };
+
+  // Returns true if results of the query generation can still be applied to the node. Must be called with WorkerMutex locked.
+  bool IsQueryGenerationCurrent( vtkMRMLBreachWarningNode* bwNode, unsigned long generation );
+
+  typedef std::map< vtkMRMLBreachWarningNode*, ToolStateQuery > ToolStateQueryMapType;
+  typedef std::map< vtkMRMLBreachWarningNode*, CompletedToolState > ToolStateMapType;
+  typedef std::map< vtkMRMLBreachWarningNode*, unsigned long > QueryGenerationMapType;
+
+  vtkSmartPointer< vtkMultiThreader > Threader;
+  int WorkerThreadId; // -1 if the worker is not running
+  bool WorkerStopRequested;
+  vtkSmartPointer< vtkMutexLock > WorkerMutex; // protects WorkerStopRequested, PendingQueries, CompletedToolStates, QueryGenerations
+  vtkSmartPointer< vtkConditionVariable > WorkerCondition;
+  ToolStateQueryMapType PendingQueries;
+  ToolStateMapType CompletedToolStates;
+  QueryGenerationMapType QueryGenerations; // current query generation of each node that has queries
+  unsigned long LastQueryGeneration;
+
+  // Nodes that have changed inputs since the last ProcessDeferredUpdates() call
+  std::set< vtkMRMLBreachWarningNode* > DeferredUpdateNodes;
+
+  // Shared with other modules
+  vtkSmartPointer< vtkPolyDataLocatorCache > LocatorCache;
+
+  vtkInternal();
+  ~vtkInternal();
+};
+
+//------------------------------------------------------------------------------
+vtkSlicerBreachWarningLogic::vtkInternal::vtkInternal()
+: WorkerThreadId(-1)
+, WorkerStopRequested(false)
+, LastQueryGeneration(0)
+{
+  this->Threader = vtkSmartPointer< vtkMultiThreader >::New();
+  this->WorkerMutex = vtkSmartPointer< vtkMutexLock >::New();
+  this->WorkerCondition = vtkSmartPointer< vtkConditionVariable >::New();
+  this->LocatorCache = vtkSmartPointer< vtkPolyDataLocatorCache >::New();
+}
+
+//------------------------------------------------------------------------------
+vtkSlicerBreachWarningLogic::vtkInternal::~vtkInternal()
+{
+  this->StopWorker();
+}
+
+//------------------------------------------------------------------------------
+vtkSlicerBreachWarningLogic::vtkInternal::ToolState::ToolState()
+: Valid(false)
+, ClosestDistance(0.0)
+, ClosestWatchedModelIndex(-1)
+, ToolShaftEnabled(false)
+, ToolShaftAxisDistance(0.0)
+, ClosestWatchedModelIndexToToolShaft(-1)
+{
+  for ( int i = 0; i < 3; i++ )
+  {
+    this->ToolTipPosition_Ras[ i ] = 0.0;
+    this->ClosestPointOnModel_Ras[ i ] = 0.0;
+    this->ClosestPointOnToolShaft_Ras[ i ] = 0.0;
+    this->ClosestPointOnModelFromToolShaft_Ras[ i ] = 0.0;
+  }
+}
+
+//------------------------------------------------------------------------------
+vtkSlicerBreachWarningLogic::vtkInternal::ToolStateQuery::ToolStateQuery()
+: Generation(0)
+, RefinementDistance(0.0)
+, QueryInModelCoordinates(false)
+, ToolShaftEnabled(false)
+{
+  vtkMatrix4x4::Identity( this->ModelToRasMatrix );
+  vtkMatrix4x4::Identity( this->RasToModelMatrix );
+  for ( int i = 0; i < 3; i++ )
+  {
+    this->ToolTipPosition_Ras[ i ] = 0.0;
+    this->ToolShaftEndPosition_Ras[ i ] = 0.0;
+  }
+}
+
+//------------------------------------------------------------------------------
+double vtkSlicerBreachWarningLogic::vtkInternal::GetTimeToBreach( vtkMRMLBreachWarningNode* bwNode, const ToolState& state )
+{
+  if ( state.ClosestDistance < 0 )
+  {
+    // already inside
+    return 0.0;
+  }
+  double velocity_Ras[3] = { 0.0, 0.0, 0.0 };
+  if ( !bwNode->GetToolTipVelocity( velocity_Ras ) )
+  {
+    return -1.0;
+  }
+  // Distance gradient is the unit vector from the closest point to the tool tip
+  double gradient[3] = { 0.0, 0.0, 0.0 };
+  vtkMath::Subtract( state.ToolTipPosition_Ras, state.ClosestPointOnModel_Ras, gradient );
+  if ( vtkMath::Normalize( gradient ) < 1e-6 )
+  {
+    // on the surface
+    return 0.0;
+  }
+  double approachSpeedMmPerSec = -vtkMath::Dot( velocity_Ras, gradient );
+  const double minimumApproachSpeedMmPerSec = 1e-3;
+  if ( approachSpeedMmPerSec < minimumApproachSpeedMmPerSec )
+  {
+    // not approaching
+    return -1.0;
+  }
+  return state.ClosestDistance / approachSpeedMmPerSec;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::ApplyToolState( vtkSlicerBreachWarningLogic* logic, vtkMRMLBreachWarningNode* bwNode, const ToolState& state )
+{
+  if ( !state.Valid )
+  {
+    bwNode->SetClosestDistanceToModelFromToolTip(0);
+    bwNode->SetClosestWatchedModelIndex(-1);
+    bwNode->SetClosestDistanceToModelFromToolShaft(0);
+    bwNode->SetClosestWatchedModelIndexToToolShaft(-1);
+    bwNode->SetEstimatedTimeToBreachSec(-1);
+    bwNode->SetCurrentDistanceBandIndex(-1);
+    return;
+  }
+
+  bwNode->SetEstimatedTimeToBreachSec( GetTimeToBreach( bwNode, state ) );
+
+  bwNode->SetClosestDistanceToModelFromToolTip(state.ClosestDistance);
+  bwNode->SetClosestPointOnModel(const_cast< double* >( state.ClosestPointOnModel_Ras ));
+  bwNode->SetClosestWatchedModelIndex(state.ClosestWatchedModelIndex);
+
+  // Distance to the capsule surface
+  bwNode->SetClosestDistanceToModelFromToolShaft( state.ToolShaftEnabled ? state.ToolShaftAxisDistance - bwNode->GetToolShaftRadiusMm() : 0 );
+  bwNode->SetClosestPointOnToolShaft(const_cast< double* >( state.ClosestPointOnToolShaft_Ras ));
+  bwNode->SetClosestPointOnModelFromToolShaft(const_cast< double* >( state.ClosestPointOnModelFromToolShaft_Ras ));
+  bwNode->SetClosestWatchedModelIndexToToolShaft(state.ClosestWatchedModelIndexToToolShaft);
+
+  // All distance bands are classified from the same distance (only invokes an event if the band is changed)
+  double toolDistance = state.ClosestDistance;
+  if ( state.ToolShaftEnabled && bwNode->GetClosestDistanceToModelFromToolShaft() < toolDistance )
+  {
+    toolDistance = bwNode->GetClosestDistanceToModelFromToolShaft();
+  }
+  bwNode->SetCurrentDistanceBandIndex( bwNode->GetDistanceBandIndex( toolDistance ) );
+
+  logic->UpdateLineToClosestPoint(bwNode, const_cast< double* >( state.ToolTipPosition_Ras ),
+    const_cast< double* >( state.ClosestPointOnModel_Ras ), state.ClosestDistance);
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::PrepareToolStateQuery( vtkMRMLBreachWarningNode* bwNode, ToolStateQuery& query )
+{
+  vtkMRMLModelNode* modelNode = bwNode->GetWatchedModelNode();
+  if ( modelNode == NULL || !GetToolTipPosition( bwNode, query.ToolTipPosition_Ras ) )
+  {
+    return false;
+  }
+  bwNode->AddToolTipPositionToHistory( query.ToolTipPosition_Ras, vtkTimerLog::GetUniversalTime() );
+  query.ToolShaftEnabled = ( bwNode->GetToolShaftLengthMm() > 0 );
+  if ( query.ToolShaftEnabled )
+  {
+    double toolShaftEndPosition_Tool[3] = { 0.0, 0.0, -bwNode->GetToolShaftLengthMm() };
+    GetToolPointPosition( bwNode, toolShaftEndPosition_Tool, query.ToolShaftEndPosition_Ras );
+  }
+
+  if ( bwNode->GetNumberOfWatchedModelNodes() > 1 )
+  {
+    ModelHierarchy& modelHierarchy = this->GetUpdatedModelHierarchy( bwNode );
+    query.Hierarchy = modelHierarchy.Hierarchy;
+    query.WatchedModelIndices = modelHierarchy.WatchedModelIndices;
+    query.QueryInModelCoordinates = false;
+    query.DistanceField = NULL;
+    query.SurfaceProxy = NULL;
+  }
+  else
+  {
+    if ( modelNode->GetPolyData() == NULL )
+    {
+      return false;
+    }
+    SetQuerySurface( this->GetUpdatedDistanceEngine( bwNode, modelNode ), query );
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::SetQuerySurface( DistanceEngine& engine, ToolStateQuery& query )
+{
+  query.Hierarchy = GetUpdatedHierarchy( engine );
+  query.WatchedModelIndices.assign( 1, 0 );
+  query.DistanceField = engine.DistanceField;
+  query.SurfaceProxy = engine.SurfaceProxy;
+  query.RefinementDistance = engine.RefinementDistance;
+  if ( engine.QueryInModelCoordinates )
+  {
+    // Refinement distance is specified in RAS, but the decimated surface is queried in model coordinates
+    // (the transform is a similarity transform, so all directions are scaled the same way)
+    double rasToModelScale = sqrt( engine.RasToModelMatrix->GetElement( 0, 0 ) * engine.RasToModelMatrix->GetElement( 0, 0 )
+      + engine.RasToModelMatrix->GetElement( 1, 0 ) * engine.RasToModelMatrix->GetElement( 1, 0 )
+      + engine.RasToModelMatrix->GetElement( 2, 0 ) * engine.RasToModelMatrix->GetElement( 2, 0 ) );
+    query.RefinementDistance *= rasToModelScale;
+  }
+  query.QueryInModelCoordinates = engine.QueryInModelCoordinates;
+  vtkMatrix4x4::DeepCopy( query.ModelToRasMatrix, engine.ModelToRasMatrix );
+  vtkMatrix4x4::DeepCopy( query.RasToModelMatrix, engine.RasToModelMatrix );
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::ExecuteToolStateQuery( ToolStateQuery& query, ToolState& state )
+{
+  state = ToolState();
+  for ( int i = 0; i < 3; i++ )
+  {
+    state.ToolTipPosition_Ras[ i ] = query.ToolTipPosition_Ras[ i ];
+  }
+
+  // Query points in the coordinate system of the hierarchy
+  double toolTipPosition[4] = { query.ToolTipPosition_Ras[ 0 ], query.ToolTipPosition_Ras[ 1 ], query.ToolTipPosition_Ras[ 2 ], 1.0 };
+  double toolShaftEndPosition[4] = { query.ToolShaftEndPosition_Ras[ 0 ], query.ToolShaftEndPosition_Ras[ 1 ], query.ToolShaftEndPosition_Ras[ 2 ], 1.0 };
+  if ( query.QueryInModelCoordinates )
+  {
+    vtkMatrix4x4::MultiplyPoint( query.RasToModelMatrix, toolTipPosition, toolTipPosition );
+    vtkMatrix4x4::MultiplyPoint( query.RasToModelMatrix, toolShaftEndPosition, toolShaftEndPosition );
+  }
+
+  double closestPoint[4] = { 0.0, 0.0, 0.0, 1.0 };
+  int closestSurfaceIndex = -1;
+  if ( query.DistanceField.GetPointer() != NULL
+    && query.DistanceField->InterpolateFunctionAndGetClosestPoint( toolTipPosition, state.ClosestDistance, closestPoint ) )
+  {
+    // far from the surface, the grid lookup is accurate enough
+    closestSurfaceIndex = 0;
+  }
+  else if ( query.SurfaceProxy.GetPointer() != NULL
+    && query.SurfaceProxy->FindClosestPoint( toolTipPosition, query.RefinementDistance, state.ClosestDistance, closestPoint ) )
+  {
+    // far from the surface, the decimated surface is accurate enough
+    closestSurfaceIndex = 0;
+  }
+  else
+  {
+    state.ClosestDistance = query.Hierarchy->FindClosestPoint( toolTipPosition, closestPoint, closestSurfaceIndex );
+  }
+  if ( closestSurfaceIndex < 0 )
+  {
+    // no surface
+    return;
+  }
+  state.Valid = true;
+  state.ClosestWatchedModelIndex = query.WatchedModelIndices[ closestSurfaceIndex ];
+
+  state.ToolShaftEnabled = query.ToolShaftEnabled;
+  double closestPointOnToolShaft[4] = { 0.0, 0.0, 0.0, 1.0 };
+  double closestPointOnModelFromToolShaft[4] = { 0.0, 0.0, 0.0, 1.0 };
+  if ( query.ToolShaftEnabled )
+  {
+    int closestSurfaceIndexToToolShaft = -1;
+    if ( query.SurfaceProxy.GetPointer() != NULL
+      && query.SurfaceProxy->FindClosestPointToSegment( toolTipPosition, toolShaftEndPosition, query.RefinementDistance,
+        state.ToolShaftAxisDistance, closestPointOnToolShaft, closestPointOnModelFromToolShaft ) )
+    {
+      closestSurfaceIndexToToolShaft = 0;
+    }
+    else
+    {
+      state.ToolShaftAxisDistance = query.Hierarchy->FindClosestPointToSegment( toolTipPosition, toolShaftEndPosition,
+        closestPointOnToolShaft, closestPointOnModelFromToolShaft, closestSurfaceIndexToToolShaft );
+    }
+    state.ClosestWatchedModelIndexToToolShaft = ( closestSurfaceIndexToToolShaft >= 0 )
+      ? query.WatchedModelIndices[ closestSurfaceIndexToToolShaft ] : -1;
+  }
+
+  if ( !query.QueryInModelCoordinates )
+  {
+    for ( int i = 0; i < 3; i++ )
+    {
+      state.ClosestPointOnModel_Ras[ i ] = closestPoint[ i ];
+      state.ClosestPointOnToolShaft_Ras[ i ] = closestPointOnToolShaft[ i ];
+      state.ClosestPointOnModelFromToolShaft_Ras[ i ] = closestPointOnModelFromToolShaft[ i ];
+    }
+    return;
+  }
+
+  // Map closest points back to RAS. The transform may contain scaling, so compute the distances in RAS.
+  double point_Ras[4] = { 0.0, 0.0, 0.0, 1.0 };
+  vtkMatrix4x4::MultiplyPoint( query.ModelToRasMatrix, closestPoint, point_Ras );
+  for ( int i = 0; i < 3; i++ )
+  {
+    state.ClosestPointOnModel_Ras[ i ] = point_Ras[ i ];
+  }
+  double distance_Ras = sqrt( vtkMath::Distance2BetweenPoints( state.ToolTipPosition_Ras, state.ClosestPointOnModel_Ras ) );
+  state.ClosestDistance = ( state.ClosestDistance < 0 ) ? -distance_Ras : distance_Ras;
+  if ( query.ToolShaftEnabled )
+  {
+    vtkMatrix4x4::MultiplyPoint( query.ModelToRasMatrix, closestPointOnToolShaft, point_Ras );
+    for ( int i = 0; i < 3; i++ )
+    {
+      state.ClosestPointOnToolShaft_Ras[ i ] = point_Ras[ i ];
+    }
+    vtkMatrix4x4::MultiplyPoint( query.ModelToRasMatrix, closestPointOnModelFromToolShaft, point_Ras );
+    for ( int i = 0; i < 3; i++ )
+    {
+      state.ClosestPointOnModelFromToolShaft_Ras[ i ] = point_Ras[ i ];
+    }
+    double toolShaftDistance_Ras = sqrt( vtkMath::Distance2BetweenPoints( state.ClosestPointOnToolShaft_Ras, state.ClosestPointOnModelFromToolShaft_Ras ) );
+    state.ToolShaftAxisDistance = ( state.ToolShaftAxisDistance < 0 ) ? -toolShaftDistance_Ras : toolShaftDistance_Ras;
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::StartWorker()
+{
+  if ( this->WorkerThreadId >= 0 )
+  {
+    // already running
+    return;
+  }
+  this->WorkerStopRequested = false;
+  this->WorkerThreadId = this->Threader->SpawnThread( &vtkSlicerBreachWarningLogic::vtkInternal::WorkerThreadFunction, this );
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::StopWorker()
+{
+  if ( this->WorkerThreadId < 0 )
+  {
+    // not running
+    return;
+  }
+  this->WorkerMutex->Lock();
+  this->WorkerStopRequested = true;
+  this->WorkerCondition->Signal();
+  this->WorkerMutex->Unlock();
+  this->Threader->TerminateThread( this->WorkerThreadId ); // waits for the thread to finish
+  this->WorkerThreadId = -1;
+
+  this->WorkerMutex->Lock();
+  this->PendingQueries.clear();
+  this->CompletedToolStates.clear();
+  this->QueryGenerations.clear();
+  this->WorkerMutex->Unlock();
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::IsWorkerRunning()
+{
+  return this->WorkerThreadId >= 0;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::PostQuery( vtkMRMLBreachWarningNode* bwNode, const ToolStateQuery& query )
+{
+  this->WorkerMutex->Lock();
+  QueryGenerationMapType::iterator generationIt = this->QueryGenerations.find( bwNode );
+  if ( generationIt == this->QueryGenerations.end() )
+  {
+    generationIt = this->QueryGenerations.insert( std::make_pair( bwNode, ++this->LastQueryGeneration ) ).first;
+  }
+  ToolStateQuery& pendingQuery = this->PendingQueries[ bwNode ];
+  pendingQuery = query; // replaces the stale query of the same node
+  pendingQuery.Generation = generationIt->second;
+  this->WorkerCondition->Signal();
+  this->WorkerMutex->Unlock();
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::vtkInternal::RemoveQueries( vtkMRMLBreachWarningNode* bwNode )
+{
+  this->WorkerMutex->Lock();
+  this->PendingQueries.erase( bwNode );
+  this->CompletedToolStates.erase( bwNode );
+  // result of a query that the worker is computing now will not match any generation
+  this->QueryGenerations.erase( bwNode );
+  this->WorkerMutex->Unlock();
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::IsQueryGenerationCurrent( vtkMRMLBreachWarningNode* bwNode, unsigned long generation )
+{
+  QueryGenerationMapType::iterator generationIt = this->QueryGenerations.find( bwNode );
+  return generationIt != this->QueryGenerations.end() && generationIt->second == generation;
+}
+
+//------------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSlicerBreachWarningLogic::vtkInternal::WorkerThreadFunction( void* threadInfoPtr )
+{
+  vtkMultiThreader::ThreadInfo* threadInfo = static_cast< vtkMultiThreader::ThreadInfo* >( threadInfoPtr );
+  vtkInternal* self = static_cast< vtkInternal* >( threadInfo->UserData );
+
+  self->WorkerMutex->Lock();
+  while ( true )
+  {
+    while ( !self->WorkerStopRequested && self->PendingQueries.empty() )
+    {
+      self->WorkerCondition->Wait( self->WorkerMutex );
+    }
+    if ( self->WorkerStopRequested )
+    {
+      break;
+    }
+    vtkMRMLBreachWarningNode* bwNode = self->PendingQueries.begin()->first;
+    ToolStateQuery query = self->PendingQueries.begin()->second;
+    self->PendingQueries.erase( self->PendingQueries.begin() );
+    self->WorkerMutex->Unlock();
+
+    // Compute without holding the lock, so that new queries can be posted meanwhile
+    ToolState state;
+    ExecuteToolStateQuery( query, state );
+
+    self->WorkerMutex->Lock();
+    if ( !self->IsQueryGenerationCurrent( bwNode, query.Generation ) )
+    {
+      // queries of the node have been removed while computing
+      continue;
+    }
+    CompletedToolState& completedToolState = self->CompletedToolStates[ bwNode ]; // replaces the result that has not been applied yet
+    completedToolState.Generation = query.Generation;
+    completedToolState.State = state;
+  }
+  self->WorkerMutex->Unlock();
+  return VTK_THREAD_RETURN_VALUE;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::IsSimilarityTransform( vtkMatrix4x4* matrix )
+{
+  // Columns of the upper 3x3 part must be orthogonal and have the same length
+  double columns[3][3] = { { 0 } };
+  for ( int i = 0; i < 3; i++ )
+  {
+    for ( int j = 0; j < 3; j++ )
+    {
+      columns[ j ][ i ] = matrix->GetElement( i, j );
+    }
+  }
+  double squaredScale = vtkMath::Dot( columns[ 0 ], columns[ 0 ] );
+  if ( squaredScale <= 0 )
+  {
+    return false;
+  }
+  double tolerance = SIMILARITY_TRANSFORM_TOLERANCE * squaredScale;
+  return fabs( vtkMath::Dot( columns[ 1 ], columns[ 1 ] ) - squaredScale ) < tolerance
+    && fabs( vtkMath::Dot( columns[ 2 ], columns[ 2 ] ) - squaredScale ) < tolerance
+    && fabs( vtkMath::Dot( columns[ 0 ], columns[ 1 ] ) ) < tolerance
+    && fabs( vtkMath::Dot( columns[ 0 ], columns[ 2 ] ) ) < tolerance
+    && fabs( vtkMath::Dot( columns[ 1 ], columns[ 2 ] ) ) < tolerance;
+}
+
+//------------------------------------------------------------------------------
+vtkSlicerBreachWarningLogic::vtkInternal::DistanceEngine& vtkSlicerBreachWarningLogic::vtkInternal::GetUpdatedDistanceEngine( vtkMRMLBreachWarningNode* bwNode, vtkMRMLModelNode* modelNode )
+{
+  vtkPolyData* body = modelNode->GetPolyData();
+  vtkMRMLTransformNode* bodyParentTransform = modelNode->GetParentTransformNode();
+  vtkMTimeType bodyToRasTransformMTime = ( bodyParentTransform != NULL ) ? bodyParentTransform->GetTransformToWorldMTime() : 0;
+
+  DistanceEngine& engine = this->DistanceEngines[ bwNode ];
+  engine.LocatorCache = this->LocatorCache;
+
+  // Linear transforms that preserve distances are applied to the tool tip instead of the model points,
+  // so moving the model does not require rebuilding the locator.
+  bool queryInModelCoordinates = true;
+  if ( bodyParentTransform == NULL )
+  {
+    engine.ModelToRasMatrix->Identity();
+  }
+  else if ( bodyParentTransform->IsTransformToWorldLinear() )
+  {
+    bodyParentTransform->GetMatrixTransformToWorld( engine.ModelToRasMatrix );
+    queryInModelCoordinates = IsSimilarityTransform( engine.ModelToRasMatrix );
+  }
+  else
+  {
+    queryInModelCoordinates = false;
+  }
+  if ( queryInModelCoordinates )
+  {
+    vtkMatrix4x4::Invert( engine.ModelToRasMatrix, engine.RasToModelMatrix );
+  }
+
+  bool locatorUpToDate = engine.Surface.GetPointer() != NULL
+    && engine.PolyData.GetPointer() == body
+    && engine.PolyDataMTime == body->GetMTime()
+    && engine.QueryInModelCoordinates == queryInModelCoordinates
+    && ( queryInModelCoordinates // model transform is applied to the tool tip, therefore its change does not matter
+      || ( engine.ModelParentTransformNode.GetPointer() == bodyParentTransform
+        && engine.ModelToRasTransformMTime == bodyToRasTransformMTime ) );
+
+  if ( !locatorUpToDate )
+  {
+    // If the same polydata is deformed (or its non-linear transform is changed) then the cells are the same,
+    // only the points moved, therefore the hierarchy can be refitted.
+    vtkMTimeType topologyMTime = GetTopologyMTime( body );
+    bool deformed = engine.Surface.GetPointer() != NULL
+      && engine.PolyData.GetPointer() == body
+      && engine.TopologyMTime == topologyMTime
+      && engine.QueryInModelCoordinates == queryInModelCoordinates
+      && engine.ModelParentTransformNode.GetPointer() == bodyParentTransform;
+
+    engine.DistanceField = NULL; // surface changed, distance field has to be recomputed
+    engine.SurfaceProxy = NULL;
+    vtkSmartPointer< vtkTriangleBVH > previousHierarchy = engine.Hierarchy;
+    engine.Hierarchy = NULL;
+
+    if ( queryInModelCoordinates )
+    {
+      engine.Surface = body;
+    }
+    else
+    {
+      // Transform the body poly data to RAS (non-linear transform, or linear transform that does not preserve distances)
+      vtkSmartPointer< vtkGeneralTransform > bodyToRasTransform = vtkSmartPointer< vtkGeneralTransform >::New();
+      bodyParentTransform->GetTransformToWorld( bodyToRasTransform );
+
+      vtkSmartPointer< vtkTransformPolyDataFilter > bodyToRasFilter = vtkSmartPointer< vtkTransformPolyDataFilter >::New();
+#if (VTK_MAJOR_VERSION <= 5)
+      bodyToRasFilter->SetInput( body );
+#else
+      bodyToRasFilter->SetInputData( body );
+#endif
+      bodyToRasFilter->SetTransform( bodyToRasTransform );
+      bodyToRasFilter->Update(); // expensive: transforms all the points of the polydata
+      engine.Surface = bodyToRasFilter->GetOutput();
+    }
+
+    if ( deformed && previousHierarchy.GetPointer() != NULL )
+    {
+      // cheap compared to rebuilding: only node bounds are recomputed
+      std::vector< vtkPolyData* > surfaces( 1, engine.Surface.GetPointer() );
+      std::vector< vtkAbstractTransform* > transforms( 1, static_cast< vtkAbstractTransform* >( NULL ) );
+      engine.Hierarchy = this->GetRefittedHierarchy( previousHierarchy, engine.HierarchyShared, surfaces, transforms );
+    }
+    engine.HierarchyShared = false;
+
+    engine.Deforming = deformed;
+    if ( deformed )
+    {
+      engine.LastDeformationTimeSec = vtkTimerLog::GetUniversalTime();
+    }
+    engine.QueryInModelCoordinates = queryInModelCoordinates;
+    engine.PolyData = body;
+    engine.PolyDataMTime = body->GetMTime();
+    engine.TopologyMTime = topologyMTime;
+    engine.ModelParentTransformNode = bodyParentTransform;
+    engine.ModelToRasTransformMTime = bodyToRasTransformMTime;
+  }
+
+  if ( engine.Deforming && vtkTimerLog::GetUniversalTime() - engine.LastDeformationTimeSec >= SURFACE_STABLE_TIME_SEC )
+  {
+    // surface is stable now, distance field and decimated surface can be built
+    engine.Deforming = false;
+  }
+
+  if ( bwNode->GetUseSignedDistanceField() )
+  {
+    // while deforming, the refitted hierarchy is queried until the surface is stable
+    if ( !engine.Deforming && ( engine.DistanceField.GetPointer() == NULL
+      || engine.DistanceField->GetSpacing() != bwNode->GetSignedDistanceFieldSpacingMm()
+      || engine.DistanceField->GetMargin() != bwNode->GetSignedDistanceFieldMarginMm() ) )
+    {
+      engine.DistanceField = vtkSmartPointer< vtkSignedDistanceField >::New();
+      engine.DistanceField->SetSpacing( bwNode->GetSignedDistanceFieldSpacingMm() );
+      engine.DistanceField->SetMargin( bwNode->GetSignedDistanceFieldMarginMm() );
+      if ( !engine.DistanceField->Build( engine.Surface, GetUpdatedHierarchy( engine ) ) ) // expensive: computes distance at each grid point
+      {
+        // exact distance computation will be used
+        engine.DistanceField = NULL;
+      }
+    }
+  }
+  else
+  {
+    engine.DistanceField = NULL;
+  }
+
+  if ( bwNode->GetUseLevelOfDetail() )
+  {
+    // while deforming, the refitted hierarchy is queried until the surface is stable
+    if ( !engine.Deforming && ( engine.SurfaceProxy.GetPointer() == NULL
+      || engine.SurfaceProxy->GetTargetReduction() != bwNode->GetLevelOfDetailTargetReduction() ) )
+    {
+      engine.SurfaceProxy = vtkSmartPointer< vtkDecimatedSurfaceProxy >::New();
+      engine.SurfaceProxy->SetTargetReduction( bwNode->GetLevelOfDetailTargetReduction() );
+      if ( !engine.SurfaceProxy->Build( engine.Surface, GetUpdatedHierarchy( engine ) ) ) // expensive: decimates the surface and measures the error
+      {
+        // full-resolution surface will be used
+        engine.SurfaceProxy = NULL;
+      }
+    }
+    // The decimated surface is only queried where the distance is at least the refinement distance plus its error bound.
+    // Distances within the largest band threshold (or inside the model) must be exact, otherwise the tool could be
+    // classified into the wrong band or a breach could be missed. Tool shaft distance is measured from the shaft axis,
+    // so the shaft radius is added.
+    double largestThresholdMm = 0.0;
+    for ( int bandIndex = 0; bandIndex < bwNode->GetNumberOfDistanceBands(); bandIndex++ )
+    {
+      largestThresholdMm = std::max( largestThresholdMm, bwNode->GetNthDistanceBandThresholdMm( bandIndex ) );
+    }
+    if ( bwNode->GetToolShaftLengthMm() > 0 )
+    {
+      largestThresholdMm += std::max( bwNode->GetToolShaftRadiusMm(), 0.0 );
+    }
+    engine.RefinementDistance = std::max( bwNode->GetLevelOfDetailRefinementDistanceMm(), largestThresholdMm );
+  }
+  else
+  {
+    engine.SurfaceProxy = NULL;
+  }
+
+  return engine;
+}
+
+//------------------------------------------------------------------------------
+vtkSlicerBreachWarningLogic::vtkInternal::ModelHierarchy& vtkSlicerBreachWarningLogic::vtkInternal::GetUpdatedModelHierarchy( vtkMRMLBreachWarningNode* bwNode )
+{
+  // Get current state of the watched models
+  ModelHierarchy current;
+  for ( int watchedModelIndex = 0; watchedModelIndex < bwNode->GetNumberOfWatchedModelNodes(); watchedModelIndex++ )
+  {
+    vtkMRMLModelNode* modelNode = bwNode->GetNthWatchedModelNode( watchedModelIndex );
+    if ( modelNode == NULL || modelNode->GetPolyData() == NULL )
+    {
+      continue;
+    }
+    vtkMRMLTransformNode* parentTransform = modelNode->GetParentTransformNode();
+    current.WatchedModelIndices.push_back( watchedModelIndex );
+    current.PolyDatas.push_back( modelNode->GetPolyData() );
+    current.PolyDataMTimes.push_back( modelNode->GetPolyData()->GetMTime() );
+    current.TopologyMTimes.push_back( GetTopologyMTime( modelNode->GetPolyData() ) );
+    current.ModelParentTransformNodes.push_back( parentTransform );
+    current.ModelToRasTransformMTimes.push_back( ( parentTransform != NULL ) ? parentTransform->GetTransformToWorldMTime() : 0 );
+  }
+
+  ModelHierarchy& hierarchy = this->ModelHierarchies[ bwNode ];
+  // Same surfaces with the same cells: only point coordinates may have changed
+  bool sameTopology = hierarchy.Hierarchy.GetPointer() != NULL
+    && hierarchy.WatchedModelIndices == current.WatchedModelIndices
+    && hierarchy.TopologyMTimes == current.TopologyMTimes;
+  for ( unsigned int i = 0; sameTopology && i < current.PolyDatas.size(); i++ )
+  {
+    sameTopology = hierarchy.PolyDatas[ i ].GetPointer() == current.PolyDatas[ i ].GetPointer()
+      && hierarchy.ModelParentTransformNodes[ i ].GetPointer() == current.ModelParentTransformNodes[ i ].GetPointer();
+  }
+  if ( sameTopology
+    && hierarchy.PolyDataMTimes == current.PolyDataMTimes
+    && hierarchy.ModelToRasTransformMTimes == current.ModelToRasTransformMTimes )
+  {
+    return hierarchy;
+  }
+
+  std::vector< vtkSmartPointer< vtkGeneralTransform > > modelToRasTransforms( current.PolyDatas.size() );
+  for ( unsigned int i = 0; i < current.PolyDatas.size(); i++ )
+  {
+    if ( current.ModelParentTransformNodes[ i ].GetPointer() != NULL )
+    {
+      modelToRasTransforms[ i ] = vtkSmartPointer< vtkGeneralTransform >::New();
+      current.ModelParentTransformNodes[ i ]->GetTransformToWorld( modelToRasTransforms[ i ] );
+    }
+  }
+
+  if ( sameTopology )
+  {
+    // Surfaces moved or deformed: refit the existing hierarchy
+    std::vector< vtkPolyData* > surfaces;
+    std::vector< vtkAbstractTransform* > transforms;
+    for ( unsigned int i = 0; i < current.PolyDatas.size(); i++ )
+    {
+      surfaces.push_back( current.PolyDatas[ i ] );
+      transforms.push_back( modelToRasTransforms[ i ] );
+    }
+    current.Hierarchy = this->GetRefittedHierarchy( hierarchy.Hierarchy, false, surfaces, transforms );
+  }
+
+  if ( current.Hierarchy.GetPointer() == NULL )
+  {
+    current.Hierarchy = vtkSmartPointer< vtkTriangleBVH >::New();
+    for ( unsigned int i = 0; i < current.PolyDatas.size(); i++ )
+    {
+      current.Hierarchy->AddSurface( current.PolyDatas[ i ], modelToRasTransforms[ i ] ); // transforms all the points to RAS
+    }
+    current.Hierarchy->Build(); // expensive: sorts all the triangles into the hierarchy
+  }
+  hierarchy = current;
+  return hierarchy;
+}
+
+//------------------------------------------------------------------------------
+vtkMTimeType vtkSlicerBreachWarningLogic::vtkInternal::GetTopologyMTime( vtkPolyData* surface )
+{
+  vtkMTimeType topologyMTime = 0;
+  vtkCellArray* cellArrays[2] = { surface->GetPolys(), surface->GetStrips() };
+  for ( int i = 0; i < 2; i++ )
+  {
+    if ( cellArrays[ i ] != NULL )
+    {
+      topologyMTime = std::max( topologyMTime, cellArrays[ i ]->GetMTime() );
+    }
+  }
+  return topologyMTime;
+}
+
+//------------------------------------------------------------------------------
+vtkSmartPointer< vtkTriangleBVH > vtkSlicerBreachWarningLogic::vtkInternal::GetRefittedHierarchy( vtkTriangleBVH* hierarchy, bool hierarchyShared,
+  const std::vector< vtkPolyData* >& surfaces, const std::vector< vtkAbstractTransform* >& transforms )
+{
+  vtkSmartPointer< vtkTriangleBVH > refittedHierarchy = hierarchy;
+  if ( hierarchyShared || this->IsWorkerRunning() )
+  {
+    // the background worker or other modules may be querying the current hierarchy
+    refittedHierarchy = vtkSmartPointer< vtkTriangleBVH >::New();
+    refittedHierarchy->DeepCopy( hierarchy );
+  }
+  if ( static_cast< int >( surfaces.size() ) != refittedHierarchy->GetNumberOfSurfaces() )
+  {
+    return NULL;
+  }
+  for ( unsigned int i = 0; i < surfaces.size(); i++ )
+  {
+    if ( !refittedHierarchy->UpdateSurfacePoints( i, surfaces[ i ], transforms[ i ] ) )
+    {
+      // number of points changed
+      return NULL;
+    }
+  }
+  if ( !refittedHierarchy->Refit() )
+  {
+    return NULL;
+  }
+  return refittedHierarchy;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::GetToolTipPosition( vtkMRMLBreachWarningNode* bwNode, double toolTipPosition_Ras[3] )
+{
+  double toolTipPosition_Tool[3] = { 0.0, 0.0, 0.0 };
+  return GetToolPointPosition( bwNode, toolTipPosition_Tool, toolTipPosition_Ras );
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::vtkInternal::GetToolPointPosition( vtkMRMLBreachWarningNode* bwNode, const double point_Tool[3], double point_Ras[3] )
+{
+  vtkMRMLTransformNode* toolToRasNode = bwNode->GetToolTransformNode();
+  if ( toolToRasNode == NULL )
+  {
+    return false;
+  }
+  vtkSmartPointer<vtkGeneralTransform> toolToRasTransform = vtkSmartPointer<vtkGeneralTransform>::New();
+  toolToRasNode->GetTransformToWorld( toolToRasTransform );
+  toolToRasTransform->TransformPoint( point_Tool, point_Ras );
+  return true;
+}
+
+//------------------------------------------------------------------------------
+vtkTriangleBVH* vtkSlicerBreachWarningLogic::vtkInternal::GetUpdatedHierarchy( DistanceEngine& engine )
+{
+  if ( engine.Hierarchy.GetPointer() == NULL )
+  {
+    if ( engine.LocatorCache.GetPointer() != NULL && !engine.Deforming
+      && engine.Surface.GetPointer() == engine.PolyData.GetPointer() )
+    {
+      // untransformed model surface, other modules may have already built the hierarchy
+      engine.Hierarchy = engine.LocatorCache->GetTriangleBVH( engine.Surface );
+      engine.HierarchyShared = true;
+    }
+    else
+    {
+      engine.Hierarchy = vtkSmartPointer< vtkTriangleBVH >::New();
+      engine.Hierarchy->AddSurface( engine.Surface );
+      engine.Hierarchy->Build(); // expensive: sorts all the triangles into the hierarchy
+      engine.HierarchyShared = false;
+    }
+  }
+  return engine.Hierarchy;
+}
+
 //------------------------------------------------------------------------------
 vtkSlicerBreachWarningLogic::vtkSlicerBreachWarningLogic()
-: WarningSoundPlaying(false)
+: Internal(new vtkInternal)
+, WarningSoundPlaying(false)
+, AsynchronousUpdate(false)
+, DeferredUpdate(false)
 , DefaultLineToClosestPointTextScale(2.0)
 , DefaultLineToClosestPointThickness(3.0)
 {
@@ -64,12 +1099,100 @@ vtkSlicerBreachWarningLogic::vtkSlicerBreachWarningLogic()
 //------------------------------------------------------------------------------
 vtkSlicerBreachWarningLogic::~vtkSlicerBreachWarningLogic()
 {
+  this->Internal->StopWorker();
+  delete this->Internal;
+  this->Internal = NULL;
 }
 
 //------------------------------------------------------------------------------
 void vtkSlicerBreachWarningLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os, indent);
+  os << indent << "AsynchronousUpdate: " << this->AsynchronousUpdate << std::endl;
+  os << indent << "DeferredUpdate: " << this->DeferredUpdate << std::endl;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::SetAsynchronousUpdate(bool asynchronous)
+{
+  if (this->AsynchronousUpdate == asynchronous)
+  {
+    return;
+  }
+  this->AsynchronousUpdate = asynchronous;
+  if (asynchronous)
+  {
+    this->Internal->StartWorker();
+  }
+  else
+  {
+    // pending results are discarded, the next tool update is computed synchronously
+    this->Internal->StopWorker();
+  }
+  this->Modified();
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::ProcessAsynchronousUpdateResults()
+{
+  vtkInternal::ToolStateMapType completedToolStates;
+  this->Internal->WorkerMutex->Lock();
+  completedToolStates.swap(this->Internal->CompletedToolStates);
+  this->Internal->WorkerMutex->Unlock();
+
+  bool applied = false;
+  for (vtkInternal::ToolStateMapType::iterator it = completedToolStates.begin(); it != completedToolStates.end(); ++it)
+  {
+    // Queries of a node are removed when the node is removed from the scene, so the node pointer is only
+    // dereferenced if the query generation is still current. Checked for each result, because applying a result
+    // may trigger removal of other nodes.
+    vtkMRMLBreachWarningNode* bwNode = it->first;
+    this->Internal->WorkerMutex->Lock();
+    bool generationCurrent = this->Internal->IsQueryGenerationCurrent(bwNode, it->second.Generation);
+    this->Internal->WorkerMutex->Unlock();
+    if (!generationCurrent || this->GetMRMLScene() == NULL)
+    {
+      // node has been removed or its outputs have been reset since the query was posted
+      continue;
+    }
+    vtkInternal::ApplyToolState(this, bwNode, it->second.State);
+    this->UpdateWarning(bwNode);
+    applied = true;
+  }
+  return applied;
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::SetDeferredUpdate(bool deferred)
+{
+  if (this->DeferredUpdate == deferred)
+  {
+    return;
+  }
+  this->DeferredUpdate = deferred;
+  if (!deferred)
+  {
+    // do not leave nodes with outdated outputs
+    this->ProcessDeferredUpdates();
+  }
+  this->Modified();
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::ProcessDeferredUpdates()
+{
+  if (this->Internal->DeferredUpdateNodes.empty())
+  {
+    return false;
+  }
+  // Swap first: updates may modify the nodes and add them to the list again
+  std::set< vtkMRMLBreachWarningNode* > nodesToUpdate;
+  nodesToUpdate.swap(this->Internal->DeferredUpdateNodes);
+  for (std::set< vtkMRMLBreachWarningNode* >::iterator it = nodesToUpdate.begin(); it != nodesToUpdate.end(); ++it)
+  {
+    this->UpdateNode(*it);
+  }
+  return true;
 }
 
 //------------------------------------------------------------------------------
@@ -79,7 +1202,22 @@ void vtkSlicerBreachWarningLogic::SetMRMLSceneInternal(vtkMRMLScene * newScene)
   events->InsertNextValue(vtkMRMLScene::NodeAddedEvent);
   events->InsertNextValue(vtkMRMLScene::NodeRemovedEvent);
   events->InsertNextValue(vtkMRMLScene::EndBatchProcessEvent);
+  events->InsertNextValue(vtkMRMLScene::EndCloseEvent);
   this->SetAndObserveMRMLSceneEventsInternal(newScene, events.GetPointer());
+  // cached locators belong to models of the previous scene
+  this->Internal->LocatorCache->RemoveAll();
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::OnMRMLSceneEndClose()
+{
+  this->Internal->LocatorCache->RemoveAll();
+}
+
+//------------------------------------------------------------------------------
+vtkPolyDataLocatorCache* vtkSlicerBreachWarningLogic::GetLocatorCache()
+{
+  return this->Internal->LocatorCache;
 }
 
 //------------------------------------------------------------------------------
@@ -102,63 +1240,23 @@ void vtkSlicerBreachWarningLogic::UpdateToolState( vtkMRMLBreachWarningNode* bwN
     return;
   }
 
-  vtkMRMLModelNode* modelNode = bwNode->GetWatchedModelNode();
-  vtkMRMLTransformNode* toolToRasNode = bwNode->GetToolTransformNode();
-
-  if ( modelNode == NULL || toolToRasNode == NULL )
+  // Same computation as in the background worker (distance field, decimated surface, or triangle hierarchy)
+  vtkInternal::ToolState state;
+  vtkInternal::ToolStateQuery query;
+  if ( this->Internal->PrepareToolStateQuery( bwNode, query ) )
   {
-    bwNode->SetClosestDistanceToModelFromToolTip(0);
-    return;
+    vtkInternal::ExecuteToolStateQuery( query, state );
+    if ( !state.Valid )
+    {
+      vtkWarningMacro( "No surface model in watched model nodes" );
+    }
   }
-
-  vtkPolyData* body = modelNode->GetPolyData();
-  if ( body == NULL )
+  else if ( bwNode->GetWatchedModelNode() != NULL && bwNode->GetWatchedModelNode()->GetPolyData() == NULL
+    && bwNode->GetToolTransformNode() != NULL )
   {
     vtkWarningMacro( "No surface model in node" );
-    return;
-  }
-  
-  vtkSmartPointer< vtkImplicitPolyDataDistance > implicitDistanceFilter = vtkSmartPointer< vtkImplicitPolyDataDistance >::New();
-
-  // Transform the body poly data if there is a parent transform.
-  vtkMRMLTransformNode* bodyParentTransform = modelNode->GetParentTransformNode();
-  if ( bodyParentTransform != NULL )
-  {
-    vtkSmartPointer< vtkGeneralTransform > bodyToRasTransform = vtkSmartPointer< vtkGeneralTransform >::New();
-    bodyParentTransform->GetTransformToWorld( bodyToRasTransform );
-
-    vtkSmartPointer< vtkTransformPolyDataFilter > bodyToRasFilter = vtkSmartPointer< vtkTransformPolyDataFilter >::New();
-#if (VTK_MAJOR_VERSION <= 5)
-    bodyToRasFilter->SetInput( body );
-#else
-    bodyToRasFilter->SetInputData( body );
-#endif
-    bodyToRasFilter->SetTransform( bodyToRasTransform );
-    bodyToRasFilter->Update(); // expensive: transforms all the points of the polydata
-
-    implicitDistanceFilter->SetInput( bodyToRasFilter->GetOutput() ); // expensive: builds a locator
-  }
-  else
-  {
-    implicitDistanceFilter->SetInput( body ); // expensive: builds a locator
   }
-  
-  // Note: Performance could be improved by
-  // - keeping the filter in memory for all the observed nodes.
-  // - in case of linear transform of model and tooltip: transform only the tooltip (with the tooltip to model transform),
-  //   and not transform the model at all
-
-  vtkSmartPointer<vtkGeneralTransform> toolToRasTransform = vtkSmartPointer<vtkGeneralTransform>::New();
-  toolToRasNode->GetTransformToWorld( toolToRasTransform ); 
-  double toolTipPosition_Tool[4] = { 0.0, 0.0, 0.0, 1.0 };
-  double* toolTipPosition_Ras = toolToRasTransform->TransformDoublePoint( toolTipPosition_Tool);
-
-  double closestPointOnModel_Ras[3] = {0};
-  double closestPointDistance = implicitDistanceFilter->EvaluateFunctionAndGetClosestPoint( toolTipPosition_Ras, closestPointOnModel_Ras);
-  bwNode->SetClosestDistanceToModelFromToolTip(closestPointDistance);
-  bwNode->SetClosestPointOnModel(closestPointOnModel_Ras);
-
-  this->UpdateLineToClosestPoint(bwNode, toolTipPosition_Ras, closestPointOnModel_Ras, closestPointDistance);
+  vtkInternal::ApplyToolState( this, bwNode, state ); // resets the outputs if the state is not valid
 }
 
 //------------------------------------------------------------------------------
@@ -168,25 +1266,45 @@ void vtkSlicerBreachWarningLogic::UpdateModelColor( vtkMRMLBreachWarningNode* bw
   {
     return;
   }
-  vtkMRMLModelNode* modelNode = bwNode->GetWatchedModelNode();
-  if ( modelNode == NULL )
+  // Distance bands are classified by the watched model that is closest to the tool (tip or shaft)
+  int distanceBandIndex = bwNode->GetCurrentDistanceBandIndex();
+  int distanceBandModelIndex = bwNode->GetClosestWatchedModelIndex();
+  if ( bwNode->GetToolShaftLengthMm() > 0
+    && bwNode->GetClosestDistanceToModelFromToolShaft() < bwNode->GetClosestDistanceToModelFromToolTip() )
   {
-    return;
+    distanceBandModelIndex = bwNode->GetClosestWatchedModelIndexToToolShaft();
   }
-  if ( modelNode->GetDisplayNode() == NULL )
+  for ( int watchedModelIndex = 0; watchedModelIndex < bwNode->GetNumberOfWatchedModelNodes(); watchedModelIndex++ )
   {
-    return;
-  }
+    vtkMRMLModelNode* modelNode = bwNode->GetNthWatchedModelNode( watchedModelIndex );
+    if ( modelNode == NULL )
+    {
+      continue;
+    }
+    if ( modelNode->GetDisplayNode() == NULL )
+    {
+      continue;
+    }
 
-  if ( bwNode->IsToolTipInsideModel())
-  {
-    double* color = bwNode->GetWarningColor();
-    modelNode->GetDisplayNode()->SetColor(color);
-  }
-  else
-  {
-    double* color = bwNode->GetOriginalColor();
-    modelNode->GetDisplayNode()->SetColor(color);
+    // Only the closest model can contain the tool tip (or tool shaft)
+    if ( distanceBandIndex >= 0 && watchedModelIndex == distanceBandModelIndex )
+    {
+      double color[3] = { 0.5, 0.5, 0.5 };
+      bwNode->GetNthDistanceBandColor( distanceBandIndex, color );
+      modelNode->GetDisplayNode()->SetColor(color);
+    }
+    else if ( ( ( bwNode->IsToolTipInsideModel() || bwNode->IsBreachPredicted() ) && watchedModelIndex == bwNode->GetClosestWatchedModelIndex() )
+      || ( bwNode->IsToolShaftInsideModel() && watchedModelIndex == bwNode->GetClosestWatchedModelIndexToToolShaft() ) )
+    {
+      double* color = bwNode->GetWarningColor();
+      modelNode->GetDisplayNode()->SetColor(color);
+    }
+    else
+    {
+      double color[3] = { 0.5, 0.5, 0.5 };
+      bwNode->GetNthWatchedModelOriginalColor( watchedModelIndex, color );
+      modelNode->GetDisplayNode()->SetColor(color);
+    }
   }
 }
 
@@ -208,7 +1326,7 @@ void vtkSlicerBreachWarningLogic::OnMRMLSceneNodeAdded( vtkMRMLNode* node )
     events->InsertNextValue( vtkCommand::ModifiedEvent );
     events->InsertNextValue( vtkMRMLBreachWarningNode::InputDataModifiedEvent );
     vtkObserveMRMLNodeEventsMacro( bwNode, events.GetPointer() );
-    if(bwNode->GetPlayWarningSound() && bwNode->IsToolTipInsideModel())
+    if(bwNode->IsWarningSoundRequested())
     {
       // Add to list of playing nodes (if not there already)
       std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator foundPlayingNodeIt = this->WarningSoundPlayingNodes.begin();    
@@ -224,7 +1342,7 @@ void vtkSlicerBreachWarningLogic::OnMRMLSceneNodeAdded( vtkMRMLNode* node )
       {
         this->WarningSoundPlayingNodes.push_back(bwNode);
       }
-      this->SetWarningSoundPlaying(true);
+      this->UpdateWarningSoundPlaying();
     }
   }
 }
@@ -242,6 +1360,10 @@ void vtkSlicerBreachWarningLogic::OnMRMLSceneNodeRemoved( vtkMRMLNode* node )
   {
     vtkDebugMacro( "OnMRMLSceneNodeRemoved" );
     vtkUnObserveMRMLNodeMacro( node );
+    this->Internal->DistanceEngines.erase( vtkMRMLBreachWarningNode::SafeDownCast( node ) );
+    this->Internal->ModelHierarchies.erase( vtkMRMLBreachWarningNode::SafeDownCast( node ) );
+    this->Internal->RemoveQueries( vtkMRMLBreachWarningNode::SafeDownCast( node ) );
+    this->Internal->DeferredUpdateNodes.erase( vtkMRMLBreachWarningNode::SafeDownCast( node ) );
     for (std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator it=this->WarningSoundPlayingNodes.begin(); it!=this->WarningSoundPlayingNodes.end(); ++it)
     {
       if (it->GetPointer()==node)
@@ -250,7 +1372,7 @@ void vtkSlicerBreachWarningLogic::OnMRMLSceneNodeRemoved( vtkMRMLNode* node )
         break;
       }
     }
-    this->SetWarningSoundPlaying(!this->WarningSoundPlayingNodes.empty());
+    this->UpdateWarningSoundPlaying();
 
     // Delete the line to closest point ruler
     vtkMRMLBreachWarningNode* moduleNode = vtkMRMLBreachWarningNode::SafeDownCast(node);
@@ -312,6 +1434,228 @@ void vtkSlicerBreachWarningLogic::SetWatchedModelNode( vtkMRMLModelNode* newMode
   }
 }
 
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::AddWatchedModelNode( vtkMRMLModelNode* model, vtkMRMLBreachWarningNode* moduleNode )
+{
+  if ( moduleNode == NULL )
+  {
+    vtkWarningMacro( "AddWatchedModelNode: Module node is invalid" );
+    return;
+  }
+  if ( model == NULL )
+  {
+    return;
+  }
+  if ( moduleNode->GetNumberOfWatchedModelNodes() == 0 )
+  {
+    this->SetWatchedModelNode( model, moduleNode );
+    return;
+  }
+  for ( int i = 0; i < moduleNode->GetNumberOfWatchedModelNodes(); i++ )
+  {
+    if ( moduleNode->GetNthWatchedModelNode( i ) == model )
+    {
+      // already watched
+      return;
+    }
+  }
+
+  // Save the original color of the new model node
+  double originalColor[3]={0.5,0.5,0.5};
+  if ( model->GetDisplayNode() != NULL )
+  {
+    model->GetDisplayNode()->GetColor(originalColor);
+  }
+  moduleNode->SetNthWatchedModelOriginalColor( moduleNode->GetNumberOfWatchedModelNodes(), originalColor );
+
+  moduleNode->AddAndObserveWatchedModelNodeID( model->GetID() );
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::RemoveWatchedModelNode( vtkMRMLModelNode* model, vtkMRMLBreachWarningNode* moduleNode )
+{
+  if ( moduleNode == NULL )
+  {
+    vtkWarningMacro( "RemoveWatchedModelNode: Module node is invalid" );
+    return;
+  }
+  for ( int i = 0; i < moduleNode->GetNumberOfWatchedModelNodes(); i++ )
+  {
+    if ( moduleNode->GetNthWatchedModelNode( i ) != model )
+    {
+      continue;
+    }
+    double originalColor[3]={0.5,0.5,0.5};
+    moduleNode->GetNthWatchedModelOriginalColor( i, originalColor );
+    moduleNode->RemoveNthWatchedModelNodeID( i );
+    // Restore the color of the removed model node
+    if ( model != NULL && model->GetDisplayNode() != NULL )
+    {
+      model->GetDisplayNode()->SetColor( originalColor );
+    }
+    return;
+  }
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::GetDistancesToWatchedModels( vtkMRMLBreachWarningNode* moduleNode, vtkDoubleArray* distances, vtkPoints* closestPoints )
+{
+  if ( moduleNode == NULL )
+  {
+    vtkErrorMacro( "vtkSlicerBreachWarningLogic::GetDistancesToWatchedModels failed: invalid moduleNode" );
+    return false;
+  }
+  double toolTipPosition_Ras[3] = {0};
+  if ( !vtkInternal::GetToolTipPosition( moduleNode, toolTipPosition_Ras ) )
+  {
+    return false;
+  }
+
+  int numberOfWatchedModels = moduleNode->GetNumberOfWatchedModelNodes();
+  if ( distances != NULL )
+  {
+    distances->SetNumberOfComponents( 1 );
+    distances->SetNumberOfTuples( numberOfWatchedModels );
+  }
+  if ( closestPoints != NULL )
+  {
+    closestPoints->SetNumberOfPoints( numberOfWatchedModels );
+  }
+
+  vtkInternal::ModelHierarchy* modelHierarchy = NULL;
+  if ( numberOfWatchedModels > 1 )
+  {
+    modelHierarchy = &( this->Internal->GetUpdatedModelHierarchy( moduleNode ) );
+  }
+  for ( int watchedModelIndex = 0; watchedModelIndex < numberOfWatchedModels; watchedModelIndex++ )
+  {
+    double distance = VTK_DOUBLE_MAX;
+    double closestPoint_Ras[3] = { 0.0, 0.0, 0.0 };
+    if ( modelHierarchy != NULL )
+    {
+      // Restrict the query to the triangles of this model
+      std::vector< int >::iterator surfaceIt = std::find( modelHierarchy->WatchedModelIndices.begin(),
+        modelHierarchy->WatchedModelIndices.end(), watchedModelIndex );
+      if ( surfaceIt != modelHierarchy->WatchedModelIndices.end() )
+      {
+        int closestSurfaceIndex = -1;
+        int surfaceIndex = static_cast< int >( surfaceIt - modelHierarchy->WatchedModelIndices.begin() );
+        distance = modelHierarchy->Hierarchy->FindClosestPoint( toolTipPosition_Ras, closestPoint_Ras, closestSurfaceIndex, surfaceIndex );
+      }
+    }
+    else
+    {
+      vtkMRMLModelNode* modelNode = moduleNode->GetNthWatchedModelNode( watchedModelIndex );
+      if ( modelNode != NULL && modelNode->GetPolyData() != NULL )
+      {
+        // Same computation as the regular updates, so the results are consistent with the node outputs
+        vtkInternal::ToolStateQuery query;
+        vtkInternal::SetQuerySurface( this->Internal->GetUpdatedDistanceEngine( moduleNode, modelNode ), query );
+        for ( int i = 0; i < 3; i++ )
+        {
+          query.ToolTipPosition_Ras[ i ] = toolTipPosition_Ras[ i ];
+        }
+        vtkInternal::ToolState state;
+        vtkInternal::ExecuteToolStateQuery( query, state );
+        if ( state.Valid )
+        {
+          distance = state.ClosestDistance;
+          for ( int i = 0; i < 3; i++ )
+          {
+            closestPoint_Ras[ i ] = state.ClosestPointOnModel_Ras[ i ];
+          }
+        }
+      }
+    }
+    if ( distances != NULL )
+    {
+      distances->SetValue( watchedModelIndex, distance );
+    }
+    if ( closestPoints != NULL )
+    {
+      closestPoints->SetPoint( watchedModelIndex, closestPoint_Ras );
+    }
+  }
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool vtkSlicerBreachWarningLogic::GetDistancesOfPointsToWatchedModel( vtkMRMLBreachWarningNode* moduleNode, vtkPoints* points,
+  vtkDoubleArray* distances, vtkPoints* closestPoints, int watchedModelIndex /* = 0 */ )
+{
+  if ( moduleNode == NULL || points == NULL || distances == NULL )
+  {
+    vtkErrorMacro( "vtkSlicerBreachWarningLogic::GetDistancesOfPointsToWatchedModel failed: invalid input" );
+    return false;
+  }
+  int numberOfWatchedModels = moduleNode->GetNumberOfWatchedModelNodes();
+  if ( watchedModelIndex < -1 || watchedModelIndex >= numberOfWatchedModels )
+  {
+    vtkErrorMacro( "vtkSlicerBreachWarningLogic::GetDistancesOfPointsToWatchedModel failed: invalid watched model index " << watchedModelIndex );
+    return false;
+  }
+
+  vtkBreachWarningPointDistanceComputer distanceComputer;
+  distanceComputer.SurfaceIndex = -1;
+  distanceComputer.RasToSurfaceMatrix = NULL;
+  distanceComputer.SurfaceToRasMatrix = NULL;
+  if ( numberOfWatchedModels > 1 )
+  {
+    // Hierarchy of all watched models, in RAS
+    vtkInternal::ModelHierarchy& modelHierarchy = this->Internal->GetUpdatedModelHierarchy( moduleNode );
+    distanceComputer.Hierarchy = modelHierarchy.Hierarchy;
+    if ( watchedModelIndex >= 0 )
+    {
+      std::vector< int >::iterator surfaceIt = std::find( modelHierarchy.WatchedModelIndices.begin(),
+        modelHierarchy.WatchedModelIndices.end(), watchedModelIndex );
+      if ( surfaceIt == modelHierarchy.WatchedModelIndices.end() )
+      {
+        vtkErrorMacro( "vtkSlicerBreachWarningLogic::GetDistancesOfPointsToWatchedModel failed: no surface in watched model " << watchedModelIndex );
+        return false;
+      }
+      distanceComputer.SurfaceIndex = static_cast< int >( surfaceIt - modelHierarchy.WatchedModelIndices.begin() );
+    }
+  }
+  else
+  {
+    vtkMRMLModelNode* modelNode = moduleNode->GetWatchedModelNode();
+    if ( modelNode == NULL || modelNode->GetPolyData() == NULL )
+    {
+      vtkErrorMacro( "vtkSlicerBreachWarningLogic::GetDistancesOfPointsToWatchedModel failed: no surface in watched model" );
+      return false;
+    }
+    vtkInternal::DistanceEngine& distanceEngine = this->Internal->GetUpdatedDistanceEngine( moduleNode, modelNode );
+    distanceComputer.Hierarchy = vtkInternal::GetUpdatedHierarchy( distanceEngine );
+    if ( distanceEngine.QueryInModelCoordinates )
+    {
+      distanceComputer.RasToSurfaceMatrix = distanceEngine.RasToModelMatrix;
+      distanceComputer.SurfaceToRasMatrix = distanceEngine.ModelToRasMatrix;
+    }
+  }
+
+  vtkIdType numberOfPoints = points->GetNumberOfPoints();
+  distances->SetNumberOfComponents( 1 );
+  distances->SetNumberOfTuples( numberOfPoints );
+  distanceComputer.Points_Ras = points;
+  distanceComputer.Distances = distances->GetPointer( 0 );
+  distanceComputer.ClosestPoints_Ras = NULL;
+  if ( closestPoints != NULL )
+  {
+    closestPoints->SetDataTypeToDouble();
+    closestPoints->SetNumberOfPoints( numberOfPoints );
+    distanceComputer.ClosestPoints_Ras = static_cast< double* >( closestPoints->GetVoidPointer( 0 ) );
+  }
+
+  vtkSMPTools::For( 0, numberOfPoints, distanceComputer );
+
+  distances->Modified();
+  if ( closestPoints != NULL )
+  {
+    closestPoints->Modified();
+  }
+  return true;
+}
+
 //------------------------------------------------------------------------------
 void vtkSlicerBreachWarningLogic::ProcessMRMLNodesEvents( vtkObject* caller, unsigned long event, void* vtkNotUsed(callData) )
 {
@@ -331,38 +1675,102 @@ void vtkSlicerBreachWarningLogic::ProcessMRMLNodesEvents( vtkObject* caller, uns
   {
     // only recompute output if the input is changed
     // (for example we do not recompute the distance if the computed distance is changed)
-    this->UpdateToolState(bwNode);
-    if (bwNode->GetDisplayWarningColor())
-    {
-      this->UpdateModelColor(bwNode);
-    }
-    std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator foundPlayingNodeIt = this->WarningSoundPlayingNodes.begin();    
-    for (; foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end(); ++foundPlayingNodeIt)
+    if (this->DeferredUpdate)
     {
-      if (foundPlayingNodeIt->GetPointer()==bwNode)
+      // multiple input changes (e.g., several transforms of the same tracker frame) are processed together
+      bool updateAlreadyRequested = !this->Internal->DeferredUpdateNodes.empty();
+      this->Internal->DeferredUpdateNodes.insert(bwNode);
+      if (!updateAlreadyRequested)
       {
-        // found current bw node is already in the playing list
-        break;
+        this->InvokeEvent(DeferredUpdateRequestedEvent);
       }
+      return;
     }
-    if(bwNode->GetPlayWarningSound() && bwNode->IsToolTipInsideModel())
+    this->UpdateNode(bwNode);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::UpdateNode( vtkMRMLBreachWarningNode* bwNode )
+{
+  if (this->AsynchronousUpdate)
+  {
+    // computed in the background, results are applied in ProcessAsynchronousUpdateResults
+    vtkInternal::ToolStateQuery query;
+    if (this->Internal->PrepareToolStateQuery(bwNode, query))
     {
-      // Add to list of playing nodes (if not there already)
-      if (foundPlayingNodeIt==this->WarningSoundPlayingNodes.end())
-      {
-        this->WarningSoundPlayingNodes.push_back(bwNode);
-      }
+      this->Internal->PostQuery(bwNode, query);
+      return;
     }
-    else
+    // nothing to compute, reset outputs immediately
+    this->Internal->RemoveQueries(bwNode);
+    vtkInternal::ApplyToolState(this, bwNode, vtkInternal::ToolState());
+  }
+  else
+  {
+    this->UpdateToolState(bwNode);
+  }
+  this->UpdateWarning(bwNode);
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::UpdateWarning( vtkMRMLBreachWarningNode* bwNode )
+{
+  if (bwNode->GetDisplayWarningColor())
+  {
+    this->UpdateModelColor(bwNode);
+  }
+  std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > >::iterator foundPlayingNodeIt = this->WarningSoundPlayingNodes.begin();    
+  for (; foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end(); ++foundPlayingNodeIt)
+  {
+    if (foundPlayingNodeIt->GetPointer()==bwNode)
     {
-      // Remove from list of playing nodes (if still there)
-      if (foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end())
-      {
-        this->WarningSoundPlayingNodes.erase(foundPlayingNodeIt);
-      }
+      // found current bw node is already in the playing list
+      break;
+    }
+  }
+  if(bwNode->IsWarningSoundRequested())
+  {
+    // Add to list of playing nodes (if not there already)
+    if (foundPlayingNodeIt==this->WarningSoundPlayingNodes.end())
+    {
+      this->WarningSoundPlayingNodes.push_back(bwNode);
+    }
+  }
+  else
+  {
+    // Remove from list of playing nodes (if still there)
+    if (foundPlayingNodeIt!=this->WarningSoundPlayingNodes.end())
+    {
+      this->WarningSoundPlayingNodes.erase(foundPlayingNodeIt);
     }
-    this->SetWarningSoundPlaying(!this->WarningSoundPlayingNodes.empty());
   }
+  this->UpdateWarningSoundPlaying();
+}
+
+//------------------------------------------------------------------------------
+void vtkSlicerBreachWarningLogic::UpdateWarningSoundPlaying()
+{
+  bool warningSoundPlaying = !this->WarningSoundPlayingNodes.empty();
+  std::string warningSound;
+  if (warningSoundPlaying && this->WarningSoundPlayingNodes.back().GetPointer() != NULL)
+  {
+    // the most recent warning is the most relevant
+    warningSound = this->WarningSoundPlayingNodes.back()->GetRequestedWarningSound();
+  }
+  if (this->WarningSoundPlaying == warningSoundPlaying && this->WarningSound == warningSound)
+  {
+    return;
+  }
+  this->WarningSoundPlaying = warningSoundPlaying;
+  this->WarningSound = warningSound;
+  this->Modified();
+}
+
+//------------------------------------------------------------------------------
+std::string vtkSlicerBreachWarningLogic::GetWarningSound()
+{
+  return this->WarningSound;
 }
 
 
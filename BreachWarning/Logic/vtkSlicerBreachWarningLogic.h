@@ -28,6 +28,7 @@
 #include <deque>
 
 // VTK includes
+#include "vtkCommand.h"
 #include "vtkWeakPointer.h"
 
 // Slicer includes
@@ -46,6 +47,8 @@ class vtkMRMLBreachWarningNode;
 
 class vtkMRMLModelNode;
 class vtkMRMLTransformNode;
+class vtkDoubleArray;
+class vtkPolyDataLocatorCache;
 
 // STD includes
 #include <cstdlib>
@@ -56,6 +59,13 @@ class vtkMRMLTransformNode;
 class VTK_SLICER_BREACHWARNING_MODULE_LOGIC_EXPORT vtkSlicerBreachWarningLogic : public vtkSlicerModuleLogic
 {
 public:
+  enum Events
+  {
+    /// Invoked when a breach warning node input is changed while DeferredUpdate is enabled and no other update is pending.
+    /// The application has to call ProcessDeferredUpdates() soon (e.g., in the next event loop iteration).
+    DeferredUpdateRequestedEvent = vtkCommand::UserEvent + 557
+  };
+
   static vtkSlicerBreachWarningLogic *New();
   vtkTypeMacro(vtkSlicerBreachWarningLogic,vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent);
@@ -63,6 +73,25 @@ public:
   /// Changes the watched model node, making sure the original color of the previously selected model node is restored
   void SetWatchedModelNode( vtkMRMLModelNode* newModel, vtkMRMLBreachWarningNode* moduleNode );
 
+  /// Adds a watched model node to the module node (in addition to the already watched models), saving its original color
+  void AddWatchedModelNode( vtkMRMLModelNode* model, vtkMRMLBreachWarningNode* moduleNode );
+
+  /// Removes a watched model node from the module node, restoring its original color
+  void RemoveWatchedModelNode( vtkMRMLModelNode* model, vtkMRMLBreachWarningNode* moduleNode );
+
+  /// Computes the signed distance and closest point (in RAS) of the current tool tip position to each watched model.
+  /// Only the closest model is computed during regular updates, this method can be used for getting results
+  /// for all the watched models on demand. Distance is VTK_DOUBLE_MAX for models without a surface.
+  /// Returns false if the distances cannot be computed (e.g., tool transform is not set).
+  bool GetDistancesToWatchedModels( vtkMRMLBreachWarningNode* moduleNode, vtkDoubleArray* distances, vtkPoints* closestPoints );
+
+  /// Computes the signed distance and closest point (in RAS) of many points (in RAS) to a watched model in one call.
+  /// The same cached surface hierarchy is used as for the tool shaft, points are processed in parallel.
+  /// If watchedModelIndex is -1 then distances are computed to the closest watched model.
+  /// closestPoints may be NULL. Returns false on failure.
+  bool GetDistancesOfPointsToWatchedModel( vtkMRMLBreachWarningNode* moduleNode, vtkPoints* points, vtkDoubleArray* distances,
+    vtkPoints* closestPoints, int watchedModelIndex = 0 );
+
   /// Show a line from the tooltip to the closest point on the model. Creates/deletes a ruler node.
   void SetLineToClosestPointVisibility(bool visible, vtkMRMLBreachWarningNode* moduleNode);
   bool GetLineToClosestPointVisibility(vtkMRMLBreachWarningNode* moduleNode);
@@ -86,6 +115,44 @@ public:
   vtkGetMacro(WarningSoundPlaying, bool);
   vtkSetMacro(WarningSoundPlaying, bool);
 
+  /// Returns the sound that has to be played if WarningSoundPlaying is true: the requested sound of the breach warning node
+  /// that started playing most recently (see vtkMRMLBreachWarningNode::GetRequestedWarningSound()).
+  /// Empty string means the default warning sound. The logic is modified when the sound changes (for example when
+  /// the tool moves into a distance band that has a different sound).
+  std::string GetWarningSound();
+
+  /// If enabled, distances are computed in a background thread when the tool is moved, so that
+  /// MRML event processing and rendering are not blocked by distance queries.
+  /// Only the latest tool pose is computed: if tool updates arrive faster than they can be processed
+  /// then intermediate poses are skipped. Results are stored in the nodes by ProcessAsynchronousUpdateResults().
+  /// False by default.
+  vtkGetMacro(AsynchronousUpdate, bool);
+  void SetAsynchronousUpdate(bool asynchronous);
+  vtkBooleanMacro(AsynchronousUpdate, bool);
+
+  /// Stores completed background computation results in the breach warning nodes and updates model colors and warning sound.
+  /// Must be called periodically from the main thread if AsynchronousUpdate is enabled.
+  /// Returns true if any result was applied.
+  bool ProcessAsynchronousUpdateResults();
+
+  /// If enabled, input changes of breach warning nodes (tool or model transform, etc.) only mark the node for update
+  /// and all the changes are processed once, when ProcessDeferredUpdates() is called. If a tracker frame modifies
+  /// several transforms then distances, model colors, and rulers are only updated once instead of after each transform.
+  /// DeferredUpdateRequestedEvent is invoked when processing is needed.
+  /// False by default (outputs are updated immediately).
+  vtkGetMacro(DeferredUpdate, bool);
+  void SetDeferredUpdate(bool deferred);
+  vtkBooleanMacro(DeferredUpdate, bool);
+
+  /// Updates all the breach warning nodes that have changed inputs since the last call.
+  /// Returns true if any node was updated.
+  bool ProcessDeferredUpdates();
+
+  /// Locators and triangle hierarchies of model surfaces, shared between modules.
+  /// Other modules that need closest point queries on models of the scene (for example registration modules)
+  /// can get locators from here to avoid rebuilding them for the same surface. Cleared when the scene is closed.
+  vtkPolyDataLocatorCache* GetLocatorCache();
+
 protected:
   vtkSlicerBreachWarningLogic();
   virtual ~vtkSlicerBreachWarningLogic();
@@ -96,8 +163,13 @@ protected:
   
   virtual void OnMRMLSceneNodeAdded(vtkMRMLNode* node);
   virtual void OnMRMLSceneNodeRemoved(vtkMRMLNode* node);
+  virtual void OnMRMLSceneEndClose();
 
+  /// Computes outputs of the node after its inputs changed (in the background if AsynchronousUpdate is enabled)
+  void UpdateNode( vtkMRMLBreachWarningNode* bwNode );
   void UpdateToolState( vtkMRMLBreachWarningNode* bwNode );
+  /// Updates model color and warning sound from the computed tool state
+  void UpdateWarning( vtkMRMLBreachWarningNode* bwNode );
   void UpdateModelColor( vtkMRMLBreachWarningNode* bwNode );
   void UpdateLineToClosestPoint(vtkMRMLBreachWarningNode* bwNode, double* toolTipPosition_Ras, double* closestPointOnModel_Ras, double closestPointDistance);
   
@@ -107,8 +179,17 @@ private:
 
   void UpdateRuler(vtkMRMLBreachWarningNode* bwNode, double* toolTipPosition);
 
+  /// Updates WarningSoundPlaying and WarningSound from WarningSoundPlayingNodes
+  void UpdateWarningSoundPlaying();
+
+  class vtkInternal;
+  vtkInternal* Internal;
+
   std::deque< vtkWeakPointer< vtkMRMLBreachWarningNode > > WarningSoundPlayingNodes;
   bool WarningSoundPlaying;
+  std::string WarningSound;
+  bool AsynchronousUpdate;
+  bool DeferredUpdate;
   
   double DefaultLineToClosestPointColor[3];
   double DefaultLineToClosestPointTextScale;
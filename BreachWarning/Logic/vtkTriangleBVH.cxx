@@ -0,0 +1,1029 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkTriangleBVH.h"
+#include "vtkTriangleBVHLeafKernel.h"
+
+// VTK includes
+#include <vtkCellArray.h>
+#include <vtkDataArray.h>
+#include <vtkIdList.h>
+#include <vtkMath.h>
+#include <vtkObjectFactory.h>
+#include <vtkPointData.h>
+#include <vtkPoints.h>
+#include <vtkSmartPointer.h>
+#include <vtkTriangleFilter.h>
+
+// STD includes
+#include <algorithm>
+
+// Squared length below which a segment is considered to be a single point
+static const double DEGENERATE_SEGMENT_LENGTH2 = 1e-20;
+
+// Maximum depth of the hierarchy. Median split keeps the depth logarithmic, so this is never reached in practice.
+static const int MAXIMUM_TREE_DEPTH = 64;
+
+//----------------------------------------------------------------------------
+vtkStandardNewMacro( vtkTriangleBVH );
+
+//----------------------------------------------------------------------------
+// Orders triangles by their centroid position along an axis
+class vtkTriangleBVHCentroidLess
+{
+public:
+  vtkTriangleBVHCentroidLess( const std::vector< double >& centroids, int axis )
+  : Centroids( centroids )
+  , Axis( axis )
+  {
+  }
+  bool operator()( vtkIdType a, vtkIdType b ) const
+  {
+    return this->Centroids[ 3 * a + this->Axis ] < this->Centroids[ 3 * b + this->Axis ];
+  }
+private:
+  const std::vector< double >& Centroids;
+  int Axis;
+};
+
+//----------------------------------------------------------------------------
+vtkTriangleBVH::vtkTriangleBVH()
+: MaximumNumberOfTrianglesPerLeaf( 4 )
+, LeafKernel( LEAF_KERNEL_AUTOMATIC )
+, ActiveLeafKernel( vtkTriangleBVHLeafKernel::GetFastestSupportedKernel() )
+, TriangleCoordinatesStride( 0 )
+{
+}
+
+//----------------------------------------------------------------------------
+vtkTriangleBVH::~vtkTriangleBVH()
+{
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::PrintSelf( ostream &os, vtkIndent indent )
+{
+  this->Superclass::PrintSelf( os, indent );
+  os << indent << "NumberOfSurfaces: " << this->Surfaces.size() << std::endl;
+  os << indent << "NumberOfTriangles: " << this->TriangleSurfaceIndices.size() << std::endl;
+  os << indent << "NumberOfNodes: " << this->Nodes.size() << std::endl;
+  os << indent << "MaximumNumberOfTrianglesPerLeaf: " << this->MaximumNumberOfTrianglesPerLeaf << std::endl;
+  os << indent << "LeafKernel: " << this->LeafKernel << std::endl;
+  os << indent << "ActiveLeafKernel: " << vtkTriangleBVHLeafKernel::GetKernelName( this->ActiveLeafKernel ) << std::endl;
+}
+
+//----------------------------------------------------------------------------
+bool vtkTriangleBVH::SetLeafKernel( int kernel )
+{
+  int activeKernel = kernel;
+  bool supported = true;
+  if ( kernel == LEAF_KERNEL_AUTOMATIC )
+  {
+    activeKernel = vtkTriangleBVHLeafKernel::GetFastestSupportedKernel();
+  }
+  else if ( !vtkTriangleBVHLeafKernel::IsKernelSupported( kernel ) )
+  {
+    vtkWarningMacro( "SetLeafKernel: kernel " << kernel << " is not supported on this processor, using scalar kernel" );
+    activeKernel = vtkTriangleBVHLeafKernel::KERNEL_SCALAR;
+    supported = false;
+  }
+  if ( this->LeafKernel == kernel && this->ActiveLeafKernel == activeKernel )
+  {
+    return supported;
+  }
+  this->LeafKernel = kernel;
+  this->ActiveLeafKernel = activeKernel;
+  if ( !this->Nodes.empty() )
+  {
+    this->UpdateTriangleCoordinates();
+  }
+  this->Modified();
+  return supported;
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::UpdateTriangleCoordinates()
+{
+  if ( this->ActiveLeafKernel == vtkTriangleBVHLeafKernel::KERNEL_SCALAR )
+  {
+    std::vector< double >().swap( this->TriangleCoordinates );
+    this->TriangleCoordinatesStride = 0;
+    return;
+  }
+  vtkIdType numberOfTriangles = this->GetNumberOfTriangles();
+  this->TriangleCoordinatesStride = numberOfTriangles;
+  this->TriangleCoordinates.resize( 9 * numberOfTriangles );
+  for ( vtkIdType triangle = 0; triangle < numberOfTriangles; triangle++ )
+  {
+    for ( int vertex = 0; vertex < 3; vertex++ )
+    {
+      const double* point = &( this->Points[ 3 * this->Triangles[ 3 * triangle + vertex ] ] );
+      for ( int axis = 0; axis < 3; axis++ )
+      {
+        this->TriangleCoordinates[ ( 3 * vertex + axis ) * numberOfTriangles + triangle ] = point[ axis ];
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::RemoveAllSurfaces()
+{
+  this->Surfaces.clear();
+  this->SurfaceTransforms.clear();
+  this->Points.clear();
+  this->PointNormals.clear();
+  this->SurfaceFirstPoint.clear();
+  this->SurfaceHasPointNormals.clear();
+  this->Triangles.clear();
+  this->TriangleSurfaceIndices.clear();
+  this->TriangleCoordinates.clear();
+  this->TriangleCoordinatesStride = 0;
+  this->Nodes.clear();
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVH::GetNumberOfSurfaces()
+{
+  return static_cast< int >( this->Surfaces.size() );
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkTriangleBVH::GetNumberOfTriangles()
+{
+  return static_cast< vtkIdType >( this->TriangleSurfaceIndices.size() );
+}
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVH::AddSurface( vtkPolyData* surface, vtkAbstractTransform* transform /* = NULL */ )
+{
+  if ( surface == NULL )
+  {
+    vtkErrorMacro( "vtkTriangleBVH::AddSurface failed: invalid surface" );
+    return -1;
+  }
+
+  // Points are not changed by the triangle filter, only polygons are split into triangles
+  vtkSmartPointer< vtkTriangleFilter > triangleFilter = vtkSmartPointer< vtkTriangleFilter >::New();
+  triangleFilter->PassVertsOff();
+  triangleFilter->PassLinesOff();
+#if (VTK_MAJOR_VERSION <= 5)
+  triangleFilter->SetInput( surface );
+#else
+  triangleFilter->SetInputData( surface );
+#endif
+  triangleFilter->Update();
+  vtkPolyData* triangulatedSurface = triangleFilter->GetOutput();
+
+  int surfaceIndex = static_cast< int >( this->Surfaces.size() );
+  this->Surfaces.push_back( triangulatedSurface );
+  this->SurfaceTransforms.push_back( transform );
+
+  // Points
+  vtkIdType firstPoint = static_cast< vtkIdType >( this->Points.size() / 3 );
+  this->SurfaceFirstPoint.push_back( firstPoint );
+  vtkIdType numberOfPoints = triangulatedSurface->GetNumberOfPoints();
+  this->SurfaceHasPointNormals.push_back( triangulatedSurface->GetPointData()->GetNormals() != NULL );
+  this->Points.resize( 3 * ( firstPoint + numberOfPoints ) );
+  this->PointNormals.resize( 3 * ( firstPoint + numberOfPoints ), 0.0 );
+  this->CopySurfacePoints( triangulatedSurface, transform, firstPoint );
+
+  // Triangles
+  vtkCellArray* polys = triangulatedSurface->GetPolys();
+  vtkSmartPointer< vtkIdList > pointIds = vtkSmartPointer< vtkIdList >::New();
+  polys->InitTraversal();
+  while ( polys->GetNextCell( pointIds ) )
+  {
+    if ( pointIds->GetNumberOfIds() != 3 )
+    {
+      continue;
+    }
+    this->Triangles.push_back( firstPoint + pointIds->GetId( 0 ) );
+    this->Triangles.push_back( firstPoint + pointIds->GetId( 1 ) );
+    this->Triangles.push_back( firstPoint + pointIds->GetId( 2 ) );
+    this->TriangleSurfaceIndices.push_back( surfaceIndex );
+  }
+
+  // The hierarchy has to be rebuilt
+  this->Nodes.clear();
+  this->Modified();
+  return surfaceIndex;
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::CopySurfacePoints( vtkPolyData* surface, vtkAbstractTransform* transform, vtkIdType firstPoint )
+{
+  vtkPoints* points = surface->GetPoints();
+  vtkIdType numberOfPoints = ( points != NULL ) ? points->GetNumberOfPoints() : 0;
+  vtkDataArray* pointNormals = surface->GetPointData()->GetNormals();
+  for ( vtkIdType pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
+  {
+    double point[3] = { 0.0, 0.0, 0.0 };
+    points->GetPoint( pointIndex, point );
+    double* transformedPoint = &( this->Points[ 3 * ( firstPoint + pointIndex ) ] );
+    if ( transform != NULL )
+    {
+      transform->TransformPoint( point, transformedPoint );
+    }
+    else
+    {
+      transformedPoint[ 0 ] = point[ 0 ];
+      transformedPoint[ 1 ] = point[ 1 ];
+      transformedPoint[ 2 ] = point[ 2 ];
+    }
+    if ( pointNormals != NULL )
+    {
+      double normal[3] = { 0.0, 0.0, 0.0 };
+      pointNormals->GetTuple( pointIndex, normal );
+      double* transformedNormal = &( this->PointNormals[ 3 * ( firstPoint + pointIndex ) ] );
+      if ( transform != NULL )
+      {
+        transform->TransformNormalAtPoint( point, normal, transformedNormal );
+      }
+      else
+      {
+        transformedNormal[ 0 ] = normal[ 0 ];
+        transformedNormal[ 1 ] = normal[ 1 ];
+        transformedNormal[ 2 ] = normal[ 2 ];
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+bool vtkTriangleBVH::UpdateSurfacePoints( int surfaceIndex, vtkPolyData* surface, vtkAbstractTransform* transform /* = NULL */ )
+{
+  if ( surfaceIndex < 0 || surfaceIndex >= this->GetNumberOfSurfaces() || surface == NULL )
+  {
+    vtkErrorMacro( "vtkTriangleBVH::UpdateSurfacePoints failed: invalid surface" );
+    return false;
+  }
+  vtkIdType firstPoint = this->SurfaceFirstPoint[ surfaceIndex ];
+  vtkIdType endPoint = ( surfaceIndex + 1 < this->GetNumberOfSurfaces() ) ? this->SurfaceFirstPoint[ surfaceIndex + 1 ]
+    : static_cast< vtkIdType >( this->Points.size() / 3 );
+  if ( surface->GetNumberOfPoints() != endPoint - firstPoint )
+  {
+    // topology changed, the hierarchy has to be rebuilt
+    return false;
+  }
+  this->SurfaceTransforms[ surfaceIndex ] = transform;
+  this->SurfaceHasPointNormals[ surfaceIndex ] = ( surface->GetPointData()->GetNormals() != NULL );
+  this->CopySurfacePoints( surface, transform, firstPoint );
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool vtkTriangleBVH::Refit()
+{
+  if ( this->Nodes.empty() )
+  {
+    return false;
+  }
+  // Children always have larger index than their parent, so processing nodes in reverse order
+  // guarantees that child bounds are already updated when the parent is reached.
+  for ( int nodeIndex = static_cast< int >( this->Nodes.size() ) - 1; nodeIndex >= 0; nodeIndex-- )
+  {
+    Node& node = this->Nodes[ nodeIndex ];
+    if ( node.RightChild < 0 )
+    {
+      // leaf node, triangles are stored in leaf order
+      node.Bounds[ 0 ] = node.Bounds[ 2 ] = node.Bounds[ 4 ] = VTK_DOUBLE_MAX;
+      node.Bounds[ 1 ] = node.Bounds[ 3 ] = node.Bounds[ 5 ] = -VTK_DOUBLE_MAX;
+      for ( vtkIdType triangle = node.FirstTriangle; triangle < node.FirstTriangle + node.NumberOfTriangles; triangle++ )
+      {
+        for ( int vertex = 0; vertex < 3; vertex++ )
+        {
+          const double* point = &( this->Points[ 3 * this->Triangles[ 3 * triangle + vertex ] ] );
+          for ( int axis = 0; axis < 3; axis++ )
+          {
+            node.Bounds[ 2 * axis ] = std::min( node.Bounds[ 2 * axis ], point[ axis ] );
+            node.Bounds[ 2 * axis + 1 ] = std::max( node.Bounds[ 2 * axis + 1 ], point[ axis ] );
+          }
+        }
+      }
+    }
+    else
+    {
+      const double* leftBounds = this->Nodes[ nodeIndex + 1 ].Bounds;
+      const double* rightBounds = this->Nodes[ node.RightChild ].Bounds;
+      for ( int axis = 0; axis < 3; axis++ )
+      {
+        node.Bounds[ 2 * axis ] = std::min( leftBounds[ 2 * axis ], rightBounds[ 2 * axis ] );
+        node.Bounds[ 2 * axis + 1 ] = std::max( leftBounds[ 2 * axis + 1 ], rightBounds[ 2 * axis + 1 ] );
+      }
+    }
+  }
+  this->UpdateTriangleCoordinates();
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::DeepCopy( vtkTriangleBVH* source )
+{
+  if ( source == NULL || source == this )
+  {
+    return;
+  }
+  this->MaximumNumberOfTrianglesPerLeaf = source->MaximumNumberOfTrianglesPerLeaf;
+  this->LeafKernel = source->LeafKernel;
+  this->ActiveLeafKernel = source->ActiveLeafKernel;
+  this->Surfaces = source->Surfaces;
+  this->SurfaceTransforms = source->SurfaceTransforms;
+  this->Points = source->Points;
+  this->PointNormals = source->PointNormals;
+  this->SurfaceFirstPoint = source->SurfaceFirstPoint;
+  this->SurfaceHasPointNormals = source->SurfaceHasPointNormals;
+  this->Triangles = source->Triangles;
+  this->TriangleSurfaceIndices = source->TriangleSurfaceIndices;
+  this->TriangleCoordinates = source->TriangleCoordinates;
+  this->TriangleCoordinatesStride = source->TriangleCoordinatesStride;
+  this->Nodes = source->Nodes;
+  this->Modified();
+}
+
+//----------------------------------------------------------------------------
+bool vtkTriangleBVH::Build()
+{
+  this->Nodes.clear();
+  vtkIdType numberOfTriangles = this->GetNumberOfTriangles();
+  if ( numberOfTriangles == 0 )
+  {
+    return false;
+  }
+
+  std::vector< double > centroids( 3 * numberOfTriangles );
+  std::vector< vtkIdType > triangleOrder( numberOfTriangles );
+  for ( vtkIdType triangle = 0; triangle < numberOfTriangles; triangle++ )
+  {
+    triangleOrder[ triangle ] = triangle;
+    const double* a = &( this->Points[ 3 * this->Triangles[ 3 * triangle ] ] );
+    const double* b = &( this->Points[ 3 * this->Triangles[ 3 * triangle + 1 ] ] );
+    const double* c = &( this->Points[ 3 * this->Triangles[ 3 * triangle + 2 ] ] );
+    for ( int i = 0; i < 3; i++ )
+    {
+      centroids[ 3 * triangle + i ] = ( a[ i ] + b[ i ] + c[ i ] ) / 3.0;
+    }
+  }
+
+  int leafSize = std::max( 1, this->MaximumNumberOfTrianglesPerLeaf );
+  this->Nodes.reserve( 2 * ( numberOfTriangles / leafSize + 1 ) );
+  this->BuildNode( triangleOrder, 0, numberOfTriangles, centroids );
+
+  // Store triangles in the order of leaf nodes, so that each leaf refers to a contiguous range of triangles
+  std::vector< vtkIdType > orderedTriangles( 3 * numberOfTriangles );
+  std::vector< int > orderedTriangleSurfaceIndices( numberOfTriangles );
+  for ( vtkIdType triangle = 0; triangle < numberOfTriangles; triangle++ )
+  {
+    vtkIdType originalTriangle = triangleOrder[ triangle ];
+    orderedTriangles[ 3 * triangle ] = this->Triangles[ 3 * originalTriangle ];
+    orderedTriangles[ 3 * triangle + 1 ] = this->Triangles[ 3 * originalTriangle + 1 ];
+    orderedTriangles[ 3 * triangle + 2 ] = this->Triangles[ 3 * originalTriangle + 2 ];
+    orderedTriangleSurfaceIndices[ triangle ] = this->TriangleSurfaceIndices[ originalTriangle ];
+  }
+  this->Triangles.swap( orderedTriangles );
+  this->TriangleSurfaceIndices.swap( orderedTriangleSurfaceIndices );
+  this->UpdateTriangleCoordinates();
+
+  this->Modified();
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::ComputeTriangleRangeBounds( const std::vector< vtkIdType >& triangleOrder, vtkIdType firstTriangle, vtkIdType numberOfTriangles, double bounds[6] ) const
+{
+  bounds[ 0 ] = bounds[ 2 ] = bounds[ 4 ] = VTK_DOUBLE_MAX;
+  bounds[ 1 ] = bounds[ 3 ] = bounds[ 5 ] = -VTK_DOUBLE_MAX;
+  for ( vtkIdType i = firstTriangle; i < firstTriangle + numberOfTriangles; i++ )
+  {
+    vtkIdType triangle = triangleOrder[ i ];
+    for ( int vertex = 0; vertex < 3; vertex++ )
+    {
+      const double* point = &( this->Points[ 3 * this->Triangles[ 3 * triangle + vertex ] ] );
+      for ( int axis = 0; axis < 3; axis++ )
+      {
+        bounds[ 2 * axis ] = std::min( bounds[ 2 * axis ], point[ axis ] );
+        bounds[ 2 * axis + 1 ] = std::max( bounds[ 2 * axis + 1 ], point[ axis ] );
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVH::BuildNode( std::vector< vtkIdType >& triangleOrder, vtkIdType firstTriangle, vtkIdType numberOfTriangles, const std::vector< double >& centroids )
+{
+  int nodeIndex = static_cast< int >( this->Nodes.size() );
+  this->Nodes.push_back( Node() );
+  // Note: do not keep a reference to the node, as the vector may be reallocated when child nodes are added
+  this->ComputeTriangleRangeBounds( triangleOrder, firstTriangle, numberOfTriangles, this->Nodes[ nodeIndex ].Bounds );
+  this->Nodes[ nodeIndex ].RightChild = -1;
+  this->Nodes[ nodeIndex ].FirstTriangle = firstTriangle;
+  this->Nodes[ nodeIndex ].NumberOfTriangles = numberOfTriangles;
+
+  if ( numberOfTriangles <= this->MaximumNumberOfTrianglesPerLeaf )
+  {
+    return nodeIndex;
+  }
+
+  // Split along the longest axis of the triangle centroids, at the median
+  double centroidBounds[6] = { VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX, VTK_DOUBLE_MAX, -VTK_DOUBLE_MAX };
+  for ( vtkIdType i = firstTriangle; i < firstTriangle + numberOfTriangles; i++ )
+  {
+    const double* centroid = &( centroids[ 3 * triangleOrder[ i ] ] );
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      centroidBounds[ 2 * axis ] = std::min( centroidBounds[ 2 * axis ], centroid[ axis ] );
+      centroidBounds[ 2 * axis + 1 ] = std::max( centroidBounds[ 2 * axis + 1 ], centroid[ axis ] );
+    }
+  }
+  int splitAxis = 0;
+  for ( int axis = 1; axis < 3; axis++ )
+  {
+    if ( centroidBounds[ 2 * axis + 1 ] - centroidBounds[ 2 * axis ] > centroidBounds[ 2 * splitAxis + 1 ] - centroidBounds[ 2 * splitAxis ] )
+    {
+      splitAxis = axis;
+    }
+  }
+  if ( centroidBounds[ 2 * splitAxis + 1 ] - centroidBounds[ 2 * splitAxis ] <= 0 )
+  {
+    // all centroids are at the same position, cannot be split
+    return nodeIndex;
+  }
+
+  vtkIdType numberOfLeftTriangles = numberOfTriangles / 2;
+  std::nth_element( triangleOrder.begin() + firstTriangle,
+    triangleOrder.begin() + firstTriangle + numberOfLeftTriangles,
+    triangleOrder.begin() + firstTriangle + numberOfTriangles,
+    vtkTriangleBVHCentroidLess( centroids, splitAxis ) );
+
+  this->Nodes[ nodeIndex ].NumberOfTriangles = 0; // internal node
+  this->BuildNode( triangleOrder, firstTriangle, numberOfLeftTriangles, centroids ); // left child is always nodeIndex+1
+  int rightChild = this->BuildNode( triangleOrder, firstTriangle + numberOfLeftTriangles, numberOfTriangles - numberOfLeftTriangles, centroids );
+  this->Nodes[ nodeIndex ].RightChild = rightChild;
+  return nodeIndex;
+}
+
+//----------------------------------------------------------------------------
+double vtkTriangleBVH::GetBoxDistance2( const double bounds[6], const double x[3] )
+{
+  double distance2 = 0.0;
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    double d = 0.0;
+    if ( x[ axis ] < bounds[ 2 * axis ] )
+    {
+      d = bounds[ 2 * axis ] - x[ axis ];
+    }
+    else if ( x[ axis ] > bounds[ 2 * axis + 1 ] )
+    {
+      d = x[ axis ] - bounds[ 2 * axis + 1 ];
+    }
+    distance2 += d * d;
+  }
+  return distance2;
+}
+
+//----------------------------------------------------------------------------
+double vtkTriangleBVH::GetSegmentToBoxDistance2( const double bounds[6], const double p0[3], const double p1[3] )
+{
+  // Squared distance of the segment point p0 + t * direction from the box is a convex, piecewise quadratic function
+  // of t. Pieces are separated by the parameters where the segment crosses the slab planes of the box: within a piece
+  // each coordinate is either below, inside, or above the slab of its axis, so the minimum of the piece is found
+  // in closed form.
+  double direction[3] = { p1[ 0 ] - p0[ 0 ], p1[ 1 ] - p0[ 1 ], p1[ 2 ] - p0[ 2 ] };
+  double pieceLimits[8] = { 0.0, 1.0 };
+  int numberOfPieceLimits = 2;
+  for ( int axis = 0; axis < 3; axis++ )
+  {
+    if ( direction[ axis ] == 0.0 )
+    {
+      continue;
+    }
+    for ( int side = 0; side < 2; side++ )
+    {
+      double t = ( bounds[ 2 * axis + side ] - p0[ axis ] ) / direction[ axis ];
+      if ( t > 0.0 && t < 1.0 )
+      {
+        pieceLimits[ numberOfPieceLimits++ ] = t;
+      }
+    }
+  }
+  std::sort( pieceLimits, pieceLimits + numberOfPieceLimits );
+
+  double minimumDistance2 = VTK_DOUBLE_MAX;
+  for ( int piece = 0; piece + 1 < numberOfPieceLimits; piece++ )
+  {
+    double tStart = pieceLimits[ piece ];
+    double tEnd = pieceLimits[ piece + 1 ];
+    double tMiddle = 0.5 * ( tStart + tEnd );
+    // Sum of squared axis distances outside the slabs: a * t^2 + b * t + c
+    double a = 0.0;
+    double b = 0.0;
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      double x = p0[ axis ] + tMiddle * direction[ axis ];
+      double offset = 0.0;
+      if ( x < bounds[ 2 * axis ] )
+      {
+        offset = p0[ axis ] - bounds[ 2 * axis ];
+      }
+      else if ( x > bounds[ 2 * axis + 1 ] )
+      {
+        offset = p0[ axis ] - bounds[ 2 * axis + 1 ];
+      }
+      else
+      {
+        continue;
+      }
+      a += direction[ axis ] * direction[ axis ];
+      b += 2.0 * offset * direction[ axis ];
+    }
+    double t = tStart;
+    if ( a > 0.0 )
+    {
+      t = std::min( std::max( -b / ( 2.0 * a ), tStart ), tEnd );
+    }
+    double x[3] = { p0[ 0 ] + t * direction[ 0 ], p0[ 1 ] + t * direction[ 1 ], p0[ 2 ] + t * direction[ 2 ] };
+    double distance2 = GetBoxDistance2( bounds, x );
+    if ( distance2 < minimumDistance2 )
+    {
+      minimumDistance2 = distance2;
+    }
+  }
+  return minimumDistance2;
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::GetClosestPointOnTriangle( const double x[3], const double a[3], const double b[3], const double c[3],
+  double closestPoint[3], double weights[3] )
+{
+  // Based on Christer Ericson, Real-Time Collision Detection, section 5.1.5
+  double ab[3] = { b[ 0 ] - a[ 0 ], b[ 1 ] - a[ 1 ], b[ 2 ] - a[ 2 ] };
+  double ac[3] = { c[ 0 ] - a[ 0 ], c[ 1 ] - a[ 1 ], c[ 2 ] - a[ 2 ] };
+  double ax[3] = { x[ 0 ] - a[ 0 ], x[ 1 ] - a[ 1 ], x[ 2 ] - a[ 2 ] };
+  double d1 = vtkMath::Dot( ab, ax );
+  double d2 = vtkMath::Dot( ac, ax );
+  if ( d1 <= 0 && d2 <= 0 )
+  {
+    // vertex region of A
+    weights[ 0 ] = 1.0; weights[ 1 ] = 0.0; weights[ 2 ] = 0.0;
+  }
+  else
+  {
+    double bx[3] = { x[ 0 ] - b[ 0 ], x[ 1 ] - b[ 1 ], x[ 2 ] - b[ 2 ] };
+    double d3 = vtkMath::Dot( ab, bx );
+    double d4 = vtkMath::Dot( ac, bx );
+    double cx[3] = { x[ 0 ] - c[ 0 ], x[ 1 ] - c[ 1 ], x[ 2 ] - c[ 2 ] };
+    double d5 = vtkMath::Dot( ab, cx );
+    double d6 = vtkMath::Dot( ac, cx );
+    double vc = d1 * d4 - d3 * d2;
+    double vb = d5 * d2 - d1 * d6;
+    double va = d3 * d6 - d5 * d4;
+    if ( d3 >= 0 && d4 <= d3 )
+    {
+      // vertex region of B
+      weights[ 0 ] = 0.0; weights[ 1 ] = 1.0; weights[ 2 ] = 0.0;
+    }
+    else if ( vc <= 0 && d1 >= 0 && d3 <= 0 )
+    {
+      // edge region of AB
+      double v = d1 / ( d1 - d3 );
+      weights[ 0 ] = 1.0 - v; weights[ 1 ] = v; weights[ 2 ] = 0.0;
+    }
+    else if ( d6 >= 0 && d5 <= d6 )
+    {
+      // vertex region of C
+      weights[ 0 ] = 0.0; weights[ 1 ] = 0.0; weights[ 2 ] = 1.0;
+    }
+    else if ( vb <= 0 && d2 >= 0 && d6 <= 0 )
+    {
+      // edge region of AC
+      double w = d2 / ( d2 - d6 );
+      weights[ 0 ] = 1.0 - w; weights[ 1 ] = 0.0; weights[ 2 ] = w;
+    }
+    else if ( va <= 0 && ( d4 - d3 ) >= 0 && ( d5 - d6 ) >= 0 )
+    {
+      // edge region of BC
+      double w = ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) );
+      weights[ 0 ] = 0.0; weights[ 1 ] = 1.0 - w; weights[ 2 ] = w;
+    }
+    else if ( va + vb + vc > 0 )
+    {
+      // face region
+      double denominator = 1.0 / ( va + vb + vc );
+      double v = vb * denominator;
+      double w = vc * denominator;
+      weights[ 0 ] = 1.0 - v - w; weights[ 1 ] = v; weights[ 2 ] = w;
+    }
+    else
+    {
+      // degenerate triangle
+      weights[ 0 ] = 1.0; weights[ 1 ] = 0.0; weights[ 2 ] = 0.0;
+    }
+  }
+  for ( int i = 0; i < 3; i++ )
+  {
+    closestPoint[ i ] = weights[ 0 ] * a[ i ] + weights[ 1 ] * b[ i ] + weights[ 2 ] * c[ i ];
+  }
+}
+
+//----------------------------------------------------------------------------
+double vtkTriangleBVH::GetClosestPointsOnSegments( const double p0[3], const double p1[3], const double q0[3], const double q1[3],
+  double& s, double& t, double closestPointOnP[3], double closestPointOnQ[3] )
+{
+  // Based on Christer Ericson, Real-Time Collision Detection, section 5.1.9
+  double d1[3] = { p1[ 0 ] - p0[ 0 ], p1[ 1 ] - p0[ 1 ], p1[ 2 ] - p0[ 2 ] };
+  double d2[3] = { q1[ 0 ] - q0[ 0 ], q1[ 1 ] - q0[ 1 ], q1[ 2 ] - q0[ 2 ] };
+  double r[3] = { p0[ 0 ] - q0[ 0 ], p0[ 1 ] - q0[ 1 ], p0[ 2 ] - q0[ 2 ] };
+  double a = vtkMath::Dot( d1, d1 );
+  double e = vtkMath::Dot( d2, d2 );
+  double f = vtkMath::Dot( d2, r );
+  if ( a <= DEGENERATE_SEGMENT_LENGTH2 && e <= DEGENERATE_SEGMENT_LENGTH2 )
+  {
+    // both segments degenerate into points
+    s = 0.0;
+    t = 0.0;
+  }
+  else if ( a <= DEGENERATE_SEGMENT_LENGTH2 )
+  {
+    // first segment degenerates into a point
+    s = 0.0;
+    t = std::min( std::max( f / e, 0.0 ), 1.0 );
+  }
+  else
+  {
+    double c = vtkMath::Dot( d1, r );
+    if ( e <= DEGENERATE_SEGMENT_LENGTH2 )
+    {
+      // second segment degenerates into a point
+      t = 0.0;
+      s = std::min( std::max( -c / a, 0.0 ), 1.0 );
+    }
+    else
+    {
+      double b = vtkMath::Dot( d1, d2 );
+      double denominator = a * e - b * b;
+      // if segments are parallel then pick an arbitrary s
+      s = ( denominator != 0.0 ) ? std::min( std::max( ( b * f - c * e ) / denominator, 0.0 ), 1.0 ) : 0.0;
+      t = ( b * s + f ) / e;
+      if ( t < 0.0 )
+      {
+        t = 0.0;
+        s = std::min( std::max( -c / a, 0.0 ), 1.0 );
+      }
+      else if ( t > 1.0 )
+      {
+        t = 1.0;
+        s = std::min( std::max( ( b - c ) / a, 0.0 ), 1.0 );
+      }
+    }
+  }
+  for ( int i = 0; i < 3; i++ )
+  {
+    closestPointOnP[ i ] = p0[ i ] + d1[ i ] * s;
+    closestPointOnQ[ i ] = q0[ i ] + d2[ i ] * t;
+  }
+  return vtkMath::Distance2BetweenPoints( closestPointOnP, closestPointOnQ );
+}
+
+//----------------------------------------------------------------------------
+double vtkTriangleBVH::GetClosestPointsOnSegmentAndTriangle( const double p0[3], const double p1[3],
+  const double a[3], const double b[3], const double c[3],
+  double closestPointOnSegment[3], double closestPointOnTriangle[3], double weights[3] )
+{
+  // Check if the segment intersects the triangle (Moller-Trumbore)
+  double direction[3] = { p1[ 0 ] - p0[ 0 ], p1[ 1 ] - p0[ 1 ], p1[ 2 ] - p0[ 2 ] };
+  double ab[3] = { b[ 0 ] - a[ 0 ], b[ 1 ] - a[ 1 ], b[ 2 ] - a[ 2 ] };
+  double ac[3] = { c[ 0 ] - a[ 0 ], c[ 1 ] - a[ 1 ], c[ 2 ] - a[ 2 ] };
+  double h[3] = { 0.0, 0.0, 0.0 };
+  vtkMath::Cross( direction, ac, h );
+  double determinant = vtkMath::Dot( ab, h );
+  if ( fabs( determinant ) > DEGENERATE_SEGMENT_LENGTH2 )
+  {
+    double ap0[3] = { p0[ 0 ] - a[ 0 ], p0[ 1 ] - a[ 1 ], p0[ 2 ] - a[ 2 ] };
+    double u = vtkMath::Dot( ap0, h ) / determinant;
+    if ( u >= 0.0 && u <= 1.0 )
+    {
+      double q[3] = { 0.0, 0.0, 0.0 };
+      vtkMath::Cross( ap0, ab, q );
+      double v = vtkMath::Dot( direction, q ) / determinant;
+      double t = vtkMath::Dot( ac, q ) / determinant;
+      if ( v >= 0.0 && u + v <= 1.0 && t >= 0.0 && t <= 1.0 )
+      {
+        weights[ 0 ] = 1.0 - u - v;
+        weights[ 1 ] = u;
+        weights[ 2 ] = v;
+        for ( int i = 0; i < 3; i++ )
+        {
+          closestPointOnSegment[ i ] = p0[ i ] + t * direction[ i ];
+          closestPointOnTriangle[ i ] = closestPointOnSegment[ i ];
+        }
+        return 0.0;
+      }
+    }
+  }
+
+  // No intersection: the closest point pair is between a segment endpoint and the triangle,
+  // or between the segment and a triangle edge.
+  double closestDistance2 = VTK_DOUBLE_MAX;
+  double pointOnSegment[3] = { 0.0, 0.0, 0.0 };
+  double pointOnTriangle[3] = { 0.0, 0.0, 0.0 };
+  double pointWeights[3] = { 0.0, 0.0, 0.0 };
+  const double* endpoints[2] = { p0, p1 };
+  for ( int endpoint = 0; endpoint < 2; endpoint++ )
+  {
+    GetClosestPointOnTriangle( endpoints[ endpoint ], a, b, c, pointOnTriangle, pointWeights );
+    double distance2 = vtkMath::Distance2BetweenPoints( endpoints[ endpoint ], pointOnTriangle );
+    if ( distance2 < closestDistance2 )
+    {
+      closestDistance2 = distance2;
+      for ( int i = 0; i < 3; i++ )
+      {
+        closestPointOnSegment[ i ] = endpoints[ endpoint ][ i ];
+        closestPointOnTriangle[ i ] = pointOnTriangle[ i ];
+        weights[ i ] = pointWeights[ i ];
+      }
+    }
+  }
+  const double* vertices[3] = { a, b, c };
+  for ( int edge = 0; edge < 3; edge++ )
+  {
+    int startVertex = edge;
+    int endVertex = ( edge + 1 ) % 3;
+    double s = 0.0;
+    double t = 0.0;
+    double distance2 = GetClosestPointsOnSegments( p0, p1, vertices[ startVertex ], vertices[ endVertex ],
+      s, t, pointOnSegment, pointOnTriangle );
+    if ( distance2 < closestDistance2 )
+    {
+      closestDistance2 = distance2;
+      for ( int i = 0; i < 3; i++ )
+      {
+        closestPointOnSegment[ i ] = pointOnSegment[ i ];
+        closestPointOnTriangle[ i ] = pointOnTriangle[ i ];
+        weights[ i ] = 0.0;
+      }
+      weights[ startVertex ] = 1.0 - t;
+      weights[ endVertex ] = t;
+    }
+  }
+  return closestDistance2;
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::FindClosestTriangle( const double x[3], int surfaceIndex, double& closestDistance2,
+  double closestPoint[3], double closestWeights[3], vtkIdType& closestTriangle ) const
+{
+  if ( this->Nodes.empty() )
+  {
+    return;
+  }
+
+  // Depth-first traversal, visiting the closer child first
+  int nodeStack[ 2 * MAXIMUM_TREE_DEPTH ];
+  int stackSize = 0;
+  nodeStack[ stackSize++ ] = 0;
+  while ( stackSize > 0 )
+  {
+    int nodeIndex = nodeStack[ --stackSize ];
+    const Node& node = this->Nodes[ nodeIndex ];
+    if ( GetBoxDistance2( node.Bounds, x ) >= closestDistance2 )
+    {
+      continue;
+    }
+
+    if ( node.RightChild < 0 )
+    {
+      // leaf node
+      vtkIdType firstTriangle = node.FirstTriangle;
+      vtkIdType lastTriangle = node.FirstTriangle + node.NumberOfTriangles;
+      if ( surfaceIndex < 0 && this->ActiveLeafKernel != vtkTriangleBVHLeafKernel::KERNEL_SCALAR )
+      {
+        // The vectorized kernel selects the closest triangle of the leaf, the closest point is only computed for that triangle
+        double leafDistance2 = closestDistance2;
+        firstTriangle = vtkTriangleBVHLeafKernel::FindClosestTriangle( this->ActiveLeafKernel, &( this->TriangleCoordinates[ 0 ] ),
+          this->TriangleCoordinatesStride, node.FirstTriangle, node.NumberOfTriangles, x, leafDistance2 );
+        if ( firstTriangle < 0 )
+        {
+          continue;
+        }
+        lastTriangle = firstTriangle + 1;
+      }
+      for ( vtkIdType triangle = firstTriangle; triangle < lastTriangle; triangle++ )
+      {
+        if ( surfaceIndex >= 0 && this->TriangleSurfaceIndices[ triangle ] != surfaceIndex )
+        {
+          continue;
+        }
+        double point[3] = { 0.0, 0.0, 0.0 };
+        double weights[3] = { 0.0, 0.0, 0.0 };
+        GetClosestPointOnTriangle( x,
+          &( this->Points[ 3 * this->Triangles[ 3 * triangle ] ] ),
+          &( this->Points[ 3 * this->Triangles[ 3 * triangle + 1 ] ] ),
+          &( this->Points[ 3 * this->Triangles[ 3 * triangle + 2 ] ] ),
+          point, weights );
+        double distance2 = vtkMath::Distance2BetweenPoints( x, point );
+        if ( distance2 < closestDistance2 )
+        {
+          closestDistance2 = distance2;
+          closestTriangle = triangle;
+          for ( int i = 0; i < 3; i++ )
+          {
+            closestPoint[ i ] = point[ i ];
+            closestWeights[ i ] = weights[ i ];
+          }
+        }
+      }
+      continue;
+    }
+
+    int leftChild = nodeIndex + 1;
+    int rightChild = node.RightChild;
+    double leftDistance2 = GetBoxDistance2( this->Nodes[ leftChild ].Bounds, x );
+    double rightDistance2 = GetBoxDistance2( this->Nodes[ rightChild ].Bounds, x );
+    // Push the farther child first, so that the closer child is processed first
+    if ( leftDistance2 <= rightDistance2 )
+    {
+      if ( rightDistance2 < closestDistance2 )
+      {
+        nodeStack[ stackSize++ ] = rightChild;
+      }
+      if ( leftDistance2 < closestDistance2 )
+      {
+        nodeStack[ stackSize++ ] = leftChild;
+      }
+    }
+    else
+    {
+      if ( leftDistance2 < closestDistance2 )
+      {
+        nodeStack[ stackSize++ ] = leftChild;
+      }
+      if ( rightDistance2 < closestDistance2 )
+      {
+        nodeStack[ stackSize++ ] = rightChild;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::FindClosestTriangleToSegment( const double p0[3], const double p1[3], int surfaceIndex, double& closestDistance2,
+  double closestPointOnSegment[3], double closestPoint[3], double closestWeights[3], vtkIdType& closestTriangle ) const
+{
+  if ( this->Nodes.empty() )
+  {
+    return;
+  }
+
+  // The distance between the segment and the bounding box of a node is a lower bound of the distance
+  // between the segment and any triangle of the node. The bounding box of the segment is not used for pruning,
+  // because for a long oblique segment (e.g., a needle shaft) it overlaps most of the nodes.
+  int nodeStack[ 2 * MAXIMUM_TREE_DEPTH ];
+  int stackSize = 0;
+  nodeStack[ stackSize++ ] = 0;
+  while ( stackSize > 0 && closestDistance2 > 0 )
+  {
+    int nodeIndex = nodeStack[ --stackSize ];
+    const Node& node = this->Nodes[ nodeIndex ];
+    if ( GetSegmentToBoxDistance2( node.Bounds, p0, p1 ) >= closestDistance2 )
+    {
+      continue;
+    }
+
+    if ( node.RightChild < 0 )
+    {
+      // leaf node
+      for ( vtkIdType triangle = node.FirstTriangle; triangle < node.FirstTriangle + node.NumberOfTriangles; triangle++ )
+      {
+        if ( surfaceIndex >= 0 && this->TriangleSurfaceIndices[ triangle ] != surfaceIndex )
+        {
+          continue;
+        }
+        double pointOnSegment[3] = { 0.0, 0.0, 0.0 };
+        double point[3] = { 0.0, 0.0, 0.0 };
+        double weights[3] = { 0.0, 0.0, 0.0 };
+        double distance2 = GetClosestPointsOnSegmentAndTriangle( p0, p1,
+          &( this->Points[ 3 * this->Triangles[ 3 * triangle ] ] ),
+          &( this->Points[ 3 * this->Triangles[ 3 * triangle + 1 ] ] ),
+          &( this->Points[ 3 * this->Triangles[ 3 * triangle + 2 ] ] ),
+          pointOnSegment, point, weights );
+        if ( distance2 < closestDistance2 )
+        {
+          closestDistance2 = distance2;
+          closestTriangle = triangle;
+          for ( int i = 0; i < 3; i++ )
+          {
+            closestPointOnSegment[ i ] = pointOnSegment[ i ];
+            closestPoint[ i ] = point[ i ];
+            closestWeights[ i ] = weights[ i ];
+          }
+        }
+      }
+      continue;
+    }
+
+    int leftChild = nodeIndex + 1;
+    int rightChild = node.RightChild;
+    double leftDistance2 = GetSegmentToBoxDistance2( this->Nodes[ leftChild ].Bounds, p0, p1 );
+    double rightDistance2 = GetSegmentToBoxDistance2( this->Nodes[ rightChild ].Bounds, p0, p1 );
+    // Push the farther child first, so that the closer child is processed first
+    int fartherChild = ( leftDistance2 <= rightDistance2 ) ? rightChild : leftChild;
+    int closerChild = ( leftDistance2 <= rightDistance2 ) ? leftChild : rightChild;
+    if ( std::max( leftDistance2, rightDistance2 ) < closestDistance2 )
+    {
+      nodeStack[ stackSize++ ] = fartherChild;
+    }
+    if ( std::min( leftDistance2, rightDistance2 ) < closestDistance2 )
+    {
+      nodeStack[ stackSize++ ] = closerChild;
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void vtkTriangleBVH::GetNormal( vtkIdType triangle, const double weights[3], double normal[3] ) const
+{
+  const vtkIdType* pointIds = &( this->Triangles[ 3 * triangle ] );
+  if ( this->SurfaceHasPointNormals[ this->TriangleSurfaceIndices[ triangle ] ] )
+  {
+    // Interpolate point normals (same as in vtkImplicitPolyDataDistance)
+    for ( int i = 0; i < 3; i++ )
+    {
+      normal[ i ] = weights[ 0 ] * this->PointNormals[ 3 * pointIds[ 0 ] + i ]
+        + weights[ 1 ] * this->PointNormals[ 3 * pointIds[ 1 ] + i ]
+        + weights[ 2 ] * this->PointNormals[ 3 * pointIds[ 2 ] + i ];
+    }
+    return;
+  }
+  const double* a = &( this->Points[ 3 * pointIds[ 0 ] ] );
+  const double* b = &( this->Points[ 3 * pointIds[ 1 ] ] );
+  const double* c = &( this->Points[ 3 * pointIds[ 2 ] ] );
+  double ab[3] = { b[ 0 ] - a[ 0 ], b[ 1 ] - a[ 1 ], b[ 2 ] - a[ 2 ] };
+  double ac[3] = { c[ 0 ] - a[ 0 ], c[ 1 ] - a[ 1 ], c[ 2 ] - a[ 2 ] };
+  vtkMath::Cross( ab, ac, normal );
+}
+
+//----------------------------------------------------------------------------
+double vtkTriangleBVH::FindClosestPoint( const double x[3], double closestPoint[3], int& closestSurfaceIndex, int surfaceIndex /* = -1 */ ) const
+{
+  double closestDistance2 = VTK_DOUBLE_MAX;
+  double closestWeights[3] = { 0.0, 0.0, 0.0 };
+  vtkIdType closestTriangle = -1;
+  this->FindClosestTriangle( x, surfaceIndex, closestDistance2, closestPoint, closestWeights, closestTriangle );
+  if ( closestTriangle < 0 )
+  {
+    closestSurfaceIndex = -1;
+    return VTK_DOUBLE_MAX;
+  }
+  closestSurfaceIndex = this->TriangleSurfaceIndices[ closestTriangle ];
+
+  double normal[3] = { 0.0, 0.0, 0.0 };
+  this->GetNormal( closestTriangle, closestWeights, normal );
+  double direction[3] = { x[ 0 ] - closestPoint[ 0 ], x[ 1 ] - closestPoint[ 1 ], x[ 2 ] - closestPoint[ 2 ] };
+  double distance = sqrt( closestDistance2 );
+  return ( vtkMath::Dot( direction, normal ) < 0 ) ? -distance : distance;
+}
+
+//----------------------------------------------------------------------------
+double vtkTriangleBVH::FindClosestPointToSegment( const double p0[3], const double p1[3], double closestPointOnSegment[3],
+  double closestPoint[3], int& closestSurfaceIndex, int surfaceIndex /* = -1 */ ) const
+{
+  double closestDistance2 = VTK_DOUBLE_MAX;
+  double closestWeights[3] = { 0.0, 0.0, 0.0 };
+  vtkIdType closestTriangle = -1;
+  this->FindClosestTriangleToSegment( p0, p1, surfaceIndex, closestDistance2, closestPointOnSegment, closestPoint, closestWeights, closestTriangle );
+  if ( closestTriangle < 0 )
+  {
+    closestSurfaceIndex = -1;
+    return VTK_DOUBLE_MAX;
+  }
+  closestSurfaceIndex = this->TriangleSurfaceIndices[ closestTriangle ];
+  if ( closestDistance2 <= 0.0 )
+  {
+    // the segment intersects the surface
+    return 0.0;
+  }
+
+  double normal[3] = { 0.0, 0.0, 0.0 };
+  this->GetNormal( closestTriangle, closestWeights, normal );
+  double direction[3] = { closestPointOnSegment[ 0 ] - closestPoint[ 0 ], closestPointOnSegment[ 1 ] - closestPoint[ 1 ], closestPointOnSegment[ 2 ] - closestPoint[ 2 ] };
+  double distance = sqrt( closestDistance2 );
+  return ( vtkMath::Dot( direction, normal ) < 0 ) ? -distance : distance;
+}
@@ -0,0 +1,188 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkTriangleBVH_h
+#define __vtkTriangleBVH_h
+
+#include <vtkAbstractTransform.h>
+#include <vtkObject.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+
+// STD includes
+#include <vector>
+
+// export
+#include "vtkSlicerBreachWarningModuleLogicExport.h"
+
+// Bounding volume hierarchy (tree of axis-aligned bounding boxes) built over the triangles of one or more surfaces.
+// All surfaces are stored in a single hierarchy, so one query finds the closest point among all surfaces
+// and tells which surface it belongs to. Optionally, the query can be restricted to a single surface.
+// Distance is signed: negative if the point is inside the surface (determined from point normals,
+// if available in the surface, otherwise from the triangle normal).
+// Queries do not modify the hierarchy, therefore they can be run from multiple threads at the same time.
+class VTK_SLICER_BREACHWARNING_MODULE_LOGIC_EXPORT vtkTriangleBVH : public vtkObject
+{
+public:
+  static vtkTriangleBVH* New();
+  vtkTypeMacro( vtkTriangleBVH, vtkObject );
+  void PrintSelf( ostream &os, vtkIndent indent ) VTK_OVERRIDE;
+
+  // Removes all surfaces and the hierarchy.
+  void RemoveAllSurfaces();
+
+  // Adds a surface to the hierarchy. Polygons and triangle strips are triangulated, vertices and lines are ignored.
+  // If transform is specified then surface points are transformed by it (the hierarchy is built in the transformed coordinate system).
+  // Returns the index of the added surface. Build() must be called after all the surfaces are added.
+  int AddSurface( vtkPolyData* surface, vtkAbstractTransform* transform = NULL );
+  int GetNumberOfSurfaces();
+
+  // Builds the hierarchy. Returns false if there are no triangles.
+  bool Build();
+
+  // Replaces point coordinates (and normals) of a surface that is already in the hierarchy, for example
+  // when the surface is deformed or its transform is changed. The surface must have the same number of points
+  // and the same cells as when it was added. Refit() must be called after all the surfaces are updated.
+  // Returns false if the number of points is changed (the hierarchy must be rebuilt in this case).
+  bool UpdateSurfacePoints( int surfaceIndex, vtkPolyData* surface, vtkAbstractTransform* transform = NULL );
+
+  // Recomputes node bounds bottom-up, keeping the tree structure. Much faster than Build() (linear in the
+  // number of triangles, no sorting), but queries may become slower if points moved a lot relative to each other.
+  // Returns false if the hierarchy is not built yet.
+  bool Refit();
+
+  // Copies all surfaces and the hierarchy. Can be used for refitting a copy while the original is queried from another thread.
+  void DeepCopy( vtkTriangleBVH* source );
+
+  vtkIdType GetNumberOfTriangles();
+
+  // Maximum number of triangles in a leaf node. Takes effect at the next Build().
+  vtkSetMacro( MaximumNumberOfTrianglesPerLeaf, int );
+  vtkGetMacro( MaximumNumberOfTrianglesPerLeaf, int );
+
+  enum
+  {
+    LEAF_KERNEL_AUTOMATIC = -1
+  };
+
+  // Kernel that computes point-triangle distances in leaf nodes (vtkTriangleBVHLeafKernel::KernelType).
+  // By default (LEAF_KERNEL_AUTOMATIC) the fastest kernel that the processor supports is used.
+  // Vectorized kernels process several triangles of a leaf at once and store an additional copy of
+  // triangle coordinates (9 values per triangle). They are only used for queries on all surfaces.
+  // Returns false if the kernel is not supported (the scalar kernel is used then). Must not be called during queries.
+  bool SetLeafKernel( int kernel );
+  vtkGetMacro( LeafKernel, int );
+  // Returns the kernel that is actually used for the queries
+  vtkGetMacro( ActiveLeafKernel, int );
+
+  // Finds the closest point to x.
+  // If surfaceIndex is non-negative then only the triangles of the specified surface are considered.
+  // Returns the signed distance (negative inside), or VTK_DOUBLE_MAX if no triangles were found.
+  // closestSurfaceIndex is set to the index of the surface that contains the closest point (-1 if not found).
+  double FindClosestPoint( const double x[3], double closestPoint[3], int& closestSurfaceIndex, int surfaceIndex = -1 ) const;
+
+  // Finds the closest point pair between the line segment p0-p1 and the surfaces.
+  // Subtrees are pruned by the distance between the segment and the node bounding boxes,
+  // so the cost is similar to a point query (no sampling of the segment is needed).
+  // Returns the signed distance (negative if the closest point of the segment is inside),
+  // 0 if the segment intersects the surface, or VTK_DOUBLE_MAX if no triangles were found.
+  double FindClosestPointToSegment( const double p0[3], const double p1[3], double closestPointOnSegment[3],
+    double closestPoint[3], int& closestSurfaceIndex, int surfaceIndex = -1 ) const;
+
+protected:
+  vtkTriangleBVH();
+  ~vtkTriangleBVH();
+
+  struct Node
+  {
+    double Bounds[6];
+    // Index of the right child node (left child immediately follows the node). -1 for leaf nodes.
+    int RightChild;
+    // Range of triangles in leaf nodes
+    vtkIdType FirstTriangle;
+    vtkIdType NumberOfTriangles;
+  };
+
+  // Recursively builds the subtree of the specified triangle range (indices into triangleOrder), returns the node index
+  int BuildNode( std::vector< vtkIdType >& triangleOrder, vtkIdType firstTriangle, vtkIdType numberOfTriangles, const std::vector< double >& centroids );
+
+  // Copies (transformed) points and normals of the surface into Points and PointNormals, starting at firstPoint.
+  void CopySurfacePoints( vtkPolyData* surface, vtkAbstractTransform* transform, vtkIdType firstPoint );
+
+  // Fills TriangleCoordinates from Points and Triangles if a vectorized leaf kernel is active, clears it otherwise
+  void UpdateTriangleCoordinates();
+
+  void ComputeTriangleRangeBounds( const std::vector< vtkIdType >& triangleOrder, vtkIdType firstTriangle, vtkIdType numberOfTriangles, double bounds[6] ) const;
+
+  // Finds the closest triangle to x among triangles that are closer than sqrt(closestDistance2).
+  // On return closestDistance2, closestPoint, closestWeights (barycentric) and closestTriangle are updated
+  // if a closer triangle is found.
+  void FindClosestTriangle( const double x[3], int surfaceIndex, double& closestDistance2,
+    double closestPoint[3], double closestWeights[3], vtkIdType& closestTriangle ) const;
+
+  // Finds the closest triangle to the segment p0-p1 among triangles that are closer than sqrt(closestDistance2).
+  void FindClosestTriangleToSegment( const double p0[3], const double p1[3], int surfaceIndex, double& closestDistance2,
+    double closestPointOnSegment[3], double closestPoint[3], double closestWeights[3], vtkIdType& closestTriangle ) const;
+
+  // Returns the normal direction at the point defined by barycentric weights in the triangle.
+  void GetNormal( vtkIdType triangle, const double weights[3], double normal[3] ) const;
+
+  static double GetBoxDistance2( const double bounds[6], const double x[3] );
+  // Returns the squared distance between the box and the closest point of segment p0-p1 (0 if the segment intersects the box)
+  static double GetSegmentToBoxDistance2( const double bounds[6], const double p0[3], const double p1[3] );
+  static void GetClosestPointOnTriangle( const double x[3], const double a[3], const double b[3], const double c[3],
+    double closestPoint[3], double weights[3] );
+  // Computes closest points of segments p0-p1 and q0-q1, returns squared distance.
+  // s and t are the parameters of the closest points along the segments (0 at p0 and q0, 1 at p1 and q1).
+  static double GetClosestPointsOnSegments( const double p0[3], const double p1[3], const double q0[3], const double q1[3],
+    double& s, double& t, double closestPointOnP[3], double closestPointOnQ[3] );
+  // Computes closest points of segment p0-p1 and triangle a-b-c, returns squared distance (0 if they intersect).
+  static double GetClosestPointsOnSegmentAndTriangle( const double p0[3], const double p1[3],
+    const double a[3], const double b[3], const double c[3],
+    double closestPointOnSegment[3], double closestPointOnTriangle[3], double weights[3] );
+
+  int MaximumNumberOfTrianglesPerLeaf;
+  int LeafKernel;
+  int ActiveLeafKernel;
+
+  // Surfaces (triangulated) and corresponding transforms
+  std::vector< vtkSmartPointer< vtkPolyData > > Surfaces;
+  std::vector< vtkSmartPointer< vtkAbstractTransform > > SurfaceTransforms;
+
+  // Points of all surfaces (3 coordinates per point) and the index of the first point of each surface
+  std::vector< double > Points;
+  std::vector< double > PointNormals; // only valid for surfaces that have point normals
+  std::vector< vtkIdType > SurfaceFirstPoint;
+  std::vector< bool > SurfaceHasPointNormals;
+
+  // Triangles (3 point indices per triangle) in the order of leaf nodes, and index of the surface each triangle belongs to
+  std::vector< vtkIdType > Triangles;
+  std::vector< int > TriangleSurfaceIndices;
+
+  // Triangle vertex coordinates in the order of leaf nodes, in structure-of-arrays layout
+  // (x, y, z of vertex A, B, C; TriangleCoordinatesStride values each) for the vectorized leaf kernels
+  std::vector< double > TriangleCoordinates;
+  vtkIdType TriangleCoordinatesStride;
+
+  std::vector< Node > Nodes;
+
+private:
+  vtkTriangleBVH(const vtkTriangleBVH&); // Not implemented.
+  void operator=(const vtkTriangleBVH&); // Not implemented.
+};
+
+#endif
@@ -0,0 +1,453 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#include "vtkTriangleBVHLeafKernel.h"
+
+// SIMD kernels are only available on x86 processors. The AVX2 kernel is compiled with a function-level
+// target attribute (GCC, Clang) or with intrinsics that MSVC accepts without special compiler flags,
+// so that the module can be built for generic x86-64 and the kernel is selected at runtime.
+#if defined(__x86_64__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 ) || defined(__SSE2__)
+  #define TRIANGLE_BVH_SSE2_KERNEL
+  #include <emmintrin.h>
+  #if defined(_MSC_VER) && !defined(__clang__)
+    #define TRIANGLE_BVH_AVX2_KERNEL
+    #define TRIANGLE_BVH_AVX2_TARGET
+    #include <immintrin.h>
+    #include <intrin.h>
+  #elif defined(__GNUC__)
+    #define TRIANGLE_BVH_AVX2_KERNEL
+    #define TRIANGLE_BVH_AVX2_TARGET __attribute__((target("avx2")))
+    #include <immintrin.h>
+  #endif
+#endif
+
+// Offsets of the coordinate arrays, in units of stride
+enum
+{
+  AX = 0, AY, AZ,
+  BX, BY, BZ,
+  CX, CY, CZ
+};
+
+//----------------------------------------------------------------------------
+bool vtkTriangleBVHLeafKernel::IsKernelSupported( int kernel )
+{
+  switch ( kernel )
+  {
+  case KERNEL_SCALAR:
+    return true;
+  case KERNEL_SSE2:
+#ifdef TRIANGLE_BVH_SSE2_KERNEL
+    // SSE2 is part of the x86-64 instruction set
+    return true;
+#else
+    return false;
+#endif
+  case KERNEL_AVX2:
+#if defined(TRIANGLE_BVH_AVX2_KERNEL) && defined(_MSC_VER) && !defined(__clang__)
+    {
+      int cpuInfo[4] = { 0, 0, 0, 0 };
+      __cpuid( cpuInfo, 0 );
+      if ( cpuInfo[ 0 ] < 7 )
+      {
+        return false;
+      }
+      __cpuid( cpuInfo, 1 );
+      bool osUsesXsave = ( cpuInfo[ 2 ] & ( 1 << 27 ) ) != 0;
+      bool cpuSupportsAvx = ( cpuInfo[ 2 ] & ( 1 << 28 ) ) != 0;
+      if ( !osUsesXsave || !cpuSupportsAvx )
+      {
+        return false;
+      }
+      // Check that the operating system saves the AVX registers on context switch
+      if ( ( _xgetbv( 0 ) & 0x6 ) != 0x6 )
+      {
+        return false;
+      }
+      __cpuidex( cpuInfo, 7, 0 );
+      return ( cpuInfo[ 1 ] & ( 1 << 5 ) ) != 0;
+    }
+#elif defined(TRIANGLE_BVH_AVX2_KERNEL)
+    // Also checks that the operating system supports AVX registers
+    return __builtin_cpu_supports( "avx2" ) != 0;
+#else
+    return false;
+#endif
+  default:
+    return false;
+  }
+}
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVHLeafKernel::GetFastestSupportedKernel()
+{
+  for ( int kernel = KERNEL_LAST - 1; kernel > KERNEL_SCALAR; kernel-- )
+  {
+    if ( IsKernelSupported( kernel ) )
+    {
+      return kernel;
+    }
+  }
+  return KERNEL_SCALAR;
+}
+
+//----------------------------------------------------------------------------
+const char* vtkTriangleBVHLeafKernel::GetKernelName( int kernel )
+{
+  switch ( kernel )
+  {
+  case KERNEL_SCALAR: return "Scalar";
+  case KERNEL_SSE2: return "SSE2";
+  case KERNEL_AVX2: return "AVX2";
+  default: return "Invalid";
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkTriangleBVHLeafKernel::FindClosestTriangle( int kernel, const double* triangleCoordinates, vtkIdType stride,
+  vtkIdType firstTriangle, vtkIdType numberOfTriangles, const double x[3], double& closestDistance2 )
+{
+  switch ( kernel )
+  {
+#ifdef TRIANGLE_BVH_AVX2_KERNEL
+  case KERNEL_AVX2:
+    return FindClosestTriangleAVX2( triangleCoordinates, stride, firstTriangle, numberOfTriangles, x, closestDistance2 );
+#endif
+#ifdef TRIANGLE_BVH_SSE2_KERNEL
+  case KERNEL_SSE2:
+    return FindClosestTriangleSSE2( triangleCoordinates, stride, firstTriangle, numberOfTriangles, x, closestDistance2 );
+#endif
+  default:
+    return FindClosestTriangleScalar( triangleCoordinates, stride, firstTriangle, numberOfTriangles, x, closestDistance2 );
+  }
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkTriangleBVHLeafKernel::FindClosestTriangleScalar( const double* triangleCoordinates, vtkIdType stride,
+  vtkIdType firstTriangle, vtkIdType numberOfTriangles, const double x[3], double& closestDistance2 )
+{
+  // Same computation as vtkTriangleBVH::GetClosestPointOnTriangle, only the coordinates are read from the arrays
+  vtkIdType closestTriangle = -1;
+  for ( vtkIdType triangle = firstTriangle; triangle < firstTriangle + numberOfTriangles; triangle++ )
+  {
+    const double* t = triangleCoordinates + triangle;
+    double a[3] = { t[ AX * stride ], t[ AY * stride ], t[ AZ * stride ] };
+    double b[3] = { t[ BX * stride ], t[ BY * stride ], t[ BZ * stride ] };
+    double c[3] = { t[ CX * stride ], t[ CY * stride ], t[ CZ * stride ] };
+    double ab[3] = { b[ 0 ] - a[ 0 ], b[ 1 ] - a[ 1 ], b[ 2 ] - a[ 2 ] };
+    double ac[3] = { c[ 0 ] - a[ 0 ], c[ 1 ] - a[ 1 ], c[ 2 ] - a[ 2 ] };
+    double ax[3] = { x[ 0 ] - a[ 0 ], x[ 1 ] - a[ 1 ], x[ 2 ] - a[ 2 ] };
+    double bx[3] = { x[ 0 ] - b[ 0 ], x[ 1 ] - b[ 1 ], x[ 2 ] - b[ 2 ] };
+    double cx[3] = { x[ 0 ] - c[ 0 ], x[ 1 ] - c[ 1 ], x[ 2 ] - c[ 2 ] };
+    double d1 = ab[ 0 ] * ax[ 0 ] + ab[ 1 ] * ax[ 1 ] + ab[ 2 ] * ax[ 2 ];
+    double d2 = ac[ 0 ] * ax[ 0 ] + ac[ 1 ] * ax[ 1 ] + ac[ 2 ] * ax[ 2 ];
+    double d3 = ab[ 0 ] * bx[ 0 ] + ab[ 1 ] * bx[ 1 ] + ab[ 2 ] * bx[ 2 ];
+    double d4 = ac[ 0 ] * bx[ 0 ] + ac[ 1 ] * bx[ 1 ] + ac[ 2 ] * bx[ 2 ];
+    double d5 = ab[ 0 ] * cx[ 0 ] + ab[ 1 ] * cx[ 1 ] + ab[ 2 ] * cx[ 2 ];
+    double d6 = ac[ 0 ] * cx[ 0 ] + ac[ 1 ] * cx[ 1 ] + ac[ 2 ] * cx[ 2 ];
+    double vc = d1 * d4 - d3 * d2;
+    double vb = d5 * d2 - d1 * d6;
+    double va = d3 * d6 - d5 * d4;
+    double weights[3] = { 1.0, 0.0, 0.0 };
+    if ( d1 <= 0 && d2 <= 0 )
+    {
+      // vertex region of A
+    }
+    else if ( d3 >= 0 && d4 <= d3 )
+    {
+      weights[ 0 ] = 0.0; weights[ 1 ] = 1.0; weights[ 2 ] = 0.0;
+    }
+    else if ( vc <= 0 && d1 >= 0 && d3 <= 0 )
+    {
+      double v = d1 / ( d1 - d3 );
+      weights[ 0 ] = 1.0 - v; weights[ 1 ] = v; weights[ 2 ] = 0.0;
+    }
+    else if ( d6 >= 0 && d5 <= d6 )
+    {
+      weights[ 0 ] = 0.0; weights[ 1 ] = 0.0; weights[ 2 ] = 1.0;
+    }
+    else if ( vb <= 0 && d2 >= 0 && d6 <= 0 )
+    {
+      double w = d2 / ( d2 - d6 );
+      weights[ 0 ] = 1.0 - w; weights[ 1 ] = 0.0; weights[ 2 ] = w;
+    }
+    else if ( va <= 0 && ( d4 - d3 ) >= 0 && ( d5 - d6 ) >= 0 )
+    {
+      double w = ( d4 - d3 ) / ( ( d4 - d3 ) + ( d5 - d6 ) );
+      weights[ 0 ] = 0.0; weights[ 1 ] = 1.0 - w; weights[ 2 ] = w;
+    }
+    else if ( va + vb + vc > 0 )
+    {
+      double denominator = 1.0 / ( va + vb + vc );
+      double v = vb * denominator;
+      double w = vc * denominator;
+      weights[ 0 ] = 1.0 - v - w; weights[ 1 ] = v; weights[ 2 ] = w;
+    }
+    double distance2 = 0.0;
+    for ( int i = 0; i < 3; i++ )
+    {
+      double difference = x[ i ] - ( weights[ 0 ] * a[ i ] + weights[ 1 ] * b[ i ] + weights[ 2 ] * c[ i ] );
+      distance2 += difference * difference;
+    }
+    if ( distance2 < closestDistance2 )
+    {
+      closestDistance2 = distance2;
+      closestTriangle = triangle;
+    }
+  }
+  return closestTriangle;
+}
+
+#ifdef TRIANGLE_BVH_SSE2_KERNEL
+
+//----------------------------------------------------------------------------
+// Returns a where mask is set, b elsewhere (SSE2 has no blend instruction)
+static inline __m128d SelectSSE2( __m128d mask, __m128d a, __m128d b )
+{
+  return _mm_or_pd( _mm_and_pd( mask, a ), _mm_andnot_pd( mask, b ) );
+}
+
+//----------------------------------------------------------------------------
+vtkIdType vtkTriangleBVHLeafKernel::FindClosestTriangleSSE2( const double* triangleCoordinates, vtkIdType stride,
+  vtkIdType firstTriangle, vtkIdType numberOfTriangles, const double x[3], double& closestDistance2 )
+{
+  const int packetSize = 2;
+  vtkIdType closestTriangle = -1;
+  vtkIdType numberOfPacketTriangles = numberOfTriangles - numberOfTriangles % packetSize;
+  const __m128d zero = _mm_setzero_pd();
+  const __m128d one = _mm_set1_pd( 1.0 );
+  const __m128d xx = _mm_set1_pd( x[ 0 ] );
+  const __m128d xy = _mm_set1_pd( x[ 1 ] );
+  const __m128d xz = _mm_set1_pd( x[ 2 ] );
+  double packetDistance2[ packetSize ];
+  for ( vtkIdType triangle = firstTriangle; triangle < firstTriangle + numberOfPacketTriangles; triangle += packetSize )
+  {
+    const double* t = triangleCoordinates + triangle;
+    __m128d ax = _mm_loadu_pd( t + AX * stride );
+    __m128d ay = _mm_loadu_pd( t + AY * stride );
+    __m128d az = _mm_loadu_pd( t + AZ * stride );
+    __m128d bx = _mm_loadu_pd( t + BX * stride );
+    __m128d by = _mm_loadu_pd( t + BY * stride );
+    __m128d bz = _mm_loadu_pd( t + BZ * stride );
+    __m128d cx = _mm_loadu_pd( t + CX * stride );
+    __m128d cy = _mm_loadu_pd( t + CY * stride );
+    __m128d cz = _mm_loadu_pd( t + CZ * stride );
+
+    __m128d abx = _mm_sub_pd( bx, ax ), aby = _mm_sub_pd( by, ay ), abz = _mm_sub_pd( bz, az );
+    __m128d acx = _mm_sub_pd( cx, ax ), acy = _mm_sub_pd( cy, ay ), acz = _mm_sub_pd( cz, az );
+    __m128d axx = _mm_sub_pd( xx, ax ), axy = _mm_sub_pd( xy, ay ), axz = _mm_sub_pd( xz, az );
+    __m128d bxx = _mm_sub_pd( xx, bx ), bxy = _mm_sub_pd( xy, by ), bxz = _mm_sub_pd( xz, bz );
+    __m128d cxx = _mm_sub_pd( xx, cx ), cxy = _mm_sub_pd( xy, cy ), cxz = _mm_sub_pd( xz, cz );
+    __m128d d1 = _mm_add_pd( _mm_add_pd( _mm_mul_pd( abx, axx ), _mm_mul_pd( aby, axy ) ), _mm_mul_pd( abz, axz ) );
+    __m128d d2 = _mm_add_pd( _mm_add_pd( _mm_mul_pd( acx, axx ), _mm_mul_pd( acy, axy ) ), _mm_mul_pd( acz, axz ) );
+    __m128d d3 = _mm_add_pd( _mm_add_pd( _mm_mul_pd( abx, bxx ), _mm_mul_pd( aby, bxy ) ), _mm_mul_pd( abz, bxz ) );
+    __m128d d4 = _mm_add_pd( _mm_add_pd( _mm_mul_pd( acx, bxx ), _mm_mul_pd( acy, bxy ) ), _mm_mul_pd( acz, bxz ) );
+    __m128d d5 = _mm_add_pd( _mm_add_pd( _mm_mul_pd( abx, cxx ), _mm_mul_pd( aby, cxy ) ), _mm_mul_pd( abz, cxz ) );
+    __m128d d6 = _mm_add_pd( _mm_add_pd( _mm_mul_pd( acx, cxx ), _mm_mul_pd( acy, cxy ) ), _mm_mul_pd( acz, cxz ) );
+    __m128d vc = _mm_sub_pd( _mm_mul_pd( d1, d4 ), _mm_mul_pd( d3, d2 ) );
+    __m128d vb = _mm_sub_pd( _mm_mul_pd( d5, d2 ), _mm_mul_pd( d1, d6 ) );
+    __m128d va = _mm_sub_pd( _mm_mul_pd( d3, d6 ), _mm_mul_pd( d5, d4 ) );
+
+    // Regions are applied in reverse order of priority, so that the first matching region of the scalar code wins.
+    // Degenerate triangle: vertex A.
+    __m128d u = one, v = zero, w = zero;
+    // face region
+    __m128d vSum = _mm_add_pd( _mm_add_pd( va, vb ), vc );
+    __m128d mask = _mm_cmpgt_pd( vSum, zero );
+    __m128d denominator = _mm_div_pd( one, vSum );
+    __m128d faceV = _mm_mul_pd( vb, denominator );
+    __m128d faceW = _mm_mul_pd( vc, denominator );
+    u = SelectSSE2( mask, _mm_sub_pd( _mm_sub_pd( one, faceV ), faceW ), u );
+    v = SelectSSE2( mask, faceV, v );
+    w = SelectSSE2( mask, faceW, w );
+    // edge region of BC
+    __m128d d43 = _mm_sub_pd( d4, d3 );
+    __m128d d56 = _mm_sub_pd( d5, d6 );
+    mask = _mm_and_pd( _mm_cmple_pd( va, zero ), _mm_and_pd( _mm_cmpge_pd( d43, zero ), _mm_cmpge_pd( d56, zero ) ) );
+    __m128d edgeW = _mm_div_pd( d43, _mm_add_pd( d43, d56 ) );
+    u = SelectSSE2( mask, zero, u );
+    v = SelectSSE2( mask, _mm_sub_pd( one, edgeW ), v );
+    w = SelectSSE2( mask, edgeW, w );
+    // edge region of AC
+    mask = _mm_and_pd( _mm_cmple_pd( vb, zero ), _mm_and_pd( _mm_cmpge_pd( d2, zero ), _mm_cmple_pd( d6, zero ) ) );
+    edgeW = _mm_div_pd( d2, _mm_sub_pd( d2, d6 ) );
+    u = SelectSSE2( mask, _mm_sub_pd( one, edgeW ), u );
+    v = SelectSSE2( mask, zero, v );
+    w = SelectSSE2( mask, edgeW, w );
+    // vertex region of C
+    mask = _mm_and_pd( _mm_cmpge_pd( d6, zero ), _mm_cmple_pd( d5, d6 ) );
+    u = SelectSSE2( mask, zero, u );
+    v = SelectSSE2( mask, zero, v );
+    w = SelectSSE2( mask, one, w );
+    // edge region of AB
+    mask = _mm_and_pd( _mm_cmple_pd( vc, zero ), _mm_and_pd( _mm_cmpge_pd( d1, zero ), _mm_cmple_pd( d3, zero ) ) );
+    __m128d edgeV = _mm_div_pd( d1, _mm_sub_pd( d1, d3 ) );
+    u = SelectSSE2( mask, _mm_sub_pd( one, edgeV ), u );
+    v = SelectSSE2( mask, edgeV, v );
+    w = SelectSSE2( mask, zero, w );
+    // vertex region of B
+    mask = _mm_and_pd( _mm_cmpge_pd( d3, zero ), _mm_cmple_pd( d4, d3 ) );
+    u = SelectSSE2( mask, zero, u );
+    v = SelectSSE2( mask, one, v );
+    w = SelectSSE2( mask, zero, w );
+    // vertex region of A
+    mask = _mm_and_pd( _mm_cmple_pd( d1, zero ), _mm_cmple_pd( d2, zero ) );
+    u = SelectSSE2( mask, one, u );
+    v = SelectSSE2( mask, zero, v );
+    w = SelectSSE2( mask, zero, w );
+
+    __m128d px = _mm_add_pd( _mm_add_pd( _mm_mul_pd( u, ax ), _mm_mul_pd( v, bx ) ), _mm_mul_pd( w, cx ) );
+    __m128d py = _mm_add_pd( _mm_add_pd( _mm_mul_pd( u, ay ), _mm_mul_pd( v, by ) ), _mm_mul_pd( w, cy ) );
+    __m128d pz = _mm_add_pd( _mm_add_pd( _mm_mul_pd( u, az ), _mm_mul_pd( v, bz ) ), _mm_mul_pd( w, cz ) );
+    __m128d dx = _mm_sub_pd( xx, px ), dy = _mm_sub_pd( xy, py ), dz = _mm_sub_pd( xz, pz );
+    __m128d distance2 = _mm_add_pd( _mm_add_pd( _mm_mul_pd( dx, dx ), _mm_mul_pd( dy, dy ) ), _mm_mul_pd( dz, dz ) );
+    _mm_storeu_pd( packetDistance2, distance2 );
+    for ( int lane = 0; lane < packetSize; lane++ )
+    {
+      if ( packetDistance2[ lane ] < closestDistance2 )
+      {
+        closestDistance2 = packetDistance2[ lane ];
+        closestTriangle = triangle + lane;
+      }
+    }
+  }
+
+  // Remaining triangles that do not fill a packet
+  vtkIdType remainingTriangle = FindClosestTriangleScalar( triangleCoordinates, stride,
+    firstTriangle + numberOfPacketTriangles, numberOfTriangles - numberOfPacketTriangles, x, closestDistance2 );
+  return ( remainingTriangle >= 0 ) ? remainingTriangle : closestTriangle;
+}
+
+#endif
+
+#ifdef TRIANGLE_BVH_AVX2_KERNEL
+
+//----------------------------------------------------------------------------
+// Same computation as FindClosestTriangleSSE2, with 4 triangles in a packet
+TRIANGLE_BVH_AVX2_TARGET
+vtkIdType vtkTriangleBVHLeafKernel::FindClosestTriangleAVX2( const double* triangleCoordinates, vtkIdType stride,
+  vtkIdType firstTriangle, vtkIdType numberOfTriangles, const double x[3], double& closestDistance2 )
+{
+  const int packetSize = 4;
+  vtkIdType closestTriangle = -1;
+  vtkIdType numberOfPacketTriangles = numberOfTriangles - numberOfTriangles % packetSize;
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d one = _mm256_set1_pd( 1.0 );
+  const __m256d xx = _mm256_set1_pd( x[ 0 ] );
+  const __m256d xy = _mm256_set1_pd( x[ 1 ] );
+  const __m256d xz = _mm256_set1_pd( x[ 2 ] );
+  double packetDistance2[ packetSize ];
+  for ( vtkIdType triangle = firstTriangle; triangle < firstTriangle + numberOfPacketTriangles; triangle += packetSize )
+  {
+    const double* t = triangleCoordinates + triangle;
+    __m256d ax = _mm256_loadu_pd( t + AX * stride );
+    __m256d ay = _mm256_loadu_pd( t + AY * stride );
+    __m256d az = _mm256_loadu_pd( t + AZ * stride );
+    __m256d bx = _mm256_loadu_pd( t + BX * stride );
+    __m256d by = _mm256_loadu_pd( t + BY * stride );
+    __m256d bz = _mm256_loadu_pd( t + BZ * stride );
+    __m256d cx = _mm256_loadu_pd( t + CX * stride );
+    __m256d cy = _mm256_loadu_pd( t + CY * stride );
+    __m256d cz = _mm256_loadu_pd( t + CZ * stride );
+
+    __m256d abx = _mm256_sub_pd( bx, ax ), aby = _mm256_sub_pd( by, ay ), abz = _mm256_sub_pd( bz, az );
+    __m256d acx = _mm256_sub_pd( cx, ax ), acy = _mm256_sub_pd( cy, ay ), acz = _mm256_sub_pd( cz, az );
+    __m256d axx = _mm256_sub_pd( xx, ax ), axy = _mm256_sub_pd( xy, ay ), axz = _mm256_sub_pd( xz, az );
+    __m256d bxx = _mm256_sub_pd( xx, bx ), bxy = _mm256_sub_pd( xy, by ), bxz = _mm256_sub_pd( xz, bz );
+    __m256d cxx = _mm256_sub_pd( xx, cx ), cxy = _mm256_sub_pd( xy, cy ), cxz = _mm256_sub_pd( xz, cz );
+    __m256d d1 = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( abx, axx ), _mm256_mul_pd( aby, axy ) ), _mm256_mul_pd( abz, axz ) );
+    __m256d d2 = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( acx, axx ), _mm256_mul_pd( acy, axy ) ), _mm256_mul_pd( acz, axz ) );
+    __m256d d3 = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( abx, bxx ), _mm256_mul_pd( aby, bxy ) ), _mm256_mul_pd( abz, bxz ) );
+    __m256d d4 = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( acx, bxx ), _mm256_mul_pd( acy, bxy ) ), _mm256_mul_pd( acz, bxz ) );
+    __m256d d5 = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( abx, cxx ), _mm256_mul_pd( aby, cxy ) ), _mm256_mul_pd( abz, cxz ) );
+    __m256d d6 = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( acx, cxx ), _mm256_mul_pd( acy, cxy ) ), _mm256_mul_pd( acz, cxz ) );
+    __m256d vc = _mm256_sub_pd( _mm256_mul_pd( d1, d4 ), _mm256_mul_pd( d3, d2 ) );
+    __m256d vb = _mm256_sub_pd( _mm256_mul_pd( d5, d2 ), _mm256_mul_pd( d1, d6 ) );
+    __m256d va = _mm256_sub_pd( _mm256_mul_pd( d3, d6 ), _mm256_mul_pd( d5, d4 ) );
+
+    // degenerate triangle
+    __m256d u = one, v = zero, w = zero;
+    // face region
+    __m256d vSum = _mm256_add_pd( _mm256_add_pd( va, vb ), vc );
+    __m256d mask = _mm256_cmp_pd( vSum, zero, _CMP_GT_OQ );
+    __m256d denominator = _mm256_div_pd( one, vSum );
+    __m256d faceV = _mm256_mul_pd( vb, denominator );
+    __m256d faceW = _mm256_mul_pd( vc, denominator );
+    u = _mm256_blendv_pd( u, _mm256_sub_pd( _mm256_sub_pd( one, faceV ), faceW ), mask );
+    v = _mm256_blendv_pd( v, faceV, mask );
+    w = _mm256_blendv_pd( w, faceW, mask );
+    // edge region of BC
+    __m256d d43 = _mm256_sub_pd( d4, d3 );
+    __m256d d56 = _mm256_sub_pd( d5, d6 );
+    mask = _mm256_and_pd( _mm256_cmp_pd( va, zero, _CMP_LE_OQ ),
+      _mm256_and_pd( _mm256_cmp_pd( d43, zero, _CMP_GE_OQ ), _mm256_cmp_pd( d56, zero, _CMP_GE_OQ ) ) );
+    __m256d edgeW = _mm256_div_pd( d43, _mm256_add_pd( d43, d56 ) );
+    u = _mm256_blendv_pd( u, zero, mask );
+    v = _mm256_blendv_pd( v, _mm256_sub_pd( one, edgeW ), mask );
+    w = _mm256_blendv_pd( w, edgeW, mask );
+    // edge region of AC
+    mask = _mm256_and_pd( _mm256_cmp_pd( vb, zero, _CMP_LE_OQ ),
+      _mm256_and_pd( _mm256_cmp_pd( d2, zero, _CMP_GE_OQ ), _mm256_cmp_pd( d6, zero, _CMP_LE_OQ ) ) );
+    edgeW = _mm256_div_pd( d2, _mm256_sub_pd( d2, d6 ) );
+    u = _mm256_blendv_pd( u, _mm256_sub_pd( one, edgeW ), mask );
+    v = _mm256_blendv_pd( v, zero, mask );
+    w = _mm256_blendv_pd( w, edgeW, mask );
+    // vertex region of C
+    mask = _mm256_and_pd( _mm256_cmp_pd( d6, zero, _CMP_GE_OQ ), _mm256_cmp_pd( d5, d6, _CMP_LE_OQ ) );
+    u = _mm256_blendv_pd( u, zero, mask );
+    v = _mm256_blendv_pd( v, zero, mask );
+    w = _mm256_blendv_pd( w, one, mask );
+    // edge region of AB
+    mask = _mm256_and_pd( _mm256_cmp_pd( vc, zero, _CMP_LE_OQ ),
+      _mm256_and_pd( _mm256_cmp_pd( d1, zero, _CMP_GE_OQ ), _mm256_cmp_pd( d3, zero, _CMP_LE_OQ ) ) );
+    __m256d edgeV = _mm256_div_pd( d1, _mm256_sub_pd( d1, d3 ) );
+    u = _mm256_blendv_pd( u, _mm256_sub_pd( one, edgeV ), mask );
+    v = _mm256_blendv_pd( v, edgeV, mask );
+    w = _mm256_blendv_pd( w, zero, mask );
+    // vertex region of B
+    mask = _mm256_and_pd( _mm256_cmp_pd( d3, zero, _CMP_GE_OQ ), _mm256_cmp_pd( d4, d3, _CMP_LE_OQ ) );
+    u = _mm256_blendv_pd( u, zero, mask );
+    v = _mm256_blendv_pd( v, one, mask );
+    w = _mm256_blendv_pd( w, zero, mask );
+    // vertex region of A
+    mask = _mm256_and_pd( _mm256_cmp_pd( d1, zero, _CMP_LE_OQ ), _mm256_cmp_pd( d2, zero, _CMP_LE_OQ ) );
+    u = _mm256_blendv_pd( u, one, mask );
+    v = _mm256_blendv_pd( v, zero, mask );
+    w = _mm256_blendv_pd( w, zero, mask );
+
+    __m256d px = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( u, ax ), _mm256_mul_pd( v, bx ) ), _mm256_mul_pd( w, cx ) );
+    __m256d py = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( u, ay ), _mm256_mul_pd( v, by ) ), _mm256_mul_pd( w, cy ) );
+    __m256d pz = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( u, az ), _mm256_mul_pd( v, bz ) ), _mm256_mul_pd( w, cz ) );
+    __m256d dx = _mm256_sub_pd( xx, px ), dy = _mm256_sub_pd( xy, py ), dz = _mm256_sub_pd( xz, pz );
+    __m256d distance2 = _mm256_add_pd( _mm256_add_pd( _mm256_mul_pd( dx, dx ), _mm256_mul_pd( dy, dy ) ), _mm256_mul_pd( dz, dz ) );
+    _mm256_storeu_pd( packetDistance2, distance2 );
+    for ( int lane = 0; lane < packetSize; lane++ )
+    {
+      if ( packetDistance2[ lane ] < closestDistance2 )
+      {
+        closestDistance2 = packetDistance2[ lane ];
+        closestTriangle = triangle + lane;
+      }
+    }
+  }
+
+  vtkIdType remainingTriangle = FindClosestTriangleScalar( triangleCoordinates, stride,
+    firstTriangle + numberOfPacketTriangles, numberOfTriangles - numberOfPacketTriangles, x, closestDistance2 );
+  return ( remainingTriangle >= 0 ) ? remainingTriangle : closestTriangle;
+}
+
+#endif
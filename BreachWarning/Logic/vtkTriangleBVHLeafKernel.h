@@ -0,0 +1,64 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+#ifndef __vtkTriangleBVHLeafKernel_h
+#define __vtkTriangleBVHLeafKernel_h
+
+#include <vtkType.h>
+
+// Point-triangle distance computation for a range of triangles in a leaf node of vtkTriangleBVH.
+// Triangles are stored in structure-of-arrays layout: 9 arrays (x, y, z coordinates of vertex A, B, C) of stride length,
+// so that the same coordinate of consecutive triangles can be loaded into one SIMD register.
+// The kernels perform exactly the same floating-point operations as vtkTriangleBVH::GetClosestPointOnTriangle,
+// therefore all kernels return the same triangle and distance.
+// Only the squared distance is computed, the closest point of the selected triangle has to be computed by the caller.
+class vtkTriangleBVHLeafKernel
+{
+public:
+  enum KernelType
+  {
+    KERNEL_SCALAR = 0,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_LAST // must be last
+  };
+
+  // Returns true if the kernel is compiled in and the processor can run it
+  static bool IsKernelSupported( int kernel );
+
+  // Returns the fastest kernel that the processor can run
+  static int GetFastestSupportedKernel();
+
+  static const char* GetKernelName( int kernel );
+
+  // Finds the closest triangle to x in the range [firstTriangle, firstTriangle+numberOfTriangles)
+  // among the triangles that are closer than sqrt(closestDistance2).
+  // Returns the index of the triangle and updates closestDistance2. Returns -1 if no closer triangle is found.
+  // The kernel must be supported.
+  static vtkIdType FindClosestTriangle( int kernel, const double* triangleCoordinates, vtkIdType stride,
+    vtkIdType firstTriangle, vtkIdType numberOfTriangles, const double x[3], double& closestDistance2 );
+
+protected:
+  static vtkIdType FindClosestTriangleScalar( const double* triangleCoordinates, vtkIdType stride,
+    vtkIdType firstTriangle, vtkIdType numberOfTriangles, const double x[3], double& closestDistance2 );
+  static vtkIdType FindClosestTriangleSSE2( const double* triangleCoordinates, vtkIdType stride,
+    vtkIdType firstTriangle, vtkIdType numberOfTriangles, const double x[3], double& closestDistance2 );
+  static vtkIdType FindClosestTriangleAVX2( const double* triangleCoordinates, vtkIdType stride,
+    vtkIdType firstTriangle, vtkIdType numberOfTriangles, const double x[3], double& closestDistance2 );
+};
+
+#endif
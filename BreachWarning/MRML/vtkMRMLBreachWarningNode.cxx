@@ -51,12 +51,39 @@ vtkMRMLBreachWarningNode::vtkMRMLBreachWarningNode()
   this->DisplayWarningColor = true;
   this->PlayWarningSound = false;
 
+  this->UseSignedDistanceField = false;
+  this->SignedDistanceFieldSpacingMm = 2.0;
+  this->SignedDistanceFieldMarginMm = 20.0;
+
+  this->UseLevelOfDetail = false;
+  this->LevelOfDetailTargetReduction = 0.9;
+  this->LevelOfDetailRefinementDistanceMm = 10.0;
+
+  this->ToolShaftLengthMm = 0.0;
+  this->ToolShaftRadiusMm = 0.0;
+
   this->ClosestDistanceToModelFromToolTip = 0.0;
 
   this->ClosestPointOnModel[0] = 0.0;
   this->ClosestPointOnModel[1] = 0.0;
   this->ClosestPointOnModel[2] = 0.0;
 
+  this->ClosestWatchedModelIndex = -1;
+
+  this->ClosestDistanceToModelFromToolShaft = 0.0;
+  this->ClosestWatchedModelIndexToToolShaft = -1;
+  for (int i=0; i<3; i++)
+  {
+    this->ClosestPointOnToolShaft[i] = 0.0;
+    this->ClosestPointOnModelFromToolShaft[i] = 0.0;
+  }
+
+  this->VelocityEstimationTimeWindowSec = 0.3;
+  this->TimeToBreachWarningThresholdSec = 0.0;
+  this->EstimatedTimeToBreachSec = -1.0;
+  this->ClearToolTipPositionHistory();
+
+  this->CurrentDistanceBandIndex = -1;
 }
 
 //------------------------------------------------------------------------------
@@ -74,8 +101,55 @@ void vtkMRMLBreachWarningNode::WriteXML( ostream& of, int nIndent )
   of << indent << " originalColor=\"" << this->OriginalColor[0] << " " << this->OriginalColor[1] << " " << this->OriginalColor[2] << "\"";
   of << indent << " displayWarningColor=\"" << ( this->DisplayWarningColor ? "true" : "false" ) << "\"";
   of << indent << " playWarningSound=\"" << ( this->PlayWarningSound ? "true" : "false" ) << "\"";
+  of << indent << " useSignedDistanceField=\"" << ( this->UseSignedDistanceField ? "true" : "false" ) << "\"";
+  of << indent << " signedDistanceFieldSpacingMm=\"" << this->SignedDistanceFieldSpacingMm << "\"";
+  of << indent << " signedDistanceFieldMarginMm=\"" << this->SignedDistanceFieldMarginMm << "\"";
+  of << indent << " useLevelOfDetail=\"" << ( this->UseLevelOfDetail ? "true" : "false" ) << "\"";
+  of << indent << " levelOfDetailTargetReduction=\"" << this->LevelOfDetailTargetReduction << "\"";
+  of << indent << " levelOfDetailRefinementDistanceMm=\"" << this->LevelOfDetailRefinementDistanceMm << "\"";
+  of << indent << " toolShaftLengthMm=\"" << this->ToolShaftLengthMm << "\"";
+  of << indent << " toolShaftRadiusMm=\"" << this->ToolShaftRadiusMm << "\"";
+  of << indent << " velocityEstimationTimeWindowSec=\"" << this->VelocityEstimationTimeWindowSec << "\"";
+  of << indent << " timeToBreachWarningThresholdSec=\"" << this->TimeToBreachWarningThresholdSec << "\"";
   of << indent << " closestDistanceToModelFromToolTip=\"" << ClosestDistanceToModelFromToolTip << "\"";
   of << indent << " closestPointOnModel=\"" << this->ClosestPointOnModel[0] << " " << this->ClosestPointOnModel[1] << " " << this->ClosestPointOnModel[2] << "\"";
+  of << indent << " closestWatchedModelIndex=\"" << this->ClosestWatchedModelIndex << "\"";
+  if (!this->AdditionalWatchedModelOriginalColors.empty())
+  {
+    of << indent << " additionalWatchedModelOriginalColors=\"";
+    for (std::vector<double>::iterator it=this->AdditionalWatchedModelOriginalColors.begin(); it!=this->AdditionalWatchedModelOriginalColors.end(); ++it)
+    {
+      of << (it==this->AdditionalWatchedModelOriginalColors.begin() ? "" : " ") << (*it);
+    }
+    of << "\"";
+  }
+  if (!this->DistanceBands.empty())
+  {
+    // threshold, color, and sound of each band
+    of << indent << " distanceBands=\"";
+    for (std::vector<DistanceBand>::iterator it=this->DistanceBands.begin(); it!=this->DistanceBands.end(); ++it)
+    {
+      of << (it==this->DistanceBands.begin() ? "" : " ") << it->ThresholdMm
+        << " " << it->Color[0] << " " << it->Color[1] << " " << it->Color[2]
+        << " " << (it->PlaySound ? 1 : 0);
+    }
+    of << "\"";
+    // sound file names may contain spaces, so they are stored separately (separated by semicolons)
+    bool customSound = false;
+    for (std::vector<DistanceBand>::iterator it=this->DistanceBands.begin(); it!=this->DistanceBands.end(); ++it)
+    {
+      customSound |= !it->Sound.empty();
+    }
+    if (customSound)
+    {
+      of << indent << " distanceBandSounds=\"";
+      for (std::vector<DistanceBand>::iterator it=this->DistanceBands.begin(); it!=this->DistanceBands.end(); ++it)
+      {
+        of << (it==this->DistanceBands.begin() ? "" : ";") << it->Sound;
+      }
+      of << "\"";
+    }
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -138,6 +212,92 @@ void vtkMRMLBreachWarningNode::ReadXMLAttributes( const char** atts )
         this->PlayWarningSound = false;
       }
     }
+    else if ( ! strcmp( attName, "useSignedDistanceField" ) )
+    {
+      if (!strcmp(attValue,"true"))
+      {
+        this->UseSignedDistanceField = true;
+      }
+      else
+      {
+        this->UseSignedDistanceField = false;
+      }
+    }
+    else if (!strcmp(attName, "signedDistanceFieldSpacingMm"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=2.0;
+      ss >> val;
+      this->SignedDistanceFieldSpacingMm = val;
+    }
+    else if (!strcmp(attName, "signedDistanceFieldMarginMm"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=20.0;
+      ss >> val;
+      this->SignedDistanceFieldMarginMm = val;
+    }
+    else if ( ! strcmp( attName, "useLevelOfDetail" ) )
+    {
+      if (!strcmp(attValue,"true"))
+      {
+        this->UseLevelOfDetail = true;
+      }
+      else
+      {
+        this->UseLevelOfDetail = false;
+      }
+    }
+    else if (!strcmp(attName, "levelOfDetailTargetReduction"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=0.9;
+      ss >> val;
+      this->LevelOfDetailTargetReduction = val;
+    }
+    else if (!strcmp(attName, "levelOfDetailRefinementDistanceMm"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=10.0;
+      ss >> val;
+      this->LevelOfDetailRefinementDistanceMm = val;
+    }
+    else if (!strcmp(attName, "toolShaftLengthMm"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=0.0;
+      ss >> val;
+      this->ToolShaftLengthMm = val;
+    }
+    else if (!strcmp(attName, "toolShaftRadiusMm"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=0.0;
+      ss >> val;
+      this->ToolShaftRadiusMm = val;
+    }
+    else if (!strcmp(attName, "velocityEstimationTimeWindowSec"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=0.3;
+      ss >> val;
+      this->VelocityEstimationTimeWindowSec = val;
+    }
+    else if (!strcmp(attName, "timeToBreachWarningThresholdSec"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      double val=0.0;
+      ss >> val;
+      this->TimeToBreachWarningThresholdSec = val;
+    }
     else if (!strcmp(attName, "closestDistanceToModelFromToolTip"))
     {
       std::stringstream ss;
@@ -158,6 +318,49 @@ void vtkMRMLBreachWarningNode::ReadXMLAttributes( const char** atts )
       ss >> val;
       this->ClosestPointOnModel[2] = val;
     }
+    else if (!strcmp(attName, "closestWatchedModelIndex"))
+    {
+      std::stringstream ss;
+      ss << attValue;
+      int val=-1;
+      ss >> val;
+      this->ClosestWatchedModelIndex = val;
+    }
+    else if (!strcmp(attName, "additionalWatchedModelOriginalColors"))
+    {
+      this->AdditionalWatchedModelOriginalColors.clear();
+      std::stringstream ss;
+      ss << attValue;
+      double val;
+      while (ss >> val)
+      {
+        this->AdditionalWatchedModelOriginalColors.push_back(val);
+      }
+    }
+    else if (!strcmp(attName, "distanceBands"))
+    {
+      this->DistanceBands.clear();
+      std::stringstream ss;
+      ss << attValue;
+      DistanceBand band;
+      int playSound = 0;
+      while (ss >> band.ThresholdMm >> band.Color[0] >> band.Color[1] >> band.Color[2] >> playSound)
+      {
+        band.PlaySound = (playSound!=0);
+        this->DistanceBands.push_back(band);
+      }
+    }
+    else if (!strcmp(attName, "distanceBandSounds"))
+    {
+      // written after distanceBands, one entry for each band
+      std::stringstream ss;
+      ss << attValue;
+      std::string sound;
+      for (unsigned int i=0; i<this->DistanceBands.size() && std::getline(ss, sound, ';'); i++)
+      {
+        this->DistanceBands[i].Sound = sound;
+      }
+    }
   }
 }
 
@@ -176,6 +379,18 @@ void vtkMRMLBreachWarningNode::Copy( vtkMRMLNode *anode )
 
   this->PlayWarningSound = node->PlayWarningSound;  
   this->DisplayWarningColor = node->DisplayWarningColor;
+  this->UseSignedDistanceField = node->UseSignedDistanceField;
+  this->SignedDistanceFieldSpacingMm = node->SignedDistanceFieldSpacingMm;
+  this->SignedDistanceFieldMarginMm = node->SignedDistanceFieldMarginMm;
+  this->UseLevelOfDetail = node->UseLevelOfDetail;
+  this->LevelOfDetailTargetReduction = node->LevelOfDetailTargetReduction;
+  this->LevelOfDetailRefinementDistanceMm = node->LevelOfDetailRefinementDistanceMm;
+  this->AdditionalWatchedModelOriginalColors = node->AdditionalWatchedModelOriginalColors;
+  this->ToolShaftLengthMm = node->ToolShaftLengthMm;
+  this->ToolShaftRadiusMm = node->ToolShaftRadiusMm;
+  this->VelocityEstimationTimeWindowSec = node->VelocityEstimationTimeWindowSec;
+  this->TimeToBreachWarningThresholdSec = node->TimeToBreachWarningThresholdSec;
+  this->DistanceBands = node->DistanceBands;
 
   this->Modified();
 }
@@ -187,12 +402,38 @@ void vtkMRMLBreachWarningNode::PrintSelf( ostream& os, vtkIndent indent )
 
   os << indent << "WatchedModelID: " << (this->GetWatchedModelNode() && this->GetWatchedModelNode()->GetID() ?
    this->GetWatchedModelNode()->GetID() : "(none)" ) << std::endl;
+  for (int i=1; i<this->GetNumberOfWatchedModelNodes(); i++)
+  {
+    os << indent << "WatchedModelID[" << i << "]: " << (this->GetNthWatchedModelNodeID(i) ? this->GetNthWatchedModelNodeID(i) : "(none)" ) << std::endl;
+  }
+  os << indent << "ClosestWatchedModelIndex: " << this->ClosestWatchedModelIndex << std::endl;
   os << indent << "ToolTipTransformID: " << (this->GetToolTransformNode() && this->GetToolTransformNode()->GetID() ?
    this->GetToolTransformNode()->GetID() : "(none)" ) << std::endl;
   os << indent << "LineToClosestPointID: " << (this->GetLineToClosestPointNode() && this->GetLineToClosestPointNode()->GetID() ?
    this->GetLineToClosestPointNode()->GetID() : "(none)" ) << std::endl;
   os << indent << "DisplayWarningColor: " << this->DisplayWarningColor << std::endl;
   os << indent << "PlayWarningSound: " << this->PlayWarningSound << std::endl;
+  os << indent << "UseSignedDistanceField: " << this->UseSignedDistanceField << std::endl;
+  os << indent << "SignedDistanceFieldSpacingMm: " << this->SignedDistanceFieldSpacingMm << std::endl;
+  os << indent << "SignedDistanceFieldMarginMm: " << this->SignedDistanceFieldMarginMm << std::endl;
+  os << indent << "UseLevelOfDetail: " << this->UseLevelOfDetail << std::endl;
+  os << indent << "LevelOfDetailTargetReduction: " << this->LevelOfDetailTargetReduction << std::endl;
+  os << indent << "LevelOfDetailRefinementDistanceMm: " << this->LevelOfDetailRefinementDistanceMm << std::endl;
+  os << indent << "ToolShaftLengthMm: " << this->ToolShaftLengthMm << std::endl;
+  os << indent << "ToolShaftRadiusMm: " << this->ToolShaftRadiusMm << std::endl;
+  os << indent << "ClosestDistanceToModelFromToolShaft: " << this->ClosestDistanceToModelFromToolShaft << std::endl;
+  os << indent << "VelocityEstimationTimeWindowSec: " << this->VelocityEstimationTimeWindowSec << std::endl;
+  os << indent << "TimeToBreachWarningThresholdSec: " << this->TimeToBreachWarningThresholdSec << std::endl;
+  os << indent << "EstimatedTimeToBreachSec: " << this->EstimatedTimeToBreachSec << std::endl;
+  os << indent << "NumberOfToolTipPositionsInHistory: " << this->ToolTipHistoryCount << std::endl;
+  for (unsigned int i=0; i<this->DistanceBands.size(); i++)
+  {
+    os << indent << "DistanceBand[" << i << "]: threshold=" << this->DistanceBands[i].ThresholdMm
+      << ", color=" << this->DistanceBands[i].Color[0] << ", " << this->DistanceBands[i].Color[1] << ", " << this->DistanceBands[i].Color[2]
+      << ", playSound=" << this->DistanceBands[i].PlaySound
+      << ", sound=" << (this->DistanceBands[i].Sound.empty() ? "(default)" : this->DistanceBands[i].Sound) << std::endl;
+  }
+  os << indent << "CurrentDistanceBandIndex: " << this->CurrentDistanceBandIndex << std::endl;
   os << indent << "WarningColor: " << this->WarningColor[0] << ", " << this->WarningColor[1] << ", " << this->WarningColor[2] << std::endl;
   os << indent << "OriginalColor: " << this->OriginalColor[0] << ", " << this->OriginalColor[1] << ", " << this->OriginalColor[2] << std::endl;
 }
@@ -226,6 +467,128 @@ void vtkMRMLBreachWarningNode::SetAndObserveWatchedModelNodeID( const char* mode
   this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
 }
 
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetNumberOfWatchedModelNodes()
+{
+  return this->GetNumberOfNodeReferences( MODEL_ROLE );
+}
+
+//------------------------------------------------------------------------------
+vtkMRMLModelNode* vtkMRMLBreachWarningNode::GetNthWatchedModelNode( int n )
+{
+  return vtkMRMLModelNode::SafeDownCast( this->GetNthNodeReference( MODEL_ROLE, n ) );
+}
+
+//------------------------------------------------------------------------------
+const char* vtkMRMLBreachWarningNode::GetNthWatchedModelNodeID( int n )
+{
+  return this->GetNthNodeReferenceID( MODEL_ROLE, n );
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::AddAndObserveWatchedModelNodeID( const char* modelId )
+{
+  if (modelId==NULL)
+  {
+    return;
+  }
+  for (int i=0; i<this->GetNumberOfWatchedModelNodes(); i++)
+  {
+    const char* currentNodeId=this->GetNthWatchedModelNodeID(i);
+    if (currentNodeId!=NULL && strcmp(modelId,currentNodeId)==0)
+    {
+      // already watched
+      return;
+    }
+  }
+  vtkNew<vtkIntArray> events;
+  events->InsertNextValue( vtkCommand::ModifiedEvent );
+  events->InsertNextValue( vtkMRMLTransformNode::TransformModifiedEvent );
+  this->AddAndObserveNodeReferenceID( MODEL_ROLE, modelId, events.GetPointer() );
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::RemoveNthWatchedModelNodeID( int n )
+{
+  if (n<0 || n>=this->GetNumberOfWatchedModelNodes())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::RemoveNthWatchedModelNodeID failed: invalid index "<<n);
+    return;
+  }
+  // Keep original colors in sync with the model list
+  if (n==0)
+  {
+    double nextOriginalColor[3]={0.5,0.5,0.5};
+    this->GetNthWatchedModelOriginalColor(1, nextOriginalColor);
+    this->OriginalColor[0]=nextOriginalColor[0];
+    this->OriginalColor[1]=nextOriginalColor[1];
+    this->OriginalColor[2]=nextOriginalColor[2];
+  }
+  unsigned int firstRemovedComponent = 3*(n>0 ? n-1 : 0);
+  if (firstRemovedComponent+3<=this->AdditionalWatchedModelOriginalColors.size())
+  {
+    this->AdditionalWatchedModelOriginalColors.erase(this->AdditionalWatchedModelOriginalColors.begin()+firstRemovedComponent,
+      this->AdditionalWatchedModelOriginalColors.begin()+firstRemovedComponent+3);
+  }
+  this->RemoveNthNodeReferenceID( MODEL_ROLE, n );
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::GetNthWatchedModelOriginalColor( int n, double color[3] )
+{
+  if (n==0)
+  {
+    this->GetOriginalColor(color);
+    return;
+  }
+  unsigned int firstComponent = 3*(n-1);
+  if (n<0 || firstComponent+3>this->AdditionalWatchedModelOriginalColors.size())
+  {
+    // not stored, use default
+    color[0]=0.5;
+    color[1]=0.5;
+    color[2]=0.5;
+    return;
+  }
+  color[0]=this->AdditionalWatchedModelOriginalColors[firstComponent];
+  color[1]=this->AdditionalWatchedModelOriginalColors[firstComponent+1];
+  color[2]=this->AdditionalWatchedModelOriginalColors[firstComponent+2];
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetNthWatchedModelOriginalColor( int n, double color[3] )
+{
+  if (n<0)
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::SetNthWatchedModelOriginalColor failed: invalid index "<<n);
+    return;
+  }
+  if (n==0)
+  {
+    this->SetOriginalColor(color);
+    return;
+  }
+  unsigned int firstComponent = 3*(n-1);
+  if (firstComponent+3>this->AdditionalWatchedModelOriginalColors.size())
+  {
+    this->AdditionalWatchedModelOriginalColors.resize(firstComponent+3, 0.5);
+  }
+  else if (this->AdditionalWatchedModelOriginalColors[firstComponent]==color[0]
+    && this->AdditionalWatchedModelOriginalColors[firstComponent+1]==color[1]
+    && this->AdditionalWatchedModelOriginalColors[firstComponent+2]==color[2])
+  {
+    // not changed
+    return;
+  }
+  this->AdditionalWatchedModelOriginalColors[firstComponent]=color[0];
+  this->AdditionalWatchedModelOriginalColors[firstComponent+1]=color[1];
+  this->AdditionalWatchedModelOriginalColors[firstComponent+2]=color[2];
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
 //------------------------------------------------------------------------------
 vtkMRMLAnnotationRulerNode* vtkMRMLBreachWarningNode::GetLineToClosestPointNode()
 {
@@ -279,6 +642,8 @@ void vtkMRMLBreachWarningNode::SetAndObserveToolTransformNodeId( const char* nod
   events->InsertNextValue( vtkCommand::ModifiedEvent );
   events->InsertNextValue( vtkMRMLTransformNode::TransformModifiedEvent );
   this->SetAndObserveNodeReferenceID( TOOL_ROLE, nodeId, events.GetPointer() );
+  // positions of the previous tool must not be used for velocity estimation
+  this->ClearToolTipPositionHistory();
   this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
 }
 
@@ -292,9 +657,16 @@ void vtkMRMLBreachWarningNode::ProcessMRMLEvents( vtkObject *caller, unsigned lo
   {
     this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
   }
-  else if (this->GetWatchedModelNode() && this->GetWatchedModelNode()==caller)
+  else
   {
-    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+    for (int i=0; i<this->GetNumberOfWatchedModelNodes(); i++)
+    {
+      if (this->GetNthWatchedModelNode(i)==caller)
+      {
+        this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+        break;
+      }
+    }
   }
 }
 
@@ -304,6 +676,351 @@ bool vtkMRMLBreachWarningNode::IsToolTipInsideModel()
   return (this->ClosestDistanceToModelFromToolTip<0);
 }
 
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::IsToolShaftInsideModel()
+{
+  return (this->ToolShaftLengthMm>0 && this->ClosestDistanceToModelFromToolShaft<=0);
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::IsToolInsideModel()
+{
+  return (this->IsToolTipInsideModel() || this->IsToolShaftInsideModel());
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::IsBreachPredicted()
+{
+  return (this->TimeToBreachWarningThresholdSec>0 && !this->IsToolTipInsideModel()
+    && this->EstimatedTimeToBreachSec>=0 && this->EstimatedTimeToBreachSec<=this->TimeToBreachWarningThresholdSec);
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetNumberOfDistanceBands()
+{
+  return static_cast<int>(this->DistanceBands.size());
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::AddDistanceBand( double thresholdMm, double color[3], bool playSound )
+{
+  DistanceBand band;
+  band.ThresholdMm = thresholdMm;
+  band.Color[0] = color[0];
+  band.Color[1] = color[1];
+  band.Color[2] = color[2];
+  band.PlaySound = playSound;
+  // keep the bands sorted by threshold
+  std::vector<DistanceBand>::iterator insertPosition = this->DistanceBands.begin();
+  while (insertPosition!=this->DistanceBands.end() && insertPosition->ThresholdMm<=thresholdMm)
+  {
+    ++insertPosition;
+  }
+  int bandIndex = static_cast<int>(insertPosition-this->DistanceBands.begin());
+  this->DistanceBands.insert(insertPosition, band);
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  return bandIndex;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::RemoveNthDistanceBand( int n )
+{
+  if (n<0 || n>=this->GetNumberOfDistanceBands())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::RemoveNthDistanceBand failed: invalid index "<<n);
+    return;
+  }
+  this->DistanceBands.erase(this->DistanceBands.begin()+n);
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::RemoveAllDistanceBands()
+{
+  if (this->DistanceBands.empty())
+  {
+    return;
+  }
+  this->DistanceBands.clear();
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+double vtkMRMLBreachWarningNode::GetNthDistanceBandThresholdMm( int n )
+{
+  if (n<0 || n>=this->GetNumberOfDistanceBands())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::GetNthDistanceBandThresholdMm failed: invalid index "<<n);
+    return 0.0;
+  }
+  return this->DistanceBands[n].ThresholdMm;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::GetNthDistanceBandColor( int n, double color[3] )
+{
+  if (n<0 || n>=this->GetNumberOfDistanceBands())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::GetNthDistanceBandColor failed: invalid index "<<n);
+    color[0]=0.5;
+    color[1]=0.5;
+    color[2]=0.5;
+    return;
+  }
+  color[0]=this->DistanceBands[n].Color[0];
+  color[1]=this->DistanceBands[n].Color[1];
+  color[2]=this->DistanceBands[n].Color[2];
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetNthDistanceBandColor( int n, double color[3] )
+{
+  if (n<0 || n>=this->GetNumberOfDistanceBands())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::SetNthDistanceBandColor failed: invalid index "<<n);
+    return;
+  }
+  double* bandColor = this->DistanceBands[n].Color;
+  if (bandColor[0]==color[0] && bandColor[1]==color[1] && bandColor[2]==color[2])
+  {
+    // not changed
+    return;
+  }
+  bandColor[0]=color[0];
+  bandColor[1]=color[1];
+  bandColor[2]=color[2];
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::GetNthDistanceBandPlaySound( int n )
+{
+  if (n<0 || n>=this->GetNumberOfDistanceBands())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::GetNthDistanceBandPlaySound failed: invalid index "<<n);
+    return false;
+  }
+  return this->DistanceBands[n].PlaySound;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetNthDistanceBandPlaySound( int n, bool playSound )
+{
+  if (n<0 || n>=this->GetNumberOfDistanceBands())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::SetNthDistanceBandPlaySound failed: invalid index "<<n);
+    return;
+  }
+  if (this->DistanceBands[n].PlaySound==playSound)
+  {
+    // not changed
+    return;
+  }
+  this->DistanceBands[n].PlaySound=playSound;
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+std::string vtkMRMLBreachWarningNode::GetNthDistanceBandSound( int n )
+{
+  if (n<0 || n>=this->GetNumberOfDistanceBands())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::GetNthDistanceBandSound failed: invalid index "<<n);
+    return "";
+  }
+  return this->DistanceBands[n].Sound;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetNthDistanceBandSound( int n, const std::string& sound )
+{
+  if (n<0 || n>=this->GetNumberOfDistanceBands())
+  {
+    vtkErrorMacro("vtkMRMLBreachWarningNode::SetNthDistanceBandSound failed: invalid index "<<n);
+    return;
+  }
+  if (this->DistanceBands[n].Sound==sound)
+  {
+    // not changed
+    return;
+  }
+  this->DistanceBands[n].Sound=sound;
+  this->Modified();
+  this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetDistanceBandIndex( double distanceMm )
+{
+  // bands are sorted, so the first band with larger threshold contains the distance
+  for (unsigned int i=0; i<this->DistanceBands.size(); i++)
+  {
+    if (distanceMm<this->DistanceBands[i].ThresholdMm)
+    {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetCurrentDistanceBandIndex( int bandIndex )
+{
+  if (this->CurrentDistanceBandIndex==bandIndex)
+  {
+    // tool is still in the same band, no need to notify observers
+    return;
+  }
+  this->CurrentDistanceBandIndex = bandIndex;
+  this->Modified();
+  this->InvokeCustomModifiedEvent(DistanceBandChangedEvent);
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::IsWarningSoundRequested()
+{
+  if (this->PlayWarningSound && (this->IsToolInsideModel() || this->IsBreachPredicted()))
+  {
+    return true;
+  }
+  return (this->CurrentDistanceBandIndex>=0 && this->CurrentDistanceBandIndex<this->GetNumberOfDistanceBands()
+    && this->DistanceBands[this->CurrentDistanceBandIndex].PlaySound);
+}
+
+//------------------------------------------------------------------------------
+std::string vtkMRMLBreachWarningNode::GetRequestedWarningSound()
+{
+  if (this->PlayWarningSound && (this->IsToolInsideModel() || this->IsBreachPredicted()))
+  {
+    // breach has priority over distance bands
+    return "";
+  }
+  if (this->CurrentDistanceBandIndex>=0 && this->CurrentDistanceBandIndex<this->GetNumberOfDistanceBands()
+    && this->DistanceBands[this->CurrentDistanceBandIndex].PlaySound)
+  {
+    return this->DistanceBands[this->CurrentDistanceBandIndex].Sound;
+  }
+  return "";
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::AddToolTipPositionToHistory( const double position_Ras[3], double timestampSec )
+{
+  this->ToolTipHistoryNewestIndex = (this->ToolTipHistoryNewestIndex+1) % TOOL_TIP_POSITION_HISTORY_SIZE;
+  double* newestPosition = this->ToolTipPositionHistory + 3*this->ToolTipHistoryNewestIndex;
+  newestPosition[0] = position_Ras[0];
+  newestPosition[1] = position_Ras[1];
+  newestPosition[2] = position_Ras[2];
+  this->ToolTipTimestampHistory[this->ToolTipHistoryNewestIndex] = timestampSec;
+  if (this->ToolTipHistoryCount<TOOL_TIP_POSITION_HISTORY_SIZE)
+  {
+    this->ToolTipHistoryCount++;
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::ClearToolTipPositionHistory()
+{
+  this->ToolTipHistoryNewestIndex = TOOL_TIP_POSITION_HISTORY_SIZE-1;
+  this->ToolTipHistoryCount = 0;
+}
+
+//------------------------------------------------------------------------------
+int vtkMRMLBreachWarningNode::GetNumberOfToolTipPositionsInHistory()
+{
+  return this->ToolTipHistoryCount;
+}
+
+//------------------------------------------------------------------------------
+bool vtkMRMLBreachWarningNode::GetToolTipVelocity( double velocity_Ras[3] )
+{
+  velocity_Ras[0] = 0.0;
+  velocity_Ras[1] = 0.0;
+  velocity_Ras[2] = 0.0;
+  if (this->ToolTipHistoryCount<2)
+  {
+    return false;
+  }
+
+  // Collect samples within the time window (going backward from the newest sample)
+  double newestTimestampSec = this->ToolTipTimestampHistory[this->ToolTipHistoryNewestIndex];
+  int numberOfSamples = 0;
+  double meanTimeSec = 0.0;
+  double meanPosition[3] = {0.0, 0.0, 0.0};
+  for (int i=0; i<this->ToolTipHistoryCount; i++)
+  {
+    int historyIndex = (this->ToolTipHistoryNewestIndex-i+TOOL_TIP_POSITION_HISTORY_SIZE) % TOOL_TIP_POSITION_HISTORY_SIZE;
+    if (newestTimestampSec-this->ToolTipTimestampHistory[historyIndex]>this->VelocityEstimationTimeWindowSec)
+    {
+      break;
+    }
+    meanTimeSec += this->ToolTipTimestampHistory[historyIndex];
+    meanPosition[0] += this->ToolTipPositionHistory[3*historyIndex];
+    meanPosition[1] += this->ToolTipPositionHistory[3*historyIndex+1];
+    meanPosition[2] += this->ToolTipPositionHistory[3*historyIndex+2];
+    numberOfSamples++;
+  }
+  if (numberOfSamples<2)
+  {
+    return false;
+  }
+  meanTimeSec /= numberOfSamples;
+  meanPosition[0] /= numberOfSamples;
+  meanPosition[1] /= numberOfSamples;
+  meanPosition[2] /= numberOfSamples;
+
+  // Least squares line fit: velocity = sum(dt*dp)/sum(dt*dt)
+  double sumDt2 = 0.0;
+  double sumDtDp[3] = {0.0, 0.0, 0.0};
+  for (int i=0; i<numberOfSamples; i++)
+  {
+    int historyIndex = (this->ToolTipHistoryNewestIndex-i+TOOL_TIP_POSITION_HISTORY_SIZE) % TOOL_TIP_POSITION_HISTORY_SIZE;
+    double dt = this->ToolTipTimestampHistory[historyIndex]-meanTimeSec;
+    sumDt2 += dt*dt;
+    sumDtDp[0] += dt*(this->ToolTipPositionHistory[3*historyIndex]-meanPosition[0]);
+    sumDtDp[1] += dt*(this->ToolTipPositionHistory[3*historyIndex+1]-meanPosition[1]);
+    sumDtDp[2] += dt*(this->ToolTipPositionHistory[3*historyIndex+2]-meanPosition[2]);
+  }
+  if (sumDt2<1e-12)
+  {
+    // all samples have the same timestamp
+    return false;
+  }
+  velocity_Ras[0] = sumDtDp[0]/sumDt2;
+  velocity_Ras[1] = sumDtDp[1]/sumDt2;
+  velocity_Ras[2] = sumDtDp[2]/sumDt2;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetVelocityEstimationTimeWindowSec(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting VelocityEstimationTimeWindowSec to " << _arg);
+  if (this->VelocityEstimationTimeWindowSec != _arg)
+  {
+    this->VelocityEstimationTimeWindowSec = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetTimeToBreachWarningThresholdSec(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting TimeToBreachWarningThresholdSec to " << _arg);
+  if (this->TimeToBreachWarningThresholdSec != _arg)
+  {
+    this->TimeToBreachWarningThresholdSec = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
 //------------------------------------------------------------------------------
 void vtkMRMLBreachWarningNode::SetDisplayWarningColor(bool _arg)
 {
@@ -328,6 +1045,102 @@ void vtkMRMLBreachWarningNode::SetPlayWarningSound(bool _arg)
   }
 }
 
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetUseSignedDistanceField(bool _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting UseSignedDistanceField to " << _arg);
+  if (this->UseSignedDistanceField != _arg)
+  {
+    this->UseSignedDistanceField = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetSignedDistanceFieldSpacingMm(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting SignedDistanceFieldSpacingMm to " << _arg);
+  if (this->SignedDistanceFieldSpacingMm != _arg)
+  {
+    this->SignedDistanceFieldSpacingMm = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetSignedDistanceFieldMarginMm(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting SignedDistanceFieldMarginMm to " << _arg);
+  if (this->SignedDistanceFieldMarginMm != _arg)
+  {
+    this->SignedDistanceFieldMarginMm = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetUseLevelOfDetail(bool _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting UseLevelOfDetail to " << _arg);
+  if (this->UseLevelOfDetail != _arg)
+  {
+    this->UseLevelOfDetail = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetLevelOfDetailTargetReduction(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting LevelOfDetailTargetReduction to " << _arg);
+  if (this->LevelOfDetailTargetReduction != _arg)
+  {
+    this->LevelOfDetailTargetReduction = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetLevelOfDetailRefinementDistanceMm(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting LevelOfDetailRefinementDistanceMm to " << _arg);
+  if (this->LevelOfDetailRefinementDistanceMm != _arg)
+  {
+    this->LevelOfDetailRefinementDistanceMm = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolShaftLengthMm(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting ToolShaftLengthMm to " << _arg);
+  if (this->ToolShaftLengthMm != _arg)
+  {
+    this->ToolShaftLengthMm = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkMRMLBreachWarningNode::SetToolShaftRadiusMm(double _arg)
+{
+  vtkDebugMacro(<< this->GetClassName() << " (" << this << "): setting ToolShaftRadiusMm to " << _arg);
+  if (this->ToolShaftRadiusMm != _arg)
+  {
+    this->ToolShaftRadiusMm = _arg;
+    this->Modified();
+    this->InvokeCustomModifiedEvent(InputDataModifiedEvent);
+  }
+}
+
 //------------------------------------------------------------------------------
 void vtkMRMLBreachWarningNode::SetWarningColor(double _arg1, double _arg2, double _arg3)
 {
@@ -17,6 +17,7 @@
 
 #include <ctime>
 #include <iostream>
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -45,7 +46,10 @@ public:
     /// InputDataModifiedEvent is only invoked when input parameters are changed.
     /// In contrast, ModifiedEvent event is called if either an input or output parameter is changed.
     // vtkCommand::UserEvent + 555 is just a random value that is very unlikely to be used for anything else in this class
-    InputDataModifiedEvent = vtkCommand::UserEvent + 555
+    InputDataModifiedEvent = vtkCommand::UserEvent + 555,
+    /// Invoked when the tool moves into a different distance band (CurrentDistanceBandIndex is changed).
+    /// Not invoked while the tool moves within the same band.
+    DistanceBandChangedEvent
   };
   
   vtkTypeMacro( vtkMRMLBreachWarningNode, vtkMRMLNode );
@@ -84,6 +88,73 @@ public:
   /// Computed parameter
   bool IsToolTipInsideModel();
 
+  /// Length of the tool shaft. If non-zero, then not just the tool tip but the whole shaft is checked for breach.
+  /// The shaft is a line segment from the tool tip along the -Z axis of the ToolTip coordinate system
+  /// (same as the needle model created by the CreateModels module). 0 by default.
+  vtkGetMacro( ToolShaftLengthMm, double );
+  virtual void SetToolShaftLengthMm(double _arg);
+
+  /// Radius of the tool shaft. The shaft is modeled as a capsule (segment with radius), so the shaft
+  /// breaches the model if any point of the model is closer to the shaft axis than this radius. 0 by default.
+  vtkGetMacro( ToolShaftRadiusMm, double );
+  virtual void SetToolShaftRadiusMm(double _arg);
+
+  /// Distance of the closest point on the model to the tool shaft surface (capsule). Negative if the shaft
+  /// is inside the model, 0 if the shaft axis intersects the model surface. Computed parameter.
+  vtkGetMacro( ClosestDistanceToModelFromToolShaft, double );
+  vtkSetMacro( ClosestDistanceToModelFromToolShaft, double );
+
+  /// Position of the point on the tool shaft axis that is closest to the model, in RAS coordinate system. Computed parameter.
+  vtkGetVector3Macro( ClosestPointOnToolShaft, double );
+  vtkSetVector3Macro( ClosestPointOnToolShaft, double );
+
+  /// Position of the closest point on the model to the tool shaft, in RAS coordinate system. Computed parameter.
+  vtkGetVector3Macro( ClosestPointOnModelFromToolShaft, double );
+  vtkSetVector3Macro( ClosestPointOnModelFromToolShaft, double );
+
+  /// Index of the watched model that is closest to the tool shaft. -1 if not computed. Computed parameter.
+  vtkGetMacro( ClosestWatchedModelIndexToToolShaft, int );
+  vtkSetMacro( ClosestWatchedModelIndexToToolShaft, int );
+
+  /// Returns true if the tool shaft is enabled and it touches or breaches the model. Computed parameter.
+  bool IsToolShaftInsideModel();
+
+  /// Returns true if the tool tip or the tool shaft breaches the model. Computed parameter.
+  bool IsToolInsideModel();
+
+  /// Number of recent tool tip positions that are kept for estimating the tool tip velocity.
+  static const int TOOL_TIP_POSITION_HISTORY_SIZE = 32;
+
+  /// Stores the tool tip position (in RAS coordinate system) in the position history.
+  /// The history is a fixed-size ring buffer, the oldest position is overwritten when it is full.
+  void AddToolTipPositionToHistory( const double position_Ras[3], double timestampSec );
+  void ClearToolTipPositionHistory();
+  int GetNumberOfToolTipPositionsInHistory();
+
+  /// Estimates tool tip velocity (mm/s, in RAS coordinate system) by fitting a line to the positions
+  /// recorded in the last VelocityEstimationTimeWindowSec. Returns false if there are not enough samples.
+  bool GetToolTipVelocity( double velocity_Ras[3] );
+
+  /// Length of the time period of recent tool tip positions that is used for velocity estimation.
+  /// Longer window reduces noise but makes the estimate respond slower to changes. 0.3 sec by default.
+  vtkGetMacro( VelocityEstimationTimeWindowSec, double );
+  virtual void SetVelocityEstimationTimeWindowSec(double _arg);
+
+  /// If the estimated time to breach is less than this value then warning is displayed before the tool tip
+  /// actually reaches the model. 0 (disabled) by default.
+  vtkGetMacro( TimeToBreachWarningThresholdSec, double );
+  virtual void SetTimeToBreachWarningThresholdSec(double _arg);
+
+  /// Estimated time until the tool tip reaches the watched model surface, computed from the tool tip velocity
+  /// component along the distance gradient. 0 if the tool tip is inside, -1 if the tool is not approaching
+  /// the model or the velocity is unknown. Computed parameter.
+  vtkGetMacro( EstimatedTimeToBreachSec, double );
+  vtkSetMacro( EstimatedTimeToBreachSec, double );
+
+  /// Returns true if the tool tip is outside but it is expected to breach the model within TimeToBreachWarningThresholdSec.
+  /// Computed parameter.
+  bool IsBreachPredicted();
+
   /// Indicates if the warning sound is to be played.
   /// False by default.
   /// \sa SetPlayWarningSound(), GetPlayWarningSound(), PlayWarningSoundOn(), PlayWarningSoundOff()
@@ -104,10 +175,109 @@ public:
   virtual void SetOriginalColor(double _arg1, double _arg2, double _arg3);
   virtual void SetOriginalColor(double _arg[3]);
 
+  /// If enabled, the signed distance of the watched model is precomputed on a regular grid
+  /// and distance far from the surface is computed by a fast lookup.
+  /// Exact distance computation is only performed close to the surface.
+  /// Requires extra memory and time for building the grid each time the model surface is changed.
+  /// False by default.
+  vtkGetMacro( UseSignedDistanceField, bool );
+  virtual void SetUseSignedDistanceField(bool _arg);
+  vtkBooleanMacro( UseSignedDistanceField, bool );
+
+  /// Distance between grid points of the signed distance field.
+  /// Smaller spacing makes the band around the surface where exact computation is needed narrower, but increases memory usage and build time.
+  vtkGetMacro( SignedDistanceFieldSpacingMm, double );
+  virtual void SetSignedDistanceFieldSpacingMm(double _arg);
+
+  /// Distance of the signed distance field boundary from the watched model bounding box.
+  /// Outside the field exact distance computation is used.
+  vtkGetMacro( SignedDistanceFieldMarginMm, double );
+  virtual void SetSignedDistanceFieldMarginMm(double _arg);
+
+  /// If enabled, a decimated copy of the watched model is kept and used for distance computation
+  /// when the tool is far from the model. The full-resolution model is only used within
+  /// LevelOfDetailRefinementDistanceMm from the model surface.
+  /// False by default.
+  vtkGetMacro( UseLevelOfDetail, bool );
+  virtual void SetUseLevelOfDetail(bool _arg);
+  vtkBooleanMacro( UseLevelOfDetail, bool );
+
+  /// Fraction of triangles removed from the watched model when creating the decimated model (between 0 and 1).
+  /// Higher reduction makes queries faster, but increases the error of the decimated model, so the full-resolution model
+  /// is used in a larger region. 0.9 by default.
+  vtkGetMacro( LevelOfDetailTargetReduction, double );
+  virtual void SetLevelOfDetailTargetReduction(double _arg);
+
+  /// Distance from the watched model surface where the full-resolution model is used. Distances larger than this
+  /// are computed from the decimated model and their error is at most the decimation error. 10mm by default.
+  /// If a distance band threshold (plus the tool shaft radius) is larger then the threshold is used instead,
+  /// so that band classification is always computed from the full-resolution model.
+  vtkGetMacro( LevelOfDetailRefinementDistanceMm, double );
+  virtual void SetLevelOfDetailRefinementDistanceMm(double _arg);
+
+  /// Distance bands define zones around the watched models (for example breach, caution, and warning zones).
+  /// All bands are classified from the same closest distance computation (the smaller of the tool tip and tool shaft distance).
+  /// The tool is in the band with the smallest threshold that is larger than the tool distance, so a band
+  /// with 0 threshold contains positions inside the model. Bands are kept sorted by increasing threshold.
+  /// If the tool is in a band then the watched model is displayed with the band color instead of the warning color.
+  /// No bands are defined by default.
+  int GetNumberOfDistanceBands();
+  /// Adds a new band and returns its index.
+  int AddDistanceBand( double thresholdMm, double color[3], bool playSound );
+  void RemoveNthDistanceBand( int n );
+  void RemoveAllDistanceBands();
+  double GetNthDistanceBandThresholdMm( int n );
+  void GetNthDistanceBandColor( int n, double color[3] );
+  void SetNthDistanceBandColor( int n, double color[3] );
+  /// If enabled, warning sound is played while the tool is in this band.
+  bool GetNthDistanceBandPlaySound( int n );
+  void SetNthDistanceBandPlaySound( int n, bool playSound );
+  /// Sound played while the tool is in this band (if PlaySound is enabled for the band): a sound file name,
+  /// either an absolute path or a file in the module share directory (for example alarm.wav or ComputerErrorAlert.wav).
+  /// Empty by default, which means the default warning sound.
+  std::string GetNthDistanceBandSound( int n );
+  void SetNthDistanceBandSound( int n, const std::string& sound );
+
+  /// Returns the index of the band that contains the distance. Returns -1 if the distance is not in any band.
+  int GetDistanceBandIndex( double distanceMm );
+
+  /// Index of the distance band that the tool is in. -1 if the tool is not in any band. Computed parameter.
+  /// DistanceBandChangedEvent is invoked when the value is changed.
+  vtkGetMacro( CurrentDistanceBandIndex, int );
+  void SetCurrentDistanceBandIndex( int bandIndex );
+
+  /// Returns true if warning sound has to be played: either the tool breaches (or is predicted to breach) the model
+  /// and PlayWarningSound is enabled, or the tool is in a distance band that has sound enabled. Computed parameter.
+  bool IsWarningSoundRequested();
+
+  /// Returns the sound that has to be played if IsWarningSoundRequested() is true. Breach uses the default warning sound
+  /// (empty string), otherwise the sound of the current distance band is returned. Computed parameter.
+  std::string GetRequestedWarningSound();
+
   /// Watched model defines the area that may breached.
+  /// If multiple models are watched then this is the first watched model.
   vtkMRMLModelNode* GetWatchedModelNode();
   void SetAndObserveWatchedModelNodeID( const char* modelId );
 
+  /// Multiple models can be watched by the same node. The closest watched model is found by a single query
+  /// (the closest distance, point, and watched model index are stored in the computed parameters).
+  /// Watched models are assumed not to overlap: inside/outside is determined from the closest model surface.
+  int GetNumberOfWatchedModelNodes();
+  vtkMRMLModelNode* GetNthWatchedModelNode( int n );
+  const char* GetNthWatchedModelNodeID( int n );
+  /// Adds a watched model. Does nothing if the model is already watched.
+  void AddAndObserveWatchedModelNodeID( const char* modelId );
+  void RemoveNthWatchedModelNodeID( int n );
+
+  /// Color of the n-th watched model when the tool tip is not inside.
+  /// Original color of the first watched model is the same as OriginalColor.
+  void GetNthWatchedModelOriginalColor( int n, double color[3] );
+  void SetNthWatchedModelOriginalColor( int n, double color[3] );
+
+  /// Index of the watched model that is closest to the tool tip. -1 if there is no valid watched model. Computed parameter.
+  vtkGetMacro( ClosestWatchedModelIndex, int );
+  vtkSetMacro( ClosestWatchedModelIndex, int );
+
   // Tool transform is interpreted as ToolTipToRas. The origin of ToolTip 
   // coordinate system is the tip of the surgical tool that needs to avoid the
   // risk area.
@@ -127,10 +297,47 @@ private:
   double OriginalColor[3];
   bool DisplayWarningColor;
   bool PlayWarningSound;
+  bool UseSignedDistanceField;
+  double SignedDistanceFieldSpacingMm;
+  double SignedDistanceFieldMarginMm;
+  bool UseLevelOfDetail;
+  double LevelOfDetailTargetReduction;
+  double LevelOfDetailRefinementDistanceMm;
+  double ToolShaftLengthMm;
+  double ToolShaftRadiusMm;
+  double VelocityEstimationTimeWindowSec;
+  double TimeToBreachWarningThresholdSec;
   // It is the closest distance to the model from the tool transform. If the distance is negative
   // the transform is inside the model.
   double ClosestDistanceToModelFromToolTip;
   double ClosestPointOnModel[3];
+  int ClosestWatchedModelIndex;
+  double ClosestDistanceToModelFromToolShaft;
+  double ClosestPointOnToolShaft[3];
+  double ClosestPointOnModelFromToolShaft[3];
+  int ClosestWatchedModelIndexToToolShaft;
+  double EstimatedTimeToBreachSec;
+  int CurrentDistanceBandIndex;
+
+  struct DistanceBand
+  {
+    double ThresholdMm;
+    double Color[3];
+    bool PlaySound;
+    std::string Sound; // empty means default warning sound
+  };
+  // Sorted by increasing threshold
+  std::vector< DistanceBand > DistanceBands;
+
+  // Ring buffer of recent tool tip positions (3 components per position) and their timestamps.
+  // Preallocated, no memory allocation is needed when a new position is added.
+  double ToolTipPositionHistory[3*TOOL_TIP_POSITION_HISTORY_SIZE];
+  double ToolTipTimestampHistory[TOOL_TIP_POSITION_HISTORY_SIZE];
+  int ToolTipHistoryNewestIndex;
+  int ToolTipHistoryCount;
+
+  // Original colors of the second, third, ... watched models (3 components per model)
+  std::vector< double > AdditionalWatchedModelOriginalColors;
 
 };
 #endif
@@ -0,0 +1,238 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Checks that distances computed from the decimated surface proxy are within its error bound,
+// and that the level of detail computation classifies the tool into the same distance band as
+// exact computation on the full-resolution surface, near the boundary of each band.
+
+// BreachWarning includes
+#include "vtkDecimatedSurfaceProxy.h"
+#include "vtkMRMLBreachWarningNode.h"
+#include "vtkSlicerBreachWarningLogic.h"
+#include "vtkTriangleBVH.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+
+const double MODEL_RADIUS_MM = 50.0;
+const double DISTANCE_TOLERANCE_MM = 1e-6;
+
+//----------------------------------------------------------------------------
+void GetRandomDirection( double direction[3] )
+{
+  do
+  {
+    for ( int i = 0; i < 3; i++ )
+    {
+      direction[ i ] = vtkMath::Random( -1.0, 1.0 );
+    }
+  } while ( vtkMath::Normalize( direction ) < 1e-3 );
+}
+
+//----------------------------------------------------------------------------
+// Distance returned by the proxy must not differ from the exact distance by more than the error bound
+bool TestErrorBound( vtkPolyData* surface, vtkTriangleBVH* hierarchy )
+{
+  vtkNew< vtkDecimatedSurfaceProxy > proxy;
+  proxy->SetTargetReduction( 0.95 );
+  if ( !proxy->Build( surface, hierarchy ) )
+  {
+    std::cerr << "Failed to build decimated surface proxy" << std::endl;
+    return false;
+  }
+  double errorBound = proxy->GetErrorBound();
+  if ( errorBound <= 0.0 )
+  {
+    std::cerr << "Invalid error bound: " << errorBound << std::endl;
+    return false;
+  }
+
+  int numberOfProxyResults = 0;
+  for ( int sampleIndex = 0; sampleIndex < 20000; sampleIndex++ )
+  {
+    double direction[3] = { 0.0, 0.0, 0.0 };
+    GetRandomDirection( direction );
+    // dense near the surface, where the error matters
+    double radius = MODEL_RADIUS_MM + vtkMath::Random( -3.0 * errorBound, 3.0 * errorBound );
+    double position[3] = { radius * direction[ 0 ], radius * direction[ 1 ], radius * direction[ 2 ] };
+
+    double proxyDistance = 0.0;
+    double proxyClosestPoint[3] = { 0.0, 0.0, 0.0 };
+    if ( !proxy->FindClosestPoint( position, 0.0, proxyDistance, proxyClosestPoint ) )
+    {
+      continue;
+    }
+    numberOfProxyResults++;
+    double closestPoint[3] = { 0.0, 0.0, 0.0 };
+    int closestSurfaceIndex = -1;
+    double exactDistance = hierarchy->FindClosestPoint( position, closestPoint, closestSurfaceIndex );
+    if ( fabs( proxyDistance - exactDistance ) > errorBound + DISTANCE_TOLERANCE_MM )
+    {
+      std::cerr << "Proxy distance " << proxyDistance << " differs from exact distance " << exactDistance
+        << " by more than the error bound " << errorBound << std::endl;
+      return false;
+    }
+  }
+  if ( numberOfProxyResults == 0 )
+  {
+    std::cerr << "Decimated surface proxy was not used for any query" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Moves the tool to both sides of each band boundary and compares the band of the node
+// to the band of the exact distance
+bool TestBandClassification( vtkPolyData* surface )
+{
+  vtkNew< vtkMRMLScene > scene;
+  vtkSmartPointer< vtkSlicerBreachWarningLogic > logic = vtkSmartPointer< vtkSlicerBreachWarningLogic >::New();
+  logic->SetMRMLScene( scene.GetPointer() );
+
+  vtkNew< vtkMRMLModelNode > modelNode;
+  scene->AddNode( modelNode.GetPointer() );
+  modelNode->SetAndObservePolyData( surface );
+
+  // Scaling model transform, the refinement distance must be converted to model coordinates
+  vtkNew< vtkTransform > modelToRasTransform;
+  modelToRasTransform->Translate( 10.0, -20.0, 30.0 );
+  modelToRasTransform->RotateWXYZ( 30.0, 1.0, 2.0, 3.0 );
+  modelToRasTransform->Scale( 2.0, 2.0, 2.0 );
+  vtkNew< vtkMRMLLinearTransformNode > modelToRasNode;
+  scene->AddNode( modelToRasNode.GetPointer() );
+  modelToRasNode->SetMatrixTransformToParent( modelToRasTransform->GetMatrix() );
+  modelNode->SetAndObserveTransformNodeID( modelToRasNode->GetID() );
+
+  vtkNew< vtkMRMLLinearTransformNode > toolToRasNode;
+  scene->AddNode( toolToRasNode.GetPointer() );
+
+  vtkNew< vtkMRMLBreachWarningNode > bwNode;
+  scene->AddNode( bwNode.GetPointer() );
+  bwNode->SetDisplayWarningColor( false );
+  bwNode->SetUseLevelOfDetail( true );
+  bwNode->SetLevelOfDetailTargetReduction( 0.95 );
+  // smaller than the band thresholds, must be increased by the logic
+  bwNode->SetLevelOfDetailRefinementDistanceMm( 0.1 );
+  const int numberOfBands = 3;
+  double thresholdsMm[ numberOfBands ] = { 2.0, 5.0, 15.0 };
+  double color[3] = { 1.0, 0.0, 0.0 };
+  for ( int bandIndex = 0; bandIndex < numberOfBands; bandIndex++ )
+  {
+    bwNode->AddDistanceBand( thresholdsMm[ bandIndex ], color, false );
+  }
+  bwNode->SetAndObserveToolTransformNodeId( toolToRasNode->GetID() );
+  logic->SetWatchedModelNode( modelNode.GetPointer(), bwNode.GetPointer() );
+
+  vtkNew< vtkTriangleBVH > exactHierarchy;
+  exactHierarchy->AddSurface( surface, modelToRasTransform.GetPointer() );
+  exactHierarchy->Build();
+
+  bool success = true;
+  double center_Ras[3] = { 0.0, 0.0, 0.0 };
+  modelToRasTransform->TransformPoint( center_Ras, center_Ras );
+  double radius_Ras = 2.0 * MODEL_RADIUS_MM;
+  double offsetsMm[] = { -0.5, -0.05, 0.05, 0.5 };
+  vtkNew< vtkMatrix4x4 > toolToRas;
+  for ( int directionIndex = 0; directionIndex < 50 && success; directionIndex++ )
+  {
+    double direction[3] = { 0.0, 0.0, 0.0 };
+    GetRandomDirection( direction );
+    for ( int bandIndex = -1; bandIndex < numberOfBands; bandIndex++ )
+    {
+      // band -1: model surface (inside/outside boundary)
+      double thresholdMm = ( bandIndex < 0 ) ? 0.0 : thresholdsMm[ bandIndex ];
+      for ( int offsetIndex = 0; offsetIndex < 4; offsetIndex++ )
+      {
+        double distanceFromCenter = radius_Ras + thresholdMm + offsetsMm[ offsetIndex ];
+        for ( int i = 0; i < 3; i++ )
+        {
+          toolToRas->SetElement( i, 3, center_Ras[ i ] + distanceFromCenter * direction[ i ] );
+        }
+        toolToRasNode->SetMatrixTransformToParent( toolToRas.GetPointer() );
+
+        double toolTip_Ras[3] = { toolToRas->GetElement( 0, 3 ), toolToRas->GetElement( 1, 3 ), toolToRas->GetElement( 2, 3 ) };
+        double closestPoint[3] = { 0.0, 0.0, 0.0 };
+        int closestSurfaceIndex = -1;
+        double exactDistance = exactHierarchy->FindClosestPoint( toolTip_Ras, closestPoint, closestSurfaceIndex );
+        int expectedBandIndex = bwNode->GetDistanceBandIndex( exactDistance );
+        if ( bwNode->GetCurrentDistanceBandIndex() != expectedBandIndex )
+        {
+          std::cerr << "Tool at exact distance " << exactDistance << " is classified into band " << bwNode->GetCurrentDistanceBandIndex()
+            << " instead of " << expectedBandIndex << " (computed distance: " << bwNode->GetClosestDistanceToModelFromToolTip() << ")" << std::endl;
+          success = false;
+        }
+        if ( ( exactDistance < 0 ) != bwNode->IsToolTipInsideModel() )
+        {
+          std::cerr << "Tool at exact distance " << exactDistance << " is incorrectly classified as "
+            << ( bwNode->IsToolTipInsideModel() ? "inside" : "outside" ) << " the model" << std::endl;
+          success = false;
+        }
+      }
+    }
+  }
+
+  logic->SetMRMLScene( NULL );
+  return success;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkDecimatedSurfaceProxyTest( int vtkNotUsed(argc), char* vtkNotUsed(argv)[] )
+{
+  vtkMath::RandomSeed( 12345 );
+
+  vtkNew< vtkSphereSource > sphere;
+  sphere->SetRadius( MODEL_RADIUS_MM );
+  sphere->SetThetaResolution( 80 );
+  sphere->SetPhiResolution( 80 );
+  sphere->Update();
+  vtkPolyData* surface = sphere->GetOutput();
+
+  vtkNew< vtkTriangleBVH > hierarchy;
+  hierarchy->AddSurface( surface );
+  hierarchy->Build();
+
+  if ( !TestErrorBound( surface, hierarchy.GetPointer() ) )
+  {
+    return EXIT_FAILURE;
+  }
+  if ( !TestBandClassification( surface ) )
+  {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,246 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Checks that distances computed in the background (AsynchronousUpdate enabled) are identical
+// to distances computed synchronously, and that results of removed nodes are not applied.
+
+// BreachWarning includes
+#include "vtkMRMLBreachWarningNode.h"
+#include "vtkSlicerBreachWarningLogic.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkTimerLog.h>
+#include <vtkTransform.h>
+
+// VTKSYS includes
+#include <vtksys/SystemTools.hxx>
+
+// STD includes
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const double MODEL_RADIUS_MM = 50.0;
+const int NUMBER_OF_POSITIONS = 20;
+const double RESULT_TIMEOUT_SEC = 10.0;
+
+//----------------------------------------------------------------------------
+struct ToolResult
+{
+  double TipDistance;
+  double ClosestPointOnModel[3];
+  double ShaftDistance;
+  double ClosestPointOnToolShaft[3];
+  double ClosestPointOnModelFromToolShaft[3];
+};
+
+//----------------------------------------------------------------------------
+void GetResult( vtkMRMLBreachWarningNode* bwNode, ToolResult& result )
+{
+  result.TipDistance = bwNode->GetClosestDistanceToModelFromToolTip();
+  bwNode->GetClosestPointOnModel( result.ClosestPointOnModel );
+  result.ShaftDistance = bwNode->GetClosestDistanceToModelFromToolShaft();
+  bwNode->GetClosestPointOnToolShaft( result.ClosestPointOnToolShaft );
+  bwNode->GetClosestPointOnModelFromToolShaft( result.ClosestPointOnModelFromToolShaft );
+}
+
+//----------------------------------------------------------------------------
+bool IsEqual( const double a[3], const double b[3] )
+{
+  return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+//----------------------------------------------------------------------------
+// Results must be bit-identical, as both are computed by the same routine from the same inputs
+bool IsEqual( const ToolResult& a, const ToolResult& b )
+{
+  return a.TipDistance == b.TipDistance
+    && IsEqual( a.ClosestPointOnModel, b.ClosestPointOnModel )
+    && a.ShaftDistance == b.ShaftDistance
+    && IsEqual( a.ClosestPointOnToolShaft, b.ClosestPointOnToolShaft )
+    && IsEqual( a.ClosestPointOnModelFromToolShaft, b.ClosestPointOnModelFromToolShaft );
+}
+
+//----------------------------------------------------------------------------
+// Tool positions inside, near, and far from the surface, with the shaft pointing in various directions
+void GetToolToRasMatrix( int positionIndex, vtkMatrix4x4* toolToRas )
+{
+  vtkNew< vtkTransform > toolToRasTransform;
+  double distanceFromCenter = MODEL_RADIUS_MM * ( 0.2 + 0.1 * positionIndex );
+  toolToRasTransform->RotateWXYZ( 37.0 * positionIndex, 1.0, 0.5, 0.2 );
+  toolToRasTransform->Translate( distanceFromCenter, 0.0, 0.0 );
+  toolToRas->DeepCopy( toolToRasTransform->GetMatrix() );
+}
+
+//----------------------------------------------------------------------------
+// Polls background results until one is applied or timeout occurs
+bool WaitForAsynchronousResult( vtkSlicerBreachWarningLogic* logic, double timeoutSec )
+{
+  double startTimeSec = vtkTimerLog::GetUniversalTime();
+  while ( vtkTimerLog::GetUniversalTime() - startTimeSec < timeoutSec )
+  {
+    if ( logic->ProcessAsynchronousUpdateResults() )
+    {
+      return true;
+    }
+    vtksys::SystemTools::Delay( 1 );
+  }
+  return false;
+}
+
+//----------------------------------------------------------------------------
+bool TestMode( const std::string& mode )
+{
+  vtkNew< vtkMRMLScene > scene;
+  vtkSmartPointer< vtkSlicerBreachWarningLogic > logic = vtkSmartPointer< vtkSlicerBreachWarningLogic >::New();
+  logic->SetMRMLScene( scene.GetPointer() );
+
+  vtkNew< vtkSphereSource > sphere;
+  sphere->SetRadius( MODEL_RADIUS_MM );
+  sphere->SetThetaResolution( 30 );
+  sphere->SetPhiResolution( 30 );
+  sphere->Update();
+
+  vtkNew< vtkMRMLModelNode > modelNode;
+  scene->AddNode( modelNode.GetPointer() );
+  modelNode->SetAndObservePolyData( sphere->GetOutput() );
+
+  vtkNew< vtkMRMLLinearTransformNode > modelToRasNode;
+  scene->AddNode( modelToRasNode.GetPointer() );
+  vtkNew< vtkTransform > modelToRasTransform;
+  modelToRasTransform->Translate( 10.0, -20.0, 30.0 );
+  modelToRasTransform->RotateWXYZ( 30.0, 1.0, 2.0, 3.0 );
+  modelToRasNode->SetMatrixTransformToParent( modelToRasTransform->GetMatrix() );
+  modelNode->SetAndObserveTransformNodeID( modelToRasNode->GetID() );
+
+  vtkNew< vtkMRMLLinearTransformNode > toolToRasNode;
+  scene->AddNode( toolToRasNode.GetPointer() );
+
+  vtkNew< vtkMRMLBreachWarningNode > bwNode;
+  scene->AddNode( bwNode.GetPointer() );
+  bwNode->SetDisplayWarningColor( false );
+  bwNode->SetToolShaftLengthMm( 40.0 );
+  bwNode->SetToolShaftRadiusMm( 1.0 );
+  if ( mode == "sdf" )
+  {
+    bwNode->SetUseSignedDistanceField( true );
+  }
+  else if ( mode == "lod" )
+  {
+    bwNode->SetUseLevelOfDetail( true );
+  }
+  bwNode->SetAndObserveToolTransformNodeId( toolToRasNode->GetID() );
+  logic->SetWatchedModelNode( modelNode.GetPointer(), bwNode.GetPointer() );
+
+  bool success = true;
+  vtkNew< vtkMatrix4x4 > toolToRas;
+
+  std::vector< ToolResult > synchronousResults( NUMBER_OF_POSITIONS );
+  for ( int positionIndex = 0; positionIndex < NUMBER_OF_POSITIONS; positionIndex++ )
+  {
+    GetToolToRasMatrix( positionIndex, toolToRas.GetPointer() );
+    toolToRasNode->SetMatrixTransformToParent( toolToRas.GetPointer() );
+    GetResult( bwNode.GetPointer(), synchronousResults[ positionIndex ] );
+  }
+
+  logic->SetAsynchronousUpdate( true );
+  for ( int positionIndex = 0; positionIndex < NUMBER_OF_POSITIONS && success; positionIndex++ )
+  {
+    // Move the tool away first, so that the node outputs are not already up-to-date before the result is applied
+    toolToRas->Identity();
+    toolToRas->SetElement( 0, 3, 3.0 * MODEL_RADIUS_MM );
+    toolToRasNode->SetMatrixTransformToParent( toolToRas.GetPointer() );
+    if ( !WaitForAsynchronousResult( logic, RESULT_TIMEOUT_SEC ) )
+    {
+      std::cerr << "Mode " << mode << ": background result of position " << positionIndex << " was not received" << std::endl;
+      success = false;
+      break;
+    }
+
+    GetToolToRasMatrix( positionIndex, toolToRas.GetPointer() );
+    toolToRasNode->SetMatrixTransformToParent( toolToRas.GetPointer() );
+    if ( !WaitForAsynchronousResult( logic, RESULT_TIMEOUT_SEC ) )
+    {
+      std::cerr << "Mode " << mode << ": background result of position " << positionIndex << " was not received" << std::endl;
+      success = false;
+      break;
+    }
+    ToolResult asynchronousResult;
+    GetResult( bwNode.GetPointer(), asynchronousResult );
+    if ( !IsEqual( asynchronousResult, synchronousResults[ positionIndex ] ) )
+    {
+      std::cerr << "Mode " << mode << ": background result of position " << positionIndex << " differs from synchronous result:"
+        << " tip distance " << asynchronousResult.TipDistance << " != " << synchronousResults[ positionIndex ].TipDistance
+        << ", shaft distance " << asynchronousResult.ShaftDistance << " != " << synchronousResults[ positionIndex ].ShaftDistance << std::endl;
+      success = false;
+    }
+  }
+
+  if ( success )
+  {
+    // Post a query, then remove the node before the result is collected. The result must be discarded.
+    toolToRas->Identity();
+    toolToRasNode->SetMatrixTransformToParent( toolToRas.GetPointer() );
+    double tipDistanceBeforeRemoval = bwNode->GetClosestDistanceToModelFromToolTip();
+    scene->RemoveNode( bwNode.GetPointer() );
+    vtksys::SystemTools::Delay( 100 ); // give time to the worker to finish the query
+    if ( WaitForAsynchronousResult( logic, 0.5 ) )
+    {
+      std::cerr << "Mode " << mode << ": background result of a removed node was applied" << std::endl;
+      success = false;
+    }
+    if ( bwNode->GetClosestDistanceToModelFromToolTip() != tipDistanceBeforeRemoval )
+    {
+      std::cerr << "Mode " << mode << ": removed node was modified by a background result" << std::endl;
+      success = false;
+    }
+  }
+
+  logic->SetAsynchronousUpdate( false );
+  logic->SetMRMLScene( NULL );
+  return success;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerBreachWarningLogicAsynchronousUpdateTest( int vtkNotUsed(argc), char* vtkNotUsed(argv)[] )
+{
+  const char* modes[] = { "locator", "sdf", "lod" };
+  bool success = true;
+  for ( int modeIndex = 0; modeIndex < 3; modeIndex++ )
+  {
+    if ( !TestMode( modes[ modeIndex ] ) )
+    {
+      success = false;
+    }
+  }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,364 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Measures latency of breach warning distance computation on synthetic models.
+// Runs without the Slicer application: a MRML scene and the module logic are created directly.
+//
+// Usage: vtkSlicerBreachWarningLogicBenchmark [--quick] [--updates N] [--triangles N1,N2,...] [--modes mode1,mode2,...]
+//
+// Modes:
+//   locator: default computation (cached locator of the watched model)
+//   sdf:     signed distance field lookup far from the surface
+//   lod:     decimated model far from the surface
+//   shaft:   default computation with tool shaft check enabled
+//   bvh:     triangle hierarchy queries (without MRML node updates)
+//
+// Each model is tested without a parent transform and with a rigid parent transform.
+// Tool tip follows a random trajectory (fixed seed, so results are comparable between runs).
+
+// BreachWarning includes
+#include "vtkMRMLBreachWarningNode.h"
+#include "vtkSlicerBreachWarningLogic.h"
+#include "vtkTriangleBVH.h"
+
+// MRML includes
+#include <vtkMRMLLinearTransformNode.h>
+#include <vtkMRMLModelNode.h>
+#include <vtkMRMLScene.h>
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkTimerLog.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const double MODEL_RADIUS_MM = 50.0;
+
+//----------------------------------------------------------------------------
+struct BenchmarkResult
+{
+  double SetupTimeSec; // first update, includes building of locators
+  double MeanSec;
+  double Percentile95Sec;
+  double Percentile99Sec;
+  double UpdatesPerSec;
+};
+
+//----------------------------------------------------------------------------
+std::vector< std::string > SplitString( const std::string& str )
+{
+  std::vector< std::string > items;
+  std::stringstream ss( str );
+  std::string item;
+  while ( std::getline( ss, item, ',' ) )
+  {
+    if ( !item.empty() )
+    {
+      items.push_back( item );
+    }
+  }
+  return items;
+}
+
+//----------------------------------------------------------------------------
+// Creates a sphere with approximately the requested number of triangles
+vtkSmartPointer< vtkPolyData > CreateSphereModel( int requestedNumberOfTriangles )
+{
+  // Sphere source creates 2 * thetaResolution * ( phiResolution - 2 ) triangles
+  int resolution = static_cast< int >( sqrt( requestedNumberOfTriangles / 2.0 ) ) + 1;
+  if ( resolution < 8 )
+  {
+    resolution = 8;
+  }
+  vtkSmartPointer< vtkSphereSource > sphere = vtkSmartPointer< vtkSphereSource >::New();
+  sphere->SetRadius( MODEL_RADIUS_MM );
+  sphere->SetThetaResolution( resolution );
+  sphere->SetPhiResolution( resolution + 2 );
+  sphere->Update();
+  return sphere->GetOutput();
+}
+
+//----------------------------------------------------------------------------
+// Generates a smooth random trajectory around the model (inside and outside)
+void CreateTrajectory( int numberOfPositions, std::vector< double >& positions )
+{
+  vtkMath::RandomSeed( 12345 );
+  positions.resize( 3 * numberOfPositions );
+  double position[3] = { 0.0, 0.0, 2.0 * MODEL_RADIUS_MM };
+  double velocity[3] = { 0.0, 0.0, 0.0 };
+  const double maximumPosition = 2.0 * MODEL_RADIUS_MM;
+  const double maximumStep = 0.02 * MODEL_RADIUS_MM;
+  for ( int positionIndex = 0; positionIndex < numberOfPositions; positionIndex++ )
+  {
+    for ( int i = 0; i < 3; i++ )
+    {
+      velocity[ i ] = 0.9 * velocity[ i ] + vtkMath::Gaussian( 0.0, 0.3 * maximumStep );
+      if ( fabs( position[ i ] + velocity[ i ] ) > maximumPosition )
+      {
+        // bounce back from the boundary of the region
+        velocity[ i ] = -velocity[ i ];
+      }
+      position[ i ] += velocity[ i ];
+      positions[ 3 * positionIndex + i ] = position[ i ];
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+void ComputeStatistics( std::vector< double >& updateTimesSec, BenchmarkResult& result )
+{
+  result.MeanSec = 0.0;
+  result.Percentile95Sec = 0.0;
+  result.Percentile99Sec = 0.0;
+  result.UpdatesPerSec = 0.0;
+  if ( updateTimesSec.empty() )
+  {
+    return;
+  }
+  double totalTimeSec = 0.0;
+  for ( std::vector< double >::iterator it = updateTimesSec.begin(); it != updateTimesSec.end(); ++it )
+  {
+    totalTimeSec += ( *it );
+  }
+  std::sort( updateTimesSec.begin(), updateTimesSec.end() );
+  size_t numberOfUpdates = updateTimesSec.size();
+  result.MeanSec = totalTimeSec / numberOfUpdates;
+  result.Percentile95Sec = updateTimesSec[ std::min( numberOfUpdates - 1, static_cast< size_t >( ceil( 0.95 * numberOfUpdates ) ) - 1 ) ];
+  result.Percentile99Sec = updateTimesSec[ std::min( numberOfUpdates - 1, static_cast< size_t >( ceil( 0.99 * numberOfUpdates ) ) - 1 ) ];
+  result.UpdatesPerSec = ( totalTimeSec > 0 ) ? numberOfUpdates / totalTimeSec : 0.0;
+}
+
+//----------------------------------------------------------------------------
+void GetModelToRasMatrix( bool useParentTransform, vtkMatrix4x4* modelToRas )
+{
+  vtkNew< vtkTransform > modelToRasTransform;
+  if ( useParentTransform )
+  {
+    modelToRasTransform->Translate( 10.0, -20.0, 30.0 );
+    modelToRasTransform->RotateWXYZ( 30.0, 1.0, 2.0, 3.0 );
+  }
+  modelToRas->DeepCopy( modelToRasTransform->GetMatrix() );
+}
+
+//----------------------------------------------------------------------------
+// Moves the tool along the trajectory and measures the time of each breach warning node update
+bool RunLogicBenchmark( const std::string& mode, vtkPolyData* surface, bool useParentTransform,
+  const std::vector< double >& trajectory, BenchmarkResult& result )
+{
+  vtkNew< vtkMRMLScene > scene;
+  vtkSmartPointer< vtkSlicerBreachWarningLogic > logic = vtkSmartPointer< vtkSlicerBreachWarningLogic >::New();
+  logic->SetMRMLScene( scene.GetPointer() );
+
+  vtkNew< vtkMRMLModelNode > modelNode;
+  scene->AddNode( modelNode.GetPointer() );
+  modelNode->SetAndObservePolyData( surface );
+  if ( useParentTransform )
+  {
+    vtkNew< vtkMRMLLinearTransformNode > modelToRasNode;
+    scene->AddNode( modelToRasNode.GetPointer() );
+    vtkNew< vtkMatrix4x4 > modelToRas;
+    GetModelToRasMatrix( true, modelToRas.GetPointer() );
+    modelToRasNode->SetMatrixTransformToParent( modelToRas.GetPointer() );
+    modelNode->SetAndObserveTransformNodeID( modelToRasNode->GetID() );
+  }
+
+  vtkNew< vtkMRMLLinearTransformNode > toolToRasNode;
+  scene->AddNode( toolToRasNode.GetPointer() );
+
+  vtkNew< vtkMRMLBreachWarningNode > bwNode;
+  scene->AddNode( bwNode.GetPointer() );
+  bwNode->SetDisplayWarningColor( false );
+  if ( mode == "sdf" )
+  {
+    bwNode->SetUseSignedDistanceField( true );
+  }
+  else if ( mode == "lod" )
+  {
+    bwNode->SetUseLevelOfDetail( true );
+  }
+  else if ( mode == "shaft" )
+  {
+    bwNode->SetToolShaftLengthMm( 100.0 );
+    bwNode->SetToolShaftRadiusMm( 1.0 );
+  }
+  else if ( mode != "locator" )
+  {
+    std::cerr << "Unknown mode: " << mode << std::endl;
+    return false;
+  }
+  bwNode->SetAndObserveToolTransformNodeId( toolToRasNode->GetID() );
+  logic->SetWatchedModelNode( modelNode.GetPointer(), bwNode.GetPointer() );
+
+  vtkNew< vtkMatrix4x4 > toolToRas;
+  int numberOfPositions = static_cast< int >( trajectory.size() / 3 );
+  std::vector< double > updateTimesSec;
+  updateTimesSec.reserve( numberOfPositions );
+  for ( int positionIndex = 0; positionIndex < numberOfPositions; positionIndex++ )
+  {
+    for ( int i = 0; i < 3; i++ )
+    {
+      toolToRas->SetElement( i, 3, trajectory[ 3 * positionIndex + i ] );
+    }
+    double startTimeSec = vtkTimerLog::GetUniversalTime();
+    toolToRasNode->SetMatrixTransformToParent( toolToRas.GetPointer() ); // triggers distance computation
+    double updateTimeSec = vtkTimerLog::GetUniversalTime() - startTimeSec;
+    if ( positionIndex == 0 )
+    {
+      result.SetupTimeSec = updateTimeSec;
+    }
+    else
+    {
+      updateTimesSec.push_back( updateTimeSec );
+    }
+  }
+  ComputeStatistics( updateTimesSec, result );
+
+  logic->SetMRMLScene( NULL );
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Measures closest point queries of the triangle hierarchy (the surface is transformed to RAS, the same way as the logic does it)
+void RunHierarchyBenchmark( vtkPolyData* surface, bool useParentTransform, const std::vector< double >& trajectory, BenchmarkResult& result )
+{
+  double startTimeSec = vtkTimerLog::GetUniversalTime();
+  vtkSmartPointer< vtkTriangleBVH > hierarchy = vtkSmartPointer< vtkTriangleBVH >::New();
+  vtkNew< vtkMatrix4x4 > modelToRas;
+  GetModelToRasMatrix( useParentTransform, modelToRas.GetPointer() );
+  vtkNew< vtkTransform > modelToRasTransform;
+  modelToRasTransform->SetMatrix( modelToRas.GetPointer() );
+  hierarchy->AddSurface( surface, useParentTransform ? modelToRasTransform.GetPointer() : NULL );
+  hierarchy->Build();
+  result.SetupTimeSec = vtkTimerLog::GetUniversalTime() - startTimeSec;
+
+  int numberOfPositions = static_cast< int >( trajectory.size() / 3 );
+  std::vector< double > updateTimesSec;
+  updateTimesSec.reserve( numberOfPositions );
+  double closestPoint[3] = { 0.0, 0.0, 0.0 };
+  int closestSurfaceIndex = -1;
+  for ( int positionIndex = 1; positionIndex < numberOfPositions; positionIndex++ )
+  {
+    double queryStartTimeSec = vtkTimerLog::GetUniversalTime();
+    hierarchy->FindClosestPoint( &( trajectory[ 3 * positionIndex ] ), closestPoint, closestSurfaceIndex );
+    updateTimesSec.push_back( vtkTimerLog::GetUniversalTime() - queryStartTimeSec );
+  }
+  ComputeStatistics( updateTimesSec, result );
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+  std::vector< std::string > modes = SplitString( "locator,sdf,lod,shaft,bvh" );
+  std::vector< std::string > numberOfTrianglesStr = SplitString( "1000,10000,100000,1000000,5000000" );
+  int numberOfUpdates = 1000;
+  for ( int argIndex = 1; argIndex < argc; argIndex++ )
+  {
+    std::string arg = argv[ argIndex ];
+    if ( arg == "--quick" )
+    {
+      // small run for checking that the benchmark works
+      numberOfTrianglesStr = SplitString( "1000,10000" );
+      numberOfUpdates = 100;
+    }
+    else if ( arg == "--updates" && argIndex + 1 < argc )
+    {
+      numberOfUpdates = atoi( argv[ ++argIndex ] );
+    }
+    else if ( arg == "--triangles" && argIndex + 1 < argc )
+    {
+      numberOfTrianglesStr = SplitString( argv[ ++argIndex ] );
+    }
+    else if ( arg == "--modes" && argIndex + 1 < argc )
+    {
+      modes = SplitString( argv[ ++argIndex ] );
+    }
+    else
+    {
+      std::cerr << "Usage: " << argv[ 0 ] << " [--quick] [--updates N] [--triangles N1,N2,...] [--modes locator,sdf,lod,shaft,bvh]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if ( numberOfUpdates < 2 )
+  {
+    std::cerr << "Number of updates must be at least 2" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector< double > trajectory;
+  CreateTrajectory( numberOfUpdates, trajectory );
+
+  std::cout << std::setw( 8 ) << "mode"
+    << std::setw( 12 ) << "triangles"
+    << std::setw( 11 ) << "transform"
+    << std::setw( 12 ) << "setup[ms]"
+    << std::setw( 12 ) << "mean[us]"
+    << std::setw( 12 ) << "p95[us]"
+    << std::setw( 12 ) << "p99[us]"
+    << std::setw( 14 ) << "updates/sec" << std::endl;
+
+  bool success = true;
+  for ( std::vector< std::string >::iterator trianglesIt = numberOfTrianglesStr.begin(); trianglesIt != numberOfTrianglesStr.end(); ++trianglesIt )
+  {
+    vtkSmartPointer< vtkPolyData > surface = CreateSphereModel( atoi( trianglesIt->c_str() ) );
+    for ( int useParentTransform = 0; useParentTransform < 2; useParentTransform++ )
+    {
+      for ( std::vector< std::string >::iterator modeIt = modes.begin(); modeIt != modes.end(); ++modeIt )
+      {
+        BenchmarkResult result;
+        if ( ( *modeIt ) == "bvh" )
+        {
+          RunHierarchyBenchmark( surface, useParentTransform != 0, trajectory, result );
+        }
+        else if ( !RunLogicBenchmark( *modeIt, surface, useParentTransform != 0, trajectory, result ) )
+        {
+          success = false;
+          continue;
+        }
+        std::cout << std::setw( 8 ) << ( *modeIt )
+          << std::setw( 12 ) << surface->GetNumberOfPolys()
+          << std::setw( 11 ) << ( useParentTransform ? "rigid" : "none" )
+          << std::fixed << std::setprecision( 1 )
+          << std::setw( 12 ) << result.SetupTimeSec * 1e3
+          << std::setw( 12 ) << result.MeanSec * 1e6
+          << std::setw( 12 ) << result.Percentile95Sec * 1e6
+          << std::setw( 12 ) << result.Percentile99Sec * 1e6
+          << std::setw( 14 ) << std::setprecision( 0 ) << result.UpdatesPerSec << std::endl;
+      }
+    }
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
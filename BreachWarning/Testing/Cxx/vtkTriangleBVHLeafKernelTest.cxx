@@ -0,0 +1,160 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Verifies the leaf kernels of vtkTriangleBVH: distances computed by each kernel that the processor supports
+// must match vtkImplicitPolyDataDistance, and all kernels must return exactly the same closest point.
+
+// BreachWarning includes
+#include "vtkTriangleBVH.h"
+#include "vtkTriangleBVHLeafKernel.h"
+
+// VTK includes
+#include <vtkImplicitPolyDataDistance.h>
+#include <vtkMath.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkNew.h>
+#include <vtkPolyData.h>
+#include <vtkSmartPointer.h>
+#include <vtkSphereSource.h>
+#include <vtkTransform.h>
+#include <vtkTransformPolyDataFilter.h>
+
+// STD includes
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+const double DISTANCE_TOLERANCE_MM = 1e-6;
+const int NUMBER_OF_POINTS = 2000;
+
+//----------------------------------------------------------------------------
+// Ellipsoid with an irregular triangulation, so that leaves contain triangles of various shapes
+vtkSmartPointer< vtkPolyData > CreateSurface()
+{
+  vtkNew< vtkSphereSource > sphere;
+  sphere->SetRadius( 30.0 );
+  sphere->SetThetaResolution( 47 );
+  sphere->SetPhiResolution( 31 );
+  vtkNew< vtkTransform > transform;
+  transform->Translate( 5.0, -3.0, 12.0 );
+  transform->RotateWXYZ( 35.0, 1.0, 2.0, 0.5 );
+  transform->Scale( 1.0, 0.6, 1.4 );
+  vtkNew< vtkTransformPolyDataFilter > transformFilter;
+  transformFilter->SetInputConnection( sphere->GetOutputPort() );
+  transformFilter->SetTransform( transform.GetPointer() );
+  transformFilter->Update();
+  vtkSmartPointer< vtkPolyData > surface = vtkSmartPointer< vtkPolyData >::New();
+  surface->DeepCopy( transformFilter->GetOutput() );
+  return surface;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkTriangleBVHLeafKernelTest( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  vtkSmartPointer< vtkPolyData > surface = CreateSurface();
+
+  vtkNew< vtkImplicitPolyDataDistance > referenceDistance;
+  referenceDistance->SetInput( surface );
+
+  std::vector< double > points( 3 * NUMBER_OF_POINTS );
+  vtkNew< vtkMinimalStandardRandomSequence > random;
+  random->SetSeed( 1234 );
+  for ( int i = 0; i < 3 * NUMBER_OF_POINTS; i++ )
+  {
+    points[ i ] = random->GetRangeValue( -60.0, 60.0 );
+    random->Next();
+  }
+
+  // Results of the scalar kernel, other kernels must return the same closest points
+  std::vector< double > scalarClosestPoints( 3 * NUMBER_OF_POINTS );
+
+  int numberOfErrors = 0;
+  for ( int kernel = vtkTriangleBVHLeafKernel::KERNEL_SCALAR; kernel < vtkTriangleBVHLeafKernel::KERNEL_LAST; kernel++ )
+  {
+    if ( !vtkTriangleBVHLeafKernel::IsKernelSupported( kernel ) )
+    {
+      std::cout << "Kernel " << vtkTriangleBVHLeafKernel::GetKernelName( kernel ) << " is not supported, skipped" << std::endl;
+      continue;
+    }
+    std::cout << "Testing kernel " << vtkTriangleBVHLeafKernel::GetKernelName( kernel ) << std::endl;
+
+    vtkNew< vtkTriangleBVH > hierarchy;
+    // Leaf size that is not a multiple of the packet sizes, to test partially filled packets
+    hierarchy->SetMaximumNumberOfTrianglesPerLeaf( 7 );
+    hierarchy->AddSurface( surface );
+    hierarchy->Build();
+    if ( !hierarchy->SetLeafKernel( kernel ) || hierarchy->GetActiveLeafKernel() != kernel )
+    {
+      std::cerr << "Failed to set kernel " << vtkTriangleBVHLeafKernel::GetKernelName( kernel ) << std::endl;
+      numberOfErrors++;
+      continue;
+    }
+
+    for ( int i = 0; i < NUMBER_OF_POINTS; i++ )
+    {
+      const double* x = &( points[ 3 * i ] );
+      double closestPoint[3] = { 0.0, 0.0, 0.0 };
+      int closestSurfaceIndex = -1;
+      double distance = hierarchy->FindClosestPoint( x, closestPoint, closestSurfaceIndex );
+
+      double referenceClosestPoint[3] = { 0.0, 0.0, 0.0 };
+      double expectedDistance = referenceDistance->EvaluateFunctionAndGetClosestPoint( const_cast< double* >( x ), referenceClosestPoint );
+      // Sign is ambiguous very close to the surface
+      bool signMismatch = fabs( expectedDistance ) > 1e-3 && ( distance < 0 ) != ( expectedDistance < 0 );
+      if ( closestSurfaceIndex != 0 || fabs( fabs( distance ) - fabs( expectedDistance ) ) > DISTANCE_TOLERANCE_MM || signMismatch )
+      {
+        if ( numberOfErrors < 10 )
+        {
+          std::cerr << "Kernel " << vtkTriangleBVHLeafKernel::GetKernelName( kernel ) << ": distance mismatch at point ("
+            << x[ 0 ] << ", " << x[ 1 ] << ", " << x[ 2 ] << "): " << distance << " (expected " << expectedDistance << ")" << std::endl;
+        }
+        numberOfErrors++;
+      }
+
+      double* scalarClosestPoint = &( scalarClosestPoints[ 3 * i ] );
+      if ( kernel == vtkTriangleBVHLeafKernel::KERNEL_SCALAR )
+      {
+        scalarClosestPoint[ 0 ] = closestPoint[ 0 ];
+        scalarClosestPoint[ 1 ] = closestPoint[ 1 ];
+        scalarClosestPoint[ 2 ] = closestPoint[ 2 ];
+      }
+      else if ( vtkMath::Distance2BetweenPoints( closestPoint, scalarClosestPoint ) > DISTANCE_TOLERANCE_MM * DISTANCE_TOLERANCE_MM )
+      {
+        if ( numberOfErrors < 10 )
+        {
+          std::cerr << "Kernel " << vtkTriangleBVHLeafKernel::GetKernelName( kernel ) << ": closest point differs from scalar kernel at point ("
+            << x[ 0 ] << ", " << x[ 1 ] << ", " << x[ 2 ] << ")" << std::endl;
+        }
+        numberOfErrors++;
+      }
+    }
+  }
+
+  if ( numberOfErrors > 0 )
+  {
+    std::cerr << "Number of errors: " << numberOfErrors << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "Test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -148,16 +148,19 @@ class BreachWarningSelfTestTest(ScriptedLoadableModuleTest):
 
     self.delayDisplay('Tool is outside the sphere')
     toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOutside)
+    slicer.app.processEvents() # breach warning nodes are updated in the next event loop iteration
     sphereColor = sphereModel.GetDisplayNode().GetColor()
     self.assertNotEqual(sphereColor, warningColor)
 
     self.delayDisplay('Tool is inside the sphere')
     toolToWorldTransform.SetMatrixTransformToParent(transformMatrixInside)
+    slicer.app.processEvents()
     sphereColor = sphereModel.GetDisplayNode().GetColor()
     self.assertEqual(sphereColor, warningColor)
 
     self.delayDisplay('Tool is outside the sphere')
     toolToWorldTransform.SetMatrixTransformToParent(transformMatrixOutside)
+    slicer.app.processEvents() # breach warning nodes are updated in the next event loop iteration
     sphereColor = sphereModel.GetDisplayNode().GetColor()
     self.assertNotEqual(sphereColor, warningColor)
 
@@ -17,6 +17,8 @@
 
 // Qt includes
 #include <QDir>
+#include <QFileInfo>
+#include <QMap>
 #include <QPointer>
 #include <QSound>
 #include <QTime>
@@ -45,9 +47,17 @@ class qSlicerBreachWarningModulePrivate
 public:
   qSlicerBreachWarningModulePrivate();
 
+  /// Returns the sound object of a sound identifier (see vtkMRMLBreachWarningNode::GetNthDistanceBandSound).
+  /// Empty identifier or missing sound file returns the default warning sound.
+  QSound* sound(const QString& soundName);
+
   vtkSlicerBreachWarningLogic* ObservedLogic; // should be the same as logic(), it is used for adding/removing observer safely
   QTimer UpdateWarningSoundTimer;
-  QPointer<QSound> WarningSound;
+  QTimer AsynchronousUpdateTimer; // collects results of background distance computation
+  QTimer DeferredUpdateTimer; // processes all input changes of breach warning nodes in the next event loop iteration
+  QPointer<QSound> WarningSound; // default sound
+  QMap< QString, QPointer<QSound> > Sounds; // sounds of distance bands, loaded when first needed
+  QPointer<QSound> PlayingSound;
   double WarningSoundPeriodSec;
 };
 
@@ -60,6 +70,33 @@ qSlicerBreachWarningModulePrivate::qSlicerBreachWarningModulePrivate()
 {
 }
 
+//-----------------------------------------------------------------------------
+QSound* qSlicerBreachWarningModulePrivate::sound(const QString& soundName)
+{
+  if (soundName.isEmpty() || this->ObservedLogic == NULL)
+  {
+    return this->WarningSound;
+  }
+  QMap< QString, QPointer<QSound> >::iterator soundIt = this->Sounds.find(soundName);
+  if (soundIt != this->Sounds.end() && !soundIt.value().isNull())
+  {
+    return soundIt.value();
+  }
+  QString soundFilePath = soundName;
+  if (QFileInfo(soundFilePath).isRelative())
+  {
+    soundFilePath = QDir(QString::fromStdString(this->ObservedLogic->GetModuleShareDirectory())).filePath(soundName);
+  }
+  if (!QFileInfo(soundFilePath).exists())
+  {
+    qWarning("Sound file not found: %s. Default warning sound is used instead.", qPrintable(soundFilePath));
+    return this->WarningSound;
+  }
+  QSound* sound = new QSound(QDir::toNativeSeparators(soundFilePath));
+  this->Sounds[soundName] = sound;
+  return sound;
+}
+
 //-----------------------------------------------------------------------------
 // qSlicerBreachWarningModule methods
 
@@ -92,8 +129,23 @@ qSlicerBreachWarningModule::~qSlicerBreachWarningModule()
   {
     d->WarningSound->stop();
   }
+  foreach (QPointer<QSound> sound, d->Sounds)
+  {
+    if (!sound.isNull())
+    {
+      sound->stop();
+      delete sound;
+    }
+  }
+  d->Sounds.clear();
   disconnect(&d->UpdateWarningSoundTimer, SIGNAL(timeout()), this, SLOT(updateWarningSound()));
+  d->AsynchronousUpdateTimer.stop();
+  disconnect(&d->AsynchronousUpdateTimer, SIGNAL(timeout()), this, SLOT(processAsynchronousUpdateResults()));
+  d->DeferredUpdateTimer.stop();
+  disconnect(&d->DeferredUpdateTimer, SIGNAL(timeout()), this, SLOT(processDeferredUpdates()));
+  this->qvtkReconnect(d->ObservedLogic, NULL, vtkSlicerBreachWarningLogic::DeferredUpdateRequestedEvent, this, SLOT(requestDeferredUpdate()));
   this->qvtkReconnect(d->ObservedLogic, NULL, vtkCommand::ModifiedEvent, this, SLOT(updateWarningSound()));
+  this->qvtkReconnect(d->ObservedLogic, NULL, vtkCommand::ModifiedEvent, this, SLOT(updateAsynchronousUpdateTimer()));
   d->ObservedLogic = NULL;
 }
 
@@ -145,10 +197,24 @@ void qSlicerBreachWarningModule::setup()
   }
 
   this->qvtkReconnect(d->ObservedLogic, moduleLogic, vtkCommand::ModifiedEvent, this, SLOT(updateWarningSound()));
+  this->qvtkReconnect(d->ObservedLogic, moduleLogic, vtkCommand::ModifiedEvent, this, SLOT(updateAsynchronousUpdateTimer()));
+  this->qvtkReconnect(d->ObservedLogic, moduleLogic, vtkSlicerBreachWarningLogic::DeferredUpdateRequestedEvent, this, SLOT(requestDeferredUpdate()));
   d->ObservedLogic = moduleLogic;
 
   d->UpdateWarningSoundTimer.setSingleShot(true);
   connect(&d->UpdateWarningSoundTimer, SIGNAL(timeout()), this, SLOT(updateWarningSound()));
+
+  // Short period, so that results are displayed with minimal delay after they are computed
+  d->AsynchronousUpdateTimer.setInterval(10);
+  connect(&d->AsynchronousUpdateTimer, SIGNAL(timeout()), this, SLOT(processAsynchronousUpdateResults()));
+  this->updateAsynchronousUpdateTimer();
+
+  // All transform changes of a tracker frame are received in the same event loop iteration,
+  // so the breach warning nodes are updated only once per frame
+  d->DeferredUpdateTimer.setSingleShot(true);
+  d->DeferredUpdateTimer.setInterval(0);
+  connect(&d->DeferredUpdateTimer, SIGNAL(timeout()), this, SLOT(processDeferredUpdates()));
+  moduleLogic->SetDeferredUpdate(true);
 }
 
 //-----------------------------------------------------------------------------
@@ -178,28 +244,91 @@ void qSlicerBreachWarningModule::updateWarningSound()
     return;
   }
   bool warningSoundShouldPlay = d->ObservedLogic->GetWarningSoundPlaying();
-  if (warningSoundShouldPlay)
+  QSound* sound = d->sound(QString::fromStdString(d->ObservedLogic->GetWarningSound()));
+  if (!d->PlayingSound.isNull() && (!warningSoundShouldPlay || d->PlayingSound != sound))
   {
-    d->WarningSound->setLoops(1);
-    d->WarningSound->play();
+    // warning ended or the tool moved into a band with a different sound
+    d->PlayingSound->stop();
+    d->PlayingSound = NULL;
   }
-  else
+  if (warningSoundShouldPlay)
   {
-    d->WarningSound->stop();
+    sound->setLoops(1);
+    sound->play();
+    d->PlayingSound = sound;
   }
   d->UpdateWarningSoundTimer.start(warningSoundPeriodSec()*1000);
 }
 
 
+//------------------------------------------------------------------------------
+void qSlicerBreachWarningModule::updateAsynchronousUpdateTimer()
+{
+  Q_D(qSlicerBreachWarningModule);
+  bool asynchronousUpdate = (d->ObservedLogic != NULL && d->ObservedLogic->GetAsynchronousUpdate());
+  if (asynchronousUpdate && !d->AsynchronousUpdateTimer.isActive())
+  {
+    d->AsynchronousUpdateTimer.start();
+  }
+  else if (!asynchronousUpdate && d->AsynchronousUpdateTimer.isActive())
+  {
+    d->AsynchronousUpdateTimer.stop();
+  }
+}
+
+//------------------------------------------------------------------------------
+void qSlicerBreachWarningModule::processAsynchronousUpdateResults()
+{
+  Q_D(qSlicerBreachWarningModule);
+  if (d->ObservedLogic == NULL)
+  {
+    return;
+  }
+  d->ObservedLogic->ProcessAsynchronousUpdateResults();
+}
+
+//------------------------------------------------------------------------------
+void qSlicerBreachWarningModule::requestDeferredUpdate()
+{
+  Q_D(qSlicerBreachWarningModule);
+  if (!d->DeferredUpdateTimer.isActive())
+  {
+    d->DeferredUpdateTimer.start();
+  }
+}
+
+//------------------------------------------------------------------------------
+void qSlicerBreachWarningModule::processDeferredUpdates()
+{
+  Q_D(qSlicerBreachWarningModule);
+  if (d->ObservedLogic == NULL)
+  {
+    return;
+  }
+  d->ObservedLogic->ProcessDeferredUpdates();
+}
+
 //------------------------------------------------------------------------------
 void qSlicerBreachWarningModule::stopSound()
 {
   Q_D(qSlicerBreachWarningModule);
+  if (!d->PlayingSound.isNull())
+  {
+    d->PlayingSound->stop();
+    d->PlayingSound=NULL;
+  }
   if (!d->WarningSound.isNull())
   {
     d->WarningSound->stop();
     d->WarningSound=NULL;
   }
+  foreach (QPointer<QSound> sound, d->Sounds)
+  {
+    if (!sound.isNull())
+    {
+      sound->stop();
+    }
+  }
 }
 
 //------------------------------------------------------------------------------
@@ -81,6 +81,16 @@ public slots:
   void updateWarningSound();
   void stopSound();
 
+  /// Starts/stops polling of background computation results, depending on the logic's AsynchronousUpdate setting
+  void updateAsynchronousUpdateTimer();
+  /// Applies completed background computation results (main thread)
+  void processAsynchronousUpdateResults();
+
+  /// Schedules processing of changed breach warning nodes for the next event loop iteration
+  void requestDeferredUpdate();
+  /// Updates all the breach warning nodes that changed since the last processing
+  void processDeferredUpdates();
+
 protected:
 
   /// Initialize the module. Register the volumes reader/writer
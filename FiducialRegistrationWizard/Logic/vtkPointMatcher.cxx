@@ -1,9 +1,13 @@
 #include "vtkPointMatcher.h"
-#include "vtkCombinatoricGenerator.h"
 #include <vtkMath.h>
+#include <vtkObjectFactory.h> //for vtkStandardNewMacro() macro
+
+#include <algorithm>
 
 #define RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR VTK_DOUBLE_MAX
 #define MINIMUM_NUMBER_OF_POINTS_NEEDED_TO_MATCH 3
+#define INITIAL_SEARCH_LIMIT_ROOT_MEAN_SQUARE_DISTANCE_ERROR_MM 1.0
+#define DEFAULT_MAXIMUM_NUMBER_OF_SEARCH_NODES 200000
 
 //----------------------------------------------------------------------------
 vtkStandardNewMacro( vtkPointMatcher );
@@ -18,6 +22,12 @@ vtkPointMatcher::vtkPointMatcher()
   this->ComputedRootMeanSquareDistanceErrorMm = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
   this->AmbiguityThresholdDistanceMm = 5.0;
   this->MatchingAmbiguous = false;
+  this->MaximumNumberOfSearchNodes = DEFAULT_MAXIMUM_NUMBER_OF_SEARCH_NODES;
+  this->NumberOfSearchNodes = 0;
+  this->SearchComplete = true;
+  this->SecondBestRootMeanSquareDistanceErrorMm = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+  this->SearchLimitRootMeanSquareDistanceErrorMm = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+  this->MaximumPointDistanceMm = 0.0;
   // outputs are never null
   this->OutputPointList1 = vtkSmartPointer< vtkPoints >::New();
   this->OutputPointList2 = vtkSmartPointer< vtkPoints >::New();
@@ -42,6 +52,8 @@ void vtkPointMatcher::PrintSelf( std::ostream &os, vtkIndent indent )
   os << indent << "ComputedRootMeanSquareDistanceErrorMm: " << this->ComputedRootMeanSquareDistanceErrorMm << std::endl;
   os << indent << "IsMatchingWithinTolerance: " << this->IsMatchingWithinTolerance() << std::endl;
   os << indent << "IsMatchingAmbiguous" << this->IsMatchingAmbiguous() << std::endl;
+  os << indent << "MaximumNumberOfSearchNodes: " << this->MaximumNumberOfSearchNodes << std::endl;
+  os << indent << "IsSearchComplete: " << this->IsSearchComplete() << std::endl;
   os << indent << "UpdateNeeded: " << this->UpdateNeeded() << std::endl;
 }
 
@@ -92,6 +104,15 @@ void vtkPointMatcher::SetAmbiguityThresholdDistanceMm( double thresholdMm )
   this->ComputedRootMeanSquareDistanceErrorMm = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
 }
 
+//------------------------------------------------------------------------------
+void vtkPointMatcher::SetMaximumNumberOfSearchNodes( unsigned long numberOfNodes )
+{
+  this->MaximumNumberOfSearchNodes = numberOfNodes;
+  this->Modified();
+  // mean distance error has not been computed yet. Set to maximum possible value for now
+  this->ComputedRootMeanSquareDistanceErrorMm = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+}
+
 //------------------------------------------------------------------------------
 // OUTPUT ACCESSORS
 //------------------------------------------------------------------------------
@@ -151,6 +172,17 @@ bool vtkPointMatcher::IsMatchingAmbiguous()
   return this->MatchingAmbiguous;
 }
 
+//------------------------------------------------------------------------------
+bool vtkPointMatcher::IsSearchComplete()
+{
+  if ( this->UpdateNeeded() )
+  {
+    this->Update();
+  }
+
+  return this->SearchComplete;
+}
+
 //------------------------------------------------------------------------------
 // LOGIC
 //------------------------------------------------------------------------------
@@ -204,234 +236,456 @@ void vtkPointMatcher::Update()
   int smallerPointListSize = smallerPointsList->GetNumberOfPoints();
   int largerPointListSize = largerPointsList->GetNumberOfPoints();
 
+  this->NumberOfSearchNodes = 0;
+  this->SearchComplete = true;
+  this->MatchingAmbiguous = false;
+  this->UpdatePointDistances();
+  this->UpdatePointList1SearchOrder();
+
   // iterate through all valid numbers of points, based on the sizes
   // of the inputs, and the maximum point difference specified
   int minimumNumberOfPointsToMatch = vtkMath::Max( ( largerPointListSize - this->MaximumDifferenceInNumberOfPoints ), ( unsigned int )MINIMUM_NUMBER_OF_POINTS_NEEDED_TO_MATCH );
-  for ( int numberOfPoints = smallerPointListSize; numberOfPoints >= minimumNumberOfPointsToMatch; numberOfPoints-- )
+
+  // Usually there is a matching within tolerance. Then only the matchings within
+  // AmbiguityThresholdDistanceMm of it can affect the result, so there is no need to
+  // find out how large the error is for the others (which is slow if the inputs
+  // have both missing and extra points).
+  double searchLimitMm = this->TolerableRootMeanSquareDistanceErrorMm + this->AmbiguityThresholdDistanceMm;
+  this->UpdateBestMatchingForAllNumbersOfPoints( smallerPointListSize, minimumNumberOfPointsToMatch, searchLimitMm );
+  if ( this->SearchComplete && this->ComputedRootMeanSquareDistanceErrorMm > this->TolerableRootMeanSquareDistanceErrorMm )
   {
-    this->UpdateBestMatchingForAllSubsetsOfPoints( numberOfPoints );
-    if ( this->ComputedRootMeanSquareDistanceErrorMm <= this->TolerableRootMeanSquareDistanceErrorMm )
-    {
-      // suitable solution has been found, no need to continue searching
-      break;
-    }
+    // no matching within tolerance, search for the best matching without limits
+    this->UpdateBestMatchingForAllNumbersOfPoints( smallerPointListSize, minimumNumberOfPointsToMatch, RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR );
+  }
+
+  // ambiguous if any other matching is within the threshold of the best one
+  if ( this->SecondBestRootMeanSquareDistanceErrorMm != RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR )
+  {
+    double differenceToSecondBestMm = this->SecondBestRootMeanSquareDistanceErrorMm - this->ComputedRootMeanSquareDistanceErrorMm;
+    this->MatchingAmbiguous = ( differenceToSecondBestMm <= this->AmbiguityThresholdDistanceMm );
+  }
+  if ( !this->SearchComplete )
+  {
+    // there may be a better matching, or other matchings close to this one
+    vtkWarningMacro( "Point matching search was stopped after " << this->NumberOfSearchNodes << " partial matchings. "
+      << "The best matching found so far is used, it is reported as ambiguous." );
+    this->MatchingAmbiguous = true;
   }
 
+  this->UpdateOutputPointLists();
   this->OutputChangedTime.Modified();
 }
 
 //------------------------------------------------------------------------------
-void vtkPointMatcher::UpdateBestMatchingForAllSubsetsOfPoints( int sizeOfSubset )
+void vtkPointMatcher::UpdatePointDistances()
 {
-  // generate sets of indices for all possible combinations of both input sets
-  vtkSmartPointer< vtkCombinatoricGenerator > pointList1CombinationGenerator = vtkSmartPointer< vtkCombinatoricGenerator >::New();
-  pointList1CombinationGenerator->SetCombinatoricToCombination();
-  pointList1CombinationGenerator->SetSubsetSize( sizeOfSubset );
-  pointList1CombinationGenerator->SetNumberOfInputSets( 1 );
-  for ( int pointIndex = 0; pointIndex < this->InputPointList1->GetNumberOfPoints(); pointIndex++ )
+  this->MaximumPointDistanceMm = 0.0;
+
+  vtkSmartPointer< vtkPointDistanceMatrix > pointList1DistanceMatrix = vtkSmartPointer< vtkPointDistanceMatrix >::New();
+  pointList1DistanceMatrix->SetPointList1( this->InputPointList1 );
+  pointList1DistanceMatrix->SetPointList2( this->InputPointList1 ); // distances to itself
+  pointList1DistanceMatrix->Update();
+  int pointList1Size = this->InputPointList1->GetNumberOfPoints();
+  this->PointList1Distances.resize( pointList1Size * pointList1Size );
+  for ( int rowIndex = 0; rowIndex < pointList1Size; rowIndex++ )
   {
-    pointList1CombinationGenerator->AddInputElement( 0, pointIndex );
+    for ( int columnIndex = 0; columnIndex < pointList1Size; columnIndex++ )
+    {
+      this->PointList1Distances[ rowIndex * pointList1Size + columnIndex ] = pointList1DistanceMatrix->GetDistance( rowIndex, columnIndex );
+      this->MaximumPointDistanceMm = vtkMath::Max( this->MaximumPointDistanceMm, this->PointList1Distances[ rowIndex * pointList1Size + columnIndex ] );
+    }
   }
-  pointList1CombinationGenerator->Update();
-  std::vector< std::vector< int > > pointList1CombinationIndices = pointList1CombinationGenerator->GetOutputSets();
 
-  vtkSmartPointer< vtkCombinatoricGenerator > pointList2CombinationGenerator = vtkSmartPointer< vtkCombinatoricGenerator >::New();
-  pointList2CombinationGenerator->SetCombinatoricToCombination();
-  pointList2CombinationGenerator->SetSubsetSize( sizeOfSubset );
-  pointList2CombinationGenerator->SetNumberOfInputSets( 1 );
-  for ( int pointIndex = 0; pointIndex < this->InputPointList2->GetNumberOfPoints(); pointIndex++ )
+  vtkSmartPointer< vtkPointDistanceMatrix > pointList2DistanceMatrix = vtkSmartPointer< vtkPointDistanceMatrix >::New();
+  pointList2DistanceMatrix->SetPointList1( this->InputPointList2 );
+  pointList2DistanceMatrix->SetPointList2( this->InputPointList2 ); // distances to itself
+  pointList2DistanceMatrix->Update();
+  int pointList2Size = this->InputPointList2->GetNumberOfPoints();
+  this->PointList2Distances.resize( pointList2Size * pointList2Size );
+  for ( int rowIndex = 0; rowIndex < pointList2Size; rowIndex++ )
   {
-    pointList2CombinationGenerator->AddInputElement( 0, pointIndex );
+    for ( int columnIndex = 0; columnIndex < pointList2Size; columnIndex++ )
+    {
+      this->PointList2Distances[ rowIndex * pointList2Size + columnIndex ] = pointList2DistanceMatrix->GetDistance( rowIndex, columnIndex );
+      this->MaximumPointDistanceMm = vtkMath::Max( this->MaximumPointDistanceMm, this->PointList2Distances[ rowIndex * pointList2Size + columnIndex ] );
+    }
   }
-  pointList2CombinationGenerator->Update();
-  std::vector< std::vector< int > > pointList2CombinationIndices = pointList2CombinationGenerator->GetOutputSets();
+}
 
-  // these will store the actual combinations of points themselves (not indices)
-  vtkSmartPointer< vtkPoints > pointList1Combination = vtkSmartPointer< vtkPoints >::New();
-  pointList1Combination->SetNumberOfPoints( sizeOfSubset );
-  vtkSmartPointer< vtkPoints > pointList2Combination = vtkSmartPointer< vtkPoints >::New();
-  pointList2Combination->SetNumberOfPoints( sizeOfSubset );
+//------------------------------------------------------------------------------
+// Points that are far from each other constrain the pairings the most, so among
+// equally constrained points the search prefers them: start with the point farthest
+// from all others, then repeatedly take the point farthest from those already ordered.
+void vtkPointMatcher::UpdatePointList1SearchOrder()
+{
+  int pointList1Size = this->InputPointList1->GetNumberOfPoints();
+  this->PointList1SearchOrder.clear();
+  if ( pointList1Size == 0 )
+  {
+    return;
+  }
 
-  // iterate over all combinations of both input point sets
-  for ( unsigned int pointList1CombinationIndex = 0; pointList1CombinationIndex < pointList1CombinationIndices.size(); pointList1CombinationIndex++ )
+  int firstPointIndex = 0;
+  double largestSumOfDistances = -1.0;
+  for ( int pointIndex = 0; pointIndex < pointList1Size; pointIndex++ )
   {
-    for ( unsigned int pointList2CombinationIndex = 0; pointList2CombinationIndex < pointList2CombinationIndices.size(); pointList2CombinationIndex++ )
+    double sumOfDistances = 0.0;
+    for ( int otherPointIndex = 0; otherPointIndex < pointList1Size; otherPointIndex++ )
     {
-      // store appropriate contents in the pointList1Combination and pointList2Combination variables
-      for ( vtkIdType pointIndex = 0; pointIndex < sizeOfSubset; pointIndex++ )
-      {
-        vtkIdType point1Index = ( vtkIdType ) pointList1CombinationIndices[ pointList1CombinationIndex ][ pointIndex ];
-        double* pointFromList1 = this->InputPointList1->GetPoint( point1Index );
-        pointList1Combination->SetPoint( pointIndex, pointFromList1 );
+      sumOfDistances += this->PointList1Distances[ pointIndex * pointList1Size + otherPointIndex ];
+    }
+    if ( sumOfDistances > largestSumOfDistances )
+    {
+      largestSumOfDistances = sumOfDistances;
+      firstPointIndex = pointIndex;
+    }
+  }
 
-        vtkIdType point2Index = ( vtkIdType ) pointList2CombinationIndices[ pointList2CombinationIndex ][ pointIndex ];
-        double* pointFromList2 = this->InputPointList2->GetPoint( point2Index );
-        pointList2Combination->SetPoint( pointIndex, pointFromList2 );
+  std::vector< bool > pointOrdered( pointList1Size, false );
+  std::vector< double > distanceToOrderedPoints( pointList1Size, VTK_DOUBLE_MAX );
+  int nextPointIndex = firstPointIndex;
+  while ( nextPointIndex >= 0 )
+  {
+    this->PointList1SearchOrder.push_back( nextPointIndex );
+    pointOrdered[ nextPointIndex ] = true;
+    int orderedPointIndex = nextPointIndex;
+    nextPointIndex = -1;
+    double largestDistance = -1.0;
+    for ( int pointIndex = 0; pointIndex < pointList1Size; pointIndex++ )
+    {
+      if ( pointOrdered[ pointIndex ] )
+      {
+        continue;
+      }
+      double distance = this->PointList1Distances[ pointIndex * pointList1Size + orderedPointIndex ];
+      distanceToOrderedPoints[ pointIndex ] = vtkMath::Min( distanceToOrderedPoints[ pointIndex ], distance );
+      if ( distanceToOrderedPoints[ pointIndex ] > largestDistance )
+      {
+        largestDistance = distanceToOrderedPoints[ pointIndex ];
+        nextPointIndex = pointIndex;
       }
-      // finally see how good this particular combination is
-      this->UpdateBestMatchingForSubsetOfPoints( pointList1Combination, pointList2Combination );
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+// Matchings of maximumNumberOfPoints are searched first, then smaller ones until
+// a matching within tolerance is found.
+void vtkPointMatcher::UpdateBestMatchingForAllNumbersOfPoints( int maximumNumberOfPoints, int minimumNumberOfPoints, double maximumSearchLimitMm )
+{
+  // start the search from scratch
+  this->ComputedRootMeanSquareDistanceErrorMm = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+  this->SecondBestRootMeanSquareDistanceErrorMm = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+  this->BestMatching.clear();
+  for ( int numberOfPoints = maximumNumberOfPoints; numberOfPoints >= minimumNumberOfPoints; numberOfPoints-- )
+  {
+    this->UpdateBestMatchingForAllSubsetsOfPoints( numberOfPoints, maximumSearchLimitMm );
+    if ( this->ComputedRootMeanSquareDistanceErrorMm <= this->TolerableRootMeanSquareDistanceErrorMm
+      || !this->SearchComplete )
+    {
+      // suitable solution has been found, no need to continue searching
+      break;
     }
   }
 }
 
 //------------------------------------------------------------------------------
 // point pair matching will be based on the distances between each pair of ordered points.
-// we have an input reference point list and a compare point list. We want to reorder
-// the compare list such that the point-to-point distances are as close as possible to those 
-// in the reference list. We will permute over all possibilities (and only ever keep the best result.)
-void vtkPointMatcher::UpdateBestMatchingForSubsetOfPoints( vtkPoints* pointSubset1, vtkPoints* pointSubset2 )
+// We look for sizeOfSubset points from list 1 and as many points from list 2, paired such that
+// the point-to-point distances are as close as possible between the two lists.
+// Instead of enumerating every combination and permutation, the pairing is built one
+// list 1 point at a time (each point is either assigned to an unused list 2 point or left out).
+// A partial pairing is abandoned as soon as the distance errors it already has, plus a lower
+// bound of the errors the remaining points will add, cannot lead to a matching that
+// either improves the best one or is close enough to it to make the result ambiguous.
+void vtkPointMatcher::UpdateBestMatchingForAllSubsetsOfPoints( int sizeOfSubset, double maximumSearchLimitMm )
 {
-  // error checking
-  if ( pointSubset1 == NULL )
+  int pointList1Size = this->InputPointList1->GetNumberOfPoints();
+  int pointList2Size = this->InputPointList2->GetNumberOfPoints();
+  if ( sizeOfSubset > pointList1Size || sizeOfSubset > pointList2Size )
   {
-    vtkGenericWarningMacro( "Reference point set is NULL. This is a coding error. Please report." );
+    vtkGenericWarningMacro( "Subset size is larger than a point set. This is a coding error. Please report." );
     return;
   }
 
-  if ( pointSubset2 == NULL )
+  // allocate the partial cost tables once, the search only overwrites their contents
+  this->PartialCostsPerLevel.resize( sizeOfSubset + 1 );
+  for ( int level = 0; level <= sizeOfSubset; level++ )
+  {
+    this->PartialCostsPerLevel[ level ].resize( pointList1Size * pointList2Size );
+  }
+  std::fill( this->PartialCostsPerLevel[ 0 ].begin(), this->PartialCostsPerLevel[ 0 ].end(), 0.0 );
+
+  // Until a good matching is found, the pruning is too loose to be effective.
+  // So first only look for matchings below a small error limit, and increase the
+  // limit until it covers every matching that can affect the result (the best one
+  // and those within AmbiguityThresholdDistanceMm of it). No distance error can be
+  // larger than the largest point distance, so that limit means no limit at all.
+  double bestRootMeanSquareDistanceErrorMm = this->ComputedRootMeanSquareDistanceErrorMm;
+  double secondBestRootMeanSquareDistanceErrorMm = this->SecondBestRootMeanSquareDistanceErrorMm;
+  std::vector< int > bestMatching = this->BestMatching;
+  double searchLimitMm = vtkMath::Min( INITIAL_SEARCH_LIMIT_ROOT_MEAN_SQUARE_DISTANCE_ERROR_MM, maximumSearchLimitMm );
+  double previousPassBestRootMeanSquareDistanceErrorMm = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+  std::vector< int > previousPassBestMatching;
+  while ( true )
   {
-    vtkGenericWarningMacro( "Compare point set is NULL. This is a coding error. Please report." );
+    // each pass starts from the results of the previous subset sizes, matchings
+    // found in a previous pass must not be counted twice
+    previousPassBestRootMeanSquareDistanceErrorMm = this->ComputedRootMeanSquareDistanceErrorMm;
+    previousPassBestMatching = this->BestMatching;
+    this->ComputedRootMeanSquareDistanceErrorMm = bestRootMeanSquareDistanceErrorMm;
+    this->SecondBestRootMeanSquareDistanceErrorMm = secondBestRootMeanSquareDistanceErrorMm;
+    this->BestMatching = bestMatching;
+    this->CurrentMatching.assign( pointList1Size, -1 );
+    this->PointList1Processed.assign( pointList1Size, false );
+    this->PointList2Assigned.assign( pointList2Size, false );
+    this->SearchLimitRootMeanSquareDistanceErrorMm = searchLimitMm;
+
+    this->SearchMatchings( 0, 0, sizeOfSubset, 0.0 );
+
+    if ( !this->SearchComplete )
+    {
+      // the interrupted pass may not have found the best matching of the previous pass yet
+      if ( previousPassBestRootMeanSquareDistanceErrorMm < this->ComputedRootMeanSquareDistanceErrorMm )
+      {
+        this->ComputedRootMeanSquareDistanceErrorMm = previousPassBestRootMeanSquareDistanceErrorMm;
+        this->BestMatching = previousPassBestMatching;
+      }
+      break;
+    }
+    if ( searchLimitMm >= maximumSearchLimitMm
+      || searchLimitMm >= this->MaximumPointDistanceMm
+      || this->GetPruningRootMeanSquareDistanceErrorMm() <= searchLimitMm )
+    {
+      break;
+    }
+    searchLimitMm = vtkMath::Min( 2.0 * searchLimitMm, maximumSearchLimitMm );
+  }
+  this->SearchLimitRootMeanSquareDistanceErrorMm = RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
+}
+
+//------------------------------------------------------------------------------
+// Sums of squared distance errors are over all ordered pairs of matched points,
+// so the error between two matched points is counted twice. The RMS error is
+// computed over the full sizeOfSubset x sizeOfSubset distance matrix.
+void vtkPointMatcher::SearchMatchings( int numberOfProcessedPoints, int numberOfAssignedPoints, int sizeOfSubset, double sumOfSquaredDistanceErrors )
+{
+  if ( !this->SearchComplete )
+  {
+    return;
+  }
+  this->NumberOfSearchNodes++;
+  if ( this->NumberOfSearchNodes > this->MaximumNumberOfSearchNodes )
+  {
+    // computation budget is exhausted, keep the best matching found so far
+    this->SearchComplete = false;
     return;
   }
 
-  int numberOfPoints = pointSubset1->GetNumberOfPoints(); // sizes of both lists should be identical
-  if ( numberOfPoints != pointSubset2->GetNumberOfPoints() )
+  if ( numberOfAssignedPoints == sizeOfSubset )
   {
-    vtkGenericWarningMacro( "Point sets are of different sizes. This is a coding error. Please report." );
+    double meanOfSquaredDistanceErrors = sumOfSquaredDistanceErrors / ( sizeOfSubset * sizeOfSubset );
+    this->UpdateBestMatching( sqrt( meanOfSquaredDistanceErrors ) );
     return;
   }
 
-  // Point distance matrix
-  vtkSmartPointer< vtkPointDistanceMatrix > pointSubset1DistanceMatrix = vtkSmartPointer< vtkPointDistanceMatrix >::New();
-  pointSubset1DistanceMatrix->SetPointList1( pointSubset1 );
-  pointSubset1DistanceMatrix->SetPointList2( pointSubset1 ); // distances to itself
-  pointSubset1DistanceMatrix->Update();
+  int pointList1Size = this->InputPointList1->GetNumberOfPoints();
+  int pointList2Size = this->InputPointList2->GetNumberOfPoints();
+  int numberOfPointsToAssign = sizeOfSubset - numberOfAssignedPoints;
+  if ( pointList1Size - numberOfProcessedPoints < numberOfPointsToAssign )
+  {
+    // not enough points left in list 1
+    return;
+  }
+
+  double remainingLowerBound = 0.0;
+  int point1Index = this->SelectNextPointToProcess( numberOfAssignedPoints, sizeOfSubset, sumOfSquaredDistanceErrors, remainingLowerBound );
+  if ( sumOfSquaredDistanceErrors + remainingLowerBound > this->GetPruningSumOfSquaredDistanceErrors( sizeOfSubset ) )
+  {
+    return;
+  }
 
-  // compute the permutations, store them in a vtkIntArray.
-  vtkSmartPointer< vtkCombinatoricGenerator > combinatoricGenerator = vtkSmartPointer< vtkCombinatoricGenerator >::New();
-  combinatoricGenerator->SetCombinatoricToPermutation();
-  combinatoricGenerator->SetSubsetSize( numberOfPoints );
-  combinatoricGenerator->SetNumberOfInputSets( 1 );
-  for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
+  // try the list 2 points that agree best with the points assigned so far first,
+  // so that good matchings are found early and the pruning becomes tight quickly
+  const std::vector< double >& partialCosts = this->PartialCostsPerLevel[ numberOfAssignedPoints ];
+  std::vector< std::pair< double, int > > candidates;
+  candidates.reserve( pointList2Size );
+  for ( int point2Index = 0; point2Index < pointList2Size; point2Index++ )
   {
-    combinatoricGenerator->AddInputElement( 0, pointIndex );
+    if ( !this->PointList2Assigned[ point2Index ] )
+    {
+      candidates.push_back( std::make_pair( partialCosts[ point1Index * pointList2Size + point2Index ], point2Index ) );
+    }
+  }
+  std::sort( candidates.begin(), candidates.end() );
+
+  this->PointList1Processed[ point1Index ] = true;
+  std::vector< double >& nextPartialCosts = this->PartialCostsPerLevel[ numberOfAssignedPoints + 1 ];
+  for ( unsigned int candidateIndex = 0; candidateIndex < candidates.size(); candidateIndex++ )
+  {
+    double nextSumOfSquaredDistanceErrors = sumOfSquaredDistanceErrors + 2.0 * candidates[ candidateIndex ].first;
+    if ( nextSumOfSquaredDistanceErrors > this->GetPruningSumOfSquaredDistanceErrors( sizeOfSubset ) )
+    {
+      // candidates are sorted, the remaining ones are even worse
+      break;
+    }
+    int point2Index = candidates[ candidateIndex ].second;
+
+    // errors that each remaining pairing would have with respect to the newly assigned pair
+    for ( int otherPoint1Index = 0; otherPoint1Index < pointList1Size; otherPoint1Index++ )
+    {
+      if ( this->PointList1Processed[ otherPoint1Index ] )
+      {
+        continue;
+      }
+      double distance1 = this->PointList1Distances[ otherPoint1Index * pointList1Size + point1Index ];
+      for ( int otherPoint2Index = 0; otherPoint2Index < pointList2Size; otherPoint2Index++ )
+      {
+        int costIndex = otherPoint1Index * pointList2Size + otherPoint2Index;
+        double distanceError = distance1 - this->PointList2Distances[ otherPoint2Index * pointList2Size + point2Index ];
+        nextPartialCosts[ costIndex ] = partialCosts[ costIndex ] + distanceError * distanceError;
+      }
+    }
+
+    this->CurrentMatching[ point1Index ] = point2Index;
+    this->PointList2Assigned[ point2Index ] = true;
+    this->SearchMatchings( numberOfProcessedPoints + 1, numberOfAssignedPoints + 1, sizeOfSubset, nextSumOfSquaredDistanceErrors );
+    this->CurrentMatching[ point1Index ] = -1;
+    this->PointList2Assigned[ point2Index ] = false;
   }
-  combinatoricGenerator->Update();
-  std::vector< std::vector< int > > pointSubset2IndexPermutations = combinatoricGenerator->GetOutputSets();
 
-  // iterate over all permutations - look for the most 'suitable'
-  // point matching that gives distances most similar to the reference
+  // leave this point out of the matching
+  if ( pointList1Size - numberOfProcessedPoints - 1 >= numberOfPointsToAssign )
+  {
+    this->SearchMatchings( numberOfProcessedPoints + 1, numberOfAssignedPoints, sizeOfSubset, sumOfSquaredDistanceErrors );
+  }
+  this->PointList1Processed[ point1Index ] = false;
+}
 
-  // create + allocate the permuted compare list once outside
-  // the loop to avoid allocation/deallocation time costs.
-  vtkSmartPointer< vtkPoints > permutedPointSubset2 = vtkSmartPointer< vtkPoints >::New();
-  permutedPointSubset2->DeepCopy( pointSubset2 ); // fill it with placeholder data, same size as compareList
-  vtkSmartPointer< vtkPointDistanceMatrix > permutedPointSubset2DistanceMatrix = vtkSmartPointer< vtkPointDistanceMatrix >::New();
-  int numberOfPermutations = pointSubset2IndexPermutations.size();
-  for ( int permutationIndex = 0; permutationIndex < numberOfPermutations; permutationIndex++ )
+//------------------------------------------------------------------------------
+// Each list 1 point that is not processed yet will add at least the errors of its
+// best pairing with respect to the points already assigned. Only the points that
+// still have to be assigned are counted, so the cheapest ones are taken.
+// Errors between two points that are both not assigned yet are bounded by zero.
+// The point to process next is the one with the fewest list 2 points it can still
+// be paired with (ties: the one with the worst best pairing), so that dead ends
+// are found as early as possible.
+int vtkPointMatcher::SelectNextPointToProcess( int numberOfAssignedPoints, int sizeOfSubset, double sumOfSquaredDistanceErrors, double& remainingLowerBound )
+{
+  int pointList1Size = this->InputPointList1->GetNumberOfPoints();
+  int pointList2Size = this->InputPointList2->GetNumberOfPoints();
+  const std::vector< double >& partialCosts = this->PartialCostsPerLevel[ numberOfAssignedPoints ];
+  double pruningSumOfSquaredDistanceErrors = this->GetPruningSumOfSquaredDistanceErrors( sizeOfSubset );
+
+  int selectedPoint1Index = -1;
+  int selectedNumberOfCandidates = pointList2Size + 1;
+  double selectedSmallestPartialCost = -1.0;
+  std::vector< double > smallestPartialCosts;
+  smallestPartialCosts.reserve( pointList1Size );
+  for ( int orderIndex = 0; orderIndex < pointList1Size; orderIndex++ )
   {
-    // fill permutedPointSubset2 with points from pointSubset2,
-    // in the order indicate by the permuted indices
-    for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
+    int point1Index = this->PointList1SearchOrder[ orderIndex ];
+    if ( this->PointList1Processed[ point1Index ] )
     {
-      int permutedPointIndex = pointSubset2IndexPermutations[ permutationIndex][ pointIndex ];
-      double* permutedPoint = pointSubset2->GetPoint( permutedPointIndex );
-      permutedPointSubset2->SetPoint( pointIndex, permutedPoint );
+      continue;
     }
-    permutedPointSubset2DistanceMatrix->SetPointList1( permutedPointSubset2 );
-    permutedPointSubset2DistanceMatrix->SetPointList2( permutedPointSubset2 );
-    permutedPointSubset2DistanceMatrix->Update();
-    double rootMeanSquareDistanceErrorMm = this->ComputeRootMeanSquareistanceErrors( pointSubset1DistanceMatrix, permutedPointSubset2DistanceMatrix );
-
-    // case analysis for setting MatchingAmbiguous:
-    // let ComputedRootMeanSquareDistanceErrorMm store the distance error for the *best* matching
-    // let rootMeanSquareDistanceErrorMm store the distance error for the *current* matching
-    // use AmbiguityThresholdDistanceMm and MatchingAmbiguous as described in the header file
-    // 1
-    // rootMeanSquareDistanceErrorMm is better (lower) than ComputedRootMeanSquareDistanceErrorMm,
-    // but by less than AmbiguityThresholdDistanceMm
-    // Result => MatchingAmbiguous should be set to true
-    //   - trivial justification
-    // 2
-    // rootMeanSquareDistanceErrorMm is worse (higher) than ComputedRootMeanSquareDistanceErrorMm,
-    // but by less than AmbiguityThresholdDistanceMm
-    // Result => MatchingAmbiguous should be set to true
-    //   - trivial justification
-    // 3
-    // rootMeanSquareDistanceErrorMm is better (lower) than ComputedRootMeanSquareDistanceErrorMm,
-    // but by more than AmbiguityThresholdDistanceMm
-    // Result => MatchingAmbiguous should be set to false.
-    //   - If there was a _previous_ rootMeanSquareDistanceErrorMm within AmbiguityThresholdDistanceMm,
-    //     that would have become ComputedRootMeanSquareDistanceErrorMm. Therefore there have not been
-    //     any _previous_ rootMeanSquareDistanceErrorMm within AmbiguityThresholdDistanceMm.
-    //   - If _later_ there is a rootMeanSquareDistanceErrorMm within AmbiguityThresholdDistanceMm,
-    //     then MatchingAmbiguous will be set to true by either case 1 or case 2.
-    //     Cases 1 and 2 will always catch an ambiguous matching, because the search is exhaustive.
-    // 4
-    // rootMeanSquareDistanceErrorMm is worse (higher) than ComputedRootMeanSquareDistanceErrorMm,
-    // but by more than AmbiguityThresholdDistanceMm
-    // Result => do nothing
-    //   - This result does not matter. It *cannot* be within AmbiguityThresholdDistanceMm
-    //     of the best (final) ComputedRootMeanSquareDistanceErrorMm
-
-    // flag ambiguous if suitability within some threshold of the best result so far
-    double differenceComparedToBestMm = this->ComputedRootMeanSquareDistanceErrorMm - rootMeanSquareDistanceErrorMm;
-    bool withinAmbiguityThresholdDistanceMm = ( fabs( differenceComparedToBestMm ) <= this->AmbiguityThresholdDistanceMm );
-
-    // is this the best matching?
-    if ( rootMeanSquareDistanceErrorMm < this->ComputedRootMeanSquareDistanceErrorMm )
+    double smallestPartialCost = VTK_DOUBLE_MAX;
+    int numberOfCandidates = 0;
+    for ( int point2Index = 0; point2Index < pointList2Size; point2Index++ )
     {
-      if ( withinAmbiguityThresholdDistanceMm )
+      if ( this->PointList2Assigned[ point2Index ] )
       {
-        // case 1, described above
-        this->MatchingAmbiguous = true;
+        continue;
       }
-      else
+      double partialCost = partialCosts[ point1Index * pointList2Size + point2Index ];
+      smallestPartialCost = vtkMath::Min( smallestPartialCost, partialCost );
+      if ( sumOfSquaredDistanceErrors + 2.0 * partialCost <= pruningSumOfSquaredDistanceErrors )
       {
-        // case 3, described above
-        this->MatchingAmbiguous = false;
+        numberOfCandidates++;
       }
-      this->ComputedRootMeanSquareDistanceErrorMm = rootMeanSquareDistanceErrorMm;
-      this->OutputPointList1->DeepCopy( pointSubset1 );
-      this->OutputPointList2->DeepCopy( permutedPointSubset2 );
     }
-    else if ( withinAmbiguityThresholdDistanceMm )
+    smallestPartialCosts.push_back( smallestPartialCost );
+
+    if ( numberOfCandidates < selectedNumberOfCandidates ||
+      ( numberOfCandidates == selectedNumberOfCandidates && smallestPartialCost > selectedSmallestPartialCost ) )
     {
-      // case 2, described above
-      this->MatchingAmbiguous = true;
+      selectedPoint1Index = point1Index;
+      selectedNumberOfCandidates = numberOfCandidates;
+      selectedSmallestPartialCost = smallestPartialCost;
     }
   }
+
+  remainingLowerBound = 0.0;
+  int numberOfPointsToAssign = sizeOfSubset - numberOfAssignedPoints;
+  if ( numberOfAssignedPoints > 0 && numberOfPointsToAssign > 0 )
+  {
+    std::nth_element( smallestPartialCosts.begin(), smallestPartialCosts.begin() + ( numberOfPointsToAssign - 1 ), smallestPartialCosts.end() );
+    for ( int costIndex = 0; costIndex < numberOfPointsToAssign; costIndex++ )
+    {
+      remainingLowerBound += 2.0 * smallestPartialCosts[ costIndex ];
+    }
+  }
+  return selectedPoint1Index;
 }
 
 //------------------------------------------------------------------------------
-double vtkPointMatcher::ComputeRootMeanSquareistanceErrors( vtkPointDistanceMatrix* distanceMatrix1, vtkPointDistanceMatrix* distanceMatrix2 )
+// A matching is only of interest if it improves the best matching, or if it could
+// be the closest other matching within AmbiguityThresholdDistanceMm of the best one.
+double vtkPointMatcher::GetPruningRootMeanSquareDistanceErrorMm()
 {
-  if ( distanceMatrix1 == NULL || distanceMatrix2 == NULL )
+  if ( this->ComputedRootMeanSquareDistanceErrorMm == RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR )
   {
-    vtkGenericWarningMacro( "One of the input distance matrices is null. Cannot compute similarity. Returning default value " << RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR << "." );
     return RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR;
   }
+  return vtkMath::Min( this->SecondBestRootMeanSquareDistanceErrorMm,
+    this->ComputedRootMeanSquareDistanceErrorMm + this->AmbiguityThresholdDistanceMm );
+}
 
-  vtkSmartPointer< vtkDoubleArray > distanceErrorMatrix = vtkSmartPointer< vtkDoubleArray >::New();
-  vtkPointDistanceMatrix::ComputePairWiseDifferences( distanceMatrix2, distanceMatrix1, distanceErrorMatrix );
+//------------------------------------------------------------------------------
+double vtkPointMatcher::GetPruningSumOfSquaredDistanceErrors( int sizeOfSubset )
+{
+  double pruningRootMeanSquareDistanceErrorMm = vtkMath::Min( this->GetPruningRootMeanSquareDistanceErrorMm(),
+    this->SearchLimitRootMeanSquareDistanceErrorMm );
+  if ( pruningRootMeanSquareDistanceErrorMm == RESET_VALUE_COMPUTED_ROOT_MEAN_DISTANCE_ERROR )
+  {
+    return VTK_DOUBLE_MAX;
+  }
+  return pruningRootMeanSquareDistanceErrorMm * pruningRootMeanSquareDistanceErrorMm * sizeOfSubset * sizeOfSubset;
+}
 
-  double sumOfSquaredDistanceErrors = 0;
-  int numberOfColumns = distanceErrorMatrix->GetNumberOfTuples();
-  int numberOfRows = distanceErrorMatrix->GetNumberOfComponents();
-  for ( int columnIndex = 0; columnIndex < numberOfColumns; columnIndex++ )
+//------------------------------------------------------------------------------
+// Keep the best and the second best matching. The matching is ambiguous if the
+// second best is within AmbiguityThresholdDistanceMm of the best one. The search
+// visits every matching that could be either, so this is decided exactly.
+void vtkPointMatcher::UpdateBestMatching( double rootMeanSquareDistanceErrorMm )
+{
+  if ( rootMeanSquareDistanceErrorMm < this->ComputedRootMeanSquareDistanceErrorMm )
+  {
+    this->SecondBestRootMeanSquareDistanceErrorMm = this->ComputedRootMeanSquareDistanceErrorMm;
+    this->ComputedRootMeanSquareDistanceErrorMm = rootMeanSquareDistanceErrorMm;
+    this->BestMatching = this->CurrentMatching;
+  }
+  else if ( rootMeanSquareDistanceErrorMm < this->SecondBestRootMeanSquareDistanceErrorMm )
   {
-    for ( int rowIndex = 0; rowIndex < numberOfRows; rowIndex++ )
+    this->SecondBestRootMeanSquareDistanceErrorMm = rootMeanSquareDistanceErrorMm;
+  }
+}
+
+//------------------------------------------------------------------------------
+void vtkPointMatcher::UpdateOutputPointLists()
+{
+  this->OutputPointList1->Reset();
+  this->OutputPointList2->Reset();
+  for ( unsigned int point1Index = 0; point1Index < this->BestMatching.size(); point1Index++ )
+  {
+    int point2Index = this->BestMatching[ point1Index ];
+    if ( point2Index < 0 )
     {
-      double currentDistanceError = distanceErrorMatrix->GetComponent( columnIndex, rowIndex );
-      sumOfSquaredDistanceErrors += ( currentDistanceError * currentDistanceError );
+      continue;
     }
+    this->OutputPointList1->InsertNextPoint( this->InputPointList1->GetPoint( point1Index ) );
+    this->OutputPointList2->InsertNextPoint( this->InputPointList2->GetPoint( point2Index ) );
   }
-
-  int numberOfDistances = numberOfColumns * numberOfRows;
-  double meanOfSquaredDistanceErrors = sumOfSquaredDistanceErrors / numberOfDistances;
-  double rootMeanSquareistanceErrors = sqrt( meanOfSquaredDistanceErrors );
-
-  return rootMeanSquareistanceErrors;
 }
 
 //------------------------------------------------------------------------------
@@ -6,6 +6,8 @@
 #include <vtkTimeStamp.h>
 #include "vtkPointDistanceMatrix.h"
 
+#include <vector>
+
 // export
 #include "vtkSlicerFiducialRegistrationWizardModuleLogicExport.h"
 
@@ -13,6 +15,8 @@
 // InputPointList2), and tries to determine their pairing. The outputs are two lists
 // (OutputPointList1 and OutputPointList2) that contain ordered, corresponding pairs
 // from the two input lists. Extra or missing points are removed from the output.
+// Pairings are found by a branch-and-bound search over partial point assignments,
+// so lists of around twenty points can be matched without enumerating every permutation.
 class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkPointMatcher : public vtkObject //vtkAlgorithm?
 {
   public:
@@ -27,9 +31,11 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkPointMatcher
     void SetMaximumDifferenceInNumberOfPoints( unsigned int );
     void SetTolerableRootMeanSquareDistanceErrorMm( double );
     void SetAmbiguityThresholdDistanceMm( double );
+    void SetMaximumNumberOfSearchNodes( unsigned long );
     vtkGetMacro( MaximumDifferenceInNumberOfPoints, unsigned int );
     vtkGetMacro( TolerableRootMeanSquareDistanceErrorMm, double );
     vtkGetMacro( AmbiguityThresholdDistanceMm, double );
+    vtkGetMacro( MaximumNumberOfSearchNodes, unsigned long );
 
     // Output Accessors
     vtkPoints* GetOutputPointList1();
@@ -37,6 +43,7 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkPointMatcher
     double GetComputedRootMeanSquareDistanceErrorMm();
     bool IsMatchingAmbiguous();
     bool IsMatchingWithinTolerance();
+    bool IsSearchComplete();
 
     // Logic
     void Update();
@@ -79,6 +86,16 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkPointMatcher
     double AmbiguityThresholdDistanceMm;
     bool MatchingAmbiguous;
 
+    // Limits the computation time for inputs where the search cannot prune
+    // much (e.g., extra and missing points in both lists). If more partial
+    // matchings than this are visited then the search stops, the best matching
+    // found so far is returned, and the matching is reported as ambiguous.
+    // Higher = slower in the worst case, but more likely to find the best matching
+    // Lower = faster in the worst case, but more likely to give up
+    unsigned long MaximumNumberOfSearchNodes;
+    unsigned long NumberOfSearchNodes;
+    bool SearchComplete;
+
     // these points will be ordered pairs
     // and the lists will be the same length as one another
     vtkSmartPointer< vtkPoints > OutputPointList1;
@@ -88,10 +105,43 @@ class VTK_SLICER_FIDUCIALREGISTRATIONWIZARD_MODULE_LOGIC_EXPORT vtkPointMatcher
     vtkTimeStamp OutputChangedTime;
     bool UpdateNeeded();
 
+    // Distances between all points of each input list (row-major, n x n).
+    // Computed once per update, the search only reads from these.
+    std::vector< double > PointList1Distances;
+    std::vector< double > PointList2Distances;
+
+    // Branch-and-bound search state
+    // Order in which points of list 1 are considered when several are equally
+    // constrained, most spread out points first
+    std::vector< int > PointList1SearchOrder;
+    std::vector< bool > PointList1Processed;
+    // Index of the list 2 point assigned to each list 1 point, -1 if not assigned
+    std::vector< int > CurrentMatching;
+    std::vector< int > BestMatching;
+    std::vector< bool > PointList2Assigned;
+    // For each number of assigned points m, the squared distance errors that
+    // pairing list 1 point u with list 2 point v would add with respect to the
+    // m points already assigned (n1 x n2 per level).
+    std::vector< std::vector< double > > PartialCostsPerLevel;
+    // RMS error of the best matching that differs from the best one,
+    // used to determine ambiguity and to bound the search
+    double SecondBestRootMeanSquareDistanceErrorMm;
+    // Matchings with a larger RMS error are not searched in the current pass
+    double SearchLimitRootMeanSquareDistanceErrorMm;
+    double MaximumPointDistanceMm;
+
     // Logic helpers
-    void UpdateBestMatchingForAllSubsetsOfPoints( int sizeOfSubset );
-    void UpdateBestMatchingForSubsetOfPoints( vtkPoints* list1, vtkPoints* list2 );
-    double ComputeRootMeanSquareistanceErrors( vtkPointDistanceMatrix*, vtkPointDistanceMatrix* );
+    void UpdatePointDistances();
+    void UpdatePointList1SearchOrder();
+    // Matchings with an RMS error above maximumSearchLimitMm are not searched
+    void UpdateBestMatchingForAllNumbersOfPoints( int maximumNumberOfPoints, int minimumNumberOfPoints, double maximumSearchLimitMm );
+    void UpdateBestMatchingForAllSubsetsOfPoints( int sizeOfSubset, double maximumSearchLimitMm );
+    void SearchMatchings( int numberOfProcessedPoints, int numberOfAssignedPoints, int sizeOfSubset, double sumOfSquaredDistanceErrors );
+    int SelectNextPointToProcess( int numberOfAssignedPoints, int sizeOfSubset, double sumOfSquaredDistanceErrors, double& remainingLowerBound );
+    double GetPruningRootMeanSquareDistanceErrorMm();
+    double GetPruningSumOfSquaredDistanceErrors( int sizeOfSubset );
+    void UpdateBestMatching( double rootMeanSquareDistanceErrorMm );
+    void UpdateOutputPointLists();
 
     // Not implemented:
 		vtkPointMatcher(const vtkPointMatcher&);
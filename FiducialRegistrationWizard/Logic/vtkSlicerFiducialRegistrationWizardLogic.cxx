@@ -286,7 +286,7 @@ bool vtkSlicerFiducialRegistrationWizardLogic::UpdateCalibration(vtkMRMLNode* no
         << " registration is being used." << std::endl << "Unexpected results may occur.";
       fiducialRegistrationWizardNode->AddToCalibrationStatusMessage(msg.str());
     }
-    const int MAX_NUMBER_OF_POINTS_FOR_POINT_MATCHING_AUTOMATIC = 8; // more than this and it tends to take a long time. Algorithm is at least N!
+    const int MAX_NUMBER_OF_POINTS_FOR_POINT_MATCHING_AUTOMATIC = 20; // the point matcher search is also bounded by its maximum number of search nodes
     int fromNumberOfPoints = fromPointsUnordered->GetNumberOfPoints();
     int toNumberOfPoints = toPointsUnordered->GetNumberOfPoints();
     int numberOfPointsToMatch = std::max(fromNumberOfPoints, toNumberOfPoints);
@@ -315,6 +315,14 @@ bool vtkSlicerFiducialRegistrationWizardLogic::UpdateCalibration(vtkMRMLNode* no
         << "Results are not expected to be accurate.";
       fiducialRegistrationWizardNode->AddToCalibrationStatusMessage(msg.str());
     }
+    if (!pointMatcher->IsSearchComplete())
+    {
+      std::stringstream msg;
+      msg << "Point matching search was stopped after " << pointMatcher->GetMaximumNumberOfSearchNodes() << " search steps." << std::endl
+        << "The point matching is reported as ambiguous because better matchings may exist." << std::endl
+        << "Reducing the number of points or the number of unmatched points makes the search faster.";
+      fiducialRegistrationWizardNode->AddToCalibrationStatusMessage(msg.str());
+    }
     if (pointMatcher->IsMatchingAmbiguous())
     {
       std::stringstream msg;
@@ -0,0 +1,322 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Verifies vtkPointMatcher on point sets with known correspondences: a permuted and
+// moved point set, a point set with one missing and one extra point, and a symmetric
+// point set that has several equally good matchings.
+
+// FiducialRegistrationWizard includes
+#include "vtkPointMatcher.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkNew.h>
+#include <vtkPoints.h>
+#include <vtkSmartPointer.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+const double RMS_TOLERANCE_MM = 1e-3;
+const double NOISE_MM = 0.5;
+const double MINIMUM_POINT_DISTANCE_MM = 30.0;
+// Tolerance and ambiguity threshold are lower than the registration defaults.
+// Swapping two points that are MINIMUM_POINT_DISTANCE_MM apart may increase the
+// error by only a few millimeters, that must not be reported as ambiguous.
+const double TOLERABLE_RMS_DISTANCE_ERROR_MM = 2.0;
+const double AMBIGUITY_THRESHOLD_DISTANCE_MM = 1.5;
+
+//----------------------------------------------------------------------------
+double GetRandomValue( vtkMinimalStandardRandomSequence* random, double minimum, double maximum )
+{
+  double value = random->GetRangeValue( minimum, maximum );
+  random->Next();
+  return value;
+}
+
+//----------------------------------------------------------------------------
+// Points in a box, far enough from each other that the point set has no symmetries
+vtkSmartPointer< vtkPoints > CreateRandomPoints( vtkMinimalStandardRandomSequence* random, int numberOfPoints )
+{
+  vtkSmartPointer< vtkPoints > points = vtkSmartPointer< vtkPoints >::New();
+  while ( points->GetNumberOfPoints() < numberOfPoints )
+  {
+    double point[3] = { GetRandomValue( random, -80.0, 80.0 ), GetRandomValue( random, -60.0, 60.0 ), GetRandomValue( random, -40.0, 40.0 ) };
+    bool tooClose = false;
+    for ( vtkIdType pointIndex = 0; pointIndex < points->GetNumberOfPoints(); pointIndex++ )
+    {
+      if ( vtkMath::Distance2BetweenPoints( point, points->GetPoint( pointIndex ) ) < MINIMUM_POINT_DISTANCE_MM * MINIMUM_POINT_DISTANCE_MM )
+      {
+        tooClose = true;
+        break;
+      }
+    }
+    if ( !tooClose )
+    {
+      points->InsertNextPoint( point );
+    }
+  }
+  return points;
+}
+
+//----------------------------------------------------------------------------
+// Corners of a box with different side lengths. Each mirroring of the box maps
+// the corners onto each other, so there are 8 matchings with zero error.
+vtkSmartPointer< vtkPoints > CreateBoxCornerPoints()
+{
+  vtkSmartPointer< vtkPoints > points = vtkSmartPointer< vtkPoints >::New();
+  for ( int cornerIndex = 0; cornerIndex < 8; cornerIndex++ )
+  {
+    points->InsertNextPoint( ( cornerIndex & 1 ) ? 30.0 : -30.0, ( cornerIndex & 2 ) ? 50.0 : -50.0, ( cornerIndex & 4 ) ? 80.0 : -80.0 );
+  }
+  return points;
+}
+
+//----------------------------------------------------------------------------
+// Moves the points (and adds noise to them) and shuffles their order.
+// pointIndicesInOutput[ i ] is the index of input point i in the output list.
+vtkSmartPointer< vtkPoints > CreateMovedPoints( vtkMinimalStandardRandomSequence* random, vtkPoints* points, double noiseMm,
+  std::vector< int >& pointIndicesInOutput )
+{
+  vtkNew< vtkTransform > transform;
+  transform->Translate( 120.0, -35.0, 250.0 );
+  transform->RotateWXYZ( 70.0, 0.3, -1.0, 0.6 );
+
+  int numberOfPoints = points->GetNumberOfPoints();
+  std::vector< int > outputOrder( numberOfPoints );
+  for ( int pointIndex = 0; pointIndex < numberOfPoints; pointIndex++ )
+  {
+    outputOrder[ pointIndex ] = pointIndex;
+  }
+  for ( int pointIndex = numberOfPoints - 1; pointIndex > 0; pointIndex-- )
+  {
+    int swapIndex = std::min( ( int )GetRandomValue( random, 0.0, pointIndex + 1 ), pointIndex );
+    std::swap( outputOrder[ pointIndex ], outputOrder[ swapIndex ] );
+  }
+
+  vtkSmartPointer< vtkPoints > movedPoints = vtkSmartPointer< vtkPoints >::New();
+  movedPoints->SetNumberOfPoints( numberOfPoints );
+  pointIndicesInOutput.assign( numberOfPoints, -1 );
+  for ( int outputIndex = 0; outputIndex < numberOfPoints; outputIndex++ )
+  {
+    int pointIndex = outputOrder[ outputIndex ];
+    double movedPoint[3] = { 0.0, 0.0, 0.0 };
+    transform->TransformPoint( points->GetPoint( pointIndex ), movedPoint );
+    for ( int axis = 0; axis < 3; axis++ )
+    {
+      movedPoint[ axis ] += GetRandomValue( random, -noiseMm, noiseMm );
+    }
+    movedPoints->SetPoint( outputIndex, movedPoint );
+    pointIndicesInOutput[ pointIndex ] = outputIndex;
+  }
+  return movedPoints;
+}
+
+//----------------------------------------------------------------------------
+int FindPointIndex( vtkPoints* points, const double* point )
+{
+  for ( vtkIdType pointIndex = 0; pointIndex < points->GetNumberOfPoints(); pointIndex++ )
+  {
+    if ( vtkMath::Distance2BetweenPoints( point, points->GetPoint( pointIndex ) ) == 0.0 )
+    {
+      return pointIndex;
+    }
+  }
+  return -1;
+}
+
+//----------------------------------------------------------------------------
+// Same error metric as vtkPointMatcher: RMS of the differences between the
+// point distance matrices of the paired points (including the diagonal).
+double ComputeExpectedRootMeanSquareDistanceErrorMm( vtkPoints* points1, vtkPoints* points2, const std::vector< int >& expectedMatching )
+{
+  double sumOfSquaredDistanceErrors = 0.0;
+  int numberOfPairs = 0;
+  for ( unsigned int pointIndexA = 0; pointIndexA < expectedMatching.size(); pointIndexA++ )
+  {
+    if ( expectedMatching[ pointIndexA ] < 0 )
+    {
+      continue;
+    }
+    numberOfPairs++;
+    for ( unsigned int pointIndexB = 0; pointIndexB < expectedMatching.size(); pointIndexB++ )
+    {
+      if ( expectedMatching[ pointIndexB ] < 0 )
+      {
+        continue;
+      }
+      double point1A[3] = { 0.0, 0.0, 0.0 };
+      double point1B[3] = { 0.0, 0.0, 0.0 };
+      double point2A[3] = { 0.0, 0.0, 0.0 };
+      double point2B[3] = { 0.0, 0.0, 0.0 };
+      points1->GetPoint( pointIndexA, point1A );
+      points1->GetPoint( pointIndexB, point1B );
+      points2->GetPoint( expectedMatching[ pointIndexA ], point2A );
+      points2->GetPoint( expectedMatching[ pointIndexB ], point2B );
+      double distance1 = sqrt( vtkMath::Distance2BetweenPoints( point1A, point1B ) );
+      double distance2 = sqrt( vtkMath::Distance2BetweenPoints( point2A, point2B ) );
+      sumOfSquaredDistanceErrors += ( distance1 - distance2 ) * ( distance1 - distance2 );
+    }
+  }
+  return sqrt( sumOfSquaredDistanceErrors / ( numberOfPairs * numberOfPairs ) );
+}
+
+//----------------------------------------------------------------------------
+// Runs the matcher and compares the results to the expected ones.
+// expectedMatching[ i ] is the index in points2 of the point corresponding to points1 point i,
+// -1 if it has no corresponding point. If checkPairs is false then only the number of pairs is checked.
+int TestMatching( const char* testName, vtkPoints* points1, vtkPoints* points2, const std::vector< int >& expectedMatching,
+  bool checkPairs, double expectedRootMeanSquareDistanceErrorMm, bool expectedAmbiguous )
+{
+  std::cout << "Testing " << testName << std::endl;
+
+  vtkNew< vtkPointMatcher > pointMatcher;
+  pointMatcher->SetInputPointList1( points1 );
+  pointMatcher->SetInputPointList2( points2 );
+  pointMatcher->SetMaximumDifferenceInNumberOfPoints( 2 );
+  pointMatcher->SetTolerableRootMeanSquareDistanceErrorMm( TOLERABLE_RMS_DISTANCE_ERROR_MM );
+  pointMatcher->SetAmbiguityThresholdDistanceMm( AMBIGUITY_THRESHOLD_DISTANCE_MM );
+  pointMatcher->Update();
+
+  int numberOfErrors = 0;
+  if ( !pointMatcher->IsSearchComplete() )
+  {
+    std::cerr << testName << ": search was not completed" << std::endl;
+    numberOfErrors++;
+  }
+  if ( !pointMatcher->IsMatchingWithinTolerance() )
+  {
+    std::cerr << testName << ": matching is not within tolerance" << std::endl;
+    numberOfErrors++;
+  }
+  double rootMeanSquareDistanceErrorMm = pointMatcher->GetComputedRootMeanSquareDistanceErrorMm();
+  if ( fabs( rootMeanSquareDistanceErrorMm - expectedRootMeanSquareDistanceErrorMm ) > RMS_TOLERANCE_MM )
+  {
+    std::cerr << testName << ": RMS distance error is " << rootMeanSquareDistanceErrorMm
+      << " (expected " << expectedRootMeanSquareDistanceErrorMm << ")" << std::endl;
+    numberOfErrors++;
+  }
+  if ( pointMatcher->IsMatchingAmbiguous() != expectedAmbiguous )
+  {
+    std::cerr << testName << ": matching is " << ( pointMatcher->IsMatchingAmbiguous() ? "" : "not " )
+      << "reported as ambiguous (expected " << ( expectedAmbiguous ? "" : "not " ) << "ambiguous)" << std::endl;
+    numberOfErrors++;
+  }
+
+  int expectedNumberOfPairs = expectedMatching.size() - std::count( expectedMatching.begin(), expectedMatching.end(), -1 );
+  vtkPoints* outputPoints1 = pointMatcher->GetOutputPointList1();
+  vtkPoints* outputPoints2 = pointMatcher->GetOutputPointList2();
+  if ( outputPoints1->GetNumberOfPoints() != expectedNumberOfPairs || outputPoints2->GetNumberOfPoints() != expectedNumberOfPairs )
+  {
+    std::cerr << testName << ": number of matched points is " << outputPoints1->GetNumberOfPoints() << " and " << outputPoints2->GetNumberOfPoints()
+      << " (expected " << expectedNumberOfPairs << ")" << std::endl;
+    return numberOfErrors + 1;
+  }
+  if ( !checkPairs )
+  {
+    return numberOfErrors;
+  }
+  for ( int pairIndex = 0; pairIndex < expectedNumberOfPairs; pairIndex++ )
+  {
+    int pointIndex1 = FindPointIndex( points1, outputPoints1->GetPoint( pairIndex ) );
+    int pointIndex2 = FindPointIndex( points2, outputPoints2->GetPoint( pairIndex ) );
+    if ( pointIndex1 < 0 || pointIndex2 < 0 || expectedMatching[ pointIndex1 ] != pointIndex2 )
+    {
+      std::cerr << testName << ": point " << pointIndex1 << " of list 1 is paired with point " << pointIndex2
+        << " of list 2 (expected " << ( pointIndex1 < 0 ? -1 : expectedMatching[ pointIndex1 ] ) << ")" << std::endl;
+      numberOfErrors++;
+    }
+  }
+  return numberOfErrors;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkPointMatcherTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  vtkNew< vtkMinimalStandardRandomSequence > random;
+  random->SetSeed( 1234 );
+  int numberOfErrors = 0;
+
+  // Same points in a different order and position
+  {
+    vtkSmartPointer< vtkPoints > points1 = CreateRandomPoints( random.GetPointer(), 16 );
+    std::vector< int > expectedMatching;
+    vtkSmartPointer< vtkPoints > points2 = CreateMovedPoints( random.GetPointer(), points1, NOISE_MM, expectedMatching );
+    double expectedRootMeanSquareDistanceErrorMm = ComputeExpectedRootMeanSquareDistanceErrorMm( points1, points2, expectedMatching );
+    numberOfErrors += TestMatching( "permuted points", points1, points2, expectedMatching, true, expectedRootMeanSquareDistanceErrorMm, false );
+  }
+
+  // One point of list 1 is missing from list 2, and list 2 has a point that is not in list 1
+  {
+    vtkSmartPointer< vtkPoints > points1 = CreateRandomPoints( random.GetPointer(), 12 );
+    const int missingPointIndex = 4;
+    const int extraPointIndex = 12;
+    // The extra point is far from the missing one, so that pairing them is clearly wrong
+    vtkSmartPointer< vtkPoints > allPoints = vtkSmartPointer< vtkPoints >::New();
+    allPoints->DeepCopy( points1 );
+    double extraPoint[3] = { 0.0, 0.0, 0.0 };
+    points1->GetPoint( missingPointIndex, extraPoint );
+    extraPoint[ 2 ] += 150.0;
+    allPoints->InsertNextPoint( extraPoint );
+    std::vector< int > allPointIndicesInPoints2;
+    vtkSmartPointer< vtkPoints > allMovedPoints = CreateMovedPoints( random.GetPointer(), allPoints, NOISE_MM, allPointIndicesInPoints2 );
+    vtkSmartPointer< vtkPoints > points2 = vtkSmartPointer< vtkPoints >::New();
+    std::vector< int > expectedMatching( points1->GetNumberOfPoints(), -1 );
+    for ( vtkIdType movedPointIndex = 0; movedPointIndex < allMovedPoints->GetNumberOfPoints(); movedPointIndex++ )
+    {
+      if ( movedPointIndex == allPointIndicesInPoints2[ missingPointIndex ] )
+      {
+        continue;
+      }
+      int pointIndex = std::find( allPointIndicesInPoints2.begin(), allPointIndicesInPoints2.end(), movedPointIndex ) - allPointIndicesInPoints2.begin();
+      if ( pointIndex != extraPointIndex )
+      {
+        expectedMatching[ pointIndex ] = points2->GetNumberOfPoints();
+      }
+      points2->InsertNextPoint( allMovedPoints->GetPoint( movedPointIndex ) );
+    }
+    double expectedRootMeanSquareDistanceErrorMm = ComputeExpectedRootMeanSquareDistanceErrorMm( points1, points2, expectedMatching );
+    numberOfErrors += TestMatching( "missing and extra point", points1, points2, expectedMatching, true, expectedRootMeanSquareDistanceErrorMm, false );
+  }
+
+  // Symmetric point set, several matchings are equally good
+  {
+    vtkSmartPointer< vtkPoints > points1 = CreateBoxCornerPoints();
+    std::vector< int > expectedMatching;
+    vtkSmartPointer< vtkPoints > points2 = CreateMovedPoints( random.GetPointer(), points1, 0.0, expectedMatching );
+    numberOfErrors += TestMatching( "symmetric points", points1, points2, expectedMatching, false, 0.0, true );
+  }
+
+  if ( numberOfErrors > 0 )
+  {
+    std::cerr << "Number of errors: " << numberOfErrors << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "Test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -227,10 +227,8 @@ class FiducialsToModelRegistrationLogic(ScriptedLoadableModuleLogic):
     cellId = vtk.mutable(0)
     subId = vtk.mutable(0)
     dist2 = vtk.mutable(0.0)
-    locator = vtk.vtkCellLocator()
-    locator.SetDataSet( inputModel.GetPolyData() )
-    locator.SetNumberOfCellsPerBucket( 1 )
-    locator.BuildLocator()
+    from ModelRegistration import ModelRegistrationLogic
+    locator = ModelRegistrationLogic().GetCellLocator( inputModel.GetPolyData() )
     totalDistance = 0.0
 
     n = inputFiducials.GetNumberOfFiducials()
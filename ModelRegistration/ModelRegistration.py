@@ -207,10 +207,7 @@ class ModelRegistrationLogic(ScriptedLoadableModuleLogic):
     cellId = vtk.mutable(0)
     subId = vtk.mutable(0)
     dist2 = vtk.mutable(0.0)
-    locator = vtk.vtkCellLocator()
-    locator.SetDataSet( targetPolyData )
-    locator.SetNumberOfCellsPerBucket( 1 )
-    locator.BuildLocator()
+    locator = self.GetCellLocator( targetPolyData )
     
     totalDistance = 0.0
 
@@ -232,6 +229,19 @@ class ModelRegistrationLogic(ScriptedLoadableModuleLogic):
 
     return ( totalDistance / n )
 
+  def GetCellLocator(self, polyData):
+    """Returns a cell locator of the polydata. If the BreachWarning module is available then the locator
+    is taken from its shared locator cache, so it is only built once for the same (unmodified) surface.
+    The returned locator must not be modified.
+    """
+    if hasattr(slicer.modules, 'breachwarning'):
+      return slicer.modules.breachwarning.logic().GetLocatorCache().GetCellLocator( polyData )
+    locator = vtk.vtkCellLocator()
+    locator.SetDataSet( polyData )
+    locator.SetNumberOfCellsPerBucket( 1 )
+    locator.BuildLocator()
+    return locator
+
 class ModelRegistrationTest(ScriptedLoadableModuleTest):
   """
   This is the test case for your scripted module.
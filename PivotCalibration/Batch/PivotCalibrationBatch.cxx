@@ -0,0 +1,504 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Computes pivot or spin calibration of tools from recorded tracking sessions, without the Slicer application.
+// Each input file contains the ToolToReference transforms of one tool. Tools are calibrated in parallel.
+//
+// Usage: PivotCalibrationBatch [options] input1 [input2 ...]
+//
+// Options:
+//   --output FILE        write results to FILE (CSV) instead of the standard output
+//   --spin               compute spin calibration instead of pivot calibration
+//   --snap               snap rotation to right-angle (spin calibration)
+//   --robust             use robust (RANSAC) pivot calibration
+//   --confidence         compute bootstrap confidence intervals
+//   --deduplicate        skip tool transforms that are very similar to an already acquired transform
+//   --max-poses N        maximum number of transforms used per tool (the most recent ones are kept, default: all)
+//
+// Input formats:
+//   Text (any extension except .bin): one transform per line, 12 or 16 values of the 4x4 matrix in row-major order,
+//   separated by commas, semicolons, or whitespace. Empty lines, comments (starting with #), and header lines are skipped.
+//   Binary (.bin): 16 double values per transform (4x4 matrix, row-major order, native byte order).
+//   Records containing non-finite values (NaN, infinity) are counted as invalid records.
+//
+// Files are read sequentially in small chunks and transforms are added to the calibration one by one.
+// Only the transforms are stored (128 bytes per transform); use --max-poses to bound memory usage
+// for very long recordings.
+
+// PivotCalibration includes
+#include "vtkSlicerPivotCalibrationLogic.h"
+
+// VTK includes
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkNew.h>
+#include <vtkSMPTools.h>
+#include <vtkTimerLog.h>
+
+// STD includes
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// Number of transforms read from binary files at once
+const unsigned int BINARY_READ_CHUNK_SIZE = 4096;
+
+//----------------------------------------------------------------------------
+struct CalibrationOptions
+{
+  CalibrationOptions()
+    : Spin( false )
+    , Snap( false )
+    , Robust( false )
+    , Confidence( false )
+    , Deduplicate( false )
+    , MaximumNumberOfPoses( 0 )
+  {
+  }
+  bool Spin;
+  bool Snap;
+  bool Robust;
+  bool Confidence;
+  bool Deduplicate;
+  // 0 if all transforms are used
+  unsigned int MaximumNumberOfPoses;
+};
+
+//----------------------------------------------------------------------------
+// Calibration of one tool
+struct CalibrationJob
+{
+  CalibrationJob()
+    : Success( false )
+    , NumberOfReadPoses( 0 )
+    , NumberOfUsedPoses( 0 )
+    , NumberOfInvalidRecords( 0 )
+    , Rmse( 0 )
+    , InlierRatio( 1.0 )
+    , OrientationSpreadDeg( 0 )
+    , ShaftAxisConfidenceAngleDeg( 0 )
+    , ComputationTimeSec( 0 )
+  {
+    for ( int i = 0; i < 3; i++ )
+    {
+      this->ToolTipToToolTranslationConfidenceIntervalLower[ i ] = 0;
+      this->ToolTipToToolTranslationConfidenceIntervalUpper[ i ] = 0;
+    }
+    for ( int i = 0; i < 16; i++ )
+    {
+      this->ToolTipToToolMatrix[ i ] = ( i % 5 == 0 ) ? 1.0 : 0.0;
+    }
+  }
+  std::string InputFileName;
+  // Results
+  bool Success;
+  std::string ErrorText;
+  unsigned int NumberOfReadPoses;
+  unsigned int NumberOfUsedPoses;
+  unsigned int NumberOfInvalidRecords;
+  double Rmse;
+  double InlierRatio;
+  double OrientationSpreadDeg;
+  double ToolTipToToolMatrix[ 16 ];
+  double ToolTipToToolTranslationConfidenceIntervalLower[ 3 ];
+  double ToolTipToToolTranslationConfidenceIntervalUpper[ 3 ];
+  double ShaftAxisConfidenceAngleDeg;
+  double ComputationTimeSec;
+};
+
+//----------------------------------------------------------------------------
+bool IsBinaryFile( const std::string& fileName )
+{
+  return fileName.size() >= 4 && fileName.compare( fileName.size() - 4, 4, ".bin" ) == 0;
+}
+
+//----------------------------------------------------------------------------
+// Adds a transform to the calibration from 12 or 16 values (row-major)
+void AddPose( vtkSlicerPivotCalibrationLogic* logic, vtkMatrix4x4* matrix, const double* values, int numberOfValues,
+  CalibrationJob& job, const CalibrationOptions& options )
+{
+  for ( int i = 0; i < numberOfValues; i++ )
+  {
+    if ( !vtkMath::IsFinite( values[ i ] ) )
+    {
+      job.NumberOfInvalidRecords++;
+      return;
+    }
+  }
+  if ( options.MaximumNumberOfPoses == 0
+    && logic->GetNumberOfToolToReferenceMatrices() >= logic->GetMaximumNumberOfToolToReferenceMatrices() )
+  {
+    // All transforms are used, grow the buffer instead of discarding the oldest transform
+    logic->SetMaximumNumberOfToolToReferenceMatrices( 2 * logic->GetMaximumNumberOfToolToReferenceMatrices() );
+  }
+  for ( int i = 0; i < 3; i++ )
+  {
+    for ( int j = 0; j < 4; j++ )
+    {
+      matrix->SetElement( i, j, values[ 4 * i + j ] );
+    }
+  }
+  job.NumberOfReadPoses++;
+  logic->AddToolToReferenceMatrix( matrix );
+}
+
+//----------------------------------------------------------------------------
+bool ReadTextFile( vtkSlicerPivotCalibrationLogic* logic, CalibrationJob& job, const CalibrationOptions& options )
+{
+  std::ifstream file( job.InputFileName.c_str() );
+  if ( !file )
+  {
+    job.ErrorText = "Failed to open input file";
+    return false;
+  }
+  vtkNew< vtkMatrix4x4 > matrix;
+  std::string line;
+  double values[ 16 ] = { 0 };
+  while ( std::getline( file, line ) )
+  {
+    std::replace( line.begin(), line.end(), ',', ' ' );
+    std::replace( line.begin(), line.end(), ';', ' ' );
+    std::replace( line.begin(), line.end(), '\t', ' ' );
+    const char* current = line.c_str();
+    while ( *current == ' ' )
+    {
+      current++;
+    }
+    if ( *current == 0 || *current == '#' )
+    {
+      continue;
+    }
+    int numberOfValues = 0;
+    char* end = NULL;
+    while ( numberOfValues < 16 )
+    {
+      double value = strtod( current, &end );
+      if ( end == current )
+      {
+        break;
+      }
+      values[ numberOfValues++ ] = value;
+      current = end;
+    }
+    while ( *current == ' ' || *current == '\r' )
+    {
+      current++;
+    }
+    if ( numberOfValues == 0 && job.NumberOfReadPoses == 0 )
+    {
+      // Header line
+      continue;
+    }
+    if ( ( numberOfValues != 12 && numberOfValues != 16 ) || *current != 0 )
+    {
+      job.NumberOfInvalidRecords++;
+      continue;
+    }
+    AddPose( logic, matrix.GetPointer(), values, numberOfValues, job, options );
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool ReadBinaryFile( vtkSlicerPivotCalibrationLogic* logic, CalibrationJob& job, const CalibrationOptions& options )
+{
+  std::ifstream file( job.InputFileName.c_str(), std::ios::in | std::ios::binary );
+  if ( !file )
+  {
+    job.ErrorText = "Failed to open input file";
+    return false;
+  }
+  vtkNew< vtkMatrix4x4 > matrix;
+  std::vector< double > buffer( 16 * BINARY_READ_CHUNK_SIZE );
+  while ( file )
+  {
+    file.read( reinterpret_cast< char* >( &( buffer[ 0 ] ) ), buffer.size() * sizeof( double ) );
+    std::streamsize numberOfBytesRead = file.gcount();
+    unsigned int numberOfPoses = static_cast< unsigned int >( numberOfBytesRead / ( 16 * sizeof( double ) ) );
+    for ( unsigned int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++ )
+    {
+      AddPose( logic, matrix.GetPointer(), &( buffer[ 16 * poseIndex ] ), 16, job, options );
+    }
+    if ( numberOfBytesRead % ( 16 * sizeof( double ) ) != 0 )
+    {
+      // Truncated last record
+      job.NumberOfInvalidRecords++;
+    }
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+void Calibrate( CalibrationJob& job, const CalibrationOptions& options )
+{
+  vtkNew< vtkTimerLog > timer;
+  timer->StartTimer();
+
+  vtkNew< vtkSlicerPivotCalibrationLogic > logic;
+  if ( options.MaximumNumberOfPoses > 0 )
+  {
+    logic->SetMaximumNumberOfToolToReferenceMatrices( options.MaximumNumberOfPoses );
+  }
+  logic->SetPoseDeduplication( options.Deduplicate );
+  bool readSuccess = IsBinaryFile( job.InputFileName ) ? ReadBinaryFile( logic.GetPointer(), job, options )
+    : ReadTextFile( logic.GetPointer(), job, options );
+  if ( !readSuccess )
+  {
+    return;
+  }
+  job.NumberOfUsedPoses = logic->GetNumberOfToolToReferenceMatrices();
+  job.OrientationSpreadDeg = logic->GetToolOrientationSpreadDeg();
+
+  if ( options.Spin )
+  {
+    job.Success = logic->ComputeSpinCalibration( options.Snap );
+    job.Rmse = logic->GetSpinRMSE();
+  }
+  else
+  {
+    job.Success = options.Robust ? logic->ComputeRobustPivotCalibration() : logic->ComputePivotCalibration();
+    job.Rmse = logic->GetPivotRMSE();
+    job.InlierRatio = logic->GetPivotInlierRatio();
+  }
+  if ( !job.Success )
+  {
+    job.ErrorText = logic->GetErrorText();
+    return;
+  }
+
+  vtkNew< vtkMatrix4x4 > toolTipToToolMatrix;
+  logic->GetToolTipToToolMatrix( toolTipToToolMatrix.GetPointer() );
+  for ( int i = 0; i < 4; i++ )
+  {
+    for ( int j = 0; j < 4; j++ )
+    {
+      job.ToolTipToToolMatrix[ 4 * i + j ] = toolTipToToolMatrix->GetElement( i, j );
+    }
+  }
+
+  if ( options.Confidence )
+  {
+    if ( options.Spin ? logic->ComputeSpinCalibrationConfidenceIntervals() : logic->ComputePivotCalibrationConfidenceIntervals() )
+    {
+      logic->GetToolTipToToolTranslationConfidenceIntervalLower( job.ToolTipToToolTranslationConfidenceIntervalLower );
+      logic->GetToolTipToToolTranslationConfidenceIntervalUpper( job.ToolTipToToolTranslationConfidenceIntervalUpper );
+      job.ShaftAxisConfidenceAngleDeg = logic->GetShaftAxisConfidenceAngleDeg();
+    }
+  }
+
+  timer->StopTimer();
+  job.ComputationTimeSec = timer->GetElapsedTime();
+}
+
+//----------------------------------------------------------------------------
+// Calibrates a range of tools (for vtkSMPTools)
+class CalibrationWorker
+{
+public:
+  std::vector< CalibrationJob >* Jobs;
+  CalibrationOptions Options;
+
+  void operator()( vtkIdType begin, vtkIdType end )
+  {
+    for ( vtkIdType jobIndex = begin; jobIndex < end; jobIndex++ )
+    {
+      Calibrate( ( *this->Jobs )[ jobIndex ], this->Options );
+    }
+  }
+};
+
+//----------------------------------------------------------------------------
+// Values containing separators are not expected in the error texts, but quote them anyway
+std::string QuoteCsv( const std::string& text )
+{
+  std::string quoted = "\"";
+  for ( std::string::const_iterator it = text.begin(); it != text.end(); ++it )
+  {
+    if ( *it == '"' )
+    {
+      quoted += '"';
+    }
+    quoted += *it;
+  }
+  return quoted + "\"";
+}
+
+//----------------------------------------------------------------------------
+void WriteResults( std::ostream& out, const std::vector< CalibrationJob >& jobs, const CalibrationOptions& options )
+{
+  out << "File,Success,Error,ReadPoses,UsedPoses,InvalidRecords,OrientationSpreadDeg,RMSE,InlierRatio";
+  for ( int i = 0; i < 4; i++ )
+  {
+    for ( int j = 0; j < 4; j++ )
+    {
+      out << ",ToolTipToTool_" << i << j;
+    }
+  }
+  if ( options.Confidence )
+  {
+    out << ",TipLowerX,TipUpperX,TipLowerY,TipUpperY,TipLowerZ,TipUpperZ,ShaftAxisConfidenceAngleDeg";
+  }
+  out << ",ComputationTimeSec" << std::endl;
+
+  out << std::setprecision( 10 );
+  for ( std::vector< CalibrationJob >::const_iterator job = jobs.begin(); job != jobs.end(); ++job )
+  {
+    out << QuoteCsv( job->InputFileName ) << "," << ( job->Success ? "true" : "false" ) << "," << QuoteCsv( job->ErrorText )
+      << "," << job->NumberOfReadPoses << "," << job->NumberOfUsedPoses << "," << job->NumberOfInvalidRecords
+      << "," << job->OrientationSpreadDeg << "," << job->Rmse << "," << job->InlierRatio;
+    for ( int i = 0; i < 16; i++ )
+    {
+      out << "," << job->ToolTipToToolMatrix[ i ];
+    }
+    if ( options.Confidence )
+    {
+      for ( int i = 0; i < 3; i++ )
+      {
+        out << "," << job->ToolTipToToolTranslationConfidenceIntervalLower[ i ] << "," << job->ToolTipToToolTranslationConfidenceIntervalUpper[ i ];
+      }
+      out << "," << job->ShaftAxisConfidenceAngleDeg;
+    }
+    out << "," << job->ComputationTimeSec << std::endl;
+  }
+}
+
+//----------------------------------------------------------------------------
+void PrintUsage( const char* programName )
+{
+  std::cerr << "Usage: " << programName << " [--output FILE] [--spin] [--snap] [--robust] [--confidence] [--deduplicate] [--max-poses N]"
+    << " input1 [input2 ...]" << std::endl;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+  CalibrationOptions options;
+  std::string outputFileName;
+  std::vector< CalibrationJob > jobs;
+  for ( int argIndex = 1; argIndex < argc; argIndex++ )
+  {
+    std::string arg = argv[ argIndex ];
+    if ( arg == "--output" && argIndex + 1 < argc )
+    {
+      outputFileName = argv[ ++argIndex ];
+    }
+    else if ( arg == "--spin" )
+    {
+      options.Spin = true;
+    }
+    else if ( arg == "--snap" )
+    {
+      options.Snap = true;
+    }
+    else if ( arg == "--robust" )
+    {
+      options.Robust = true;
+    }
+    else if ( arg == "--confidence" )
+    {
+      options.Confidence = true;
+    }
+    else if ( arg == "--deduplicate" )
+    {
+      options.Deduplicate = true;
+    }
+    else if ( arg == "--max-poses" && argIndex + 1 < argc )
+    {
+      int maximumNumberOfPoses = atoi( argv[ ++argIndex ] );
+      if ( maximumNumberOfPoses < 1 )
+      {
+        PrintUsage( argv[ 0 ] );
+        return EXIT_FAILURE;
+      }
+      options.MaximumNumberOfPoses = static_cast< unsigned int >( maximumNumberOfPoses );
+    }
+    else if ( arg.size() > 1 && arg[ 0 ] == '-' )
+    {
+      PrintUsage( argv[ 0 ] );
+      return EXIT_FAILURE;
+    }
+    else
+    {
+      CalibrationJob job;
+      job.InputFileName = arg;
+      jobs.push_back( job );
+    }
+  }
+  if ( jobs.empty() )
+  {
+    PrintUsage( argv[ 0 ] );
+    return EXIT_FAILURE;
+  }
+
+  CalibrationWorker worker;
+  worker.Jobs = &jobs;
+  worker.Options = options;
+  // Each tool is an independent task
+  vtkSMPTools::For( 0, static_cast< vtkIdType >( jobs.size() ), 1, worker );
+
+  if ( outputFileName.empty() )
+  {
+    WriteResults( std::cout, jobs, options );
+  }
+  else
+  {
+    std::ofstream outputFile( outputFileName.c_str() );
+    if ( !outputFile )
+    {
+      std::cerr << "Failed to open output file: " << outputFileName << std::endl;
+      return EXIT_FAILURE;
+    }
+    WriteResults( outputFile, jobs, options );
+  }
+
+  // Summary
+  unsigned int numberOfFailedJobs = 0;
+  double maximumRmse = 0;
+  for ( std::vector< CalibrationJob >::const_iterator job = jobs.begin(); job != jobs.end(); ++job )
+  {
+    if ( options.MaximumNumberOfPoses > 0 && job->NumberOfReadPoses > options.MaximumNumberOfPoses )
+    {
+      std::cerr << job->InputFileName << ": warning: at most the last " << options.MaximumNumberOfPoses << " of "
+        << job->NumberOfReadPoses << " transforms are used (--max-poses)" << std::endl;
+    }
+    if ( !job->Success )
+    {
+      std::cerr << job->InputFileName << ": calibration failed: " << job->ErrorText << std::endl;
+      numberOfFailedJobs++;
+      continue;
+    }
+    maximumRmse = std::max( maximumRmse, job->Rmse );
+  }
+  std::cerr << "Calibrated " << jobs.size() - numberOfFailedJobs << " of " << jobs.size() << " tools";
+  if ( numberOfFailedJobs < jobs.size() )
+  {
+    std::cerr << ", maximum RMSE: " << maximumRmse;
+  }
+  std::cerr << std::endl;
+
+  return numberOfFailedJobs == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
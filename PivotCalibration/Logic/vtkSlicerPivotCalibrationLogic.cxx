@@ -27,10 +27,13 @@
 #include <vtkSmartPointer.h>
 #include <vtkCommand.h>
 #include <vtkMatrix4x4.h>
+#include <vtkMinimalStandardRandomSequence.h>
 #include <vtkObjectFactory.h>
+#include <vtkSMPTools.h>
 #include <vtkTransform.h>
 
 // STD includes
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 
@@ -50,6 +53,188 @@ static const double SHAFT_AXIS[ 3 ] = { 0, 0, -1 };
 static const double ORTHOGONAL_AXIS[ 3 ] = { 1, 0, 0 };
 static const double BACKUP_AXIS[ 3 ] = { 0, 1, 0 };
 
+// Number of values stored per tool pose (3x4 matrix)
+static const unsigned int POSE_SIZE = 12;
+// Number of values stored per tool orientation (quaternion)
+static const unsigned int ORIENTATION_SIZE = 4;
+// Default capacity of the tool pose buffer (100 seconds at 100Hz)
+static const unsigned int DEFAULT_TOOL_TO_REFERENCE_POSES_CAPACITY = 10000;
+
+// Minimum number of poses for pivot calibration
+static const unsigned int MINIMUM_NUMBER_OF_POSES = 10;
+// Number of poses used for computing a candidate solution in robust pivot calibration.
+// Two poses are not enough: the tip position along the relative rotation axis of the two poses would be undetermined.
+static const unsigned int ROBUST_MINIMAL_NUMBER_OF_POSES = 3;
+// Singular values of the pivot calibration equation matrix below this value are ignored
+static const double PIVOT_SINGULAR_VALUE_THRESHOLD = 1e-1;
+
+//----------------------------------------------------------------------------
+// Scores candidate pivot calibration solutions: counts the poses where the tool tip is within the
+// inlier threshold from the pivot point. Each candidate is processed by one thread.
+class vtkPivotCalibrationHypothesisScorer
+{
+public:
+  // Tool poses, 12 values per pose (see vtkSlicerPivotCalibrationLogic::GetToolToReferencePose)
+  std::vector< const double* > Poses;
+  // Candidate solutions, 6 values per candidate: tool tip in Tool, pivot point in Reference
+  const double* Hypotheses;
+  double InlierThresholdSquared;
+  // Results
+  int* NumberOfInliers;
+  double* SumSquaredInlierResiduals;
+
+  void operator()( vtkIdType begin, vtkIdType end )
+  {
+    for ( vtkIdType hypothesisIndex = begin; hypothesisIndex < end; hypothesisIndex++ )
+    {
+      const double* toolTip_Tool = this->Hypotheses + 6 * hypothesisIndex;
+      const double* pivot_Reference = toolTip_Tool + 3;
+      int numberOfInliers = 0;
+      double sumSquaredInlierResiduals = 0;
+      for ( std::vector< const double* >::const_iterator poseIt = this->Poses.begin(); poseIt != this->Poses.end(); ++poseIt )
+      {
+        const double* pose = *poseIt;
+        double residualSquared = 0;
+        for ( int i = 0; i < 3; i++ )
+        {
+          double residual = pose[ 4 * i ] * toolTip_Tool[ 0 ] + pose[ 4 * i + 1 ] * toolTip_Tool[ 1 ] + pose[ 4 * i + 2 ] * toolTip_Tool[ 2 ]
+            + pose[ 4 * i + 3 ] - pivot_Reference[ i ];
+          residualSquared += residual * residual;
+        }
+        if ( residualSquared < this->InlierThresholdSquared )
+        {
+          numberOfInliers++;
+          sumSquaredInlierResiduals += residualSquared;
+        }
+      }
+      this->NumberOfInliers[ hypothesisIndex ] = numberOfInliers;
+      this->SumSquaredInlierResiduals[ hypothesisIndex ] = sumSquaredInlierResiduals;
+    }
+  }
+};
+
+//----------------------------------------------------------------------------
+// Solves pivot calibration for bootstrap resamples of the tool poses.
+// Each resample draws its poses using its own random sequence (seeded by the resample index),
+// therefore the results do not depend on how the resamples are distributed between threads.
+class vtkPivotCalibrationBootstrapPivotSolver
+{
+public:
+  // Tool poses, 12 values per pose (see vtkSlicerPivotCalibrationLogic::GetToolToReferencePose)
+  std::vector< const double* > Poses;
+  // Results, 3 values per resample: tool tip in Tool
+  double* ToolTipToToolTranslations;
+
+  void operator()( vtkIdType begin, vtkIdType end )
+  {
+    vtkNew< vtkMinimalStandardRandomSequence > random;
+    const int numberOfPoses = static_cast< int >( this->Poses.size() );
+    vnl_matrix< double > normalMatrix( 6, 6 );
+    vnl_vector< double > normalVector( 6 );
+    for ( vtkIdType resampleIndex = begin; resampleIndex < end; resampleIndex++ )
+    {
+      random->SetSeed( static_cast< int >( resampleIndex ) + 1 );
+      // Sums of R, R'R, R't, t over the resampled poses
+      double sumRotation[ 3 ][ 3 ] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+      double sumRotationTransposeRotation[ 3 ][ 3 ] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+      double sumRotationTransposeTranslation[ 3 ] = { 0, 0, 0 };
+      double sumTranslation[ 3 ] = { 0, 0, 0 };
+      for ( int sampleIndex = 0; sampleIndex < numberOfPoses; sampleIndex++ )
+      {
+        int poseIndex = std::min( numberOfPoses - 1, static_cast< int >( random->GetValue() * numberOfPoses ) );
+        random->Next();
+        const double* pose = this->Poses[ poseIndex ];
+        for ( int i = 0; i < 3; i++ )
+        {
+          for ( int j = 0; j < 3; j++ )
+          {
+            sumRotation[ i ][ j ] += pose[ 4 * i + j ];
+            sumRotationTransposeRotation[ i ][ j ] += pose[ i ] * pose[ j ] + pose[ 4 + i ] * pose[ 4 + j ] + pose[ 8 + i ] * pose[ 8 + j ];
+          }
+          sumRotationTransposeTranslation[ i ] += pose[ i ] * pose[ 3 ] + pose[ 4 + i ] * pose[ 7 ] + pose[ 8 + i ] * pose[ 11 ];
+          sumTranslation[ i ] += pose[ 4 * i + 3 ];
+        }
+      }
+
+      // Normal equations of [ R -I ] * [ toolTip_Tool; pivot_Reference ] = -t over the resampled poses
+      for ( int i = 0; i < 3; i++ )
+      {
+        for ( int j = 0; j < 3; j++ )
+        {
+          normalMatrix( i, j ) = sumRotationTransposeRotation[ i ][ j ];
+          normalMatrix( i, 3 + j ) = -sumRotation[ j ][ i ];
+          normalMatrix( 3 + i, j ) = -sumRotation[ i ][ j ];
+          normalMatrix( 3 + i, 3 + j ) = ( i == j ? numberOfPoses : 0 );
+        }
+        normalVector( i ) = -sumRotationTransposeTranslation[ i ];
+        normalVector( 3 + i ) = sumTranslation[ i ];
+      }
+      vnl_svd< double > svdNormalMatrix( normalMatrix );
+      svdNormalMatrix.zero_out_absolute( PIVOT_SINGULAR_VALUE_THRESHOLD * PIVOT_SINGULAR_VALUE_THRESHOLD );
+      vnl_vector< double > x = svdNormalMatrix.solve( normalVector );
+      for ( int i = 0; i < 3; i++ )
+      {
+        this->ToolTipToToolTranslations[ 3 * resampleIndex + i ] = x[ i ];
+      }
+    }
+  }
+};
+
+//----------------------------------------------------------------------------
+// Solves spin calibration for bootstrap resamples of the rotations between consecutive tool poses
+// and computes the angle between the resulting shaft axis and the reference shaft axis.
+class vtkPivotCalibrationBootstrapSpinSolver
+{
+public:
+  // (R - I)' * (R - I) of the rotations between consecutive poses, 9 values per rotation (row-major)
+  std::vector< double > Terms;
+  double ReferenceShaftAxis_ToolTip[ 3 ];
+  // Results, 1 value per resample
+  double* AnglesDeg;
+
+  void operator()( vtkIdType begin, vtkIdType end )
+  {
+    vtkNew< vtkMinimalStandardRandomSequence > random;
+    const int numberOfTerms = static_cast< int >( this->Terms.size() / 9 );
+    vnl_matrix< double > A( 3, 3 );
+    vnl_matrix< double > eigenvectors( 3, 3 );
+    vnl_vector< double > eigenvalues( 3 );
+    for ( vtkIdType resampleIndex = begin; resampleIndex < end; resampleIndex++ )
+    {
+      random->SetSeed( static_cast< int >( resampleIndex ) + 1 );
+      A.fill( 0 );
+      for ( int sampleIndex = 0; sampleIndex < numberOfTerms; sampleIndex++ )
+      {
+        int termIndex = std::min( numberOfTerms - 1, static_cast< int >( random->GetValue() * numberOfTerms ) );
+        random->Next();
+        const double* term = &( this->Terms[ 9 * termIndex ] );
+        for ( int i = 0; i < 3; i++ )
+        {
+          for ( int j = 0; j < 3; j++ )
+          {
+            A( i, j ) += term[ 3 * i + j ];
+          }
+        }
+      }
+      // Eigenvector of the smallest eigenvalue is the shaft axis (the sign is arbitrary)
+      vnl_symmetric_eigensystem_compute( A, eigenvectors, eigenvalues );
+      double norm = sqrt( eigenvectors( 0, 0 ) * eigenvectors( 0, 0 ) + eigenvectors( 1, 0 ) * eigenvectors( 1, 0 ) + eigenvectors( 2, 0 ) * eigenvectors( 2, 0 ) );
+      double dot = ( eigenvectors( 0, 0 ) * this->ReferenceShaftAxis_ToolTip[ 0 ] + eigenvectors( 1, 0 ) * this->ReferenceShaftAxis_ToolTip[ 1 ]
+        + eigenvectors( 2, 0 ) * this->ReferenceShaftAxis_ToolTip[ 2 ] ) / norm;
+      this->AnglesDeg[ resampleIndex ] = vtkMath::DegreesFromRadians( acos( std::min( 1.0, fabs( dot ) ) ) );
+    }
+  }
+};
+
+//----------------------------------------------------------------------------
+// Returns the value at the specified ratio (between 0 and 1) of the sorted values. Values are reordered.
+static double GetPercentile( std::vector< double >& values, double ratio )
+{
+  size_t index = std::min( values.size() - 1, static_cast< size_t >( ratio * ( values.size() - 1 ) + 0.5 ) );
+  std::nth_element( values.begin(), values.begin() + index, values.end() );
+  return values[ index ];
+}
+
 //----------------------------------------------------------------------------
 vtkStandardNewMacro(vtkSlicerPivotCalibrationLogic);
 
@@ -58,7 +243,41 @@ vtkSlicerPivotCalibrationLogic::vtkSlicerPivotCalibrationLogic()
 {
   this->ToolTipToToolMatrix = vtkMatrix4x4::New();
   this->ObservedTransformNode = NULL;
+  this->ObservedTransformMatrix = vtkMatrix4x4::New();
   this->MinimumOrientationDifferenceDeg = 15.0;
+  this->RecordingState = false;
+  this->PivotRMSE = 0;
+  this->SpinRMSE = 0;
+  this->PivotInlierRatio = 1.0;
+  this->RobustInlierThresholdMm = 2.0;
+  this->RobustNumberOfHypotheses = 500;
+  this->BootstrapNumberOfResamples = 200;
+  this->BootstrapConfidenceLevel = 0.95;
+  for (int i = 0; i < 3; i++)
+  {
+    this->ToolTipToToolTranslationConfidenceIntervalLower[i] = 0;
+    this->ToolTipToToolTranslationConfidenceIntervalUpper[i] = 0;
+  }
+  this->ShaftAxisConfidenceAngleDeg = 0;
+  this->ConvergenceMonitoringMode = CONVERGENCE_MONITORING_OFF;
+  this->ConvergenceWindowSize = 50;
+  this->ConvergenceTolerancePositionMm = 0.5;
+  this->ConvergenceToleranceAngleDeg = 1.0;
+  this->Converged = false;
+  this->ConvergenceHistory.resize( 3 * this->ConvergenceWindowSize );
+  this->ConvergenceHistoryStart = 0;
+  this->NumberOfConvergenceHistoryEntries = 0;
+  this->PoseDeduplication = false;
+  this->PoseDeduplicationPositionResolutionMm = 1.0;
+  this->PoseDeduplicationOrientationResolutionDeg = 2.0;
+  this->ToolToReferencePosesCapacity = DEFAULT_TOOL_TO_REFERENCE_POSES_CAPACITY;
+  this->ToolToReferencePoses.resize( POSE_SIZE * this->ToolToReferencePosesCapacity );
+  this->ToolToReferenceOrientations.resize( ORIENTATION_SIZE * this->ToolToReferencePosesCapacity );
+  this->ToolToReferencePosesStart = 0;
+  this->NumberOfToolToReferencePoses = 0;
+  this->ClearOrientationSum();
+  this->ClearPivotEquations();
+  this->ClearSpinEquations();
 }
 
 //----------------------------------------------------------------------------
@@ -67,12 +286,18 @@ vtkSlicerPivotCalibrationLogic::~vtkSlicerPivotCalibrationLogic()
   this->ClearToolToReferenceMatrices();
   this->ToolTipToToolMatrix->Delete();
   this->SetAndObserveTransformNode( NULL ); // Remove the observer
+  this->ObservedTransformMatrix->Delete();
 }
 
 //----------------------------------------------------------------------------
 void vtkSlicerPivotCalibrationLogic::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf( os, indent );
+  os << indent << "NumberOfToolToReferenceMatrices: " << this->NumberOfToolToReferencePoses << std::endl;
+  os << indent << "MaximumNumberOfToolToReferenceMatrices: " << this->ToolToReferencePosesCapacity << std::endl;
+  os << indent << "IncrementalPivotNumberOfSamples: " << this->IncrementalPivotNumberOfSamples << std::endl;
+  os << indent << "BootstrapNumberOfResamples: " << this->BootstrapNumberOfResamples << std::endl;
+  os << indent << "BootstrapConfidenceLevel: " << this->BootstrapConfidenceLevel << std::endl;
 }
 
 //---------------------------------------------------------------------------
@@ -83,9 +308,8 @@ void vtkSlicerPivotCalibrationLogic::ProcessMRMLNodesEvents(vtkObject* caller, u
     vtkMRMLLinearTransformNode* transformNode = vtkMRMLLinearTransformNode::SafeDownCast(caller);
     if ( event == vtkMRMLLinearTransformNode::TransformModifiedEvent && this->RecordingState == true && strcmp( transformNode->GetID(), this->ObservedTransformNode->GetID() ) == 0 )
     {
-      vtkMatrix4x4* matrixCopy = vtkMatrix4x4::New();
-      transformNode->GetMatrixTransformToParent(matrixCopy);      
-      this->AddToolToReferenceMatrix(matrixCopy);
+      transformNode->GetMatrixTransformToParent(this->ObservedTransformMatrix);
+      this->AddToolToReferenceMatrix(this->ObservedTransformMatrix);
     }
   }
 }
@@ -99,81 +323,661 @@ void vtkSlicerPivotCalibrationLogic::SetAndObserveTransformNode( vtkMRMLLinearTr
 }
 
 //---------------------------------------------------------------------------
-void vtkSlicerPivotCalibrationLogic::AddToolToReferenceMatrix(vtkMatrix4x4* transformMatrix)
+bool vtkSlicerPivotCalibrationLogic::AddToolToReferenceMatrix(vtkMatrix4x4* transformMatrix)
 {
-  this->ToolToReferenceMatrices.push_back(transformMatrix);
+  if (transformMatrix == NULL || this->ToolToReferencePosesCapacity == 0)
+  {
+    return false;
+  }
+
+  double newPose[POSE_SIZE];
+  double rotation[3][3];
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      newPose[4 * i + j] = transformMatrix->GetElement(i, j);
+    }
+    for (int j = 0; j < 3; j++)
+    {
+      rotation[i][j] = newPose[4 * i + j];
+    }
+  }
+  double newOrientation[ORIENTATION_SIZE];
+  vtkMath::Matrix3x3ToQuaternion(rotation, newOrientation);
+
+  PoseCell newPoseCell;
+  if (this->PoseDeduplication)
+  {
+    this->GetPoseCell(newPose, newOrientation, newPoseCell);
+    std::map<PoseCell, unsigned int>::iterator occupiedCell = this->OccupiedPoseCells.find(newPoseCell);
+    unsigned int numberOfSimilarPoses = (occupiedCell != this->OccupiedPoseCells.end()) ? occupiedCell->second : 0;
+    if (numberOfSimilarPoses > 0 && this->NumberOfToolToReferencePoses == this->ToolToReferencePosesCapacity)
+    {
+      // The oldest pose is replaced by the new pose, so it is not taken into account
+      PoseCell oldestPoseCell;
+      this->GetPoseCell(this->GetToolToReferencePose(0), this->GetToolToReferenceOrientation(0), oldestPoseCell);
+      if (!(oldestPoseCell < newPoseCell) && !(newPoseCell < oldestPoseCell))
+      {
+        numberOfSimilarPoses--;
+      }
+    }
+    if (numberOfSimilarPoses > 0)
+    {
+      // a similar pose is already stored
+      return false;
+    }
+  }
+
+  unsigned int poseIndex = 0;
+  if (this->NumberOfToolToReferencePoses < this->ToolToReferencePosesCapacity)
+  {
+    poseIndex = (this->ToolToReferencePosesStart + this->NumberOfToolToReferencePoses) % this->ToolToReferencePosesCapacity;
+    this->NumberOfToolToReferencePoses++;
+  }
+  else
+  {
+    // Buffer is full, replace the oldest pose
+    poseIndex = this->ToolToReferencePosesStart;
+    this->AccumulatePivotEquations(&(this->ToolToReferencePoses[POSE_SIZE * poseIndex]), -1.0);
+    if (this->NumberOfToolToReferencePoses > 1)
+    {
+      this->AccumulateSpinEquations(this->GetToolToReferencePose(1), this->GetToolToReferencePose(0), -1.0);
+    }
+    if (this->PoseDeduplication)
+    {
+      // Other stored poses may be in the same cell, so the cell is only released when its last pose is removed
+      PoseCell removedPoseCell;
+      this->GetPoseCell(&(this->ToolToReferencePoses[POSE_SIZE * poseIndex]), &(this->ToolToReferenceOrientations[ORIENTATION_SIZE * poseIndex]), removedPoseCell);
+      std::map<PoseCell, unsigned int>::iterator removedCell = this->OccupiedPoseCells.find(removedPoseCell);
+      if (removedCell != this->OccupiedPoseCells.end() && --(removedCell->second) == 0)
+      {
+        this->OccupiedPoseCells.erase(removedCell);
+      }
+    }
+    this->AccumulateOrientation(&(this->ToolToReferenceOrientations[ORIENTATION_SIZE * poseIndex]), -1.0);
+    this->ToolToReferencePosesStart = (this->ToolToReferencePosesStart + 1) % this->ToolToReferencePosesCapacity;
+  }
+  double* pose = &(this->ToolToReferencePoses[POSE_SIZE * poseIndex]);
+  std::copy(newPose, newPose + POSE_SIZE, pose);
+  std::copy(newOrientation, newOrientation + ORIENTATION_SIZE, &(this->ToolToReferenceOrientations[ORIENTATION_SIZE * poseIndex]));
+  if (this->PoseDeduplication)
+  {
+    this->OccupiedPoseCells[newPoseCell]++;
+  }
+  this->AccumulateOrientation(newOrientation, 1.0);
+  this->AccumulatePivotEquations(pose, 1.0);
+  if (this->NumberOfToolToReferencePoses > 1)
+  {
+    this->AccumulateSpinEquations(pose, this->GetToolToReferencePose(this->NumberOfToolToReferencePoses - 2), 1.0);
+  }
+  this->InvokeEvent(ToolToReferenceMatrixAddedEvent);
+  // Convergence is checked last, as observers of the converged event may clear the transforms
+  this->UpdateConvergence();
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetConvergenceWindowSize(unsigned int windowSize)
+{
+  windowSize = std::max(windowSize, 1u);
+  if (windowSize == this->ConvergenceWindowSize)
+  {
+    return;
+  }
+  this->ConvergenceWindowSize = windowSize;
+  this->ConvergenceHistory.resize(3 * windowSize);
+  this->ConvergenceHistoryStart = 0;
+  this->NumberOfConvergenceHistoryEntries = 0;
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::UpdateConvergence()
+{
+  if (this->ConvergenceMonitoringMode == CONVERGENCE_MONITORING_OFF || this->Converged)
+  {
+    return;
+  }
+
+  double result[3] = { 0, 0, 0 };
+  double rmse = 0;
+  bool pivot = (this->ConvergenceMonitoringMode == CONVERGENCE_MONITORING_PIVOT);
+  if (pivot ? !this->GetIncrementalPivotCalibration(result, rmse) : !this->GetIncrementalSpinCalibration(result, rmse))
+  {
+    return;
+  }
+
+  // Add to the history, replace the oldest result if the window is full
+  unsigned int latestIndex = 0;
+  if (this->NumberOfConvergenceHistoryEntries < this->ConvergenceWindowSize)
+  {
+    latestIndex = (this->ConvergenceHistoryStart + this->NumberOfConvergenceHistoryEntries) % this->ConvergenceWindowSize;
+    this->NumberOfConvergenceHistoryEntries++;
+  }
+  else
+  {
+    latestIndex = this->ConvergenceHistoryStart;
+    this->ConvergenceHistoryStart = (this->ConvergenceHistoryStart + 1) % this->ConvergenceWindowSize;
+  }
+  std::copy(result, result + 3, &(this->ConvergenceHistory[3 * latestIndex]));
+
+  if (this->NumberOfConvergenceHistoryEntries < this->ConvergenceWindowSize
+    || this->NumberOfToolToReferencePoses < MINIMUM_NUMBER_OF_POSES
+    || this->GetToolOrientationCoverage() < 1.0)
+  {
+    return;
+  }
+
+  // Shaft axis direction is arbitrary, therefore the absolute value of the cosine is compared
+  double minimumAxisSimilarity = cos(vtkMath::RadiansFromDegrees(this->ConvergenceToleranceAngleDeg));
+  double tolerancePositionSquared = this->ConvergenceTolerancePositionMm * this->ConvergenceTolerancePositionMm;
+  for (unsigned int n = 0; n < this->NumberOfConvergenceHistoryEntries; n++)
+  {
+    const double* previousResult = &(this->ConvergenceHistory[3 * n]);
+    if (pivot)
+    {
+      if (vtkMath::Distance2BetweenPoints(previousResult, result) > tolerancePositionSquared)
+      {
+        return;
+      }
+    }
+    else if (fabs(vtkMath::Dot(previousResult, result)) < minimumAxisSimilarity)
+    {
+      return;
+    }
+  }
+
+  this->Converged = true;
+  this->SetRecordingState(false);
+  this->InvokeEvent(CalibrationConvergedEvent);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::PoseCell::operator<(const PoseCell& other) const
+{
+  return std::lexicographical_compare(this->Index, this->Index + 7, other.Index, other.Index + 7);
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::GetPoseCell(const double* pose, const double* orientation, PoseCell& cell) const
+{
+  for (int i = 0; i < 3; i++)
+  {
+    cell.Index[i] = static_cast<int>(floor(pose[4 * i + 3] / this->PoseDeduplicationPositionResolutionMm));
+  }
+  // q and -q represent the same orientation, use the one with non-negative w.
+  // Distance between unit quaternions of orientations that differ by a small angle is about half of the angle (in radians).
+  double sign = (orientation[0] < 0) ? -1.0 : 1.0;
+  double orientationStep = vtkMath::RadiansFromDegrees(this->PoseDeduplicationOrientationResolutionDeg) / 2.0;
+  for (int i = 0; i < 4; i++)
+  {
+    cell.Index[3 + i] = static_cast<int>(floor(sign * orientation[i] / orientationStep));
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::UpdateOccupiedPoseCells()
+{
+  this->OccupiedPoseCells.clear();
+  if (!this->PoseDeduplication)
+  {
+    return;
+  }
+  for (unsigned int n = 0; n < this->NumberOfToolToReferencePoses; n++)
+  {
+    PoseCell cell;
+    this->GetPoseCell(this->GetToolToReferencePose(n), this->GetToolToReferenceOrientation(n), cell);
+    this->OccupiedPoseCells[cell]++;
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetPoseDeduplication(bool enable)
+{
+  if (this->PoseDeduplication == enable)
+  {
+    return;
+  }
+  this->PoseDeduplication = enable;
+  this->UpdateOccupiedPoseCells();
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetPoseDeduplicationPositionResolutionMm(double resolutionMm)
+{
+  if (resolutionMm <= 0)
+  {
+    vtkErrorMacro("SetPoseDeduplicationPositionResolutionMm: resolution must be positive");
+    return;
+  }
+  if (this->PoseDeduplicationPositionResolutionMm == resolutionMm)
+  {
+    return;
+  }
+  this->PoseDeduplicationPositionResolutionMm = resolutionMm;
+  this->UpdateOccupiedPoseCells();
+  this->Modified();
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetPoseDeduplicationOrientationResolutionDeg(double resolutionDeg)
+{
+  if (resolutionDeg <= 0)
+  {
+    vtkErrorMacro("SetPoseDeduplicationOrientationResolutionDeg: resolution must be positive");
+    return;
+  }
+  if (this->PoseDeduplicationOrientationResolutionDeg == resolutionDeg)
+  {
+    return;
+  }
+  this->PoseDeduplicationOrientationResolutionDeg = resolutionDeg;
+  this->UpdateOccupiedPoseCells();
+  this->Modified();
 }
 
 //---------------------------------------------------------------------------
 void vtkSlicerPivotCalibrationLogic::ClearToolToReferenceMatrices()
 {
-  std::vector<vtkMatrix4x4*>::const_iterator it;
-  std::vector<vtkMatrix4x4*>::const_iterator matricesEnd = this->ToolToReferenceMatrices.end();
-  for(it = this->ToolToReferenceMatrices.begin(); it != matricesEnd; it++)
+  this->ToolToReferencePosesStart = 0;
+  this->NumberOfToolToReferencePoses = 0;
+  this->ClearOrientationSum();
+  this->OccupiedPoseCells.clear();
+  this->ClearPivotEquations();
+  this->ClearSpinEquations();
+  this->Converged = false;
+  this->ConvergenceHistoryStart = 0;
+  this->NumberOfConvergenceHistoryEntries = 0;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::SetMaximumNumberOfToolToReferenceMatrices(unsigned int capacity)
+{
+  if (capacity == this->ToolToReferencePosesCapacity)
   {
-    (*it)->Delete();
+    return;
   }
-  this->ToolToReferenceMatrices.clear();
+  // Keep the most recent poses, stored from the beginning of the new buffer
+  unsigned int numberOfKeptPoses = std::min(capacity, this->NumberOfToolToReferencePoses);
+  unsigned int firstKeptPose = this->NumberOfToolToReferencePoses - numberOfKeptPoses;
+  std::vector<double> poses(POSE_SIZE * capacity);
+  std::vector<double> orientations(ORIENTATION_SIZE * capacity);
+  for (unsigned int n = 0; n < numberOfKeptPoses; n++)
+  {
+    std::copy(this->GetToolToReferencePose(firstKeptPose + n), this->GetToolToReferencePose(firstKeptPose + n) + POSE_SIZE, &(poses[POSE_SIZE * n]));
+    std::copy(this->GetToolToReferenceOrientation(firstKeptPose + n), this->GetToolToReferenceOrientation(firstKeptPose + n) + ORIENTATION_SIZE,
+      &(orientations[ORIENTATION_SIZE * n]));
+  }
+  this->ToolToReferencePoses.swap(poses);
+  this->ToolToReferenceOrientations.swap(orientations);
+  this->ToolToReferencePosesCapacity = capacity;
+  this->ToolToReferencePosesStart = 0;
+  this->NumberOfToolToReferencePoses = numberOfKeptPoses;
+
+  // Recompute the accumulators for the kept poses
+  this->UpdateOccupiedPoseCells();
+  this->ClearOrientationSum();
+  this->ClearPivotEquations();
+  this->ClearSpinEquations();
+  for (unsigned int n = 0; n < numberOfKeptPoses; n++)
+  {
+    this->AccumulateOrientation(this->GetToolToReferenceOrientation(n), 1.0);
+    this->AccumulatePivotEquations(this->GetToolToReferencePose(n), 1.0);
+    if (n > 0)
+    {
+      this->AccumulateSpinEquations(this->GetToolToReferencePose(n), this->GetToolToReferencePose(n - 1), 1.0);
+    }
+  }
+  this->Modified();
 }
 
-//----------------------------------------------------------------------------
-double vtkSlicerPivotCalibrationLogic::GetOrientationDifferenceDeg(vtkMatrix4x4* aMatrix, vtkMatrix4x4* bMatrix)
+//---------------------------------------------------------------------------
+unsigned int vtkSlicerPivotCalibrationLogic::GetMaximumNumberOfToolToReferenceMatrices()
 {
-  vtkSmartPointer<vtkMatrix4x4> diffMatrix = vtkSmartPointer<vtkMatrix4x4>::New(); 
-  vtkSmartPointer<vtkMatrix4x4> invBmatrix = vtkSmartPointer<vtkMatrix4x4>::New(); 
+  return this->ToolToReferencePosesCapacity;
+}
 
-  vtkMatrix4x4::Invert(bMatrix, invBmatrix);  
+//---------------------------------------------------------------------------
+unsigned int vtkSlicerPivotCalibrationLogic::GetNumberOfToolToReferenceMatrices()
+{
+  return this->NumberOfToolToReferencePoses;
+}
 
-  vtkMatrix4x4::Multiply4x4(aMatrix, invBmatrix, diffMatrix); 
+//---------------------------------------------------------------------------
+const double* vtkSlicerPivotCalibrationLogic::GetToolToReferencePose(unsigned int n) const
+{
+  return &(this->ToolToReferencePoses[POSE_SIZE * ((this->ToolToReferencePosesStart + n) % this->ToolToReferencePosesCapacity)]);
+}
 
-  vtkSmartPointer<vtkTransform> diffTransform = vtkSmartPointer<vtkTransform>::New(); 
-  diffTransform->SetMatrix(diffMatrix); 
+//---------------------------------------------------------------------------
+const double* vtkSlicerPivotCalibrationLogic::GetToolToReferenceOrientation(unsigned int n) const
+{
+  return &(this->ToolToReferenceOrientations[ORIENTATION_SIZE * ((this->ToolToReferencePosesStart + n) % this->ToolToReferencePosesCapacity)]);
+}
 
-  double angleDiff_rad= vtkMath::RadiansFromDegrees(diffTransform->GetOrientationWXYZ()[0]);
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::GetNthToolToReferenceMatrix(unsigned int n, vtkMatrix4x4* toolToReferenceMatrix)
+{
+  if (toolToReferenceMatrix == NULL || n >= this->NumberOfToolToReferencePoses)
+  {
+    return false;
+  }
+  const double* pose = this->GetToolToReferencePose(n);
+  toolToReferenceMatrix->Identity();
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      toolToReferenceMatrix->SetElement(i, j, pose[4 * i + j]);
+    }
+  }
+  return true;
+}
 
-  double normalizedAngleDiff_rad = atan2( sin(angleDiff_rad), cos(angleDiff_rad) ); // normalize angle to domain -pi, pi 
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ClearPivotEquations()
+{
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      this->IncrementalPivotSumRotation[i][j] = 0;
+      this->IncrementalPivotSumRotationTransposeRotation[i][j] = 0;
+    }
+    this->IncrementalPivotSumRotationTransposeTranslation[i] = 0;
+    this->IncrementalPivotSumTranslation[i] = 0;
+  }
+  this->IncrementalPivotSumSquaredTranslation = 0;
+  this->IncrementalPivotNumberOfSamples = 0;
+}
 
-  return vtkMath::DegreesFromRadians(normalizedAngleDiff_rad);
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::AccumulatePivotEquations(const double* toolToReferencePose, double weight)
+{
+  // Same equations as in ComputePivotCalibration: [ R -I ] * [ toolTip_Tool; pivot_Reference ] = -t
+  // Only the sums that make up the normal equations are accumulated (see GetIncrementalPivotCalibration)
+  const double* pose = toolToReferencePose;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      this->IncrementalPivotSumRotation[i][j] += weight * pose[4 * i + j];
+      this->IncrementalPivotSumRotationTransposeRotation[i][j] += weight * (pose[i] * pose[j] + pose[4 + i] * pose[4 + j] + pose[8 + i] * pose[8 + j]);
+    }
+    this->IncrementalPivotSumRotationTransposeTranslation[i] += weight * (pose[i] * pose[3] + pose[4 + i] * pose[7] + pose[8 + i] * pose[11]);
+    this->IncrementalPivotSumTranslation[i] += weight * pose[4 * i + 3];
+  }
+  this->IncrementalPivotSumSquaredTranslation += weight * (pose[3] * pose[3] + pose[7] * pose[7] + pose[11] * pose[11]);
+  if (weight > 0)
+  {
+    this->IncrementalPivotNumberOfSamples++;
+  }
+  else
+  {
+    this->IncrementalPivotNumberOfSamples--;
+  }
 }
 
 //---------------------------------------------------------------------------
-double vtkSlicerPivotCalibrationLogic::GetMaximumToolOrientationDifferenceDeg()
+void vtkSlicerPivotCalibrationLogic::ClearSpinEquations()
 {
-  // this will store the maximum difference in orientation between the first transform and all the other transforms
-  double maximumOrientationDifferenceDeg = 0;
-  
-    std::vector<vtkMatrix4x4*>::const_iterator it;
-  std::vector<vtkMatrix4x4*>::const_iterator matricesEnd = this->ToolToReferenceMatrices.end();
-  unsigned int currentRow;
-  vtkMatrix4x4* referenceOrientationMatrix = this->ToolToReferenceMatrices.front();
-  for(currentRow = 0, it = this->ToolToReferenceMatrices.begin(); it != matricesEnd; it++, currentRow += 3)
+  for (int i = 0; i < 3; i++)
   {
-    double orientationDifferenceDeg = GetOrientationDifferenceDeg(referenceOrientationMatrix, (*it));
-    if (maximumOrientationDifferenceDeg < orientationDifferenceDeg)
+    for (int j = 0; j < 3; j++)
     {
-      maximumOrientationDifferenceDeg = orientationDifferenceDeg;    
+      this->IncrementalSpinMatrix[i][j] = 0;
     }
   }
+}
 
-  return maximumOrientationDifferenceDeg;
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::AccumulateSpinEquations(const double* toolToReferencePose, const double* previousToolToReferencePose, double weight)
+{
+  double term[3][3];
+  vtkSlicerPivotCalibrationLogic::ComputeSpinEquationsTerm(toolToReferencePose, previousToolToReferencePose, term);
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      this->IncrementalSpinMatrix[i][j] += weight * term[i][j];
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ComputeSpinEquationsTerm(const double* toolToReferencePose, const double* previousToolToReferencePose, double term[3][3])
+{
+  // Rotation part of inverse(current) * previous is inverse(currentRotation) * previousRotation
+  double rotation[3][3];
+  double previousRotation[3][3];
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++ )
+    {
+      rotation[i][j] = toolToReferencePose[4 * i + j];
+      previousRotation[i][j] = previousToolToReferencePose[4 * i + j];
+    }
+  }
+  double rotationInverse[3][3];
+  vtkMath::Invert3x3(rotation, rotationInverse);
+  double RI[3][3];
+  vtkMath::Multiply3x3(rotationInverse, previousRotation, RI);
+
+  // term = (RI - I)' * (RI - I)
+  for (int i = 0; i < 3; i++)
+  {
+    RI[i][i] -= 1.0;
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      term[i][j] = RI[0][i] * RI[0][j] + RI[1][i] * RI[1][j] + RI[2][i] * RI[2][j];
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ComputeSpinAxis(double shaftAxis_ToolTip[3], double& rmse)
+{
+  vnl_matrix<double> A(3, 3);
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      A(i, j) = this->IncrementalSpinMatrix[i][j];
+    }
+  }
+
+  // Find the eigenvector associated with the smallest eigenvalue
+  // This is the best axis of rotation over all instantaneous rotations
+  vnl_matrix<double> eigenvectors( 3, 3, 0 );
+  vnl_vector<double> eigenvalues( 3, 0 );
+  vnl_symmetric_eigensystem_compute( A, eigenvectors, eigenvalues );
+  // Note: eigenvectors are ordered in increasing eigenvalue ( 0 = smallest, end = biggest )
+  vnl_vector<double> axis( 3, 0 );
+  axis( 0 ) = eigenvectors( 0, 0 );
+  axis( 1 ) = eigenvectors( 1, 0 );
+  axis( 2 ) = eigenvectors( 2, 0 );
+  axis.normalize();
+  shaftAxis_ToolTip[0] = axis( 0 );
+  shaftAxis_ToolTip[1] = axis( 1 );
+  shaftAxis_ToolTip[2] = axis( 2 );
+
+  // Removing terms from the accumulated matrix may leave a tiny negative eigenvalue due to round-off
+  rmse = sqrt( std::max( 0.0, eigenvalues( 0 ) ) / this->NumberOfToolToReferencePoses );
+  // Note: This error is the RMS distance from the ideal axis of rotation to the axis of rotation for each instantaneous rotation
+  // This RMS distance can be computed to an angle in the following way: angle = arccos( 1 - SpinRMSE^2 / 2 )
+  // Here we elect to return the RMS distance because this is the quantity that was actually minimized in the calculation
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::GetIncrementalSpinCalibration(double shaftAxis_ToolTip[3], double& rmse)
+{
+  if (this->NumberOfToolToReferencePoses < 2)
+  {
+    return false;
+  }
+  this->ComputeSpinAxis(shaftAxis_ToolTip, rmse);
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::GetIncrementalPivotCalibration(double toolTipToToolTranslation[3], double& rmse)
+{
+  double pivotPoint_Reference[3] = { 0, 0, 0 };
+  return this->GetIncrementalPivotCalibration(toolTipToToolTranslation, pivotPoint_Reference, rmse);
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::GetIncrementalPivotCalibration(double toolTipToToolTranslation[3], double pivotPoint_Reference[3], double& rmse)
+{
+  // At least two different orientations are needed to determine the 6 unknowns
+  if (this->IncrementalPivotNumberOfSamples < 2)
+  {
+    return false;
+  }
+
+  // Normal equations A'A x = A'b of [ R -I ] * [ toolTip_Tool; pivot_Reference ] = -t over all poses
+  vnl_matrix<double> normalMatrix(6, 6);
+  vnl_vector<double> normalVector(6);
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      normalMatrix(i, j) = this->IncrementalPivotSumRotationTransposeRotation[i][j];
+      normalMatrix(i, 3 + j) = -this->IncrementalPivotSumRotation[j][i];
+      normalMatrix(3 + i, j) = -this->IncrementalPivotSumRotation[i][j];
+      normalMatrix(3 + i, 3 + j) = (i == j ? this->IncrementalPivotNumberOfSamples : 0);
+    }
+    normalVector(i) = -this->IncrementalPivotSumRotationTransposeTranslation[i];
+    normalVector(3 + i) = this->IncrementalPivotSumTranslation[i];
+  }
+
+  // Singular values of A'A are the squares of singular values of A, therefore the threshold
+  // is the square of the one used in ComputePivotCalibration
+  vnl_svd<double> svdNormalMatrix(normalMatrix);
+  svdNormalMatrix.zero_out_absolute( PIVOT_SINGULAR_VALUE_THRESHOLD * PIVOT_SINGULAR_VALUE_THRESHOLD );
+  vnl_vector<double> x = svdNormalMatrix.solve(normalVector);
+
+  // |Ax-b|^2 = x'A'Ax - 2x'A'b + b'b
+  double sumSquaredResiduals = dot_product(x, normalMatrix * x)
+    - 2 * dot_product(x, normalVector) + this->IncrementalPivotSumSquaredTranslation;
+  // Round-off may make the sum slightly negative for a perfect fit
+  rmse = sqrt(std::max(0.0, sumSquaredResiduals) / (3 * this->IncrementalPivotNumberOfSamples));
+
+  for (int i = 0; i < 3; i++)
+  {
+    toolTipToToolTranslation[i] = x[i];
+    pivotPoint_Reference[i] = x[3 + i];
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::ClearOrientationSum()
+{
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      this->OrientationSum[i][j] = 0;
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+void vtkSlicerPivotCalibrationLogic::AccumulateOrientation(const double* orientation, double weight)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      this->OrientationSum[i][j] += weight * orientation[i] * orientation[j];
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetToolOrientationSpreadDeg()
+{
+  if (this->NumberOfToolToReferencePoses < 2)
+  {
+    return 0.0;
+  }
+  // The largest eigenvalue of the sum of q * q' is the sum of (q.m)^2, where m is the mean orientation
+  vnl_matrix<double> orientationSum(4, 4);
+  for (int i = 0; i < 4; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      orientationSum(i, j) = this->OrientationSum[i][j];
+    }
+  }
+  vnl_matrix<double> eigenvectors(4, 4, 0);
+  vnl_vector<double> eigenvalues(4, 0);
+  vnl_symmetric_eigensystem_compute(orientationSum, eigenvectors, eigenvalues);
+  double meanSimilarity = sqrt(std::max(0.0, std::min(1.0, eigenvalues(3) / this->NumberOfToolToReferencePoses)));
+  // Rotation angle between unit quaternions p and q is 2 * acos(|p.q|), in domain 0, pi.
+  // The deviation from the mean is doubled to get the spread.
+  return vtkMath::DegreesFromRadians(4.0 * acos(meanSimilarity));
+}
+
+//---------------------------------------------------------------------------
+double vtkSlicerPivotCalibrationLogic::GetToolOrientationCoverage()
+{
+  if (this->MinimumOrientationDifferenceDeg <= 0)
+  {
+    return 1.0;
+  }
+  return std::min(1.0, this->GetToolOrientationSpreadDeg() / this->MinimumOrientationDifferenceDeg);
 }
 
 //---------------------------------------------------------------------------
 bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration( bool autoOrient /*=true*/)
 {
-  if (this->ToolToReferenceMatrices.size() < 10)
+  if (this->NumberOfToolToReferencePoses < MINIMUM_NUMBER_OF_POSES)
   {
     this->ErrorText = "Not enough input transforms are available";
     return false;
   }
 
-  if (this->GetMaximumToolOrientationDifferenceDeg() < this->MinimumOrientationDifferenceDeg)
+  if (this->GetToolOrientationSpreadDeg() < this->MinimumOrientationDifferenceDeg)
   {
     this->ErrorText = "Not enough variation in the input transforms";
     return false;
   }
-  
-  unsigned int rows = 3 * this->ToolToReferenceMatrices.size();
+
+  std::vector<unsigned int> poseIndices(this->NumberOfToolToReferencePoses);
+  for (unsigned int n = 0; n < this->NumberOfToolToReferencePoses; n++)
+  {
+    poseIndices[n] = n;
+  }
+  double toolTipToToolTranslation[3] = { 0, 0, 0 };
+  double pivotPoint_Reference[3] = { 0, 0, 0 };
+  this->SolvePivotCalibration(poseIndices, toolTipToToolTranslation, pivotPoint_Reference, this->PivotRMSE);
+  this->PivotInlierRatio = 1.0;
+
+  //set the transformation
+  this->ToolTipToToolMatrix->SetElement( 0, 3, toolTipToToolTranslation[ 0 ] );
+  this->ToolTipToToolMatrix->SetElement( 1, 3, toolTipToToolTranslation[ 1 ] );
+  this->ToolTipToToolMatrix->SetElement( 2, 3, toolTipToToolTranslation[ 2 ] );
+  if (autoOrient)
+  {
+    this->UpdateShaftDirection(); // Flip it if necessary
+  }
+
+  this->ErrorText.clear();
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::SolvePivotCalibration(const std::vector<unsigned int>& poseIndices,
+  double toolTipToToolTranslation[3], double pivotPoint_Reference[3], double& rmse)
+{
+  unsigned int rows = 3 * poseIndices.size();
   unsigned int columns = 6;
 
   vnl_matrix<double> A(rows, columns);
@@ -188,14 +992,13 @@ bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration( bool autoOrient /*
   vnl_vector<double> x(columns);
   vnl_vector<double> t(3);
 
-  std::vector<vtkMatrix4x4*>::const_iterator it;
-  std::vector<vtkMatrix4x4*>::const_iterator matricesEnd = this->ToolToReferenceMatrices.end();
-  unsigned int currentRow;
-  for(currentRow = 0, it = this->ToolToReferenceMatrices.begin(); it != matricesEnd; it++, currentRow += 3)
-  {    
+  unsigned int currentRow = 0;
+  for (std::vector<unsigned int>::const_iterator poseIndexIt = poseIndices.begin(); poseIndexIt != poseIndices.end(); ++poseIndexIt, currentRow += 3)
+  {
+    const double* pose = this->GetToolToReferencePose(*poseIndexIt);
     for (int i = 0; i < 3; i++)
     {
-      t(i) = (*it)->GetElement(i, 3);
+      t(i) = pose[4 * i + 3];
     }
     t *= -1;
     b.update(t, currentRow);
@@ -204,7 +1007,7 @@ bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration( bool autoOrient /*
     {
       for (int j = 0; j < 3; j++ )
       {
-        R(i, j) = (*it)->GetElement(i, j);
+        R(i, j) = pose[4 * i + j];
       }
     }
     A.update(R, currentRow, 0);
@@ -212,95 +1015,267 @@ bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibration( bool autoOrient /*
   }
     
   vnl_svd<double> svdA(A);    
-  svdA.zero_out_absolute( 1e-1 );    
+  svdA.zero_out_absolute( PIVOT_SINGULAR_VALUE_THRESHOLD );
   x = svdA.solve( b );
     
   //set the RMSE
-  this->PivotRMSE = ( A * x - b ).rms();
+  rmse = ( A * x - b ).rms();
+
+  for (int i = 0; i < 3; i++)
+  {
+    toolTipToToolTranslation[i] = x[i];
+    pivotPoint_Reference[i] = x[3 + i];
+  }
+  return svdA.rank() == columns;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::ComputeRobustPivotCalibration( bool autoOrient /*=true*/)
+{
+  if (this->NumberOfToolToReferencePoses < MINIMUM_NUMBER_OF_POSES)
+  {
+    this->ErrorText = "Not enough input transforms are available";
+    return false;
+  }
+
+  if (this->GetToolOrientationSpreadDeg() < this->MinimumOrientationDifferenceDeg)
+  {
+    this->ErrorText = "Not enough variation in the input transforms";
+    return false;
+  }
+
+  // Compute candidate solutions from random minimal sets of poses.
+  // A fixed seed is used so that results are reproducible.
+  int numberOfHypotheses = std::max(1, this->RobustNumberOfHypotheses);
+  std::vector<double> hypotheses;
+  hypotheses.reserve(6 * numberOfHypotheses);
+  vtkNew<vtkMinimalStandardRandomSequence> random;
+  random->SetSeed(1);
+  std::vector<unsigned int> minimalPoseIndices(ROBUST_MINIMAL_NUMBER_OF_POSES);
+  // Some minimal sets may be degenerate (similar orientations), allow some extra attempts to replace them
+  for (int attempt = 0; attempt < 3 * numberOfHypotheses && static_cast<int>(hypotheses.size()) < 6 * numberOfHypotheses; attempt++)
+  {
+    for (unsigned int i = 0; i < ROBUST_MINIMAL_NUMBER_OF_POSES; i++)
+    {
+      bool duplicate = true;
+      while (duplicate)
+      {
+        minimalPoseIndices[i] = std::min(this->NumberOfToolToReferencePoses - 1,
+          static_cast<unsigned int>(random->GetValue() * this->NumberOfToolToReferencePoses));
+        random->Next();
+        duplicate = (std::find(minimalPoseIndices.begin(), minimalPoseIndices.begin() + i, minimalPoseIndices[i]) != minimalPoseIndices.begin() + i);
+      }
+    }
+    double hypothesis[6] = { 0, 0, 0, 0, 0, 0 };
+    double minimalRmse = 0;
+    if (!this->SolvePivotCalibration(minimalPoseIndices, hypothesis, hypothesis + 3, minimalRmse))
+    {
+      continue;
+    }
+    hypotheses.insert(hypotheses.end(), hypothesis, hypothesis + 6);
+  }
+  if (hypotheses.empty())
+  {
+    this->ErrorText = "Not enough variation in the input transforms";
+    return false;
+  }
+  numberOfHypotheses = static_cast<int>(hypotheses.size() / 6);
+
+  // Score all candidates (expensive: each candidate is compared to all poses)
+  std::vector<int> numberOfInliers(numberOfHypotheses);
+  std::vector<double> sumSquaredInlierResiduals(numberOfHypotheses);
+  vtkPivotCalibrationHypothesisScorer scorer;
+  scorer.Poses.resize(this->NumberOfToolToReferencePoses);
+  for (unsigned int n = 0; n < this->NumberOfToolToReferencePoses; n++)
+  {
+    scorer.Poses[n] = this->GetToolToReferencePose(n);
+  }
+  scorer.Hypotheses = &(hypotheses[0]);
+  scorer.InlierThresholdSquared = this->RobustInlierThresholdMm * this->RobustInlierThresholdMm;
+  scorer.NumberOfInliers = &(numberOfInliers[0]);
+  scorer.SumSquaredInlierResiduals = &(sumSquaredInlierResiduals[0]);
+  vtkSMPTools::For(0, numberOfHypotheses, scorer);
+
+  // Best candidate has the most inliers, and the smallest residual if there are multiple
+  int bestHypothesisIndex = 0;
+  for (int hypothesisIndex = 1; hypothesisIndex < numberOfHypotheses; hypothesisIndex++)
+  {
+    if (numberOfInliers[hypothesisIndex] > numberOfInliers[bestHypothesisIndex]
+      || (numberOfInliers[hypothesisIndex] == numberOfInliers[bestHypothesisIndex]
+      && sumSquaredInlierResiduals[hypothesisIndex] < sumSquaredInlierResiduals[bestHypothesisIndex]))
+    {
+      bestHypothesisIndex = hypothesisIndex;
+    }
+  }
+
+  // Refine the solution on the inliers. Inliers are determined again after the first refinement,
+  // as the refined solution is more accurate than the candidate computed from a minimal set.
+  double toolTipToToolTranslation[3] = { hypotheses[6 * bestHypothesisIndex], hypotheses[6 * bestHypothesisIndex + 1], hypotheses[6 * bestHypothesisIndex + 2] };
+  double pivotPoint_Reference[3] = { hypotheses[6 * bestHypothesisIndex + 3], hypotheses[6 * bestHypothesisIndex + 4], hypotheses[6 * bestHypothesisIndex + 5] };
+  std::vector<unsigned int> inlierPoseIndices;
+  double rmse = 0;
+  const int numberOfRefinements = 2;
+  for (int refinement = 0; refinement < numberOfRefinements; refinement++)
+  {
+    std::vector<unsigned int> newInlierPoseIndices;
+    newInlierPoseIndices.reserve(this->NumberOfToolToReferencePoses);
+    for (unsigned int n = 0; n < this->NumberOfToolToReferencePoses; n++)
+    {
+      const double* pose = this->GetToolToReferencePose(n);
+      double residualSquared = 0;
+      for (int i = 0; i < 3; i++)
+      {
+        double residual = pose[4 * i] * toolTipToToolTranslation[0] + pose[4 * i + 1] * toolTipToToolTranslation[1] + pose[4 * i + 2] * toolTipToToolTranslation[2]
+          + pose[4 * i + 3] - pivotPoint_Reference[i];
+        residualSquared += residual * residual;
+      }
+      if (residualSquared < scorer.InlierThresholdSquared)
+      {
+        newInlierPoseIndices.push_back(n);
+      }
+    }
+    if (newInlierPoseIndices.size() < MINIMUM_NUMBER_OF_POSES)
+    {
+      if (inlierPoseIndices.empty())
+      {
+        this->ErrorText = "Not enough inlier transforms are found";
+        return false;
+      }
+      // keep the previous refinement
+      break;
+    }
+    if (newInlierPoseIndices == inlierPoseIndices)
+    {
+      break;
+    }
+    inlierPoseIndices.swap(newInlierPoseIndices);
+    this->SolvePivotCalibration(inlierPoseIndices, toolTipToToolTranslation, pivotPoint_Reference, rmse);
+  }
+
+  this->PivotRMSE = rmse;
+  this->PivotInlierRatio = static_cast<double>(inlierPoseIndices.size()) / this->NumberOfToolToReferencePoses;
 
   //set the transformation
-  this->ToolTipToToolMatrix->SetElement( 0, 3, x[ 0 ] );
-  this->ToolTipToToolMatrix->SetElement( 1, 3, x[ 1 ] );
-  this->ToolTipToToolMatrix->SetElement( 2, 3, x[ 2 ] );
+  this->ToolTipToToolMatrix->SetElement( 0, 3, toolTipToToolTranslation[ 0 ] );
+  this->ToolTipToToolMatrix->SetElement( 1, 3, toolTipToToolTranslation[ 1 ] );
+  this->ToolTipToToolMatrix->SetElement( 2, 3, toolTipToToolTranslation[ 2 ] );
   if (autoOrient)
   {
     this->UpdateShaftDirection(); // Flip it if necessary
   }
 
-  this->ErrorText.empty();
+  this->ErrorText.clear();
   return true;
 }
 
 //---------------------------------------------------------------------------
-bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration( bool snapRotation /*=false*/, bool autoOrient /*=true*/)
+bool vtkSlicerPivotCalibrationLogic::ComputePivotCalibrationConfidenceIntervals()
 {
-  if ( this->ToolToReferenceMatrices.size() < 10 )
+  if (this->NumberOfToolToReferencePoses < MINIMUM_NUMBER_OF_POSES)
   {
     this->ErrorText = "Not enough input transforms are available";
     return false;
   }
 
-  if (this->GetMaximumToolOrientationDifferenceDeg() < this->MinimumOrientationDifferenceDeg)
+  // Resampled solutions of degenerate input are not meaningful
+  if (this->GetToolOrientationSpreadDeg() < this->MinimumOrientationDifferenceDeg)
   {
     this->ErrorText = "Not enough variation in the input transforms";
     return false;
   }
-  
-  // Setup our system to find the axis of rotation
-  unsigned int rows = 3, columns = 3;
-
-  vnl_matrix<double> A( rows, columns, 0);
 
-  vnl_matrix<double> I( 3, 3, 0 );
-  I.set_identity();
-
-  vnl_matrix<double> RI( rows, columns );
+  int numberOfResamples = std::max(1, this->BootstrapNumberOfResamples);
+  std::vector<double> toolTipToToolTranslations(3 * numberOfResamples);
+  vtkPivotCalibrationBootstrapPivotSolver solver;
+  solver.Poses.resize(this->NumberOfToolToReferencePoses);
+  for (unsigned int n = 0; n < this->NumberOfToolToReferencePoses; n++)
+  {
+    solver.Poses[n] = this->GetToolToReferencePose(n);
+  }
+  solver.ToolTipToToolTranslations = &(toolTipToToolTranslations[0]);
+  vtkSMPTools::For(0, numberOfResamples, solver);
 
-  std::vector< vtkMatrix4x4* >::const_iterator previt = this->ToolToReferenceMatrices.end();
-  for(std::vector< vtkMatrix4x4* >::const_iterator it = this->ToolToReferenceMatrices.begin(); it != this->ToolToReferenceMatrices.end(); it++ )
+  // Percentile intervals of each component
+  double alpha = 1.0 - this->BootstrapConfidenceLevel;
+  std::vector<double> values(numberOfResamples);
+  for (int i = 0; i < 3; i++)
   {
-    if ( previt == this->ToolToReferenceMatrices.end() )
+    for (int resampleIndex = 0; resampleIndex < numberOfResamples; resampleIndex++)
     {
-      previt = it;
-      continue; // No comparison to make for the first matrix
+      values[resampleIndex] = toolTipToToolTranslations[3 * resampleIndex + i];
     }
-    
-    vtkSmartPointer< vtkMatrix4x4 > itinverse = vtkSmartPointer< vtkMatrix4x4 >::New();
-    vtkMatrix4x4::Invert( (*it), itinverse );
+    this->ToolTipToToolTranslationConfidenceIntervalLower[i] = GetPercentile(values, alpha / 2.0);
+    this->ToolTipToToolTranslationConfidenceIntervalUpper[i] = GetPercentile(values, 1.0 - alpha / 2.0);
+  }
 
-    vtkSmartPointer< vtkMatrix4x4 > instRotation = vtkSmartPointer< vtkMatrix4x4 >::New();
-    vtkMatrix4x4::Multiply4x4( itinverse, (*previt), instRotation );
+  this->ErrorText.clear();
+  return true;
+}
 
-    for (int i = 0; i < 3; i++)
-    {
-      for (int j = 0; j < 3; j++ )
-      {
-        RI(i, j) = instRotation->GetElement(i, j);
-      }
-    }
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibrationConfidenceIntervals()
+{
+  if (this->NumberOfToolToReferencePoses < MINIMUM_NUMBER_OF_POSES)
+  {
+    this->ErrorText = "Not enough input transforms are available";
+    return false;
+  }
 
-    RI = RI - I;
-    A = A + RI.transpose() * RI;
+  // Resampled solutions of degenerate input are not meaningful
+  if (this->GetToolOrientationSpreadDeg() < this->MinimumOrientationDifferenceDeg)
+  {
+    this->ErrorText = "Not enough variation in the input transforms";
+    return false;
+  }
 
-    previt = it;
+  int numberOfResamples = std::max(1, this->BootstrapNumberOfResamples);
+  std::vector<double> anglesDeg(numberOfResamples);
+  vtkPivotCalibrationBootstrapSpinSolver solver;
+  double rmse = 0;
+  this->ComputeSpinAxis(solver.ReferenceShaftAxis_ToolTip, rmse);
+  solver.Terms.resize(9 * (this->NumberOfToolToReferencePoses - 1));
+  for (unsigned int n = 1; n < this->NumberOfToolToReferencePoses; n++)
+  {
+    double term[3][3];
+    vtkSlicerPivotCalibrationLogic::ComputeSpinEquationsTerm(this->GetToolToReferencePose(n), this->GetToolToReferencePose(n - 1), term);
+    std::copy(term[0], term[0] + 9, &(solver.Terms[9 * (n - 1)]));
   }
+  solver.AnglesDeg = &(anglesDeg[0]);
+  vtkSMPTools::For(0, numberOfResamples, solver);
+
+  this->ShaftAxisConfidenceAngleDeg = GetPercentile(anglesDeg, this->BootstrapConfidenceLevel);
+
+  this->ErrorText.clear();
+  return true;
+}
+
+//---------------------------------------------------------------------------
+bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration( bool snapRotation /*=false*/, bool autoOrient /*=true*/)
+{
+  if ( this->NumberOfToolToReferencePoses < MINIMUM_NUMBER_OF_POSES )
+  {
+    this->ErrorText = "Not enough input transforms are available";
+    return false;
+  }
+
+  if (this->GetToolOrientationSpreadDeg() < this->MinimumOrientationDifferenceDeg)
+  {
+    this->ErrorText = "Not enough variation in the input transforms";
+    return false;
+  }
+  
+  // The system to find the axis of rotation is accumulated as the transforms are added
+  unsigned int columns = 3;
 
   // Setup the axes
   vnl_vector<double> shaftAxis_Shaft( columns, columns, SHAFT_AXIS );
   vnl_vector<double> orthogonalAxis_Shaft( columns, columns, ORTHOGONAL_AXIS );
   vnl_vector<double> backupAxis_Shaft( columns, columns, BACKUP_AXIS );
 
-  // Find the eigenvector associated with the smallest eigenvalue
-  // This is the best axis of rotation over all instantaneous rotations
-  vnl_matrix<double> eigenvectors( columns, columns, 0 );
-  vnl_vector<double> eigenvalues( columns, 0 );
-  vnl_symmetric_eigensystem_compute( A, eigenvectors, eigenvalues );
-  // Note: eigenvectors are ordered in increasing eigenvalue ( 0 = smallest, end = biggest )
-  vnl_vector<double> shaftAxis_ToolTip( columns, 0 );
-  shaftAxis_ToolTip( 0 ) = eigenvectors( 0, 0 );
-  shaftAxis_ToolTip( 1 ) = eigenvectors( 1, 0 );
-  shaftAxis_ToolTip( 2 ) = eigenvectors( 2, 0 );
-  shaftAxis_ToolTip.normalize();
+  // Find the best axis of rotation over all instantaneous rotations and set the RMSE
+  double shaftAxis[3] = { 0, 0, 0 };
+  this->ComputeSpinAxis( shaftAxis, this->SpinRMSE );
+  vnl_vector<double> shaftAxis_ToolTip( columns, columns, shaftAxis );
 
   // Snap the direction vector to be exactly aligned with one of the coordinate axes
   // This is if the sensor is known to be parallel to one of the axis, just not which one
@@ -311,13 +1286,6 @@ bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration( bool snapRotation /
     shaftAxis_ToolTip.put( closestCoordinateAxis, 1 ); // Doesn't matter the direction, will be sorted out later
   }
 
-  //set the RMSE
-  this->SpinRMSE = sqrt( eigenvalues( 0 ) / this->ToolToReferenceMatrices.size() );
-  // Note: This error is the RMS distance from the ideal axis of rotation to the axis of rotation for each instantaneous rotation
-  // This RMS distance can be computed to an angle in the following way: angle = arccos( 1 - SpinRMSE^2 / 2 )
-  // Here we elect to return the RMS distance because this is the quantity that was actually minimized in the calculation
-
-
   // If the secondary axis 1 is parallel to the shaft axis in the tooltip frame, then use secondary axis 2
   vnl_vector<double> orthogonalAxis_ToolTip = this->ComputeSecondaryAxis( shaftAxis_ToolTip );
   // Do the registration find the appropriate rotation
@@ -378,7 +1346,7 @@ bool vtkSlicerPivotCalibrationLogic::ComputeSpinCalibration( bool snapRotation /
     this->UpdateShaftDirection(); // Flip it if necessary
   }
   
-  this->ErrorText.empty();
+  this->ErrorText.clear();
   return true;
 }
 
@@ -24,6 +24,7 @@
 #include "vtkSlicerModuleLogic.h"
 
 // VTK includes
+#include <vtkCommand.h>
 #include <vtkMatrix4x4.h>
 #include <vtkMath.h>
 
@@ -32,9 +33,12 @@
 
 // STD includes
 #include <cstdlib>
+#include <map>
+#include <vector>
 
 // VNL includes
 #include "vnl/vnl_matrix.h"
+#include "vnl/vnl_vector.h"
 
 #include "vtkSlicerPivotCalibrationModuleLogicExport.h"
 
@@ -54,23 +58,111 @@ public:
   vtkTypeMacro(vtkSlicerPivotCalibrationLogic, vtkSlicerModuleLogic);
   void PrintSelf(ostream& os, vtkIndent indent);
 
+  enum Events
+  {
+    // Invoked when a tool transform is added, the incremental pivot calibration result is updated
+    ToolToReferenceMatrixAddedEvent = vtkCommand::UserEvent + 1,
+    // Invoked when convergence monitoring detects that the calibration result is stable, recording is stopped
+    CalibrationConvergedEvent
+  };
+
+  enum ConvergenceMonitoringModes
+  {
+    CONVERGENCE_MONITORING_OFF,
+    CONVERGENCE_MONITORING_PIVOT, // tool tip position
+    CONVERGENCE_MONITORING_SPIN // shaft axis
+  };
+
   // Clears all previously acquired tool transforms.
   // Call this before start adding transforms.
   void ClearToolToReferenceMatrices();
 
+  // Maximum number of stored tool transforms. Tool transforms are stored in a preallocated buffer,
+  // when the buffer is full then the oldest transform is replaced by the new one.
+  // If the capacity is reduced then the most recent transforms are kept.
+  void SetMaximumNumberOfToolToReferenceMatrices( unsigned int capacity );
+  unsigned int GetMaximumNumberOfToolToReferenceMatrices();
+  unsigned int GetNumberOfToolToReferenceMatrices();
+  // Get a stored tool transform (0 is the oldest). Returns false if the index is out of range.
+  bool GetNthToolToReferenceMatrix( unsigned int n, vtkMatrix4x4* toolToReferenceMatrix );
+
   // Add a tool transforms automatically by observing transform changes
   vtkGetMacro(RecordingState, bool);
   vtkSetMacro(RecordingState, bool);
   void SetAndObserveTransformNode( vtkMRMLLinearTransformNode* );
 
-  // Add a single tool transform manually
-  void AddToolToReferenceMatrix( vtkMatrix4x4* );
+  // Add a single tool transform manually. The matrix is copied.
+  // Returns false if the transform is not added (when pose deduplication is enabled and a similar pose is already stored).
+  bool AddToolToReferenceMatrix( vtkMatrix4x4* );
+
+  // Pose deduplication: if enabled, then at most one tool transform is stored in each cell of a pose-space grid
+  // (position resolution in mm, orientation resolution in degrees). This prevents a tool that is held still
+  // from flooding the calibration with nearly identical transforms, keeping the problem size bounded and well conditioned.
+  // Disabled by default. Transforms that are already stored are kept when the settings are changed.
+  void SetPoseDeduplication( bool enable );
+  vtkGetMacro(PoseDeduplication, bool);
+  vtkBooleanMacro(PoseDeduplication, bool);
+  void SetPoseDeduplicationPositionResolutionMm( double resolutionMm );
+  vtkGetMacro(PoseDeduplicationPositionResolutionMm, double);
+  void SetPoseDeduplicationOrientationResolutionDeg( double resolutionDeg );
+  vtkGetMacro(PoseDeduplicationOrientationResolutionDeg, double);
 
   // Computes calibration results.
   // By default, automatically flips the shaft direction to be consistent with the needle orientation protocol.
   // Returns with false on failure
   bool ComputePivotCalibration( bool autoOrient = true );
 
+  // Computes pivot calibration results, ignoring outlier samples (e.g., caused by tracking glitches).
+  // Pivot calibration is computed from many random minimal sets of samples (RANSAC), each candidate is scored by the number of
+  // samples that it fits within RobustInlierThresholdMm (candidates are scored in parallel), and the final result is
+  // computed from the inliers of the best candidate by least squares. PivotRMSE is computed from the inliers.
+  // Returns with false on failure
+  bool ComputeRobustPivotCalibration( bool autoOrient = true );
+
+  // Maximum distance of the tool tip from the pivot point for a sample to be considered an inlier in robust pivot calibration
+  vtkGetMacro(RobustInlierThresholdMm, double);
+  vtkSetMacro(RobustInlierThresholdMm, double);
+  // Number of candidate solutions evaluated in robust pivot calibration
+  vtkGetMacro(RobustNumberOfHypotheses, int);
+  vtkSetMacro(RobustNumberOfHypotheses, int);
+  // Ratio of inliers among all samples in the last pivot calibration (1.0 if not robust)
+  vtkGetMacro(PivotInlierRatio, double);
+
+  // Computes bootstrap confidence intervals of the calibration results.
+  // The acquired tool transforms (for spin calibration: the rotations between consecutive transforms) are resampled
+  // with replacement BootstrapNumberOfResamples times and the calibration is solved from the normal equations
+  // of each resample (resamples are processed in parallel). All acquired transforms are used (outliers are not removed).
+  // Calibration result (ToolTipToToolMatrix) is not changed. Returns with false on failure, including when
+  // the input does not have enough orientation variation for the calibration (see MinimumOrientationDifferenceDeg).
+  bool ComputePivotCalibrationConfidenceIntervals();
+  bool ComputeSpinCalibrationConfidenceIntervals();
+  vtkGetMacro(BootstrapNumberOfResamples, int);
+  vtkSetMacro(BootstrapNumberOfResamples, int);
+  // Confidence level of the intervals (e.g., 0.95 for 95% confidence intervals)
+  vtkGetMacro(BootstrapConfidenceLevel, double);
+  vtkSetClampMacro(BootstrapConfidenceLevel, double, 0.0, 1.0);
+  // Confidence interval of each component of the tool tip position (in Tool coordinate system)
+  vtkGetVector3Macro(ToolTipToToolTranslationConfidenceIntervalLower, double);
+  vtkGetVector3Macro(ToolTipToToolTranslationConfidenceIntervalUpper, double);
+  // Confidence interval of the shaft axis: angle between the shaft axis computed from all
+  // and from the resampled rotations that is not exceeded at the confidence level
+  vtkGetMacro(ShaftAxisConfidenceAngleDeg, double);
+
+  // Incremental pivot calibration.
+  // Normal equations of the pivot calibration problem (6x6) and the sum of squared residual terms are accumulated
+  // as tool transforms are added, therefore the current tip position and RMSE can be computed at any time
+  // in constant time, independently of the number of acquired transforms (for live feedback during acquisition).
+  // Returns with false if not enough transforms are available. Calibration result (ToolTipToToolMatrix) is not changed.
+  bool GetIncrementalPivotCalibration( double toolTipToToolTranslation[3], double& rmse );
+  bool GetIncrementalPivotCalibration( double toolTipToToolTranslation[3], double pivotPoint_Reference[3], double& rmse );
+  vtkGetMacro(IncrementalPivotNumberOfSamples, unsigned int);
+
+  // Incremental spin calibration.
+  // The 3x3 matrix of the spin axis problem is accumulated from the rotations between consecutive tool transforms
+  // as they are added, therefore the current shaft axis (in ToolTip coordinate system) and RMSE can be computed at any time in constant time.
+  // Returns with false if not enough transforms are available. Calibration result (ToolTipToToolMatrix) is not changed.
+  bool GetIncrementalSpinCalibration( double shaftAxis_ToolTip[3], double& rmse );
+
   // Computes calibration results.
   // By default, automatically flips the shaft direction to be consistent with the needle orientation protocol.
   // Optionally, snaps the rotation to be a 90 degree rotation about one of the coordinate axes.
@@ -88,6 +180,37 @@ public:
   vtkGetMacro(PivotRMSE, double);
   vtkGetMacro(SpinRMSE, double);
 
+  // Orientation spread of the acquired tool transforms, in degrees: twice the angular deviation from the mean
+  // orientation (4 * acos(sqrt(mean squared |q.m|)), where q are the orientations and m is the mean orientation).
+  // For two transforms it is the orientation difference between them.
+  // The mean is computed from the sum of quaternion outer products, which is updated when transforms are
+  // added or replaced, therefore a query takes constant time, independently of the number of transforms.
+  double GetToolOrientationSpreadDeg();
+  // Ratio of orientation spread and the minimum orientation difference that is required for calibration,
+  // clamped to [0, 1]. Calibration input has enough variation if coverage is 1.
+  double GetToolOrientationCoverage();
+
+  // Minimum orientation spread (in degrees) required for pivot and spin calibration
+  vtkGetMacro(MinimumOrientationDifferenceDeg, double);
+  vtkSetMacro(MinimumOrientationDifferenceDeg, double);
+
+  // Convergence monitoring.
+  // If enabled, then the incremental calibration result (tip position or shaft axis) is computed after each added tool transform.
+  // When orientation coverage is sufficient and the result of the last ConvergenceWindowSize transforms is within the tolerance
+  // of the current result, then recording is stopped (RecordingState is set to false) and CalibrationConvergedEvent is invoked.
+  // Monitoring is restarted by ClearToolToReferenceMatrices.
+  vtkGetMacro(ConvergenceMonitoringMode, int);
+  vtkSetMacro(ConvergenceMonitoringMode, int);
+  void SetConvergenceWindowSize( unsigned int windowSize );
+  vtkGetMacro(ConvergenceWindowSize, unsigned int);
+  // Maximum change of the tool tip position (pivot calibration)
+  vtkGetMacro(ConvergenceTolerancePositionMm, double);
+  vtkSetMacro(ConvergenceTolerancePositionMm, double);
+  // Maximum change of the shaft axis direction (spin calibration)
+  vtkGetMacro(ConvergenceToleranceAngleDeg, double);
+  vtkSetMacro(ConvergenceToleranceAngleDeg, double);
+  vtkGetMacro(Converged, bool);
+
   // Returns human-readable description of the error occurred (non-empty if ComputePivotCalibration returns with failure)
   vtkGetMacro(ErrorText, std::string);
   
@@ -97,12 +220,14 @@ protected:
   
   void ProcessMRMLNodesEvents( vtkObject* caller, unsigned long event, void* callData );
 
-  // Returns the orientation difference in degrees between two 4x4 homogeneous transformation matrix, in degrees.
-  double GetOrientationDifferenceDeg(vtkMatrix4x4* aMatrix, vtkMatrix4x4* bMatrix);
-  
-  // Computes the maximum orientation difference in degrees between the first tool transformation
-  // and all the others. Used for determining if there was enough variation in the input data.
-  double GetMaximumToolOrientationDifferenceDeg();
+  // Returns the n-th stored tool pose (0 is the oldest): first 3 rows of the ToolToReference matrix (12 values, row-major)
+  const double* GetToolToReferencePose( unsigned int n ) const;
+  // Returns the orientation of the n-th stored tool pose as a unit quaternion (w, x, y, z)
+  const double* GetToolToReferenceOrientation( unsigned int n ) const;
+
+  // Adds (weight = 1) or removes (weight = -1) the outer product of a tool pose orientation to/from OrientationSum
+  void AccumulateOrientation( const double* orientation, double weight );
+  void ClearOrientationSum();
 
   // Verify whether the tool's shaft is in the same direction as the ToolTip to Tool vector.
   // Rotate the ToolTip coordinate frame by 180 degrees about the secondary axis to make the 
@@ -112,6 +237,36 @@ protected:
   // Helper method to compute the secondary axis, given a shaft axis
   static vnl_vector< double > ComputeSecondaryAxis( vnl_vector< double > shaftAxis_ToolTip );
 
+  // Cell of the pose-space grid that is used for pose deduplication
+  struct PoseCell
+  {
+    int Index[7]; // 3 position and 4 orientation (quaternion) components
+    bool operator<( const PoseCell& other ) const;
+  };
+  void GetPoseCell( const double* pose, const double* orientation, PoseCell& cell ) const;
+  // Recomputes OccupiedPoseCells from the stored poses
+  void UpdateOccupiedPoseCells();
+
+  // Computes pivot calibration by least squares from the specified poses.
+  // Returns false if the poses do not determine the solution (the solution is still set, but it is not reliable).
+  bool SolvePivotCalibration( const std::vector< unsigned int >& poseIndices, double toolTipToToolTranslation[3], double pivotPoint_Reference[3], double& rmse );
+
+  // Adds (weight = 1) or removes (weight = -1) the equations of a tool pose to/from the incremental pivot calibration accumulators
+  void AccumulatePivotEquations( const double* toolToReferencePose, double weight );
+  void ClearPivotEquations();
+
+  // Adds (weight = 1) or removes (weight = -1) the term of the rotation between two consecutive tool poses
+  // to/from the incremental spin calibration matrix
+  void AccumulateSpinEquations( const double* toolToReferencePose, const double* previousToolToReferencePose, double weight );
+  void ClearSpinEquations();
+  // Computes (R - I)' * (R - I) for the rotation R between two consecutive tool poses
+  static void ComputeSpinEquationsTerm( const double* toolToReferencePose, const double* previousToolToReferencePose, double term[3][3] );
+  // Computes the best axis of rotation over all rotations between consecutive poses from the incremental spin calibration matrix
+  void ComputeSpinAxis( double shaftAxis_ToolTip[3], double& rmse );
+
+  // Adds the current incremental calibration result to the convergence history and stops recording if converged
+  void UpdateConvergence();
+
   
 private:
 
@@ -120,14 +275,61 @@ private:
 
   // Calibration inputs
   double MinimumOrientationDifferenceDeg;
-  std::vector< vtkMatrix4x4* > ToolToReferenceMatrices;
+  // Ring buffer of tool poses (12 values per pose, see GetToolToReferencePose)
+  std::vector< double > ToolToReferencePoses;
+  unsigned int ToolToReferencePosesCapacity;
+  unsigned int ToolToReferencePosesStart; // index of the oldest pose in the buffer
+  unsigned int NumberOfToolToReferencePoses;
+  // Orientation quaternion of each pose (4 values per pose, same indexing as ToolToReferencePoses)
+  std::vector< double > ToolToReferenceOrientations;
+  // Sum of q * q' over the orientation quaternions of the stored poses (sign of q does not matter),
+  // its eigenvector of the largest eigenvalue is the mean orientation
+  double OrientationSum[4][4];
+  // Pose deduplication
+  bool PoseDeduplication;
+  double PoseDeduplicationPositionResolutionMm;
+  double PoseDeduplicationOrientationResolutionDeg;
+  // Number of stored poses in each occupied cell, only updated if PoseDeduplication is enabled
+  std::map< PoseCell, unsigned int > OccupiedPoseCells;
   vtkMRMLLinearTransformNode* ObservedTransformNode;
+  vtkMatrix4x4* ObservedTransformMatrix; // reused for reading the observed transform
   bool RecordingState;
 
+  // Incremental pivot calibration: sums of R, R'R, R't, t and t't over the tool poses,
+  // the normal equations of the pivot calibration are built from these when solving
+  double IncrementalPivotSumRotation[3][3];
+  double IncrementalPivotSumRotationTransposeRotation[3][3];
+  double IncrementalPivotSumRotationTransposeTranslation[3];
+  double IncrementalPivotSumTranslation[3];
+  double IncrementalPivotSumSquaredTranslation;
+  unsigned int IncrementalPivotNumberOfSamples;
+
+  // Sum of (R - I)' * (R - I) for the rotations R between consecutive poses
+  double IncrementalSpinMatrix[3][3];
+
+  // Convergence monitoring
+  int ConvergenceMonitoringMode;
+  unsigned int ConvergenceWindowSize;
+  double ConvergenceTolerancePositionMm;
+  double ConvergenceToleranceAngleDeg;
+  bool Converged;
+  // Ring buffer of the last ConvergenceWindowSize incremental calibration results (3 values per result)
+  std::vector< double > ConvergenceHistory;
+  unsigned int ConvergenceHistoryStart; // index of the oldest result in the buffer
+  unsigned int NumberOfConvergenceHistoryEntries;
+
   // Calibration results
   vtkMatrix4x4* ToolTipToToolMatrix;
   double PivotRMSE;
+  double PivotInlierRatio;
+  double RobustInlierThresholdMm;
+  int RobustNumberOfHypotheses;
   double SpinRMSE; 
+  int BootstrapNumberOfResamples;
+  double BootstrapConfidenceLevel;
+  double ToolTipToToolTranslationConfidenceIntervalLower[3];
+  double ToolTipToToolTranslationConfidenceIntervalUpper[3];
+  double ShaftAxisConfidenceAngleDeg;
   std::string ErrorText;
 };
 
@@ -0,0 +1,117 @@
+# Checks the CSV output of PivotCalibrationBatch.
+# Usage: cmake -DBATCH_EXECUTABLE=... -DDATA_DIR=... -DTEMP_DIR=... -P PivotCalibrationBatchTest.cmake
+#
+# Test data (tip position in the tool coordinate system, noise: 0.05 mm):
+#   PivotCalibrationBatchTestToolA.csv: 60 valid transforms, tip (5, -3, 150); header, comment, and empty lines;
+#     4 invalid records: one value missing, trailing text, NaN, infinity
+#   PivotCalibrationBatchTestToolB.bin: 50 valid transforms, tip (-2, 1, 120);
+#     2 invalid records: NaN, truncated last record
+
+# Keep empty fields (error text) when splitting result rows
+cmake_policy(SET CMP0007 NEW)
+
+set(TIP_TOLERANCE_MM 1)
+
+#-----------------------------------------------------------------------------
+function(run_batch output_file)
+  execute_process(
+    COMMAND ${BATCH_EXECUTABLE} --output ${output_file} ${ARGN}
+    RESULT_VARIABLE result
+    ERROR_VARIABLE error_output
+    )
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "PivotCalibrationBatch failed (${result}): ${error_output}")
+  endif()
+  set(BATCH_ERROR_OUTPUT "${error_output}" PARENT_SCOPE)
+endfunction()
+
+#-----------------------------------------------------------------------------
+# Returns the fields of the result row of the input file
+function(get_result_fields output_file input_file fields_var)
+  file(STRINGS ${output_file} lines)
+  foreach(line ${lines})
+    string(FIND "${line}" "\"${input_file}\"" position)
+    if(position EQUAL 0)
+      string(REPLACE "\"" "" line "${line}")
+      string(REPLACE "," ";" fields "${line}")
+      set(${fields_var} "${fields}" PARENT_SCOPE)
+      return()
+    endif()
+  endforeach()
+  message(FATAL_ERROR "No result for ${input_file} in ${output_file}")
+endfunction()
+
+#-----------------------------------------------------------------------------
+function(check_field fields index name expected_value)
+  list(GET fields ${index} value)
+  if(NOT value STREQUAL expected_value)
+    message(FATAL_ERROR "${name}: ${value} (expected: ${expected_value})")
+  endif()
+endfunction()
+
+#-----------------------------------------------------------------------------
+function(check_tip fields expected_x expected_y expected_z)
+  set(expected ${expected_x} ${expected_y} ${expected_z})
+  # ToolTipToTool_03, ToolTipToTool_13, ToolTipToTool_23
+  set(indices 12 16 20)
+  foreach(axis 0 1 2)
+    list(GET indices ${axis} index)
+    list(GET fields ${index} value)
+    list(GET expected ${axis} expected_value)
+    math(EXPR lower "${expected_value} - ${TIP_TOLERANCE_MM}")
+    math(EXPR upper "${expected_value} + ${TIP_TOLERANCE_MM}")
+    if(NOT (value GREATER lower AND value LESS upper))
+      message(FATAL_ERROR "Tip position component ${axis}: ${value} (expected: ${expected_value})")
+    endif()
+  endforeach()
+endfunction()
+
+file(MAKE_DIRECTORY ${TEMP_DIR})
+set(tool_a ${DATA_DIR}/PivotCalibrationBatchTestToolA.csv)
+set(tool_b ${DATA_DIR}/PivotCalibrationBatchTestToolB.bin)
+
+#-----------------------------------------------------------------------------
+# Multiple tools, text and binary files with invalid records
+set(output_file ${TEMP_DIR}/PivotCalibrationBatchTestResults.csv)
+run_batch(${output_file} ${tool_a} ${tool_b})
+get_result_fields(${output_file} ${tool_a} fields)
+check_field("${fields}" 1 "Tool A Success" true)
+check_field("${fields}" 3 "Tool A ReadPoses" 60)
+check_field("${fields}" 4 "Tool A UsedPoses" 60)
+check_field("${fields}" 5 "Tool A InvalidRecords" 4)
+check_tip("${fields}" 5 -3 150)
+get_result_fields(${output_file} ${tool_b} fields)
+check_field("${fields}" 1 "Tool B Success" true)
+check_field("${fields}" 3 "Tool B ReadPoses" 50)
+check_field("${fields}" 4 "Tool B UsedPoses" 50)
+check_field("${fields}" 5 "Tool B InvalidRecords" 2)
+check_tip("${fields}" -2 1 120)
+
+#-----------------------------------------------------------------------------
+# Limiting the number of transforms keeps the most recent ones and reports it
+run_batch(${output_file} --max-poses 20 ${tool_a})
+get_result_fields(${output_file} ${tool_a} fields)
+check_field("${fields}" 3 "Tool A ReadPoses with --max-poses" 60)
+check_field("${fields}" 4 "Tool A UsedPoses with --max-poses" 20)
+if(NOT BATCH_ERROR_OUTPUT MATCHES "warning")
+  message(FATAL_ERROR "No warning about discarded transforms: ${BATCH_ERROR_OUTPUT}")
+endif()
+
+#-----------------------------------------------------------------------------
+# All transforms are used by default, even if there are more than the default buffer size (10000).
+# The repeated header lines are invalid records after the first transform.
+set(long_recording ${TEMP_DIR}/PivotCalibrationBatchTestLongRecording.csv)
+file(READ ${tool_a} recording)
+file(WRITE ${long_recording} "")
+foreach(repetition RANGE 1 170)
+  file(APPEND ${long_recording} "${recording}")
+endforeach()
+run_batch(${output_file} ${long_recording})
+get_result_fields(${output_file} ${long_recording} fields)
+check_field("${fields}" 1 "Long recording Success" true)
+check_field("${fields}" 3 "Long recording ReadPoses" 10200)
+check_field("${fields}" 4 "Long recording UsedPoses" 10200)
+check_field("${fields}" 5 "Long recording InvalidRecords" 849)
+if(BATCH_ERROR_OUTPUT MATCHES "warning")
+  message(FATAL_ERROR "Unexpected warning: ${BATCH_ERROR_OUTPUT}")
+endif()
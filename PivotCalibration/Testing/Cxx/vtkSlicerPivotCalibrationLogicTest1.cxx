@@ -0,0 +1,584 @@
+/*==============================================================================
+
+  Program: 3D Slicer
+
+  Portions (c) Copyright Brigham and Women's Hospital (BWH) All Rights Reserved.
+
+  See COPYRIGHT.txt
+  or http://www.slicer.org/copyright/copyright.txt for details.
+
+  Unless required by applicable law or agreed to in writing, software
+  distributed under the License is distributed on an "AS IS" BASIS,
+  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+  See the License for the specific language governing permissions and
+  limitations under the License.
+
+==============================================================================*/
+
+// Verifies pivot and spin calibration on synthetic tool poses with a known tool tip and shaft axis:
+// incremental results must match the results computed from the stored poses (also after the pose
+// buffer is full and the oldest poses are replaced), robust pivot calibration must reject outliers,
+// orientation spread must only depend on the stored poses, pose deduplication must only reject poses
+// that are similar to a pose that remains stored, bootstrap confidence intervals must contain the true
+// tool tip and must not be computed from input without orientation variation, and convergence monitoring
+// must stop recording.
+
+// PivotCalibration Logic includes
+#include "vtkSlicerPivotCalibrationLogic.h"
+
+// VTK includes
+#include <vtkCallbackCommand.h>
+#include <vtkMath.h>
+#include <vtkMatrix4x4.h>
+#include <vtkMinimalStandardRandomSequence.h>
+#include <vtkNew.h>
+#include <vtkTransform.h>
+
+// STD includes
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace
+{
+
+const double TOOL_TIP_TO_TOOL_TRANSLATION[3] = { 12.0, -8.0, 160.0 };
+const double PIVOT_POINT_REFERENCE[3] = { 50.0, 60.0, -30.0 };
+const double SHAFT_AXIS_TOOL[3] = { 0.0, 0.6, 0.8 };
+const double NOISE_MM = 0.1;
+// Tolerance of incremental results compared to the results computed from the stored poses
+const double INCREMENTAL_TOLERANCE = 1e-4;
+
+//----------------------------------------------------------------------------
+double GetRandomValue( vtkMinimalStandardRandomSequence* random, double minimum, double maximum )
+{
+  double value = random->GetRangeValue( minimum, maximum );
+  random->Next();
+  return value;
+}
+
+//----------------------------------------------------------------------------
+// Tool pose while pivoting: random orientation, tool tip at the pivot point (with some noise)
+void CreatePivotPose( vtkMinimalStandardRandomSequence* random, const double toolTipToToolTranslation[3], double noiseMm, vtkMatrix4x4* toolToReferenceMatrix )
+{
+  vtkNew< vtkTransform > transform;
+  transform->RotateWXYZ( GetRandomValue( random, -40.0, 40.0 ),
+    GetRandomValue( random, -1.0, 1.0 ), GetRandomValue( random, -1.0, 1.0 ), GetRandomValue( random, -1.0, 1.0 ) );
+  transform->RotateX( 30.0 );
+  toolToReferenceMatrix->DeepCopy( transform->GetMatrix() );
+  double toolTip_Reference[3] = { 0.0, 0.0, 0.0 };
+  transform->TransformVector( toolTipToToolTranslation, toolTip_Reference );
+  for ( int i = 0; i < 3; i++ )
+  {
+    toolToReferenceMatrix->SetElement( i, 3, PIVOT_POINT_REFERENCE[ i ] - toolTip_Reference[ i ] + GetRandomValue( random, -noiseMm, noiseMm ) );
+  }
+}
+
+//----------------------------------------------------------------------------
+// Tool pose while spinning: rotated about the shaft axis by the specified angle
+void CreateSpinPose( const double shaftAxis_Tool[3], double angleDeg, vtkMatrix4x4* toolToReferenceMatrix )
+{
+  vtkNew< vtkTransform > transform;
+  transform->Translate( 20.0, -40.0, 100.0 );
+  transform->RotateWXYZ( 25.0, 1.0, 2.0, 0.0 );
+  transform->RotateWXYZ( angleDeg, shaftAxis_Tool[ 0 ], shaftAxis_Tool[ 1 ], shaftAxis_Tool[ 2 ] );
+  toolToReferenceMatrix->DeepCopy( transform->GetMatrix() );
+}
+
+//----------------------------------------------------------------------------
+bool CheckVector( const char* name, const double* actual, const double* expected, double tolerance )
+{
+  if ( sqrt( vtkMath::Distance2BetweenPoints( actual, expected ) ) > tolerance )
+  {
+    std::cerr << name << " is (" << actual[ 0 ] << ", " << actual[ 1 ] << ", " << actual[ 2 ] << "), expected ("
+      << expected[ 0 ] << ", " << expected[ 1 ] << ", " << expected[ 2 ] << ")" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+bool CheckValue( const char* name, double actual, double expected, double tolerance )
+{
+  if ( fabs( actual - expected ) > tolerance )
+  {
+    std::cerr << name << " is " << actual << ", expected " << expected << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Shaft axis direction is arbitrary
+bool CheckAxis( const char* name, const double* actual, const double* expected, double toleranceDeg )
+{
+  double angleDeg = vtkMath::DegreesFromRadians( acos( std::min( 1.0, fabs( vtkMath::Dot( actual, expected ) ) ) ) );
+  if ( angleDeg > toleranceDeg )
+  {
+    std::cerr << name << " is (" << actual[ 0 ] << ", " << actual[ 1 ] << ", " << actual[ 2 ] << "), expected ("
+      << expected[ 0 ] << ", " << expected[ 1 ] << ", " << expected[ 2 ] << "), difference: " << angleDeg << " deg" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+// Compares the incremental pivot calibration to the one computed from the stored poses
+int CheckIncrementalPivotCalibration( vtkSlicerPivotCalibrationLogic* logic, const double expectedToolTipToToolTranslation[3] )
+{
+  int numberOfErrors = 0;
+  double incrementalToolTipToToolTranslation[3] = { 0.0, 0.0, 0.0 };
+  double incrementalPivotRmse = 0.0;
+  if ( !logic->GetIncrementalPivotCalibration( incrementalToolTipToToolTranslation, incrementalPivotRmse ) )
+  {
+    std::cerr << "Incremental pivot calibration failed" << std::endl;
+    return 1;
+  }
+  if ( !logic->ComputePivotCalibration( false ) )
+  {
+    std::cerr << "Pivot calibration failed: " << logic->GetErrorText() << std::endl;
+    return 1;
+  }
+  vtkNew< vtkMatrix4x4 > toolTipToToolMatrix;
+  logic->GetToolTipToToolMatrix( toolTipToToolMatrix.GetPointer() );
+  double toolTipToToolTranslation[3] = { toolTipToToolMatrix->GetElement( 0, 3 ), toolTipToToolMatrix->GetElement( 1, 3 ), toolTipToToolMatrix->GetElement( 2, 3 ) };
+
+  numberOfErrors += CheckVector( "Incremental pivot calibration tool tip", incrementalToolTipToToolTranslation, toolTipToToolTranslation, INCREMENTAL_TOLERANCE ) ? 0 : 1;
+  numberOfErrors += CheckValue( "Incremental pivot calibration RMSE", incrementalPivotRmse, logic->GetPivotRMSE(), INCREMENTAL_TOLERANCE ) ? 0 : 1;
+  numberOfErrors += CheckVector( "Pivot calibration tool tip", toolTipToToolTranslation, expectedToolTipToToolTranslation, 0.5 ) ? 0 : 1;
+  numberOfErrors += CheckValue( "Pivot calibration RMSE", logic->GetPivotRMSE(), 0.0, NOISE_MM ) ? 0 : 1;
+  return numberOfErrors;
+}
+
+//----------------------------------------------------------------------------
+// Compares the incremental spin calibration to the one computed from the stored poses
+int CheckIncrementalSpinCalibration( vtkSlicerPivotCalibrationLogic* logic, const double expectedShaftAxis_Tool[3] )
+{
+  int numberOfErrors = 0;
+  double incrementalShaftAxis[3] = { 0.0, 0.0, 0.0 };
+  double incrementalSpinRmse = 0.0;
+  if ( !logic->GetIncrementalSpinCalibration( incrementalShaftAxis, incrementalSpinRmse ) )
+  {
+    std::cerr << "Incremental spin calibration failed" << std::endl;
+    return 1;
+  }
+  if ( !logic->ComputeSpinCalibration( false, false ) )
+  {
+    std::cerr << "Spin calibration failed: " << logic->GetErrorText() << std::endl;
+    return 1;
+  }
+  // The rotation of the calibration result maps the shaft axis (-z) of the ToolTip coordinate system to the shaft axis in Tool
+  vtkNew< vtkMatrix4x4 > toolTipToToolMatrix;
+  logic->GetToolTipToToolMatrix( toolTipToToolMatrix.GetPointer() );
+  double shaftAxis_Tool[3] = { -toolTipToToolMatrix->GetElement( 0, 2 ), -toolTipToToolMatrix->GetElement( 1, 2 ), -toolTipToToolMatrix->GetElement( 2, 2 ) };
+
+  numberOfErrors += CheckAxis( "Incremental spin calibration shaft axis", incrementalShaftAxis, shaftAxis_Tool, 1e-3 ) ? 0 : 1;
+  numberOfErrors += CheckValue( "Incremental spin calibration RMSE", incrementalSpinRmse, logic->GetSpinRMSE(), INCREMENTAL_TOLERANCE ) ? 0 : 1;
+  numberOfErrors += CheckAxis( "Spin calibration shaft axis", shaftAxis_Tool, expectedShaftAxis_Tool, 1e-3 ) ? 0 : 1;
+  numberOfErrors += CheckValue( "Spin calibration RMSE", logic->GetSpinRMSE(), 0.0, 1e-6 ) ? 0 : 1;
+  return numberOfErrors;
+}
+
+//----------------------------------------------------------------------------
+int TestIncrementalPivotCalibration()
+{
+  std::cout << "Testing incremental pivot calibration" << std::endl;
+  int numberOfErrors = 0;
+  vtkNew< vtkMinimalStandardRandomSequence > random;
+  random->SetSeed( 1234 );
+  vtkNew< vtkMatrix4x4 > toolToReferenceMatrix;
+
+  vtkNew< vtkSlicerPivotCalibrationLogic > logic;
+  const unsigned int maximumNumberOfPoses = 60;
+  logic->SetMaximumNumberOfToolToReferenceMatrices( maximumNumberOfPoses );
+  for ( unsigned int poseIndex = 0; poseIndex < maximumNumberOfPoses / 2; poseIndex++ )
+  {
+    CreatePivotPose( random.GetPointer(), TOOL_TIP_TO_TOOL_TRANSLATION, NOISE_MM, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+  numberOfErrors += CheckIncrementalPivotCalibration( logic.GetPointer(), TOOL_TIP_TO_TOOL_TRANSLATION );
+
+  // Fill the buffer with poses of a different tool tip, then replace all of them.
+  // Only the last poses must affect the result.
+  const double otherToolTipToToolTranslation[3] = { -30.0, 10.0, 90.0 };
+  for ( unsigned int poseIndex = 0; poseIndex < maximumNumberOfPoses * 3 / 2; poseIndex++ )
+  {
+    CreatePivotPose( random.GetPointer(), otherToolTipToToolTranslation, NOISE_MM, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+  for ( unsigned int poseIndex = 0; poseIndex < maximumNumberOfPoses; poseIndex++ )
+  {
+    CreatePivotPose( random.GetPointer(), TOOL_TIP_TO_TOOL_TRANSLATION, NOISE_MM, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+  if ( logic->GetNumberOfToolToReferenceMatrices() != maximumNumberOfPoses || logic->GetIncrementalPivotNumberOfSamples() != maximumNumberOfPoses )
+  {
+    std::cerr << "Number of stored poses is " << logic->GetNumberOfToolToReferenceMatrices() << ", number of incremental pivot calibration samples is "
+      << logic->GetIncrementalPivotNumberOfSamples() << ", expected " << maximumNumberOfPoses << std::endl;
+    numberOfErrors++;
+  }
+  numberOfErrors += CheckIncrementalPivotCalibration( logic.GetPointer(), TOOL_TIP_TO_TOOL_TRANSLATION );
+  return numberOfErrors;
+}
+
+//----------------------------------------------------------------------------
+int TestIncrementalSpinCalibration()
+{
+  std::cout << "Testing incremental spin calibration" << std::endl;
+  int numberOfErrors = 0;
+  vtkNew< vtkMatrix4x4 > toolToReferenceMatrix;
+
+  vtkNew< vtkSlicerPivotCalibrationLogic > logic;
+  const unsigned int maximumNumberOfPoses = 60;
+  logic->SetMaximumNumberOfToolToReferenceMatrices( maximumNumberOfPoses );
+  for ( unsigned int poseIndex = 0; poseIndex < maximumNumberOfPoses / 2; poseIndex++ )
+  {
+    CreateSpinPose( SHAFT_AXIS_TOOL, 6.0 * poseIndex, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+  numberOfErrors += CheckIncrementalSpinCalibration( logic.GetPointer(), SHAFT_AXIS_TOOL );
+
+  // Fill the buffer with rotations about a different axis, then replace all of them.
+  // Only the rotations between the last poses must affect the result.
+  const double otherShaftAxis_Tool[3] = { 1.0, 0.0, 0.0 };
+  for ( unsigned int poseIndex = 0; poseIndex < maximumNumberOfPoses * 3 / 2; poseIndex++ )
+  {
+    CreateSpinPose( otherShaftAxis_Tool, 6.0 * poseIndex, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+  for ( unsigned int poseIndex = 0; poseIndex < maximumNumberOfPoses; poseIndex++ )
+  {
+    CreateSpinPose( SHAFT_AXIS_TOOL, 6.0 * poseIndex, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+  numberOfErrors += CheckIncrementalSpinCalibration( logic.GetPointer(), SHAFT_AXIS_TOOL );
+  return numberOfErrors;
+}
+
+//----------------------------------------------------------------------------
+int TestRobustPivotCalibration()
+{
+  std::cout << "Testing robust pivot calibration" << std::endl;
+  int numberOfErrors = 0;
+  vtkNew< vtkMinimalStandardRandomSequence > random;
+  random->SetSeed( 5678 );
+  vtkNew< vtkMatrix4x4 > toolToReferenceMatrix;
+
+  // Every 10th pose is displaced by 20 mm, as if there was a tracking glitch
+  vtkNew< vtkSlicerPivotCalibrationLogic > logic;
+  const int numberOfPoses = 100;
+  for ( int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++ )
+  {
+    CreatePivotPose( random.GetPointer(), TOOL_TIP_TO_TOOL_TRANSLATION, NOISE_MM, toolToReferenceMatrix.GetPointer() );
+    if ( poseIndex % 10 == 5 )
+    {
+      double displacement[3] = { GetRandomValue( random.GetPointer(), -1.0, 1.0 ), GetRandomValue( random.GetPointer(), -1.0, 1.0 ), 1.0 };
+      vtkMath::Normalize( displacement );
+      for ( int i = 0; i < 3; i++ )
+      {
+        toolToReferenceMatrix->SetElement( i, 3, toolToReferenceMatrix->GetElement( i, 3 ) + 20.0 * displacement[ i ] );
+      }
+    }
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+
+  if ( !logic->ComputeRobustPivotCalibration( false ) )
+  {
+    std::cerr << "Robust pivot calibration failed: " << logic->GetErrorText() << std::endl;
+    return 1;
+  }
+  vtkNew< vtkMatrix4x4 > toolTipToToolMatrix;
+  logic->GetToolTipToToolMatrix( toolTipToToolMatrix.GetPointer() );
+  double toolTipToToolTranslation[3] = { toolTipToToolMatrix->GetElement( 0, 3 ), toolTipToToolMatrix->GetElement( 1, 3 ), toolTipToToolMatrix->GetElement( 2, 3 ) };
+  numberOfErrors += CheckVector( "Robust pivot calibration tool tip", toolTipToToolTranslation, TOOL_TIP_TO_TOOL_TRANSLATION, 0.5 ) ? 0 : 1;
+  numberOfErrors += CheckValue( "Robust pivot calibration inlier ratio", logic->GetPivotInlierRatio(), 0.9, 1e-6 ) ? 0 : 1;
+  numberOfErrors += CheckValue( "Robust pivot calibration RMSE", logic->GetPivotRMSE(), 0.0, NOISE_MM ) ? 0 : 1;
+  return numberOfErrors;
+}
+
+//----------------------------------------------------------------------------
+// Pivot poses with rotations up to the specified angle
+void AddPivotPoses( vtkSlicerPivotCalibrationLogic* logic, vtkMinimalStandardRandomSequence* random, int numberOfPoses, double maximumAngleDeg )
+{
+  vtkNew< vtkMatrix4x4 > toolToReferenceMatrix;
+  for ( int poseIndex = 0; poseIndex < numberOfPoses; poseIndex++ )
+  {
+    vtkNew< vtkTransform > transform;
+    transform->RotateWXYZ( GetRandomValue( random, -maximumAngleDeg, maximumAngleDeg ),
+      GetRandomValue( random, -1.0, 1.0 ), GetRandomValue( random, -1.0, 1.0 ), 1.0 );
+    toolToReferenceMatrix->DeepCopy( transform->GetMatrix() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+}
+
+//----------------------------------------------------------------------------
+int TestOrientationSpread()
+{
+  std::cout << "Testing orientation spread" << std::endl;
+  int numberOfErrors = 0;
+  vtkNew< vtkMatrix4x4 > toolToReferenceMatrix;
+
+  // Spread of two poses is the angle between them, it does not depend on the number of identical poses
+  vtkNew< vtkSlicerPivotCalibrationLogic > logic;
+  logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  numberOfErrors += CheckValue( "Orientation spread of one pose", logic->GetToolOrientationSpreadDeg(), 0.0, 1e-3 ) ? 0 : 1;
+  logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  numberOfErrors += CheckValue( "Orientation spread of identical poses", logic->GetToolOrientationSpreadDeg(), 0.0, 1e-3 ) ? 0 : 1;
+  vtkNew< vtkTransform > transform;
+  transform->RotateWXYZ( 30.0, 1.0, 2.0, 3.0 );
+  logic->ClearToolToReferenceMatrices();
+  logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  logic->AddToolToReferenceMatrix( transform->GetMatrix() );
+  numberOfErrors += CheckValue( "Orientation spread of two poses", logic->GetToolOrientationSpreadDeg(), 30.0, 1e-6 ) ? 0 : 1;
+
+  // After the buffer is full, the spread must be the same as the spread of the stored poses only
+  vtkNew< vtkMinimalStandardRandomSequence > random;
+  random->SetSeed( 2468 );
+  const unsigned int maximumNumberOfPoses = 50;
+  logic->ClearToolToReferenceMatrices();
+  logic->SetMaximumNumberOfToolToReferenceMatrices( maximumNumberOfPoses );
+  AddPivotPoses( logic.GetPointer(), random.GetPointer(), maximumNumberOfPoses, 40.0 );
+  if ( logic->GetToolOrientationCoverage() < 1.0 )
+  {
+    std::cerr << "Orientation coverage of poses with large rotations is " << logic->GetToolOrientationCoverage() << ", expected 1" << std::endl;
+    numberOfErrors++;
+  }
+  random->SetSeed( 1357 );
+  AddPivotPoses( logic.GetPointer(), random.GetPointer(), 3 * maximumNumberOfPoses, 3.0 );
+  vtkNew< vtkSlicerPivotCalibrationLogic > expectedLogic;
+  random->SetSeed( 1357 );
+  AddPivotPoses( expectedLogic.GetPointer(), random.GetPointer(), 3 * maximumNumberOfPoses, 3.0 );
+  expectedLogic->SetMaximumNumberOfToolToReferenceMatrices( maximumNumberOfPoses );
+  numberOfErrors += CheckValue( "Orientation spread after the oldest poses are replaced", logic->GetToolOrientationSpreadDeg(),
+    expectedLogic->GetToolOrientationSpreadDeg(), 1e-6 ) ? 0 : 1;
+  if ( logic->GetToolOrientationCoverage() >= 1.0 )
+  {
+    std::cerr << "Orientation coverage of poses with small rotations is " << logic->GetToolOrientationCoverage() << ", expected less than 1" << std::endl;
+    numberOfErrors++;
+  }
+  return numberOfErrors;
+}
+
+//----------------------------------------------------------------------------
+// Adds a pose with identity orientation at the specified position
+bool AddTranslationPose( vtkSlicerPivotCalibrationLogic* logic, double x, double y, double z )
+{
+  vtkNew< vtkMatrix4x4 > toolToReferenceMatrix;
+  toolToReferenceMatrix->SetElement( 0, 3, x );
+  toolToReferenceMatrix->SetElement( 1, 3, y );
+  toolToReferenceMatrix->SetElement( 2, 3, z );
+  return logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+}
+
+//----------------------------------------------------------------------------
+bool CheckPoseAdded( const char* name, bool added, bool expectedAdded )
+{
+  if ( added != expectedAdded )
+  {
+    std::cerr << name << " is " << ( added ? "added" : "rejected" ) << ", expected " << ( expectedAdded ? "added" : "rejected" ) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------------
+int TestPoseDeduplication()
+{
+  std::cout << "Testing pose deduplication" << std::endl;
+  int numberOfErrors = 0;
+
+  // Poses in the same cell (1 mm resolution) are rejected
+  vtkNew< vtkSlicerPivotCalibrationLogic > logic;
+  logic->SetPoseDeduplication( true );
+  logic->SetMaximumNumberOfToolToReferenceMatrices( 3 );
+  numberOfErrors += CheckPoseAdded( "First pose", AddTranslationPose( logic.GetPointer(), 0.2, 0.2, 0.2 ), true ) ? 0 : 1;
+  numberOfErrors += CheckPoseAdded( "Similar pose", AddTranslationPose( logic.GetPointer(), 0.7, 0.7, 0.7 ), false ) ? 0 : 1;
+  numberOfErrors += CheckPoseAdded( "Second pose", AddTranslationPose( logic.GetPointer(), 10.2, 0.2, 0.2 ), true ) ? 0 : 1;
+  numberOfErrors += CheckPoseAdded( "Third pose", AddTranslationPose( logic.GetPointer(), 20.2, 0.2, 0.2 ), true ) ? 0 : 1;
+
+  // Buffer is full: the pose that is similar to the oldest pose replaces it, as the oldest pose is removed
+  numberOfErrors += CheckPoseAdded( "Pose similar to the oldest pose", AddTranslationPose( logic.GetPointer(), 0.7, 0.7, 0.7 ), true ) ? 0 : 1;
+  numberOfErrors += CheckPoseAdded( "Pose similar to a stored pose", AddTranslationPose( logic.GetPointer(), 20.7, 0.7, 0.7 ), false ) ? 0 : 1;
+  numberOfErrors += CheckValue( "Number of poses after replacing the oldest pose", logic->GetNumberOfToolToReferenceMatrices(), 3, 0 ) ? 0 : 1;
+
+  // Two stored poses in the same cell: the cell remains occupied when one of them is removed
+  logic->SetPoseDeduplication( false );
+  logic->ClearToolToReferenceMatrices();
+  logic->SetMaximumNumberOfToolToReferenceMatrices( 4 );
+  AddTranslationPose( logic.GetPointer(), 0.2, 0.2, 0.2 );
+  AddTranslationPose( logic.GetPointer(), 10.2, 0.2, 0.2 );
+  AddTranslationPose( logic.GetPointer(), 0.4, 0.4, 0.4 );
+  AddTranslationPose( logic.GetPointer(), 20.2, 0.2, 0.2 );
+  logic->SetPoseDeduplication( true );
+  numberOfErrors += CheckPoseAdded( "Pose that replaces one of two poses in a cell", AddTranslationPose( logic.GetPointer(), 30.2, 0.2, 0.2 ), true ) ? 0 : 1;
+  numberOfErrors += CheckPoseAdded( "Pose similar to the remaining pose in the cell", AddTranslationPose( logic.GetPointer(), 0.7, 0.7, 0.7 ), false ) ? 0 : 1;
+  numberOfErrors += CheckPoseAdded( "Pose that replaces the oldest pose", AddTranslationPose( logic.GetPointer(), 40.2, 0.2, 0.2 ), true ) ? 0 : 1;
+  numberOfErrors += CheckPoseAdded( "Pose similar to the oldest pose, which is the last pose in its cell",
+    AddTranslationPose( logic.GetPointer(), 0.7, 0.7, 0.7 ), true ) ? 0 : 1;
+  return numberOfErrors;
+}
+
+//----------------------------------------------------------------------------
+int TestConfidenceIntervals()
+{
+  std::cout << "Testing confidence intervals" << std::endl;
+  int numberOfErrors = 0;
+  vtkNew< vtkMinimalStandardRandomSequence > random;
+  random->SetSeed( 8642 );
+  vtkNew< vtkMatrix4x4 > toolToReferenceMatrix;
+
+  // High confidence level, so that the result does not depend on the random noise
+  vtkNew< vtkSlicerPivotCalibrationLogic > logic;
+  logic->SetBootstrapNumberOfResamples( 1000 );
+  logic->SetBootstrapConfidenceLevel( 0.999 );
+  for ( int poseIndex = 0; poseIndex < 200; poseIndex++ )
+  {
+    CreatePivotPose( random.GetPointer(), TOOL_TIP_TO_TOOL_TRANSLATION, NOISE_MM, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+  if ( !logic->ComputePivotCalibrationConfidenceIntervals() )
+  {
+    std::cerr << "Pivot calibration confidence interval computation failed: " << logic->GetErrorText() << std::endl;
+    return numberOfErrors + 1;
+  }
+  double lower[3] = { 0.0, 0.0, 0.0 };
+  double upper[3] = { 0.0, 0.0, 0.0 };
+  logic->GetToolTipToToolTranslationConfidenceIntervalLower( lower );
+  logic->GetToolTipToToolTranslationConfidenceIntervalUpper( upper );
+  for ( int i = 0; i < 3; i++ )
+  {
+    if ( TOOL_TIP_TO_TOOL_TRANSLATION[ i ] < lower[ i ] || TOOL_TIP_TO_TOOL_TRANSLATION[ i ] > upper[ i ] || upper[ i ] - lower[ i ] > 1.0 )
+    {
+      std::cerr << "Confidence interval of tool tip component " << i << " is [" << lower[ i ] << ", " << upper[ i ] << "], expected to contain "
+        << TOOL_TIP_TO_TOOL_TRANSLATION[ i ] << " and be narrower than 1 mm" << std::endl;
+      numberOfErrors++;
+    }
+  }
+
+  // Spin calibration confidence interval
+  logic->ClearToolToReferenceMatrices();
+  for ( int poseIndex = 0; poseIndex < 30; poseIndex++ )
+  {
+    CreateSpinPose( SHAFT_AXIS_TOOL, 6.0 * poseIndex, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+  if ( !logic->ComputeSpinCalibrationConfidenceIntervals() )
+  {
+    std::cerr << "Spin calibration confidence interval computation failed: " << logic->GetErrorText() << std::endl;
+    numberOfErrors++;
+  }
+  else
+  {
+    numberOfErrors += CheckValue( "Shaft axis confidence angle", logic->GetShaftAxisConfidenceAngleDeg(), 0.0, 0.1 ) ? 0 : 1;
+  }
+
+  // Not enough orientation variation: confidence intervals must not be computed, same as the calibration
+  const std::string expectedErrorText = "Not enough variation in the input transforms";
+  logic->ClearToolToReferenceMatrices();
+  for ( int poseIndex = 0; poseIndex < 20; poseIndex++ )
+  {
+    CreateSpinPose( SHAFT_AXIS_TOOL, 0.5 * poseIndex, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+  if ( logic->ComputeSpinCalibrationConfidenceIntervals() || logic->GetErrorText() != expectedErrorText )
+  {
+    std::cerr << "Spin calibration confidence intervals of poses without orientation variation did not fail as expected,"
+      << " error text: " << logic->GetErrorText() << std::endl;
+    numberOfErrors++;
+  }
+  if ( logic->ComputePivotCalibrationConfidenceIntervals() || logic->GetErrorText() != expectedErrorText )
+  {
+    std::cerr << "Pivot calibration confidence intervals of poses without orientation variation did not fail as expected,"
+      << " error text: " << logic->GetErrorText() << std::endl;
+    numberOfErrors++;
+  }
+  return numberOfErrors;
+}
+
+//----------------------------------------------------------------------------
+void CountEvent( vtkObject* vtkNotUsed( caller ), unsigned long vtkNotUsed( eid ), void* clientData, void* vtkNotUsed( callData ) )
+{
+  int* numberOfEvents = reinterpret_cast< int* >( clientData );
+  ( *numberOfEvents )++;
+}
+
+//----------------------------------------------------------------------------
+int TestConvergence()
+{
+  std::cout << "Testing convergence monitoring" << std::endl;
+  int numberOfErrors = 0;
+  vtkNew< vtkMinimalStandardRandomSequence > random;
+  random->SetSeed( 4321 );
+  vtkNew< vtkMatrix4x4 > toolToReferenceMatrix;
+
+  vtkNew< vtkSlicerPivotCalibrationLogic > logic;
+  logic->SetConvergenceMonitoringMode( vtkSlicerPivotCalibrationLogic::CONVERGENCE_MONITORING_PIVOT );
+  logic->SetConvergenceWindowSize( 20 );
+  logic->SetConvergenceTolerancePositionMm( 0.5 );
+  int numberOfConvergedEvents = 0;
+  vtkNew< vtkCallbackCommand > convergedCallback;
+  convergedCallback->SetCallback( CountEvent );
+  convergedCallback->SetClientData( &numberOfConvergedEvents );
+  logic->AddObserver( vtkSlicerPivotCalibrationLogic::CalibrationConvergedEvent, convergedCallback.GetPointer() );
+  int numberOfModifiedEvents = 0;
+  vtkNew< vtkCallbackCommand > modifiedCallback;
+  modifiedCallback->SetCallback( CountEvent );
+  modifiedCallback->SetClientData( &numberOfModifiedEvents );
+  logic->AddObserver( vtkCommand::ModifiedEvent, modifiedCallback.GetPointer() );
+
+  logic->SetRecordingState( true );
+  numberOfModifiedEvents = 0;
+  const int maximumNumberOfPoses = 1000;
+  for ( int poseIndex = 0; poseIndex < maximumNumberOfPoses && logic->GetRecordingState(); poseIndex++ )
+  {
+    CreatePivotPose( random.GetPointer(), TOOL_TIP_TO_TOOL_TRANSLATION, NOISE_MM, toolToReferenceMatrix.GetPointer() );
+    logic->AddToolToReferenceMatrix( toolToReferenceMatrix.GetPointer() );
+  }
+
+  if ( !logic->GetConverged() || logic->GetRecordingState() )
+  {
+    std::cerr << "Calibration did not converge after " << logic->GetNumberOfToolToReferenceMatrices() << " poses" << std::endl;
+    return numberOfErrors + 1;
+  }
+  std::cout << "Calibration converged after " << logic->GetNumberOfToolToReferenceMatrices() << " poses" << std::endl;
+  if ( numberOfConvergedEvents != 1 )
+  {
+    std::cerr << "Converged event was invoked " << numberOfConvergedEvents << " times, expected once" << std::endl;
+    numberOfErrors++;
+  }
+  if ( numberOfModifiedEvents == 0 )
+  {
+    std::cerr << "Modified event was not invoked when recording was stopped" << std::endl;
+    numberOfErrors++;
+  }
+  double toolTipToToolTranslation[3] = { 0.0, 0.0, 0.0 };
+  double rmse = 0.0;
+  logic->GetIncrementalPivotCalibration( toolTipToToolTranslation, rmse );
+  numberOfErrors += CheckVector( "Converged pivot calibration tool tip", toolTipToToolTranslation, TOOL_TIP_TO_TOOL_TRANSLATION, 1.0 ) ? 0 : 1;
+  return numberOfErrors;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+int vtkSlicerPivotCalibrationLogicTest1( int vtkNotUsed( argc ), char* vtkNotUsed( argv )[] )
+{
+  int numberOfErrors = 0;
+  numberOfErrors += TestIncrementalPivotCalibration();
+  numberOfErrors += TestIncrementalSpinCalibration();
+  numberOfErrors += TestRobustPivotCalibration();
+  numberOfErrors += TestOrientationSpread();
+  numberOfErrors += TestPoseDeduplication();
+  numberOfErrors += TestConfidenceIntervals();
+  numberOfErrors += TestConvergence();
+
+  if ( numberOfErrors > 0 )
+  {
+    std::cerr << "Number of errors: " << numberOfErrors << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "Test passed" << std::endl;
+  return EXIT_SUCCESS;
+}
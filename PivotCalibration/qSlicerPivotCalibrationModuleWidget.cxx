@@ -30,6 +30,10 @@
 #include <vtkNew.h>
 #include <vtkCommand.h>
 
+// STD includes
+#include <iomanip>
+#include <sstream>
+
 #include <vtkMRMLLinearTransformNode.h>
 
 //-----------------------------------------------------------------------------
@@ -138,6 +142,80 @@ void qSlicerPivotCalibrationModuleWidget::setup()
   connect( d->durationTimerEdit, SIGNAL( valueChanged(double) ), this, SLOT( setSamplingDurationSec(double) ) );
 
   connect( d->flipButton, SIGNAL( clicked() ), this, SLOT( onFlipButtonClicked() ) );
+
+  qvtkConnect( d->logic(), vtkSlicerPivotCalibrationLogic::ToolToReferenceMatrixAddedEvent, this, SLOT( onToolToReferenceMatrixAdded() ) );
+  qvtkConnect( d->logic(), vtkSlicerPivotCalibrationLogic::CalibrationConvergedEvent, this, SLOT( onCalibrationConverged() ) );
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerPivotCalibrationModuleWidget::onToolToReferenceMatrixAdded()
+{
+  Q_D(qSlicerPivotCalibrationModuleWidget);
+
+  if (!this->pivotSamplingTimer->isActive() && !this->spinSamplingTimer->isActive())
+  {
+    return;
+  }
+
+  // Orientation spread is computed in constant time in the logic, so it can be queried for each sample
+  std::stringstream ssSpread;
+  ssSpread << std::fixed << std::setprecision(1) << d->logic()->GetToolOrientationSpreadDeg() << " deg";
+  if (d->logic()->GetToolOrientationCoverage() < 1.0)
+  {
+    ssSpread << " (minimum: " << d->logic()->GetMinimumOrientationDifferenceDeg() << " deg)";
+  }
+  else
+  {
+    ssSpread << " (sufficient)";
+  }
+  d->orientationSpreadLabel->setText(ssSpread.str().c_str());
+
+  // Live spin calibration error is shown while spinning
+  if (this->spinSamplingTimer->isActive())
+  {
+    double shaftAxis_ToolTip[3] = { 0, 0, 0 };
+    double spinRmse = 0;
+    if (d->logic()->GetIncrementalSpinCalibration(shaftAxis_ToolTip, spinRmse))
+    {
+      std::stringstream ssSpinRmse;
+      ssSpinRmse << spinRmse;
+      d->rmseLabel->setText(ssSpinRmse.str().c_str());
+    }
+    return;
+  }
+
+  double toolTipToToolTranslation[3] = { 0, 0, 0 };
+  double rmse = 0;
+  if (!d->logic()->GetIncrementalPivotCalibration(toolTipToToolTranslation, rmse))
+  {
+    return;
+  }
+  std::stringstream ssRmse;
+  ssRmse << rmse;
+  d->rmseLabel->setText(ssRmse.str().c_str());
+  std::stringstream ssTip;
+  ssTip << std::fixed << std::setprecision(2) << toolTipToToolTranslation[0] << ", " << toolTipToToolTranslation[1] << ", " << toolTipToToolTranslation[2];
+  d->tipPositionLabel->setText(ssTip.str().c_str());
+}
+
+//-----------------------------------------------------------------------------
+void qSlicerPivotCalibrationModuleWidget::onCalibrationConverged()
+{
+  Q_D(qSlicerPivotCalibrationModuleWidget);
+
+  // Logic already stopped recording, stop the sampling countdown and compute the calibration
+  if (this->pivotSamplingTimer->isActive())
+  {
+    d->CountdownLabel->setText("Sampling complete (converged)");
+    this->pivotSamplingTimer->stop();
+    this->onPivotStop();
+  }
+  else if (this->spinSamplingTimer->isActive())
+  {
+    d->CountdownLabel->setText("Sampling complete (converged)");
+    this->spinSamplingTimer->stop();
+    this->onSpinStop();
+  }
 }
 
 //-----------------------------------------------------------------------------
@@ -152,6 +230,9 @@ void qSlicerPivotCalibrationModuleWidget::onStartPivotPart()
   ss << this->pivotStartupRemainingTimerPeriodCount << " seconds until start";
   d->CountdownLabel->setText(ss.str().c_str());
 
+  d->logic()->SetPoseDeduplication(d->poseDeduplicationCheckBox->checkState() == Qt::Checked);
+  d->logic()->SetConvergenceMonitoringMode(d->autoStopCheckBox->checkState() == Qt::Checked ?
+    vtkSlicerPivotCalibrationLogic::CONVERGENCE_MONITORING_PIVOT : vtkSlicerPivotCalibrationLogic::CONVERGENCE_MONITORING_OFF);
   pivotStartupTimer->start();
 }
 
@@ -167,6 +248,9 @@ void qSlicerPivotCalibrationModuleWidget::onStartSpinPart()
   ss << this->spinStartupRemainingTimerPeriodCount << " seconds until start";
   d->CountdownLabel->setText(ss.str().c_str());
 
+  d->logic()->SetPoseDeduplication(d->poseDeduplicationCheckBox->checkState() == Qt::Checked);
+  d->logic()->SetConvergenceMonitoringMode(d->autoStopCheckBox->checkState() == Qt::Checked ?
+    vtkSlicerPivotCalibrationLogic::CONVERGENCE_MONITORING_SPIN : vtkSlicerPivotCalibrationLogic::CONVERGENCE_MONITORING_OFF);
   spinStartupTimer->start();
 }
 
@@ -283,13 +367,23 @@ void qSlicerPivotCalibrationModuleWidget::onPivotStop()
 
   d->logic()->SetRecordingState(false);
 
-  if (d->logic()->ComputePivotCalibration())
+  bool robust = (d->robustCheckBox->checkState() == Qt::Checked);
+  bool success = robust ? d->logic()->ComputeRobustPivotCalibration() : d->logic()->ComputePivotCalibration();
+  if (success)
   {
     d->logic()->GetToolTipToToolMatrix(outputMatrix);
     outputTransform->SetMatrixTransformToParent(outputMatrix);
     std::stringstream ss;
     ss << d->logic()->GetPivotRMSE();
+    if (robust)
+    {
+      ss << " (inliers: " << std::fixed << std::setprecision(1) << d->logic()->GetPivotInlierRatio() * 100.0 << "%)";
+    }
     d->rmseLabel->setText(ss.str().c_str());
+    std::stringstream ssTip;
+    ssTip << std::fixed << std::setprecision(2) << outputMatrix->GetElement(0, 3) << ", " << outputMatrix->GetElement(1, 3) << ", " << outputMatrix->GetElement(2, 3);
+    d->tipPositionLabel->setText(ssTip.str().c_str());
+    this->updateConfidenceIntervalLabel(true);
   }
   else
   {
@@ -297,6 +391,8 @@ void qSlicerPivotCalibrationModuleWidget::onPivotStop()
     std::string fullMessage = std::string("Pivot calibration failed: ") + d->logic()->GetErrorText();
     d->CountdownLabel->setText(fullMessage.c_str());
     d->rmseLabel->setText("N/A");
+    d->tipPositionLabel->setText("N/A");
+    d->confidenceIntervalLabel->setText("");
   }
 
   d->logic()->ClearToolToReferenceMatrices();
@@ -329,11 +425,48 @@ void qSlicerPivotCalibrationModuleWidget::onSpinStop()
   std::stringstream ss;
   ss << d->logic()->GetSpinRMSE();
   d->rmseLabel->setText(ss.str().c_str());
+  this->updateConfidenceIntervalLabel(false);
 
   d->logic()->ClearToolToReferenceMatrices();
 }
 
 
+//-----------------------------------------------------------------------------
+void qSlicerPivotCalibrationModuleWidget::updateConfidenceIntervalLabel(bool pivot)
+{
+  Q_D(qSlicerPivotCalibrationModuleWidget);
+
+  if (d->confidenceIntervalCheckBox->checkState() != Qt::Checked)
+  {
+    d->confidenceIntervalLabel->setText("");
+    return;
+  }
+
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2);
+  if (pivot)
+  {
+    if (!d->logic()->ComputePivotCalibrationConfidenceIntervals())
+    {
+      d->confidenceIntervalLabel->setText("N/A");
+      return;
+    }
+    double* lower = d->logic()->GetToolTipToToolTranslationConfidenceIntervalLower();
+    double* upper = d->logic()->GetToolTipToToolTranslationConfidenceIntervalUpper();
+    ss << "[" << lower[0] << ", " << upper[0] << "], [" << lower[1] << ", " << upper[1] << "], [" << lower[2] << ", " << upper[2] << "]";
+  }
+  else
+  {
+    if (!d->logic()->ComputeSpinCalibrationConfidenceIntervals())
+    {
+      d->confidenceIntervalLabel->setText("N/A");
+      return;
+    }
+    ss << "shaft axis within " << d->logic()->GetShaftAxisConfidenceAngleDeg() << " deg";
+  }
+  d->confidenceIntervalLabel->setText(ss.str().c_str());
+}
+
 //-----------------------------------------------------------------------------
 void qSlicerPivotCalibrationModuleWidget::setStartupDurationSec(double timeSec)
 {
@@ -60,11 +60,17 @@ protected slots:
   void onPivotSamplingTimeout();
   void onSpinStartupTimeout();
   void onSpinSamplingTimeout();
+
+  void onToolToReferenceMatrixAdded();
+  void onCalibrationConverged();
   
 protected:
   QScopedPointer<qSlicerPivotCalibrationModuleWidgetPrivate> d_ptr;
 
   virtual void setup();
+
+  // Computes and shows confidence intervals of the pivot or spin calibration result, if enabled
+  void updateConfidenceIntervalLabel(bool pivot);
   
   int startupDurationSec;
   int samplingDurationSec;